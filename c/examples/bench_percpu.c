@@ -0,0 +1,139 @@
+#include "emtrace/emtrace.h"
+#include "emtrace/memory.h"
+#include "emtrace/percpu.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <time.h>
+
+// Compares the placement options of the per-CPU rings: plain pages, huge pages, locked memory and
+// NUMA-local rings with a drain thread pinned to each node.
+//
+// Usage: bench_percpu [ring MiB per CPU] [records per thread] [threads] [simulated nodes]
+//
+// On a machine with a single node, a number of simulated nodes spreads the CPUs over that many
+// pretend nodes, each drained by a thread of its own, which exercises the hand-over between
+// drainers but of course not the memory placement.
+
+typedef struct {
+    const char* name;
+    int flags;
+} bench_config_t;
+
+static const bench_config_t configs[] = {
+    {"4 KiB pages", 0},
+    {"transparent huge pages", EMT_MEM_THP},
+    {"hugetlb pages", EMT_MEM_HUGETLB},
+    {"locked", EMT_MEM_MLOCK},
+    {"huge pages, locked", EMT_MEM_HUGETLB | EMT_MEM_MLOCK},
+    {"huge pages, locked, NUMA", EMT_MEM_HUGETLB | EMT_MEM_MLOCK | EMT_MEM_NUMA},
+};
+
+static emt_percpu_t buffers;
+static uint64_t records_per_thread;
+static int producing;
+static int simulated;
+
+static void discard(const void* data, emt_size_t size, void* arg) {
+    (void) data;
+    (void) size;
+    (void) arg;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + ((double) ts.tv_nsec * 1e-9);
+}
+
+static long minor_faults(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_minflt;
+}
+
+static void* produce(void* arg) {
+    uint64_t id = (uint64_t) (uintptr_t) arg;
+    for (uint64_t i = 0; i < records_per_thread; i++) {
+        EMTRACE_PERCPU_F(&buffers, "{} {}", uint64_t, id, uint64_t, i);
+    }
+    return NULL;
+}
+
+static void* drain(void* arg) {
+    uint32_t node = (uint32_t) (uintptr_t) arg;
+    if ((buffers.mem_flags & EMT_MEM_NUMA) && !simulated && emt_mem_pin_node(node) != 0)
+        perror("emt_mem_pin_node");
+    for (;;) {
+        int done = !__atomic_load_n(&producing, __ATOMIC_ACQUIRE);
+        if (emt_percpu_drain_node(&buffers, node) == 0 && done)
+            break;
+    }
+    return NULL;
+}
+
+static void
+run(const bench_config_t* config, uint64_t ring_size, uint32_t threads, uint32_t nodes) {
+    int flags = config->flags;
+    if (emt_percpu_open_flags(&buffers, ring_size, flags, discard, discard, discard, NULL) != 0) {
+        perror("emt_percpu_open_flags");
+        exit(1);
+    }
+    simulated = nodes > buffers.num_nodes;
+    if (simulated) {
+        for (uint32_t cpu = 0; cpu < buffers.num_cpus; cpu++)
+            buffers.cpu_node[cpu] = (uint16_t) (cpu % nodes);
+        buffers.num_nodes = nodes;
+    }
+    EMTRACE_PERCPU_INIT(&buffers);
+    producing = 1;
+
+    long faults = minor_faults();
+    pthread_t* drainers = (pthread_t*) calloc(buffers.num_nodes, sizeof(pthread_t));
+    pthread_t* producers = (pthread_t*) calloc(threads, sizeof(pthread_t));
+    for (uint32_t node = 0; node < buffers.num_nodes; node++)
+        pthread_create(&drainers[node], NULL, drain, (void*) (uintptr_t) node);
+    double start = now();
+    for (uint32_t i = 0; i < threads; i++)
+        pthread_create(&producers[i], NULL, produce, (void*) (uintptr_t) i);
+    for (uint32_t i = 0; i < threads; i++)
+        pthread_join(producers[i], NULL);
+    double elapsed = now() - start;
+    __atomic_store_n(&producing, 0, __ATOMIC_RELEASE);
+    for (uint32_t node = 0; node < buffers.num_nodes; node++)
+        pthread_join(drainers[node], NULL);
+    // records held back for a predecessor on another node
+    while (emt_percpu_drain(&buffers) > 0)
+        ;
+
+    uint64_t total = records_per_thread * threads;
+    printf(
+        "%-26s %8.1f ns/record %10ld faults %6.2f%% dropped  (applied:%s%s%s%s)\n", config->name,
+        elapsed * 1e9 / (double) records_per_thread, minor_faults() - faults,
+        100.0 * (double) emt_percpu_dropped(&buffers) / (double) total,
+        (buffers.mem_flags & EMT_MEM_HUGETLB) ? " hugetlb" : "",
+        (buffers.mem_flags & EMT_MEM_THP) ? " thp" : "",
+        (buffers.mem_flags & EMT_MEM_MLOCK) ? " mlock" : "",
+        (buffers.mem_flags & EMT_MEM_NUMA) ? " numa" : ""
+    );
+    free(drainers);
+    free(producers);
+    emt_percpu_close(&buffers);
+}
+
+int main(int argc, char** argv) {
+    uint64_t ring_mib = argc > 1 ? strtoull(argv[1], NULL, 10) : 64;
+    records_per_thread = argc > 2 ? strtoull(argv[2], NULL, 10) : 2000000;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t threads = argc > 3 ? (uint32_t) strtoul(argv[3], NULL, 10) : (uint32_t) cpus;
+    uint32_t nodes = argc > 4 ? (uint32_t) strtoul(argv[4], NULL, 10) : 1;
+
+    printf(
+        "%u threads, %llu records each, %llu MiB ring per CPU, %u (simulated) nodes\n", threads,
+        (unsigned long long) records_per_thread, (unsigned long long) ring_mib, nodes
+    );
+    for (size_t i = 0; i < sizeof(configs) / sizeof(configs[0]); i++)
+        run(&configs[i], ring_mib << 20, threads, nodes);
+    return 0;
+}
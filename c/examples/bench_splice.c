@@ -0,0 +1,82 @@
+#include "emtrace/drain.h"
+#include "emtrace/emtrace.h"
+#include "emtrace/percpu.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// Compares the drain engine writing its batches into a pipe with `write` against handing them over
+// with `vmsplice`, while a child process reads the other end.
+//
+// Usage: bench_splice [records] [batch KiB]
+
+static emt_percpu_t buffers;
+static emt_drain_t drain;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + ((double) ts.tv_nsec * 1e-9);
+}
+
+static void run(const char* name, int flags, uint64_t records, size_t batch_size) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        perror("pipe");
+        exit(1);
+    }
+    pid_t reader = fork();
+    if (reader == 0) {
+        close(fds[1]);
+        static char data[1 << 16];
+        while (read(fds[0], data, sizeof(data)) > 0)
+            ;
+        _exit(0);
+    }
+    close(fds[0]);
+
+    if (emt_percpu_open(
+            &buffers, 16 << 20, emt_drain_out, emt_drain_lock, emt_drain_unlock, &drain
+        ) != 0)
+        exit(1);
+    buffers.backpressure = EMT_BACKPRESSURE_BLOCK;
+    buffers.on_full = emt_drain_wake;
+    emt_drain_config_t config = EMT_DRAIN_CONFIG_DEFAULT(fds[1]);
+    config.drain = emt_percpu_drain_source;
+    config.source = &buffers;
+    config.batch_size = batch_size;
+    config.flags = flags;
+
+    double start = now();
+    if (emt_drain_start(&drain, &config) != 0) {
+        perror("emt_drain_start");
+        exit(1);
+    }
+    for (uint64_t i = 0; i < records; i++) {
+        EMTRACE_PERCPU_F(
+            &buffers, "{} {} {} {}", uint64_t, i, uint64_t, i, uint64_t, i, uint64_t, i
+        );
+    }
+    emt_drain_stop(&drain);
+    close(fds[1]);
+    waitpid(reader, NULL, 0);
+    double elapsed = now() - start;
+
+    printf(
+        "%-8s %8.1f ns/record %8.1f MiB/s%s\n", name, elapsed * 1e9 / (double) records,
+        (double) drain.written / elapsed / (1 << 20),
+        (drain.applied & EMT_DRAIN_APPLIED_VMSPLICE) ? "" : " (not spliced)"
+    );
+    emt_percpu_close(&buffers);
+}
+
+int main(int argc, char** argv) {
+    uint64_t records = argc > 1 ? strtoull(argv[1], NULL, 10) : 10000000;
+    size_t batch_size = (argc > 2 ? strtoull(argv[2], NULL, 10) : 64) << 10;
+    run("write", 0, records, batch_size);
+    run("vmsplice", EMT_DRAIN_VMSPLICE, records, batch_size);
+    return 0;
+}
@@ -1,6 +1,21 @@
 #include "emtrace/emtrace.h"
 
+#include <array>
+#include <span>
+
+namespace demo {
+enum class Phase : uint8_t { Startup, Running, Shutdown };
+}
+
 auto main() -> int {
+    EMTRACE_INIT();
     EMTRACELN("kjalsdjla");
     EMTRACELN_F("Here we go again {}", int, 8);
+
+    std::array<int, 4> values{1, 2, 3, 4};
+    std::span<const int> tail = std::span(values).subspan(1);
+    EMTRACELN_F("{} then {}", EMT_ARRAY(int, 4), values, EMT_SPAN(int, tail.size()), tail);
+
+    // scoped enums don't need an EMT_ENUM_TABLE
+    EMTRACELN_F("phase {}", EMT_ENUM(demo::Phase), demo::Phase::Running);
 }
@@ -0,0 +1,40 @@
+#include "emtrace/emtrace.h"
+#include "emtrace/shm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Run with e.g. `emtrace demo_shm --input shm://emtrace_demo --exit-when-idle` in another shell.
+#define NUM_WORKERS 4
+
+static void worker(int id) {
+    emt_shm_t shm;
+    if (emt_shm_open(&shm, "/emtrace_demo", 16, 1 << 16) != 0) {
+        perror("emt_shm_open");
+        exit(1);
+    }
+    EMTRACE_SHM_INIT(&shm);
+    for (int i = 0; i < 10; i++) {
+        EMTRACELN_SHM_F(&shm, "worker {} iteration {}", int, id, int, i);
+    }
+    EMTRACE_SHM(&shm, "worker ");
+    EMTRACE_SHM_S(&shm, "done");
+    EMTRACELN_SHM(&shm, "");
+    if (emt_shm_close(&shm) != 0)
+        perror("emt_shm_close");
+}
+
+int main(void) {
+    for (int id = 0; id < NUM_WORKERS; id++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            worker(id);
+            return 0;
+        }
+    }
+    for (int id = 0; id < NUM_WORKERS; id++) {
+        (void) wait(NULL);
+    }
+    return 0;
+}
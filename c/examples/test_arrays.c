@@ -0,0 +1,48 @@
+#include "test_utils.h"
+#include <emtrace/emtrace.h>
+#include <stddef.h>
+#include <stdint.h>
+
+EXPECT_OUTPUT(
+    "Fixed: [1, 2, 3, 4]\n"
+    "Histogram: 0 1 4 9 16 25 36 49 64 81 100 121 144 169 196 225\n"
+    "Doubles: [0.5, -1.25]\n"
+    "Span of 3: [-1, 0, 1]\n"
+    "Empty span: []\n"
+    "Between: 7 [10, 20] 8\n"
+    "Prefix: [100, 200]\n"
+);
+
+static void trace_samples(const int16_t* samples, size_t count) {
+    EMTRACELN_F("Span of {}: {}", size_t, count, EMT_SPAN(int16_t, count), samples);
+}
+
+int main(void) {
+    EMTRACE_INIT();
+
+    uint32_t fixed[4] = {1, 2, 3, 4};
+    EMTRACELN_F("Fixed: {}", EMT_ARRAY(uint32_t, 4), fixed);
+
+    uint64_t histogram[16];
+    for (uint64_t i = 0; i < 16; i++) {
+        histogram[i] = i * i;
+    }
+    EMTRACELN_F("Histogram: {: *}", EMT_ARRAY(uint64_t, 16), histogram);
+
+    double doubles[2] = {0.5, -1.25};
+    EMTRACELN_F("Doubles: {}", EMT_ARRAY(double, 2), doubles);
+
+    int16_t samples[3] = {-1, 0, 1};
+    trace_samples(samples, 3);
+
+    EMTRACELN_F("Empty span: {}", EMT_SPAN(int16_t, 0), samples);
+
+    int32_t pair[2] = {10, 20};
+    EMTRACELN_F("Between: {} {} {}", int, 7, EMT_ARRAY(int32_t, 2), pair, int, 8);
+
+    // only the first elements of a longer buffer
+    int64_t longer[4] = {100, 200, 300, 400};
+    EMTRACELN_F("Prefix: {}", EMT_ARRAY(int64_t, 2), longer);
+
+    return 0;
+}
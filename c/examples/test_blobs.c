@@ -0,0 +1,33 @@
+#include "test_utils.h"
+#include <emtrace/emtrace.h>
+#include <stdint.h>
+#include <string.h>
+
+EXPECT_OUTPUT(
+    "Default: de ad be ef 01\n"
+    "Contiguous: deadbeef01 DEADBEEF01\n"
+    "Separated: de:ad:be:ef:01\n"
+    "Capped: de ad be\n"
+    "Empty: []\n"
+    "00000000: 4745 5420 2f69 6e64 6578 2e68 746d 6c20  GET /index.html \n"
+    "00000010: 4854 5450 2f31 2e31 0d0a                 HTTP/1.1..\n"
+    "00000000  47 45 54 20 2f 69 6e 64  65 78 2e 68 74 6d 6c 20  |GET /index.html |\n"
+    "00000010  48 54 54 50 2f 31 2e 31  0d 0a                    |HTTP/1.1..|\n"
+);
+
+int main(void) {
+    EMTRACE_INIT();
+
+    uint8_t bytes[5] = {0xde, 0xad, 0xbe, 0xef, 0x01};
+    EMTRACELN_F("Default: {}", EMT_BLOB(sizeof(bytes)), bytes);
+    EMTRACELN_F("Contiguous: {:x} {:X}", EMT_BLOB(5), bytes, EMT_BLOB(5), bytes);
+    EMTRACELN_F("Separated: {::x}", EMT_BLOB(5), bytes);
+    EMTRACELN_F("Capped: {}", EMT_BLOB_MAX(sizeof(bytes), 3), bytes);
+    EMTRACELN_F("Empty: [{}]", EMT_BLOB(0), bytes);
+
+    const char* request = "GET /index.html HTTP/1.1\r\n";
+    EMTRACELN_F("{:xxd}", EMT_BLOB(strlen(request)), request);
+    EMTRACELN_F("{:hexdump}", EMT_BLOB_MAX(strlen(request), 64), request);
+
+    return 0;
+}
@@ -0,0 +1,41 @@
+#include "test_utils.h"
+#include <emtrace/drain.h>
+#include <emtrace/emtrace.h>
+#include <emtrace/percpu.h>
+#include <stdio.h>
+#include <unistd.h>
+
+EXPECT_OUTPUT(
+    "record 0\n"
+    "record 1\n"
+    "record 2\n"
+    "record 3\n"
+    "record 4\n"
+    "record 5\n"
+    "record 6\n"
+    "record 7\n"
+    "[emtrace] 2 records dropped\n"
+);
+
+static emt_percpu_t buffers;
+static emt_drain_t drain;
+
+int main(void) {
+    EMTRACE_INIT();
+    (void) fflush(stdout);
+    if (emt_percpu_open(&buffers, 128, emt_drain_out, emt_drain_lock, emt_drain_unlock, &drain))
+        return 1;
+    // nothing drains yet, so only the first records fit
+    for (int i = 0; i < 10; i++) {
+        EMTRACELN_PERCPU_F(&buffers, "record {}", int, i);
+    }
+
+    emt_drain_config_t config = EMT_DRAIN_CONFIG_DEFAULT(STDOUT_FILENO);
+    config.drain = emt_percpu_drain_source;
+    config.dropped = emt_percpu_dropped_source;
+    config.source = &buffers;
+    if (emt_drain_start(&drain, &config) != 0)
+        return 1;
+    // drained and flushed by the exit handler
+    return 0;
+}
@@ -0,0 +1,31 @@
+#include "test_utils.h"
+#include <emtrace/emtrace.h>
+#include <stdint.h>
+
+EXPECT_OUTPUT(
+    "state IDLE -> RUNNING\n"
+    "state RUNNING -> STOPPED (10)\n"
+    "unknown state_t(7)\n"
+    "level HIGH, state IDLE\n"
+);
+
+typedef enum { IDLE, RUNNING, STOPPED = 10 } state_t;
+#define EMT_ENUM_state_t(entry, ctx) entry(ctx, IDLE) entry(ctx, RUNNING) entry(ctx, STOPPED)
+EMTRACE_ENUM_TABLE(state_t);
+
+typedef enum { LOW = -1, HIGH = 1 } level_t;
+#define EMT_ENUM_level_t(entry, ctx) entry(ctx, LOW) entry(ctx, HIGH)
+EMTRACE_ENUM_TABLE(level_t);
+
+int main(void) {
+    EMTRACE_INIT();
+
+    state_t from = IDLE;
+    state_t to = RUNNING;
+    EMTRACELN_F("state {} -> {}", EMT_ENUM(state_t), from, EMT_ENUM(state_t), to);
+    EMTRACELN_F("state {0} -> {1} ({1:d})", EMT_ENUM(state_t), to, EMT_ENUM(state_t), STOPPED);
+    EMTRACELN_F("unknown {}", EMT_ENUM(state_t), (state_t) 7);
+    EMTRACELN_F("level {}, state {}", EMT_ENUM(level_t), HIGH, EMT_ENUM(state_t), IDLE);
+
+    return 0;
+}
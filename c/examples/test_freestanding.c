@@ -0,0 +1,37 @@
+// Built with -ffreestanding -nostdlib -static: no libc, and hence no stdio, at all.
+#include "test_utils.h"
+#include <emtrace/emtrace.h>
+#include <stdint.h>
+
+EXPECT_OUTPUT(
+    "starting without libc\n"
+    "checksum of 16 words: 136\n"
+    "exiting with 0\n"
+);
+
+EMT_FD_SINK_DEFINE(emt_stdout_sink, 1, 256);
+
+__attribute__((noreturn)) static void emt_exit(int status) {
+    __asm__ volatile("syscall" : : "a"(60L), "D"((long) status) : "rcx", "r11", "memory");
+    __builtin_unreachable();
+}
+
+static int run(void) {
+    EMTRACE_INIT();
+    EMTRACELN("starting without libc");
+    uint32_t words[16];
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < 16; i++) {
+        words[i] = i + 1;
+        sum += words[i];
+    }
+    EMTRACELN_F("checksum of {} words: {}", unsigned, 16, uint32_t, sum);
+    EMTRACELN_F("exiting with {}", int, 0);
+    emt_fd_flush(&emt_stdout_sink);
+    return 0;
+}
+
+// the entry point the linker looks for in place of libc's
+void _start(void);
+
+__attribute__((force_align_arg_pointer, noreturn, used)) void _start(void) { emt_exit(run()); }
@@ -0,0 +1,30 @@
+#include "test_utils.h"
+#include <emtrace/emtrace.h>
+#include <stdint.h>
+
+EXPECT_OUTPUT(
+    "Ten: 1 2 3 4 5 6 7 8 9 10\n"
+    "Eleven: 1 2 3 4 5 6 7 8 9 10 11\n"
+    "Sixteen: 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16\n"
+);
+
+int main(void) {
+    EMTRACE_INIT();
+
+    // the most arguments a trace takes is 16; every count from 10 on went through EMT_F_20 and up
+    EMTRACELN_F(
+        "Ten: {} {} {} {} {} {} {} {} {} {}", int, 1, int, 2, int, 3, int, 4, int, 5, int, 6, int,
+        7, int, 8, int, 9, int, 10
+    );
+    EMTRACELN_F(
+        "Eleven: {:d} {} {} {} {:d} {} {} {} {} {} {}", int8_t, 1, int16_t, 2, int32_t, 3, int64_t,
+        4, uint8_t, 5, uint16_t, 6, uint32_t, 7, uint64_t, 8, int, 9, long, 10, size_t, 11
+    );
+    EMTRACELN_F(
+        "Sixteen: {} {} {} {} {} {} {} {} {} {} {} {} {} {} {} {}", int, 1, int, 2, int, 3, int,
+        4, int, 5, int, 6, int, 7, int, 8, int, 9, int, 10, int, 11, int, 12, int, 13, int, 14,
+        int, 15, int, 16
+    );
+
+    return 0;
+}
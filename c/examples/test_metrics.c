@@ -0,0 +1,43 @@
+#include "test_utils.h"
+#include <emtrace/emtrace.h>
+#include <emtrace/metrics.h>
+#include <stdint.h>
+
+EXPECT_OUTPUT(
+    "latency_us: count=100 min=1 p50=51 p90=95 p99=100 max=100\n"
+    "requests: +100 (total 100)\n"
+    "latency_us: count=5 min=7 p50=7 p90=7 p99=7 max=7\n"
+    "requests: +5 (total 105)\n"
+    "latency_us: count=0\n"
+    "requests: +0 (total 105)\n"
+);
+
+// one set of metrics each, so that they are flushed in this order
+static emt_metrics_t latencies = EMT_METRICS_STDOUT_INITIALIZER(0);
+static emt_metrics_t requests = EMT_METRICS_STDOUT_INITIALIZER(0);
+
+static void handle_request(uint64_t latency_us) {
+    EMTRACE_COUNTER(&requests, "requests", 1);
+    EMTRACE_HISTOGRAM(&latencies, "latency_us", latency_us);
+}
+
+static void flush(void) {
+    emt_metrics_flush(&latencies);
+    emt_metrics_flush(&requests);
+}
+
+int main(void) {
+    EMTRACE_METRICS_INIT(&latencies);
+    for (uint64_t i = 1; i <= 100; i++) {
+        handle_request(i);
+    }
+    flush();
+
+    for (int i = 0; i < 5; i++) {
+        handle_request(7);
+    }
+    flush();
+
+    flush();
+    return 0;
+}
@@ -0,0 +1,51 @@
+#include "test_utils.h"
+#include <emtrace/emtrace.h>
+#include <emtrace/percpu.h>
+#include <pthread.h>
+#include <stdio.h>
+
+EXPECT_OUTPUT(
+    "main starts worker\n"
+    "worker record 0\n"
+    "worker record 1\n"
+    "worker record 2\n"
+    "main done, dropped 0\n"
+);
+
+static emt_percpu_t buffers;
+
+static void out(const void* data, emt_size_t size, void* arg) {
+    (void) fwrite(data, 1, size, (FILE*) arg);
+}
+
+static void nop(const void* data, emt_size_t size, void* arg) {
+    (void) data;
+    (void) size;
+    (void) arg;
+}
+
+static void* worker(void* arg) {
+    (void) arg;
+    for (int i = 0; i < 3; i++) {
+        EMTRACELN_PERCPU_F(&buffers, "worker record {}", int, i);
+    }
+    return NULL;
+}
+
+int main(void) {
+    if (emt_percpu_open(&buffers, 4096, out, nop, nop, stdout) != 0)
+        return 1;
+    EMTRACE_PERCPU_INIT(&buffers);
+    EMTRACELN_PERCPU(&buffers, "main starts worker");
+    (void) emt_percpu_drain(&buffers);
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, worker, NULL);
+    pthread_join(thread, NULL);
+    (void) emt_percpu_drain(&buffers);
+
+    EMTRACELN_PERCPU_F(&buffers, "main done, dropped {}", int, (int) emt_percpu_dropped(&buffers));
+    (void) emt_percpu_drain(&buffers);
+    emt_percpu_close(&buffers);
+    return 0;
+}
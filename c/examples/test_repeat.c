@@ -0,0 +1,34 @@
+#include "test_utils.h"
+#include <emtrace/emtrace.h>
+#include <emtrace/repeat.h>
+
+EXPECT_OUTPUT(
+    "connecting\n"
+    "retry 3\n"
+    "last message repeated 4 times\n"
+    "retry 4\n"
+    "progress 50% last message repeated 2 times\n"
+    "done\n"
+    "last message repeated 2 times\n"
+);
+
+static emt_repeat_t repeat = EMT_REPEAT_STDOUT_INITIALIZER(0);
+
+int main(void) {
+    EMTRACE_REPEAT_INIT(&repeat);
+    EMTRACELN_REPEAT(&repeat, "connecting");
+    for (int i = 0; i < 5; i++) {
+        EMTRACELN_REPEAT_F(&repeat, "retry {}", int, 3);
+    }
+    EMTRACELN_REPEAT_F(&repeat, "retry {}", int, 4);
+    // the summary of a run without newlines doesn't add one either
+    for (int i = 0; i < 3; i++) {
+        EMTRACE_REPEAT_F(&repeat, "progress {}% ", int, 50);
+    }
+    EMTRACELN_REPEAT(&repeat, "");
+    for (int i = 0; i < 3; i++) {
+        EMTRACELN_REPEAT(&repeat, "done");
+    }
+    emt_repeat_flush(&repeat);
+    return 0;
+}
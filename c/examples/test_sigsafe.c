@@ -0,0 +1,31 @@
+#include "test_utils.h"
+#include <emtrace/emtrace.h>
+#include <emtrace/sigsafe.h>
+#include <signal.h>
+#include <unistd.h>
+
+EXPECT_OUTPUT(
+    "installing handler\n"
+    "caught signal 10\n"
+    "back in main after signal 10\n"
+);
+
+static emt_sigsafe_t sink = EMT_SIGSAFE_INITIALIZER(STDOUT_FILENO);
+static volatile sig_atomic_t caught = 0;
+
+static void handler(int sig) {
+    caught = sig;
+    EMTRACELN_SIGSAFE_F(&sink, "caught signal {}", int, sig);
+}
+
+int main(void) {
+    EMTRACE_SIGSAFE_INIT(&sink);
+    EMTRACELN_SIGSAFE(&sink, "installing handler");
+    struct sigaction action = {0};
+    action.sa_handler = handler;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGUSR1, &action, NULL);
+    raise(SIGUSR1);
+    EMTRACELN_SIGSAFE_F(&sink, "back in main after signal {}", int, (int) caught);
+    return 0;
+}
@@ -0,0 +1,22 @@
+#include "test_utils.h"
+#include <emtrace/emtrace.h>
+
+EXPECT_OUTPUT(
+    "captured 3 frames\n"
+    "skipped all: []\n"
+);
+
+__attribute__((noinline)) static void fail(int depth) {
+    if (depth > 0) {
+        fail(depth - 1);
+        return;
+    }
+    EMTRACELN_F("captured {:depth} frames", EMT_STACK(3), 0);
+    EMTRACELN_F("skipped all: [{:oneline}]", EMT_STACK(8), 1000);
+}
+
+int main(void) {
+    EMTRACE_INIT();
+    fail(4);
+    return 0;
+}
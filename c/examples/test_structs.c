@@ -0,0 +1,48 @@
+#include "test_utils.h"
+#include <emtrace/emtrace.h>
+#include <stdint.h>
+
+EXPECT_OUTPUT(
+    "point { x: -3, y: 4 }\n"
+    "Sample 7: 0.5 (mac 01:02:03:04:05:0a)\n"
+    "Before 1, point { x: 5, y: 6 }, after 2\n"
+    "Sample 8: -1.25 (mac 00:00:00:00:00:ff)\n"
+);
+
+typedef struct {
+    int32_t x;
+    int32_t y;
+} point;
+#define EMT_STRUCT_point(field, ctx) field(ctx, int32_t, x) field(ctx, int32_t, y)
+
+typedef struct {
+    uint8_t kind; // not declared below, so not decoded
+    uint32_t id;
+    double value;
+    uint8_t mac[6];
+    uint16_t flags;
+} sample_t;
+#define EMT_STRUCT_sample_t(field, ctx)                                                            \
+    field(ctx, uint32_t, id) field(ctx, double, value) field(ctx, EMT_ARRAY(uint8_t, 6), mac)      \
+        field(ctx, uint16_t, flags)
+
+int main(void) {
+    EMTRACE_INIT();
+
+    point p = {-3, 4};
+    EMTRACELN_F("{}", EMT_STRUCT(point), p);
+
+    sample_t samples[2] = {
+        {1, 7, 0.5, {1, 2, 3, 4, 5, 10}, 0},
+        {2, 8, -1.25, {0, 0, 0, 0, 0, 255}, 0},
+    };
+    EMTRACELN_F("Sample {0.id}: {0.value} (mac {0.mac::*02x})", EMT_STRUCT(sample_t), samples[0]);
+
+    point q = {5, 6};
+    EMTRACELN_F("Before {}, {}, after {}", int, 1, EMT_STRUCT(point), q, int, 2);
+
+    const sample_t* last = &samples[1];
+    EMTRACELN_F("Sample {0.id}: {0.value} (mac {0.mac::*02x})", EMT_STRUCT(sample_t), *last);
+
+    return 0;
+}
@@ -0,0 +1,34 @@
+#include "test_utils.h"
+#include <emtrace/emtrace.h>
+#include <emtrace/transaction.h>
+#include <stdint.h>
+
+EXPECT_OUTPUT(
+    "serving 3 requests\n"
+    "request 2: parsed 512 bytes\n"
+    "request 2: failed with 503\n"
+    "all done\n"
+);
+
+static emt_txn_t txn = EMT_TXN_STDOUT_INITIALIZER;
+
+static void handle_request(int id, int status) {
+    emt_txn_begin(&txn);
+    EMTRACELN_TXN_F(&txn, "request {}: parsed {} bytes", int, id, uint32_t, 512);
+    if (status != 200) {
+        EMTRACELN_TXN_F(&txn, "request {}: failed with {}", int, id, int, status);
+        emt_txn_commit(&txn);
+    } else {
+        emt_txn_discard(&txn);
+    }
+}
+
+int main(void) {
+    EMTRACE_TXN_INIT(&txn);
+    EMTRACELN_TXN_F(&txn, "serving {} requests", int, 3);
+    handle_request(1, 200);
+    handle_request(2, 503);
+    handle_request(3, 200);
+    EMTRACELN_TXN(&txn, "all done");
+    return 0;
+}
@@ -0,0 +1,50 @@
+#include "test_utils.h"
+#include <emtrace/emtrace.h>
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <variant>
+
+EXPECT_OUTPUT(
+    "name: world (5 chars)\n"
+    "retries: 3, limit: nullopt\n"
+    "value: 2.5, then: x, then: 7\n"
+    "elapsed: 1500ns, timeout: 20ms (0.02s), period: 0.25s, uptime: 3\n"
+);
+
+auto main() -> int {
+    EMTRACE_INIT();
+
+    std::string greeting = "hello world";
+    std::string_view name = std::string_view(greeting).substr(6);
+    EMTRACELN_F("name: {} ({} chars)", EMT_STRING_VIEW, name, size_t, name.size());
+
+    std::optional<int32_t> retries = 3;
+    std::optional<int32_t> limit;
+    EMTRACELN_F(
+        "retries: {}, limit: {}", EMT_OPTIONAL(int32_t), retries, EMT_OPTIONAL(int32_t), limit
+    );
+
+    std::variant<int32_t, double, char> value = 2.5;
+    std::variant<int32_t, double, char> then = 'x';
+    std::variant<int32_t, double, char> last = 7;
+    EMTRACELN_F(
+        "value: {}, then: {}, then: {}", EMT_VARIANT(int32_t, double, char), value,
+        EMT_VARIANT(int32_t, double, char), then, EMT_VARIANT(int32_t, double, char), last
+    );
+
+    std::chrono::nanoseconds elapsed(1500);
+    std::chrono::milliseconds timeout(20);
+    std::chrono::duration<double> period(0.25);
+    EMTRACELN_F(
+        "elapsed: {0}, timeout: {1} ({1:s}), period: {2}, uptime: {3:d}",
+        EMT_DURATION(std::chrono::nanoseconds), elapsed, EMT_DURATION(std::chrono::milliseconds),
+        timeout, EMT_DURATION(std::chrono::duration<double>), period,
+        EMT_DURATION(std::chrono::seconds), std::chrono::seconds(3)
+    );
+
+    return 0;
+}
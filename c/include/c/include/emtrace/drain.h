@@ -0,0 +1,490 @@
+#ifndef EMTRACE_DRAIN_H
+#define EMTRACE_DRAIN_H
+
+#include "emtrace/emtrace.h"
+#include "emtrace/memory.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+// NOLINTBEGIN(modernize-use-using,modernize-avoid-c-arrays)
+
+/**
+ * Background drain thread.
+ *
+ * Buffered sinks (like the per-CPU rings of `percpu.h`) only collect records; the engine below is
+ * the consumer side: a thread that periodically drains a source into batches and writes each batch
+ * to a file descriptor with a single `write(2)`. A batch is written once it reaches `batch_size`
+ * bytes, once its oldest record is `deadline_ns` old, or as soon as the source runs dry. While the
+ * source is idle the thread sleeps, twice as long after every empty round up to `max_sleep_ns`;
+ * producers can cut the sleep short with `emt_drain_wake`.
+ *
+ * Records the source had to drop are reported in the stream as a synthetic record (with the
+ * `EMT_DROPPED_FORMAT` formatter) carrying their number, placed where the loss was noticed.
+ *
+ * With `EMT_DRAIN_VMSPLICE`, and if `fd` is a pipe, batches are collected in page-aligned memory
+ * and handed to the pipe with `vmsplice(SPLICE_F_GIFT)` instead of being copied by `write`: the
+ * pipe then references the pages themselves, and the reader's `read` (or `splice` to a file) is the
+ * only copy. Each batch goes into the next of a ring of buffers that together hold more than the
+ * pipe can, and a buffer is only reused once the reader has consumed everything spliced from it.
+ * The engine counts every byte that entered the pipe (what was unread when it started, and what it
+ * wrote or spliced since), so `FIONREAD` tells it how much has been consumed. The reader must
+ * therefore copy the data out of the pipe rather than `tee` or `splice` it into another pipe,
+ * which would keep referencing the pages.
+ *
+ * The sink functions (`emt_drain_out` et al.) may only be called by the engine's own thread, so the
+ * stream's init record (`EMTRACE_INIT`) is written to the file descriptor before the engine starts,
+ * rather than through the source.
+ *
+ * Engines are stopped (draining and writing everything that is left) by `emt_drain_stop`, or at
+ * `exit` if they are still running then.
+ */
+
+/// When a producer finds its buffer full: drop the record it's writing.
+#define EMT_BACKPRESSURE_DROP_NEWEST 0
+/// When a producer finds its buffer full: wait for the drainer to make room. Not for signal
+/// handlers, nor for the drainer's own thread.
+#define EMT_BACKPRESSURE_BLOCK 1
+/// When a producer finds its buffer full: discard the oldest records to make room.
+#define EMT_BACKPRESSURE_OVERWRITE_OLDEST 2
+
+/// Passes the source's buffered records on to its sink; returns how many it passed on.
+typedef uint64_t (*emt_drain_fn_t)(void* source);
+/// Returns how many records the source has dropped so far.
+typedef uint64_t (*emt_dropped_fn_t)(void* source);
+
+typedef struct {
+    emt_drain_fn_t drain;     ///< drains `source` into the engine (see `emt_drain_out` et al.)
+    emt_dropped_fn_t dropped; ///< may be NULL
+    void* source;
+    int fd;                ///< batches are written here
+    size_t batch_size;     ///< write a batch once it has this many bytes
+    uint64_t deadline_ns;  ///< write a batch once its oldest record is this old
+    uint64_t max_sleep_ns; ///< longest sleep between rounds while the source is idle
+    int cpu;               ///< pin the thread to this CPU, or -1
+    int node;              ///< pin the thread to the CPUs of this NUMA node, or -1
+    int nice;              ///< nice value of the thread
+    int rt_priority;       ///< if > 0, run the thread with `SCHED_FIFO` at this priority
+    int flags;             ///< `EMT_DRAIN_VMSPLICE`
+} emt_drain_config_t;
+
+/// If `fd` is a pipe, hand it the batches with `vmsplice` rather than copying them with `write`.
+#define EMT_DRAIN_VMSPLICE 0x1
+
+/// Default configuration of an engine writing to `fd`, for which `drain` et al. remain to be set.
+#define EMT_DRAIN_CONFIG_DEFAULT(fd)                                                               \
+    {NULL, NULL, NULL, (fd), (size_t) 64 << 10, 10000000, 1000000, -1, -1, 0, 0, 0}
+
+/// The thread's affinity was applied.
+#define EMT_DRAIN_APPLIED_AFFINITY 0x1
+/// The thread's nice value and real-time priority were applied.
+#define EMT_DRAIN_APPLIED_PRIORITY 0x2
+/// Batches are spliced into the pipe.
+#define EMT_DRAIN_APPLIED_VMSPLICE 0x4
+
+// from <fcntl.h>, which only declares them with _GNU_SOURCE
+#define EMT_DRAIN_F_GETPIPE_SZ 1032
+#define EMT_DRAIN_SPLICE_F_GIFT 0x08
+
+typedef struct emt_drain {
+    emt_drain_config_t config;
+    uint8_t* batch;
+    size_t pending;         ///< bytes in `batch`
+    uint8_t* pool;          ///< with `EMT_DRAIN_APPLIED_VMSPLICE`: `num_slots` batches
+    uint64_t* slot_end;     ///< for each of them, `piped` once it was spliced
+    uint32_t num_slots;
+    uint32_t slot;          ///< the one `batch` points to
+    uint64_t piped;         ///< bytes that entered the pipe, spliced or written
+    uint64_t pending_since; ///< when the oldest of them was added
+    uint64_t reported;      ///< dropped records reported so far
+    uint64_t written;       ///< bytes written (atomic)
+    uint64_t batches;       ///< batches written (atomic)
+    uint64_t write_errors;  ///< batches that couldn't be written (atomic)
+    int applied;            ///< `EMT_DRAIN_APPLIED_*` settings that took effect
+    int stopping;           ///< (atomic)
+    int woken;              ///< (atomic)
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    struct emt_drain* next; ///< in the list of running engines
+} emt_drain_t;
+
+static inline uint64_t emt_drain_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t) ts.tv_sec * 1000000000) + (uint64_t) ts.tv_nsec;
+}
+
+static inline void emt_drain_write(emt_drain_t* drain, const uint8_t* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = write(drain->config.fd, data, size);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0) {
+            __atomic_fetch_add(&drain->write_errors, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        __atomic_fetch_add(&drain->written, (uint64_t) written, __ATOMIC_RELAXED);
+        drain->piped += (uint64_t) written;
+        data += written;
+        size -= (size_t) written;
+    }
+}
+
+/// Hand the pending batch to the pipe; whatever can't be spliced is written.
+static inline void emt_drain_splice(emt_drain_t* drain) {
+    struct iovec iov = {drain->batch, drain->pending};
+#ifdef SYS_vmsplice
+    while (iov.iov_len > 0) {
+        long spliced = syscall(SYS_vmsplice, drain->config.fd, &iov, 1, EMT_DRAIN_SPLICE_F_GIFT);
+        if (spliced < 0 && errno == EINTR)
+            continue;
+        if (spliced <= 0) {
+            emt_drain_write(drain, (const uint8_t*) iov.iov_base, iov.iov_len);
+            break;
+        }
+        __atomic_fetch_add(&drain->written, (uint64_t) spliced, __ATOMIC_RELAXED);
+        drain->piped += (uint64_t) spliced;
+        iov.iov_base = (uint8_t*) iov.iov_base + spliced;
+        iov.iov_len -= (size_t) spliced;
+    }
+#else
+    emt_drain_write(drain, (const uint8_t*) iov.iov_base, iov.iov_len);
+#endif
+    drain->slot_end[drain->slot] = drain->piped;
+}
+
+/// Move on to the next buffer of the ring, once the reader has consumed all that was spliced from
+/// it.
+static inline void emt_drain_next_slot(emt_drain_t* drain) {
+    drain->slot = (drain->slot + 1) % drain->num_slots;
+    drain->batch = drain->pool + ((size_t) drain->slot * drain->config.batch_size);
+    for (;;) {
+        int unread = 0;
+        if (ioctl(drain->config.fd, FIONREAD, &unread) != 0)
+            break;
+        // bytes others wrote to the pipe only make this more conservative
+        const uint64_t consumed =
+            (uint64_t) unread > drain->piped ? 0 : drain->piped - (uint64_t) unread;
+        if (consumed >= drain->slot_end[drain->slot])
+            break;
+        // without a reader, the pipe is never read again
+        struct pollfd pollfd = {drain->config.fd, 0, 0};
+        if (poll(&pollfd, 1, 0) > 0 && (pollfd.revents & POLLERR))
+            break;
+        struct timespec pause = {0, 20000};
+        (void) nanosleep(&pause, NULL);
+    }
+}
+
+/// Write the pending batch.
+static inline void emt_drain_flush(emt_drain_t* drain) {
+    if (drain->pending == 0)
+        return;
+    if (drain->applied & EMT_DRAIN_APPLIED_VMSPLICE) {
+        emt_drain_splice(drain);
+        emt_drain_next_slot(drain);
+    } else {
+        emt_drain_write(drain, drain->batch, drain->pending);
+    }
+    __atomic_fetch_add(&drain->batches, 1, __ATOMIC_RELAXED);
+    drain->pending = 0;
+}
+
+/// Use as the `lock` argument of the source's sink (or of `EMT_TRACE_F` et al.), with the engine
+/// as `extra_arg`. Only to be called from the engine's thread.
+static inline void emt_drain_lock(const void* data, emt_size_t size, void* arg) {
+    (void) data;
+    emt_drain_t* drain = (emt_drain_t*) arg;
+    // for variable-sized records this is the minimum size
+    size &= (emt_size_t) ~(EMT_NULL_TERMINATED | EMT_LENGTH_PREFIXED);
+    if (drain->pending > 0 && drain->pending + size > drain->config.batch_size)
+        emt_drain_flush(drain);
+    if (drain->pending == 0)
+        drain->pending_since = emt_drain_now();
+}
+
+/// Use as the `out_fn` argument of the source's sink, like `emt_drain_lock`.
+static inline void emt_drain_out(const void* data, emt_size_t size, void* arg) {
+    emt_drain_t* drain = (emt_drain_t*) arg;
+    if (drain->pending + size > drain->config.batch_size) {
+        emt_drain_flush(drain);
+        if (size > drain->config.batch_size) {
+            emt_drain_write(drain, (const uint8_t*) data, size);
+            return;
+        }
+    }
+    memcpy(drain->batch + drain->pending, data, size);
+    drain->pending += size;
+}
+
+/// Use as the `unlock` argument of the source's sink, like `emt_drain_lock`.
+static inline void emt_drain_unlock(const void* data, emt_size_t size, void* arg) {
+    (void) data;
+    (void) size;
+    (void) arg;
+}
+
+/// Cut the engine's sleep short, e.g. from a producer waiting for room.
+static inline void emt_drain_wake(void* arg) {
+    emt_drain_t* drain = (emt_drain_t*) arg;
+    if (__atomic_exchange_n(&drain->woken, 1, __ATOMIC_RELEASE) == 0) {
+        pthread_mutex_lock(&drain->mutex);
+        pthread_cond_signal(&drain->cond);
+        pthread_mutex_unlock(&drain->mutex);
+    }
+}
+
+/// Add a record about records dropped since the last report to the batch.
+static inline void emt_drain_report_dropped(emt_drain_t* drain) {
+    if (drain->config.dropped == NULL)
+        return;
+    uint64_t dropped = drain->config.dropped(drain->config.source);
+    if (dropped == drain->reported)
+        return;
+    uint64_t count = dropped - drain->reported;
+    drain->reported = dropped;
+#if defined(EMT_DEFAULT_SEC_ATTR)
+    EMT_TRACE_F(
+        EMT_DEFAULT_SEC_ATTR, EMT_DROPPED_FORMAT, emt_drain_out, emt_drain_lock, emt_drain_unlock,
+        drain, "", "{} records dropped", uint64_t, count
+    );
+#else
+    (void) count;
+#endif
+}
+
+static inline void emt_drain_setup_thread(emt_drain_t* drain) {
+    const emt_drain_config_t* config = &drain->config;
+    if (config->node >= 0) {
+        if (emt_mem_pin_node((uint32_t) config->node) == 0)
+            drain->applied |= EMT_DRAIN_APPLIED_AFFINITY;
+    } else if (config->cpu >= 0 && config->cpu < EMT_MEM_MAX_CPUS) {
+        const unsigned cpu = (unsigned) config->cpu;
+        unsigned long mask[EMT_MEM_MAX_CPUS / 32] = {0};
+        mask[cpu / EMT_MEM_LONG_BITS] = 1UL << (cpu % EMT_MEM_LONG_BITS);
+        if (syscall(SYS_sched_setaffinity, 0, sizeof(mask), mask) == 0)
+            drain->applied |= EMT_DRAIN_APPLIED_AFFINITY;
+    }
+
+    int prioritized = 1;
+    if (config->nice != 0) {
+        // on Linux, the nice value is per thread
+        prioritized = setpriority(PRIO_PROCESS, (id_t) syscall(SYS_gettid), config->nice) == 0;
+    }
+    if (config->rt_priority > 0) {
+        struct sched_param param;
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = config->rt_priority;
+        prioritized &= pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+    }
+    if (prioritized && (config->nice != 0 || config->rt_priority > 0))
+        drain->applied |= EMT_DRAIN_APPLIED_PRIORITY;
+}
+
+static inline void* emt_drain_thread(void* arg) {
+    emt_drain_t* drain = (emt_drain_t*) arg;
+    const emt_drain_config_t* config = &drain->config;
+    emt_drain_setup_thread(drain);
+
+    const uint64_t min_sleep_ns = 10000;
+    uint64_t sleep_ns = min_sleep_ns;
+    for (;;) {
+        int stopping = __atomic_load_n(&drain->stopping, __ATOMIC_ACQUIRE);
+        __atomic_store_n(&drain->woken, 0, __ATOMIC_RELAXED);
+        uint64_t drained = config->drain(config->source);
+        emt_drain_report_dropped(drain);
+        if (drain->pending > 0 &&
+            (drained == 0 || emt_drain_now() - drain->pending_since >= config->deadline_ns))
+            emt_drain_flush(drain);
+        if (drained > 0) {
+            sleep_ns = min_sleep_ns;
+            continue;
+        }
+        if (stopping)
+            break;
+
+        uint64_t wake_at = emt_drain_now() + sleep_ns;
+        struct timespec deadline = {
+            (time_t) (wake_at / 1000000000), (long) (wake_at % 1000000000)
+        };
+        pthread_mutex_lock(&drain->mutex);
+        if (!__atomic_load_n(&drain->woken, __ATOMIC_ACQUIRE) &&
+            !__atomic_load_n(&drain->stopping, __ATOMIC_ACQUIRE))
+            (void) pthread_cond_timedwait(&drain->cond, &drain->mutex, &deadline);
+        pthread_mutex_unlock(&drain->mutex);
+        sleep_ns = sleep_ns * 2 > config->max_sleep_ns ? config->max_sleep_ns : sleep_ns * 2;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Allocate the batch buffer: with `EMT_DRAIN_VMSPLICE`, a ring of page-aligned buffers of
+ * `batch_size` (rounded up to whole pages) holding more than the pipe `fd` can, else just one.
+ *
+ * @return 0 on success, -1 on failure with `errno` set.
+ */
+static inline int emt_drain_alloc_batch(emt_drain_t* drain) {
+    emt_drain_config_t* config = &drain->config;
+    struct stat st;
+    long pipe_size = -1;
+#ifdef SYS_vmsplice
+    if ((config->flags & EMT_DRAIN_VMSPLICE) && fstat(config->fd, &st) == 0 &&
+        S_ISFIFO(st.st_mode))
+        pipe_size = fcntl(config->fd, EMT_DRAIN_F_GETPIPE_SZ);
+#endif
+    if (pipe_size > 0) {
+        config->batch_size = emt_mem_round(config->batch_size, 0);
+        drain->num_slots = (uint32_t) (((size_t) pipe_size / config->batch_size) + 2);
+        int flags = 0;
+        drain->pool = (uint8_t*) emt_mem_map(drain->num_slots * config->batch_size, &flags);
+        drain->slot_end = (uint64_t*) calloc(drain->num_slots, sizeof(uint64_t));
+        int unread = 0;
+        if (drain->pool != NULL && drain->slot_end != NULL &&
+            ioctl(config->fd, FIONREAD, &unread) == 0) {
+            // e.g. the init record, which the reader consumes before any batch
+            drain->piped = (uint64_t) unread;
+            drain->batch = drain->pool;
+            drain->applied |= EMT_DRAIN_APPLIED_VMSPLICE;
+            return 0;
+        }
+        emt_mem_unmap(drain->pool, drain->num_slots * config->batch_size, 0);
+        free(drain->slot_end);
+        drain->pool = NULL;
+        drain->slot_end = NULL;
+    }
+    drain->batch = (uint8_t*) malloc(config->batch_size);
+    if (drain->batch == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    return 0;
+}
+
+static inline void emt_drain_free_batch(emt_drain_t* drain) {
+    if (drain->applied & EMT_DRAIN_APPLIED_VMSPLICE) {
+        // pages still in the pipe stay referenced by it
+        emt_mem_unmap(drain->pool, drain->num_slots * drain->config.batch_size, 0);
+        free(drain->slot_end);
+    } else {
+        free(drain->batch);
+    }
+    drain->batch = NULL;
+    drain->pool = NULL;
+    drain->slot_end = NULL;
+}
+
+/// The engines that are running, to be stopped at exit. Per translation unit.
+static inline emt_drain_t** emt_drain_running(pthread_mutex_t** mutex) {
+    static pthread_mutex_t running_mutex = PTHREAD_MUTEX_INITIALIZER;
+    static emt_drain_t* running = NULL;
+    *mutex = &running_mutex;
+    return &running;
+}
+
+static inline void emt_drain_join(emt_drain_t* drain) {
+    __atomic_store_n(&drain->stopping, 1, __ATOMIC_RELEASE);
+    emt_drain_wake(drain);
+    (void) pthread_join(drain->thread, NULL);
+    pthread_cond_destroy(&drain->cond);
+    pthread_mutex_destroy(&drain->mutex);
+    emt_drain_free_batch(drain);
+}
+
+static inline void emt_drain_stop_all(void) {
+    pthread_mutex_t* mutex;
+    emt_drain_t** running = emt_drain_running(&mutex);
+    pthread_mutex_lock(mutex);
+    emt_drain_t* list = *running;
+    *running = NULL;
+    pthread_mutex_unlock(mutex);
+    for (emt_drain_t* drain = list; drain != NULL; drain = drain->next)
+        emt_drain_join(drain);
+}
+
+/**
+ * @brief Start a drain thread with the given configuration.
+ *
+ * Records the source's sink receives before the engine has started (such as the one of
+ * `EMT_INIT`) must not be passed to `emt_drain_out` et al. from another thread while it runs.
+ *
+ * @return 0 on success, -1 on failure with `errno` set.
+ */
+static inline int emt_drain_start(emt_drain_t* drain, const emt_drain_config_t* config) {
+    if (config->drain == NULL || config->batch_size == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    memset(drain, 0, sizeof(*drain));
+    drain->config = *config;
+    if (emt_drain_alloc_batch(drain) != 0)
+        return -1;
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&drain->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&drain->mutex, NULL);
+
+    int result = pthread_create(&drain->thread, NULL, emt_drain_thread, drain);
+    if (result != 0) {
+        pthread_cond_destroy(&drain->cond);
+        pthread_mutex_destroy(&drain->mutex);
+        emt_drain_free_batch(drain);
+        errno = result;
+        return -1;
+    }
+
+    pthread_mutex_t* mutex;
+    emt_drain_t** running = emt_drain_running(&mutex);
+    static int registered = 0;
+    pthread_mutex_lock(mutex);
+    if (!registered)
+        registered = atexit(emt_drain_stop_all) == 0;
+    drain->next = *running;
+    *running = drain;
+    pthread_mutex_unlock(mutex);
+    return 0;
+}
+
+/// Stop the engine, after draining the source and writing everything that is pending.
+static inline void emt_drain_stop(emt_drain_t* drain) {
+    pthread_mutex_t* mutex;
+    emt_drain_t** running = emt_drain_running(&mutex);
+    int found = 0;
+    pthread_mutex_lock(mutex);
+    for (emt_drain_t** link = running; *link != NULL; link = &(*link)->next) {
+        if (*link == drain) {
+            *link = drain->next;
+            found = 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(mutex);
+    // otherwise stopped already, at exit
+    if (found)
+        emt_drain_join(drain);
+}
+
+// NOLINTEND(modernize-use-using,modernize-avoid-c-arrays)
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EMTRACE_DRAIN_H
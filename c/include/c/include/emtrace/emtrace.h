@@ -3,7 +3,9 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#if !defined(EMT_FREESTANDING)
 #include <stdio.h>
+#endif
 
 #ifdef __cplusplus
 extern "C" {
@@ -62,6 +64,10 @@ enum : emt_size_t {
                     ///< are discarded.
     1,
     EMT_C_STYLE_FORMAT = 2, ///< Use python's C-style formatter
+    EMT_METRIC_FORMAT = 3,   ///< An aggregate record of a counter or histogram (see metrics.h)
+    EMT_DROPPED_FORMAT = 4,  ///< The number of records a buffered sink dropped (see drain.h)
+    EMT_OVERHEAD_FORMAT = 5, ///< The measured overhead of a call site (see overhead.h)
+    EMT_PERF_FORMAT = 6,     ///< A trace with performance counter deltas (see perf.h)
 
     EMT_ALIGNMENT = 1 << (EMT_ALIGNMENT_POWER),
 };
@@ -78,6 +84,14 @@ enum : emt_size_t {
 #define EMT_NO_FORMAT ((emt_size_t) 1)
 /// Use python's C-style formatter
 #define EMT_C_STYLE_FORMAT ((emt_size_t) 2)
+/// An aggregate record of a counter or histogram (see metrics.h)
+#define EMT_METRIC_FORMAT ((emt_size_t) 3)
+/// The number of records a buffered sink dropped (see drain.h)
+#define EMT_DROPPED_FORMAT ((emt_size_t) 4)
+/// The measured overhead of a call site (see overhead.h)
+#define EMT_OVERHEAD_FORMAT ((emt_size_t) 5)
+/// A trace with performance counter deltas (see perf.h)
+#define EMT_PERF_FORMAT ((emt_size_t) 6)
 
 #define EMT_ALIGNMENT (1 << (EMT_ALIGNMENT_POWER))
 #endif
@@ -94,9 +108,14 @@ typedef struct {
     // emt_size_t no_format;
 } emt_magic_t;
 
+#if !defined(EMT_FREESTANDING)
 static inline void emt_out_file(const void* data, emt_size_t size, FILE* file) {
     fwrite(data, 1, size, file);
 }
+#endif
+
+/// Signature of `out_fn`, `lock`, and `unlock` when a sink is passed around as function pointers.
+typedef void (*emt_sink_fn_t)(const void* data, emt_size_t size, void* arg);
 
 #define EMT_NTH_ARG(                                                                               \
     a, b, c, d, e, f, g, h, i, j, k, l, m, n, o, p, q, r, s, t, u, v, x, y, z, aa, bb, cc, dd, ee, \
@@ -120,8 +139,52 @@ EMT_STATIC_ASSERT(
 #define EMT_FIRST_ARG(a, ...) a
 #define EMT_REST_ARGS(a, ...) __VA_ARGS__
 
-#define EMT_F_0(out_fn, extra_arg, a) ((void) 0)
-#define EMT_F_2(out_fn, extra_arg, type_x, x, dummy)                                               \
+/*
+ * Per-argument dispatch. The type of a format argument is either a plain type (a scalar, sent with
+ * one `out_fn` call of `sizeof(type)` bytes), one of the array markers below, `EMT_BLOB`,
+ * `EMT_STACK`, `EMT_ENUM`, one of the C++ markers (`EMT_STRING_VIEW`, `EMT_OPTIONAL`,
+ * `EMT_VARIANT`, `EMT_DURATION`), or `EMT_STRUCT`. The markers are deliberately not defined as
+ * macros; they are recognized by pasting them onto `EMT_F_PROBE_`.
+ *
+ * - `EMT_ARRAY(elem, n)`: `n` (a constant expression) elements of type `elem`.
+ * - `EMT_SPAN(elem, n)`: a runtime number `n` of elements of type `elem`, prefixed by the count.
+ *
+ * In both cases the argument value has to be a pointer to (or in C++ also a container holding) the
+ * contiguous elements, and the whole buffer is sent with a single `out_fn` call. The decoder sees
+ * an argument of type `list` whose only child is of type `elem`.
+ */
+#define EMT_F_PROBE_EMT_ARRAY(elem, n) ~, ARRAY
+#define EMT_F_PROBE_EMT_SPAN(elem, n) ~, SPAN
+#define EMT_F_UNWRAP_EMT_ARRAY(elem, n) elem, n
+#define EMT_F_UNWRAP_EMT_SPAN(elem, n) elem, n
+
+#define EMT_F_SECOND(a, b, ...) b
+#define EMT_F_SECOND_HELPER(...) EMT_F_SECOND(__VA_ARGS__)
+#define EMT_F_APPLY(m, ...) m(__VA_ARGS__)
+#define EMT_F_SELECT(what, type_x)                                                                 \
+    EMT_F_SELECT_HELPER(what, EMT_F_SECOND_HELPER(EMT_F_PROBE_##type_x, SCALAR, ~))
+#define EMT_F_SELECT_HELPER(what, kind) EMT_F_SELECT_HELPER2(what, kind)
+#define EMT_F_SELECT_HELPER2(what, kind) EMT_F_##what##_##kind
+
+/// number of bytes the argument contributes to the record (excluding a runtime-sized payload)
+#define EMT_F_ARG_SIZE(type_x) EMT_F_SELECT(SIZE, type_x)(type_x)
+/// `EMT_NULL_TERMINATED`/`EMT_LENGTH_PREFIXED` if the argument's size is only known at runtime
+#define EMT_F_ARG_FLAGS(type_x) EMT_F_SELECT(FLAGS, type_x)(type_x)
+/// number of `emt_size_t` entries the argument occupies in the `layout` member of the info struct
+#define EMT_F_ARG_LAYOUT_SIZE(type_x) EMT_F_SELECT(LAYOUT_SIZE, type_x)(type_x)
+#define EMT_F_ARG_INFO_MEMBER(k, type_x) EMT_F_SELECT(INFO_MEMBER, type_x)(k, type_x)
+#define EMT_F_ARG_INFO(type_x) EMT_F_SELECT(INFO, type_x)(type_x)
+#define EMT_F_ARG_LAYOUT(k, type_x) EMT_F_SELECT(LAYOUT, type_x)(k, type_x)
+#define EMT_F_ARG(out_fn, extra_arg, type_x, x)                                                    \
+    EMT_F_SELECT(OUT, type_x)(out_fn, extra_arg, type_x, x)
+
+#define EMT_F_SIZE_SCALAR(type_x) sizeof(type_x)
+#define EMT_F_FLAGS_SCALAR(type_x) 0
+#define EMT_F_LAYOUT_SIZE_SCALAR(type_x) 3
+#define EMT_F_INFO_MEMBER_SCALAR(k, type_x) char type_##k[sizeof(#type_x)];
+#define EMT_F_INFO_SCALAR(type_x) #type_x,
+#define EMT_F_LAYOUT_SCALAR(k, type_x) , offsetof(info_t, type_##k), sizeof(type_x), 0
+#define EMT_F_OUT_SCALAR(out_fn, extra_arg, type_x, x)                                             \
     do {                                                                                           \
         type_x temp = x;                                                                           \
         EMT_STATIC_ASSERT_INNER(                                                                   \
@@ -132,67 +195,564 @@ EMT_STATIC_ASSERT(
         );                                                                                         \
         out_fn((const void*) &temp, sizeof(type_x), extra_arg);                                    \
     } while (0)
-#define EMT_F_4(out_fn, extra_arg, type_a, a, type_x, x, dummy)                                    \
+
+#define EMT_F_SIZE_ARRAY(type_x) EMT_F_APPLY(EMT_F_SIZE_ARRAY_, EMT_F_UNWRAP_##type_x)
+#define EMT_F_SIZE_ARRAY_(elem, n) ((n) * sizeof(elem))
+#define EMT_F_FLAGS_ARRAY(type_x) 0
+#define EMT_F_LAYOUT_SIZE_ARRAY(type_x) 7
+#define EMT_F_INFO_MEMBER_ARRAY(k, type_x)                                                         \
+    EMT_F_APPLY(EMT_F_INFO_MEMBER_LIST_, k, EMT_F_UNWRAP_##type_x)
+#define EMT_F_INFO_ARRAY(type_x) EMT_F_APPLY(EMT_F_INFO_LIST_, EMT_F_UNWRAP_##type_x)
+#define EMT_F_LAYOUT_ARRAY(k, type_x) EMT_F_APPLY(EMT_F_LAYOUT_ARRAY_, k, EMT_F_UNWRAP_##type_x)
+#define EMT_F_LAYOUT_ARRAY_(k, elem, n) EMT_F_LAYOUT_LIST_(k, elem, (emt_size_t) (n))
+#define EMT_F_OUT_ARRAY(out_fn, extra_arg, type_x, x)                                              \
+    EMT_F_APPLY(EMT_F_OUT_ARRAY_, out_fn, extra_arg, EMT_F_UNWRAP_##type_x, x)
+#define EMT_F_OUT_ARRAY_(out_fn, extra_arg, elem, n, x)                                            \
     do {                                                                                           \
-        EMT_F_2(out_fn, extra_arg, type_a, a, 0);                                                  \
-        type_x temp = x;                                                                           \
-        EMT_STATIC_ASSERT_INNER(                                                                   \
-            sizeof(type_x) != EMT_NULL_TERMINATED, "Size of type_x is too large"                   \
+        EMT_F_ARRAY_CHECK(elem, x);                                                                \
+        EMT_F_ARRAY_EXTENT_CHECK(n, x)                                                             \
+        out_fn(EMT_F_ARRAY_DATA(x), (emt_size_t) ((n) * sizeof(elem)), extra_arg);                 \
+    } while (0)
+
+#define EMT_F_SIZE_SPAN(type_x) sizeof(emt_size_t)
+#define EMT_F_FLAGS_SPAN(type_x) EMT_LENGTH_PREFIXED
+#define EMT_F_LAYOUT_SIZE_SPAN(type_x) 7
+#define EMT_F_INFO_MEMBER_SPAN(k, type_x)                                                          \
+    EMT_F_APPLY(EMT_F_INFO_MEMBER_LIST_, k, EMT_F_UNWRAP_##type_x)
+#define EMT_F_INFO_SPAN(type_x) EMT_F_APPLY(EMT_F_INFO_LIST_, EMT_F_UNWRAP_##type_x)
+#define EMT_F_LAYOUT_SPAN(k, type_x) EMT_F_APPLY(EMT_F_LAYOUT_SPAN_, k, EMT_F_UNWRAP_##type_x)
+#define EMT_F_LAYOUT_SPAN_(k, elem, n) EMT_F_LAYOUT_LIST_(k, elem, EMT_LENGTH_PREFIXED)
+#define EMT_F_OUT_SPAN(out_fn, extra_arg, type_x, x)                                               \
+    EMT_F_APPLY(EMT_F_OUT_SPAN_, out_fn, extra_arg, EMT_F_UNWRAP_##type_x, x)
+#define EMT_F_OUT_SPAN_(out_fn, extra_arg, elem, n, x)                                             \
+    do {                                                                                           \
+        EMT_F_ARRAY_CHECK(elem, x);                                                                \
+        const void* emt_data = EMT_F_ARRAY_DATA(x);                                                \
+        emt_size_t emt_count = (emt_size_t) (n);                                                   \
+        out_fn((const void*) &emt_count, sizeof(emt_count), extra_arg);                            \
+        out_fn(emt_data, (emt_size_t) (emt_count * sizeof(elem)), extra_arg);                      \
+    } while (0)
+
+#define EMT_F_INFO_MEMBER_LIST_(k, elem, n)                                                        \
+    char type_##k[sizeof("list")];                                                                 \
+    char name_##k[1];                                                                              \
+    char child_##k[sizeof(#elem)];
+#define EMT_F_INFO_LIST_(elem, n) "list", "", #elem,
+#define EMT_F_LAYOUT_LIST_(k, elem, size)                                                          \
+    , offsetof(info_t, type_##k), size, 1, offsetof(info_t, name_##k), sizeof(elem), 0,            \
+        offsetof(info_t, child_##k)
+
+/*
+ * Blob arguments. `EMT_BLOB(n)` traces `n` raw bytes starting at the argument value (a pointer),
+ * `EMT_BLOB_MAX(n, max)` at most `max` (a constant expression) of them. Either way the bytes are
+ * sent with a single `out_fn` call, prefixed by their count, and the decoder sees an argument of
+ * type `blob`, which can be rendered with hexdump-like format specs.
+ */
+#define EMT_F_PROBE_EMT_BLOB(n) ~, BLOB
+#define EMT_F_PROBE_EMT_BLOB_MAX(n, max) ~, BLOB
+#define EMT_F_UNWRAP_EMT_BLOB(n) n, 0
+#define EMT_F_UNWRAP_EMT_BLOB_MAX(n, max) n, max
+
+#define EMT_F_SIZE_BLOB(type_x) sizeof(emt_size_t)
+#define EMT_F_FLAGS_BLOB(type_x) EMT_LENGTH_PREFIXED
+#define EMT_F_LAYOUT_SIZE_BLOB(type_x) 3
+#define EMT_F_INFO_MEMBER_BLOB(k, type_x) char type_##k[sizeof("blob")];
+#define EMT_F_INFO_BLOB(type_x) "blob",
+#define EMT_F_LAYOUT_BLOB(k, type_x) , offsetof(info_t, type_##k), EMT_LENGTH_PREFIXED, 0
+#define EMT_F_OUT_BLOB(out_fn, extra_arg, type_x, x)                                               \
+    EMT_F_APPLY(EMT_F_OUT_BLOB_, out_fn, extra_arg, EMT_F_UNWRAP_##type_x, x)
+#define EMT_F_OUT_BLOB_(out_fn, extra_arg, n, max, x)                                              \
+    do {                                                                                           \
+        const void* emt_data = EMT_F_ARRAY_DATA(x);                                                \
+        emt_size_t emt_count = (emt_size_t) (n);                                                   \
+        if ((max) != 0 && emt_count > (emt_size_t) (max))                                          \
+            emt_count = (emt_size_t) (max);                                                        \
+        out_fn((const void*) &emt_count, sizeof(emt_count), extra_arg);                            \
+        out_fn(emt_data, emt_count, extra_arg);                                                    \
+    } while (0)
+
+/*
+ * Stack arguments. `EMT_STACK(max)` captures up to `max` (a constant expression) return addresses
+ * of the calling thread, innermost first, skipping as many innermost frames as the argument value
+ * says. They are sent as raw pointers, prefixed by their count, and the decoder sees an argument of
+ * type `stack`, which it resolves to function names and source locations using the ELF file.
+ *
+ * By default the addresses are collected by walking the chain of frame pointers, which is cheap but
+ * requires code compiled with `-fno-omit-frame-pointer`. Define `EMT_STACK_BACKTRACE` to use
+ * `backtrace` from `<execinfo.h>` instead.
+ */
+#if defined(EMT_STACK_BACKTRACE)
+#include <execinfo.h>
+
+static inline unsigned emt_capture_stack(void** frames, unsigned max, unsigned skip) {
+    void* all[64];
+    unsigned limit = max + skip + 1 < 64 ? max + skip + 1 : 64;
+    int captured = backtrace(all, (int) limit);
+    unsigned count = 0;
+    for (unsigned i = skip + 1; i < (unsigned) captured && count < max; i++)
+        frames[count++] = all[i];
+    return count;
+}
+#elif defined(__GNUC__) || defined(__clang__)
+
+#ifndef EMT_STACK_MAX_FRAME_SIZE
+#define EMT_STACK_MAX_FRAME_SIZE (1U << 20)
+#endif
+
+// not inline, so that the walk starts from a frame of its own
+__attribute__((noinline, unused)) static unsigned
+emt_capture_stack(void** frames, unsigned max, unsigned skip) {
+    void* const* fp = (void* const*) __builtin_frame_address(0);
+    unsigned count = 0;
+    while (fp != NULL && count < max) {
+        void* ret = fp[1];
+        if (ret == NULL)
+            break;
+        if (skip > 0)
+            skip--;
+        else
+            frames[count++] = ret;
+        void* const* next = (void* const*) fp[0];
+        // the stack grows downwards, so anything else isn't the caller's frame
+        if (next <= fp || (uintptr_t) next - (uintptr_t) fp > EMT_STACK_MAX_FRAME_SIZE ||
+            ((uintptr_t) next & (sizeof(void*) - 1)) != 0)
+            break;
+        fp = next;
+    }
+    return count;
+}
+#else
+static inline unsigned emt_capture_stack(void** frames, unsigned max, unsigned skip) {
+    (void) frames;
+    (void) max;
+    (void) skip;
+    return 0;
+}
+#endif
+
+#define EMT_F_PROBE_EMT_STACK(max) ~, STACK
+#define EMT_F_UNWRAP_EMT_STACK(max) max
+
+#define EMT_F_SIZE_STACK(type_x) sizeof(emt_size_t)
+#define EMT_F_FLAGS_STACK(type_x) EMT_LENGTH_PREFIXED
+#define EMT_F_LAYOUT_SIZE_STACK(type_x) 3
+#define EMT_F_INFO_MEMBER_STACK(k, type_x) char type_##k[sizeof("stack")];
+#define EMT_F_INFO_STACK(type_x) "stack",
+#define EMT_F_LAYOUT_STACK(k, type_x)                                                              \
+    , offsetof(info_t, type_##k), EMT_LENGTH_PREFIXED | sizeof(void*), 0
+#define EMT_F_OUT_STACK(out_fn, extra_arg, type_x, x)                                              \
+    EMT_F_APPLY(EMT_F_OUT_STACK_, out_fn, extra_arg, EMT_F_UNWRAP_##type_x, x)
+#define EMT_F_OUT_STACK_(out_fn, extra_arg, max, x)                                                \
+    do {                                                                                           \
+        void* emt_frames[max];                                                                     \
+        emt_size_t emt_count = (emt_size_t) emt_capture_stack(emt_frames, (max), (unsigned) (x));  \
+        out_fn((const void*) &emt_count, sizeof(emt_count), extra_arg);                            \
+        out_fn((const void*) emt_frames, (emt_size_t) (emt_count * sizeof(void*)), extra_arg);     \
+    } while (0)
+
+/*
+ * Enum arguments. `EMT_ENUM(e)` traces a value of the enum type `e` as a plain integer of
+ * `sizeof(e)` bytes. The names of its enumerators are stored in `.emtrace`, in a table the decoder
+ * finds by the type id `enum:<e>` of the argument, and decodes the value to.
+ *
+ * In C++17 the table of a scoped enum (`enum class`) is built by the compiler from the enumerators
+ * with values in [`EMT_ENUM_RANGE_MIN`, `EMT_ENUM_RANGE_MAX`], and stored next to each call site.
+ * For any other enum, the table is declared once with `EMT_ENUM_TABLE(attrs, e)` (or
+ * `EMTRACE_ENUM_TABLE(e)`) at file scope, from an X-macro named `EMT_ENUM_<e>` that calls
+ * `entry(ctx, name)` for each enumerator:
+ *
+ *     typedef enum { IDLE, RUNNING, STOPPED = 10 } state_t;
+ *     #define EMT_ENUM_state_t(entry, ctx) entry(ctx, IDLE) entry(ctx, RUNNING) entry(ctx, STOPPED)
+ *     EMTRACE_ENUM_TABLE(state_t);
+ *
+ * Like for structs, `e` has to be a single identifier for this. The same table may be declared in
+ * several translation units.
+ */
+/// First bytes of every enum table, by which the decoder finds them in `.emtrace`.
+#define EMT_ENUM_MAGIC                                                                             \
+    0x3e, 0x9a, 0x51, 0xc4, 0x0d, 0x7b, 0xe2, 0x86, 0x14, 0xf9, 0x6c, 0xa3, 0x58, 0x2f, 0xd0, 0x97
+
+#define EMT_F_PROBE_EMT_ENUM(e) ~, ENUM
+#define EMT_F_UNWRAP_EMT_ENUM(e) e
+
+#define EMT_F_SIZE_ENUM(type_x) sizeof(EMT_F_UNWRAP_##type_x)
+#define EMT_F_FLAGS_ENUM(type_x) 0
+#define EMT_F_LAYOUT_SIZE_ENUM(type_x) 3
+#define EMT_F_INFO_MEMBER_ENUM(k, type_x)                                                          \
+    EMT_F_APPLY(EMT_F_INFO_MEMBER_ENUM_, k, EMT_F_UNWRAP_##type_x)
+#define EMT_F_INFO_MEMBER_ENUM_(k, e) char type_##k[sizeof("enum:" #e)];
+#define EMT_F_INFO_ENUM(type_x) EMT_F_APPLY(EMT_F_INFO_ENUM_, EMT_F_UNWRAP_##type_x)
+#define EMT_F_INFO_ENUM_(e) "enum:" #e,
+#define EMT_F_LAYOUT_ENUM(k, type_x) , offsetof(info_t, type_##k), EMT_F_SIZE_ENUM(type_x), 0
+#define EMT_F_OUT_ENUM(out_fn, extra_arg, type_x, x)                                               \
+    EMT_F_APPLY(EMT_F_OUT_ENUM_, out_fn, extra_arg, EMT_F_UNWRAP_##type_x, x)
+#define EMT_F_OUT_ENUM_(out_fn, extra_arg, e, x)                                                   \
+    do {                                                                                           \
+        const e emt_enum = (x);                                                                    \
+        EMT_F_ENUM_TABLE_USE(e);                                                                   \
+        out_fn((const void*) &emt_enum, sizeof(e), extra_arg);                                     \
+    } while (0)
+
+/*
+ * Layout of an enum table: the magic, the number of enumerators, and the offsets (from the start of
+ * the table) of the enum's name, of the values (`int64_t`s), and of the offsets of the enumerator
+ * names (`emt_size_t`s), followed by the values, the name offsets, and the null-terminated names.
+ */
+#define EMT_ENUM_TABLE(attrs, e)                                                                   \
+    typedef struct {                                                                               \
+        uint8_t magic[16];                                                                         \
+        emt_size_t header[4];                                                                      \
+        int64_t values[EMT_ENUM_##e(EMT_F_ENUM_COUNT, ~) 0];                                       \
+        emt_size_t names[EMT_ENUM_##e(EMT_F_ENUM_COUNT, ~) 0];                                     \
+        char name[sizeof(#e)];                                                                     \
+        EMT_ENUM_##e(EMT_F_ENUM_MEMBER, ~)                                                         \
+    } emt_enum_table_##e##_t;                                                                      \
+    attrs emt_enum_table_##e##_t emt_enum_table_##e = {                                            \
+        {EMT_ENUM_MAGIC},                                                                          \
+        {EMT_ENUM_##e(EMT_F_ENUM_COUNT, ~) 0, offsetof(emt_enum_table_##e##_t, name),              \
+         offsetof(emt_enum_table_##e##_t, values), offsetof(emt_enum_table_##e##_t, names)},       \
+        {EMT_ENUM_##e(EMT_F_ENUM_VALUE, ~)},                                                       \
+        {EMT_ENUM_##e(EMT_F_ENUM_NAME_OFFSET, emt_enum_table_##e##_t)},                            \
+        #e,                                                                                        \
+        EMT_ENUM_##e(EMT_F_ENUM_NAME, ~)                                                           \
+    }
+
+#define EMT_F_ENUM_COUNT(ctx, name) 1 +
+#define EMT_F_ENUM_MEMBER(ctx, name) char name_##name[sizeof(#name)];
+#define EMT_F_ENUM_VALUE(ctx, name) (int64_t) (name),
+#define EMT_F_ENUM_NAME_OFFSET(table_t, name) offsetof(table_t, name_##name),
+#define EMT_F_ENUM_NAME(ctx, name) #name,
+
+/*
+ * C++ standard library vocabulary types. These markers can only be used from C++ (17 or later for
+ * `EMT_OPTIONAL` and `EMT_VARIANT`).
+ *
+ * - `EMT_STRING_VIEW`: a `std::string_view` (or anything else with `data()` and `size()` of chars),
+ *   sent length-prefixed, straight from its data. The decoder sees an argument of type `string`.
+ * - `EMT_OPTIONAL(type)`: a `std::optional<type>`, sent as a presence byte, followed by the value
+ *   if there is one. The decoder sees an argument of type `optional` whose only child is `type`.
+ * - `EMT_VARIANT(types...)`: a `std::variant<types...>` of up to 8 alternatives, sent as the byte
+ *   sized index of the alternative it holds, followed by its value. The decoder sees an argument
+ *   of type `variant` with the alternatives as children.
+ * - `EMT_DURATION(d)`: a value of the `std::chrono::duration` type `d`, sent as its raw tick count.
+ *   The decoder sees an argument of type `duration:<num>/<den>`, with the period of a tick in
+ *   seconds spelled out in the type id, and the ticks as its only child.
+ *
+ * The types of `EMT_OPTIONAL` and `EMT_VARIANT` are scalars.
+ */
+#define EMT_F_PROBE_EMT_STRING_VIEW ~, STRING_VIEW
+
+#define EMT_F_SIZE_STRING_VIEW(type_x) sizeof(emt_size_t)
+#define EMT_F_FLAGS_STRING_VIEW(type_x) EMT_LENGTH_PREFIXED
+#define EMT_F_LAYOUT_SIZE_STRING_VIEW(type_x) 3
+#define EMT_F_INFO_MEMBER_STRING_VIEW(k, type_x) char type_##k[sizeof("string")];
+#define EMT_F_INFO_STRING_VIEW(type_x) "string",
+#define EMT_F_LAYOUT_STRING_VIEW(k, type_x) , offsetof(info_t, type_##k), EMT_LENGTH_PREFIXED, 0
+#define EMT_F_OUT_STRING_VIEW(out_fn, extra_arg, type_x, x)                                        \
+    do {                                                                                           \
+        const auto& emt_view = (x);                                                                \
+        static_assert(sizeof(*emt_view.data()) == 1, "String views have to be of chars");          \
+        emt_size_t emt_count = (emt_size_t) emt_view.size();                                       \
+        out_fn((const void*) &emt_count, sizeof(emt_count), extra_arg);                            \
+        out_fn((const void*) emt_view.data(), emt_count, extra_arg);                               \
+    } while (0)
+
+#define EMT_F_PROBE_EMT_OPTIONAL(type) ~, OPTIONAL
+#define EMT_F_UNWRAP_EMT_OPTIONAL(type) type
+
+#define EMT_F_SIZE_OPTIONAL(type_x) 1
+#define EMT_F_FLAGS_OPTIONAL(type_x) EMT_LENGTH_PREFIXED
+#define EMT_F_LAYOUT_SIZE_OPTIONAL(type_x) 7
+#define EMT_F_INFO_MEMBER_OPTIONAL(k, type_x)                                                      \
+    EMT_F_APPLY(EMT_F_INFO_MEMBER_OPTIONAL_, k, EMT_F_UNWRAP_##type_x)
+#define EMT_F_INFO_MEMBER_OPTIONAL_(k, type)                                                       \
+    char type_##k[sizeof("optional")];                                                             \
+    char name_##k[1];                                                                              \
+    char child_##k[sizeof(#type)];
+#define EMT_F_INFO_OPTIONAL(type_x) EMT_F_APPLY(EMT_F_INFO_OPTIONAL_, EMT_F_UNWRAP_##type_x)
+#define EMT_F_INFO_OPTIONAL_(type) "optional", "", #type,
+#define EMT_F_LAYOUT_OPTIONAL(k, type_x)                                                           \
+    EMT_F_APPLY(EMT_F_LAYOUT_OPTIONAL_, k, EMT_F_UNWRAP_##type_x)
+#define EMT_F_LAYOUT_OPTIONAL_(k, type)                                                            \
+    , offsetof(info_t, type_##k), 1, 1, offsetof(info_t, name_##k), sizeof(type), 0,               \
+        offsetof(info_t, child_##k)
+#define EMT_F_OUT_OPTIONAL(out_fn, extra_arg, type_x, x)                                           \
+    EMT_F_APPLY(EMT_F_OUT_OPTIONAL_, out_fn, extra_arg, EMT_F_UNWRAP_##type_x, x)
+#define EMT_F_OUT_OPTIONAL_(out_fn, extra_arg, type, x)                                            \
+    do {                                                                                           \
+        const auto& emt_optional = (x);                                                            \
+        static_assert(                                                                             \
+            sizeof(*emt_optional) == sizeof(type), "Value type of optional argument doesn't match" \
         );                                                                                         \
-        EMT_STATIC_ASSERT_INNER(                                                                   \
-            sizeof(type_x) != EMT_LENGTH_PREFIXED, "Size of type_x is too large"                   \
+        uint8_t emt_present = emt_optional.has_value() ? 1 : 0;                                    \
+        out_fn((const void*) &emt_present, 1, extra_arg);                                          \
+        if (emt_present) {                                                                         \
+            type emt_value = *emt_optional;                                                        \
+            out_fn((const void*) &emt_value, sizeof(type), extra_arg);                             \
+        }                                                                                          \
+    } while (0)
+
+#define EMT_F_PROBE_EMT_VARIANT(...) ~, VARIANT
+#define EMT_F_UNWRAP_EMT_VARIANT(...) __VA_ARGS__
+
+#define EMT_F_SIZE_VARIANT(type_x) 1
+#define EMT_F_FLAGS_VARIANT(type_x) EMT_LENGTH_PREFIXED
+#define EMT_F_LAYOUT_SIZE_VARIANT(type_x)                                                          \
+    (3 + 4 * EMT_F_APPLY(EMT_NUM_ARGS_REST, ~, EMT_F_UNWRAP_##type_x))
+#define EMT_F_INFO_MEMBER_VARIANT(k, type_x)                                                       \
+    char type_##k[sizeof("variant")];                                                              \
+    char name_##k[1];                                                                              \
+    EMT_F_APPLY(EMT_F_VARIANT_EACH, EMT_F_VARIANT_INFO_MEMBER, k, EMT_F_UNWRAP_##type_x)
+#define EMT_F_INFO_VARIANT(type_x)                                                                 \
+    "variant", "", EMT_F_APPLY(EMT_F_VARIANT_EACH, EMT_F_VARIANT_INFO, ~, EMT_F_UNWRAP_##type_x)
+#define EMT_F_LAYOUT_VARIANT(k, type_x)                                                            \
+    , offsetof(info_t, type_##k), 1, EMT_F_APPLY(EMT_NUM_ARGS_REST, ~, EMT_F_UNWRAP_##type_x)      \
+        EMT_F_APPLY(EMT_F_VARIANT_EACH, EMT_F_VARIANT_LAYOUT, k, EMT_F_UNWRAP_##type_x)
+#define EMT_F_OUT_VARIANT(out_fn, extra_arg, type_x, x)                                            \
+    do {                                                                                           \
+        const auto& emt_variant = (x);                                                             \
+        static_assert(                                                                             \
+            std::is_same<                                                                          \
+                typename std::decay<decltype(emt_variant)>::type,                                  \
+                std::variant<EMT_F_UNWRAP_##type_x>>::value,                                       \
+            "Alternatives of variant argument don't match"                                         \
         );                                                                                         \
-        out_fn((const void*) &temp, sizeof(type_x), extra_arg);                                    \
+        uint8_t emt_index = (uint8_t) emt_variant.index();                                         \
+        out_fn((const void*) &emt_index, 1, extra_arg);                                            \
+        EMT_F_APPLY(                                                                               \
+            EMT_F_VARIANT_EACH, EMT_F_VARIANT_OUT, (out_fn, extra_arg), EMT_F_UNWRAP_##type_x      \
+        )                                                                                          \
+    } while (0)
+
+// The per-alternative callbacks of `EMT_VARIANT`, called as `m(ctx, index, type)`.
+#define EMT_F_VARIANT_EACH(m, ctx, ...)                                                            \
+    EMT_F_VARIANT_EACH_HELPER(EMT_NUM_ARGS_REST(~, __VA_ARGS__), m, ctx, __VA_ARGS__)
+#define EMT_F_VARIANT_EACH_HELPER(n, m, ctx, ...) EMT_F_VARIANT_EACH_HELPER2(n, m, ctx, __VA_ARGS__)
+#define EMT_F_VARIANT_EACH_HELPER2(n, m, ctx, ...) EMT_F_VARIANT_EACH_##n(m, ctx, __VA_ARGS__)
+#define EMT_F_VARIANT_EACH_1(m, ctx, a) m(ctx, 0, a)
+#define EMT_F_VARIANT_EACH_2(m, ctx, a, b) m(ctx, 0, a) m(ctx, 1, b)
+#define EMT_F_VARIANT_EACH_3(m, ctx, a, b, c) EMT_F_VARIANT_EACH_2(m, ctx, a, b) m(ctx, 2, c)
+#define EMT_F_VARIANT_EACH_4(m, ctx, a, b, c, d) EMT_F_VARIANT_EACH_3(m, ctx, a, b, c) m(ctx, 3, d)
+#define EMT_F_VARIANT_EACH_5(m, ctx, a, b, c, d, e)                                                \
+    EMT_F_VARIANT_EACH_4(m, ctx, a, b, c, d) m(ctx, 4, e)
+#define EMT_F_VARIANT_EACH_6(m, ctx, a, b, c, d, e, f)                                             \
+    EMT_F_VARIANT_EACH_5(m, ctx, a, b, c, d, e) m(ctx, 5, f)
+#define EMT_F_VARIANT_EACH_7(m, ctx, a, b, c, d, e, f, g)                                          \
+    EMT_F_VARIANT_EACH_6(m, ctx, a, b, c, d, e, f) m(ctx, 6, g)
+#define EMT_F_VARIANT_EACH_8(m, ctx, a, b, c, d, e, f, g, h)                                       \
+    EMT_F_VARIANT_EACH_7(m, ctx, a, b, c, d, e, f, g) m(ctx, 7, h)
+
+#define EMT_F_VARIANT_INFO_MEMBER(k, i, type) char alt_##k##_##i[sizeof(#type)];
+#define EMT_F_VARIANT_INFO(ctx, i, type) #type,
+#define EMT_F_VARIANT_LAYOUT(k, i, type)                                                           \
+    , offsetof(info_t, name_##k), sizeof(type), 0, offsetof(info_t, alt_##k##_##i)
+#define EMT_F_VARIANT_OUT(ctx, i, type) EMT_F_VARIANT_OUT_HELPER(EMT_F_VARIANT_CTX ctx, i, type)
+#define EMT_F_VARIANT_CTX(out_fn, extra_arg) out_fn, extra_arg
+#define EMT_F_VARIANT_OUT_HELPER(...) EMT_F_VARIANT_OUT_HELPER2(__VA_ARGS__)
+#define EMT_F_VARIANT_OUT_HELPER2(out_fn, extra_arg, i, type)                                      \
+    if (const type* emt_alternative = std::get_if<i>(&emt_variant))                                \
+        out_fn((const void*) emt_alternative, sizeof(type), extra_arg);
+
+#define EMT_F_PROBE_EMT_DURATION(d) ~, DURATION
+#define EMT_F_UNWRAP_EMT_DURATION(d) d
+
+#define EMT_F_SIZE_DURATION(type_x) sizeof(EMT_F_UNWRAP_##type_x)
+#define EMT_F_FLAGS_DURATION(type_x) 0
+#define EMT_F_LAYOUT_SIZE_DURATION(type_x) 7
+#define EMT_F_INFO_MEMBER_DURATION(k, type_x)                                                      \
+    EMT_F_APPLY(EMT_F_INFO_MEMBER_DURATION_, k, EMT_F_UNWRAP_##type_x)
+#define EMT_F_INFO_MEMBER_DURATION_(k, d)                                                          \
+    emt_duration_id<d> type_##k;                                                                   \
+    char ticks_##k[sizeof("ticks")];                                                               \
+    char signed_##k[sizeof("signed")];                                                             \
+    char float_##k[sizeof("float")];
+#define EMT_F_INFO_DURATION(type_x) EMT_F_APPLY(EMT_F_INFO_DURATION_, EMT_F_UNWRAP_##type_x)
+#define EMT_F_INFO_DURATION_(d) emt_duration_id<d>::make(), "ticks", "signed", "float",
+#define EMT_F_LAYOUT_DURATION(k, type_x)                                                           \
+    EMT_F_APPLY(EMT_F_LAYOUT_DURATION_, k, EMT_F_UNWRAP_##type_x)
+#define EMT_F_LAYOUT_DURATION_(k, d)                                                               \
+    , offsetof(info_t, type_##k), sizeof(d), 1, offsetof(info_t, ticks_##k), sizeof(d), 0,         \
+        std::is_floating_point<d::rep>::value ? offsetof(info_t, float_##k)                        \
+                                              : offsetof(info_t, signed_##k)
+#define EMT_F_OUT_DURATION(out_fn, extra_arg, type_x, x)                                           \
+    EMT_F_APPLY(EMT_F_OUT_DURATION_, out_fn, extra_arg, EMT_F_UNWRAP_##type_x, x)
+#define EMT_F_OUT_DURATION_(out_fn, extra_arg, d, x)                                               \
+    do {                                                                                           \
+        const d emt_duration = (x);                                                                \
+        d::rep emt_ticks = emt_duration.count();                                                   \
+        out_fn((const void*) &emt_ticks, sizeof(emt_ticks), extra_arg);                            \
+    } while (0)
+
+/*
+ * Struct arguments. `EMT_STRUCT(s)` traces a value of the struct type `s` (which has to be a single
+ * identifier, e.g. a typedef name) with a single `out_fn` call of `sizeof(s)` bytes, padding
+ * included. The traceable fields are declared once, next to the struct, as an X-macro named
+ * `EMT_STRUCT_<s>` that calls `field(ctx, type, name)` for each of them:
+ *
+ *     typedef struct {
+ *         uint32_t id;
+ *         double value;
+ *         uint8_t mac[6];
+ *     } sample_t;
+ *     #define EMT_STRUCT_sample_t(field, ctx)                                                     \
+ *         field(ctx, uint32_t, id) field(ctx, double, value) field(ctx, EMT_ARRAY(uint8_t, 6), mac)
+ *
+ * Field types are scalars or `EMT_ARRAY`s. Fields that aren't declared are sent, but skipped by the
+ * decoder. The decoder sees an argument of type `struct <s>` with, for each declared field, a child
+ * of type `offset` (whose size is the field's offset in the struct) followed by the field itself.
+ */
+#define EMT_F_PROBE_EMT_STRUCT(s) ~, STRUCT
+#define EMT_F_UNWRAP_EMT_STRUCT(s) s
+
+#define EMT_F_SIZE_STRUCT(type_x) sizeof(EMT_F_UNWRAP_##type_x)
+#define EMT_F_FLAGS_STRUCT(type_x) 0
+#define EMT_F_LAYOUT_SIZE_STRUCT(type_x)                                                           \
+    EMT_F_APPLY(EMT_F_LAYOUT_SIZE_STRUCT_, EMT_F_UNWRAP_##type_x)
+#define EMT_F_LAYOUT_SIZE_STRUCT_(s) (3 + EMT_STRUCT_##s(EMT_F_FIELD_LAYOUT_SIZE, ~) 0)
+#define EMT_F_INFO_MEMBER_STRUCT(k, type_x)                                                        \
+    EMT_F_APPLY(EMT_F_INFO_MEMBER_STRUCT_, k, EMT_F_UNWRAP_##type_x)
+#define EMT_F_INFO_MEMBER_STRUCT_(k, s)                                                            \
+    char type_##k[sizeof("struct " #s)];                                                           \
+    char offset_##k[sizeof("offset")];                                                             \
+    char empty_##k[1];                                                                             \
+    EMT_STRUCT_##s(EMT_F_FIELD_INFO_MEMBER, k)
+#define EMT_F_INFO_STRUCT(type_x) EMT_F_APPLY(EMT_F_INFO_STRUCT_, EMT_F_UNWRAP_##type_x)
+#define EMT_F_INFO_STRUCT_(s) "struct " #s, "offset", "", EMT_STRUCT_##s(EMT_F_FIELD_INFO, ~)
+#define EMT_F_LAYOUT_STRUCT(k, type_x) EMT_F_APPLY(EMT_F_LAYOUT_STRUCT_, k, EMT_F_UNWRAP_##type_x)
+#define EMT_F_LAYOUT_STRUCT_(k, s)                                                                 \
+    , offsetof(info_t, type_##k), sizeof(s), (EMT_STRUCT_##s(EMT_F_FIELD_COUNT, ~) 0)              \
+        EMT_STRUCT_##s(EMT_F_FIELD_LAYOUT, (k, s))
+#define EMT_F_OUT_STRUCT(out_fn, extra_arg, type_x, x)                                             \
+    EMT_F_APPLY(EMT_F_OUT_STRUCT_, out_fn, extra_arg, EMT_F_UNWRAP_##type_x, x)
+#define EMT_F_OUT_STRUCT_(out_fn, extra_arg, s, x)                                                 \
+    do {                                                                                           \
+        const s* emt_struct = &(x);                                                                \
+        EMT_F_STRUCT_CHECK(s);                                                                     \
+        EMT_STRUCT_##s(EMT_F_FIELD_CHECK, s)                                                       \
+        out_fn((const void*) emt_struct, sizeof(s), extra_arg);                                    \
+    } while (0)
+
+// The field callbacks of the `EMT_STRUCT_<s>` X-macros. They get their own dispatch macros, as they
+// are expanded while the argument level ones are still being expanded.
+#define EMT_F_FIELD_SECOND(a, b, ...) b
+#define EMT_F_FIELD_SECOND_HELPER(...) EMT_F_FIELD_SECOND(__VA_ARGS__)
+#define EMT_F_FIELD_APPLY(m, ...) m(__VA_ARGS__)
+#define EMT_F_FIELD_SELECT(what, type)                                                             \
+    EMT_F_FIELD_SELECT_HELPER(what, EMT_F_FIELD_SECOND_HELPER(EMT_F_PROBE_##type, SCALAR, ~))
+#define EMT_F_FIELD_SELECT_HELPER(what, kind) EMT_F_FIELD_SELECT_HELPER2(what, kind)
+#define EMT_F_FIELD_SELECT_HELPER2(what, kind) EMT_F_FIELD_##what##_##kind
+#define EMT_F_FIELD_CTX(k, s) k, s
+
+#define EMT_F_FIELD_COUNT(ctx, type, name) 2 +
+#define EMT_F_FIELD_LAYOUT_SIZE(ctx, type, name) EMT_F_FIELD_SELECT(LAYOUT_SIZE, type) +
+#define EMT_F_FIELD_INFO_MEMBER(k, type, name)                                                     \
+    char field_name_##k##_##name[sizeof(#name)];                                                   \
+    EMT_F_FIELD_SELECT(INFO_MEMBER, type)(k, type, name)
+#define EMT_F_FIELD_INFO(ctx, type, name) #name, EMT_F_FIELD_SELECT(INFO, type)(type)
+#define EMT_F_FIELD_LAYOUT(ctx, type, name)                                                        \
+    EMT_F_FIELD_LAYOUT_HELPER(EMT_F_FIELD_CTX ctx, type, name)
+#define EMT_F_FIELD_LAYOUT_HELPER(...) EMT_F_FIELD_LAYOUT_HELPER2(__VA_ARGS__)
+#define EMT_F_FIELD_LAYOUT_HELPER2(k, s, type, name)                                               \
+    , offsetof(info_t, empty_##k), offsetof(s, name), 0, offsetof(info_t, offset_##k),             \
+        offsetof(info_t, field_name_##k##_##name)                                                  \
+            EMT_F_FIELD_SELECT(LAYOUT, type)(k, type, name)
+#define EMT_F_FIELD_CHECK(s, type, name)                                                           \
+    EMT_STATIC_ASSERT_INNER(                                                                       \
+        sizeof(((const s*) 0)->name) == EMT_F_FIELD_SELECT(SIZE, type)(type),                      \
+        "Size of traced struct field doesn't match its declaration"                                \
+    );
+
+#define EMT_F_FIELD_SIZE_SCALAR(type) sizeof(type)
+#define EMT_F_FIELD_LAYOUT_SIZE_SCALAR 8
+#define EMT_F_FIELD_INFO_MEMBER_SCALAR(k, type, name) char field_type_##k##_##name[sizeof(#type)];
+#define EMT_F_FIELD_INFO_SCALAR(type) #type,
+#define EMT_F_FIELD_LAYOUT_SCALAR(k, type, name)                                                   \
+    , sizeof(type), 0, offsetof(info_t, field_type_##k##_##name)
+
+#define EMT_F_FIELD_SIZE_ARRAY(type) EMT_F_FIELD_APPLY(EMT_F_SIZE_ARRAY_, EMT_F_UNWRAP_##type)
+#define EMT_F_FIELD_LAYOUT_SIZE_ARRAY 12
+#define EMT_F_FIELD_INFO_MEMBER_ARRAY(k, type, name)                                               \
+    char field_type_##k##_##name[sizeof("list")];                                                  \
+    EMT_F_FIELD_APPLY(EMT_F_FIELD_INFO_MEMBER_ARRAY_, k, name, EMT_F_UNWRAP_##type)
+#define EMT_F_FIELD_INFO_MEMBER_ARRAY_(k, name, elem, n)                                           \
+    char field_child_##k##_##name[sizeof(#elem)];
+#define EMT_F_FIELD_INFO_ARRAY(type)                                                               \
+    "list", EMT_F_FIELD_APPLY(EMT_F_FIELD_INFO_ARRAY_, EMT_F_UNWRAP_##type)
+#define EMT_F_FIELD_INFO_ARRAY_(elem, n) #elem,
+#define EMT_F_FIELD_LAYOUT_ARRAY(k, type, name)                                                    \
+    EMT_F_FIELD_APPLY(EMT_F_FIELD_LAYOUT_ARRAY_, k, name, EMT_F_UNWRAP_##type)
+#define EMT_F_FIELD_LAYOUT_ARRAY_(k, name, elem, n)                                                \
+    , (emt_size_t) (n), 1, offsetof(info_t, field_type_##k##_##name), offsetof(info_t, empty_##k), \
+        sizeof(elem), 0, offsetof(info_t, field_child_##k##_##name)
+
+#ifdef __cplusplus
+#define EMT_F_ARRAY_DATA(x) ((const void*) emt_array_data(x))
+#define EMT_F_ARRAY_CHECK(elem, x)                                                                 \
+    static_assert(                                                                                 \
+        emt_array_elem_matches<elem, decltype(emt_array_data(x))>::value,                          \
+        "Element type of array argument doesn't match"                                             \
+    )
+#define EMT_F_ARRAY_EXTENT_CHECK(n, x)                                                             \
+    static_assert(                                                                                 \
+        emt_array_extent<decltype(x)>::value == 0 ||                                               \
+            emt_array_extent<decltype(x)>::value >= (n),                                           \
+        "Array argument has fewer elements than traced"                                            \
+    );
+#define EMT_F_STRUCT_CHECK(s)                                                                      \
+    static_assert(                                                                                 \
+        std::is_trivially_copyable<s>::value, "Traced structs have to be trivially copyable"       \
+    )
+#if __cplusplus >= 201703L && (defined(__GNUC__) || defined(__clang__))
+// GCC ignores section attributes of template instantiations, so the table is a static of the call
+// site instead of a member of `emt_enum_table`.
+#define EMT_F_ENUM_TABLE_USE(e)                                                                    \
+    __attribute__((used, aligned(EMT_ALIGNMENT), section(".emtrace"))) static constexpr            \
+        typename emt_enum_table<e>::type emt_enum_names = emt_enum_table<e>::make()
+#else
+#define EMT_F_ENUM_TABLE_USE(e) ((void) 0)
+#endif
+#else
+#define EMT_F_ARRAY_DATA(x) ((const void*) (x))
+#define EMT_F_ARRAY_CHECK(elem, x)                                                                 \
+    EMT_STATIC_ASSERT_INNER(                                                                       \
+        sizeof(*(x)) == sizeof(elem), "Element size of array argument doesn't match"               \
+    )
+#define EMT_F_ARRAY_EXTENT_CHECK(n, x)
+#define EMT_F_STRUCT_CHECK(s) ((void) 0)
+#define EMT_F_ENUM_TABLE_USE(e) ((void) 0)
+#endif
+
+#define EMT_F_0(out_fn, extra_arg, a) ((void) 0)
+#define EMT_F_2(out_fn, extra_arg, type_x, x, dummy)                                               \
+    do {                                                                                           \
+        EMT_F_ARG(out_fn, extra_arg, type_x, x);                                                   \
+    } while (0)
+#define EMT_F_4(out_fn, extra_arg, type_a, a, type_x, x, dummy)                                    \
+    do {                                                                                           \
+        EMT_F_2(out_fn, extra_arg, type_a, a, 0);                                                  \
+        EMT_F_ARG(out_fn, extra_arg, type_x, x);                                                   \
     } while (0)
 #define EMT_F_6(out_fn, extra_arg, type_a, a, type_b, b, type_x, x, dummy)                         \
     do {                                                                                           \
         EMT_F_4(out_fn, extra_arg, type_a, a, type_b, b, 0);                                       \
-        type_x temp = x;                                                                           \
-        EMT_STATIC_ASSERT_INNER(                                                                   \
-            sizeof(type_x) != EMT_NULL_TERMINATED, "Size of type_x is too large"                   \
-        );                                                                                         \
-        EMT_STATIC_ASSERT_INNER(                                                                   \
-            sizeof(type_x) != EMT_LENGTH_PREFIXED, "Size of type_x is too large"                   \
-        );                                                                                         \
-        out_fn((const void*) &temp, sizeof(type_x), extra_arg);                                    \
+        EMT_F_ARG(out_fn, extra_arg, type_x, x);                                                   \
     } while (0)
 #define EMT_F_8(out_fn, extra_arg, type_a, a, type_b, b, type_c, c, type_x, x, dummy)              \
     do {                                                                                           \
         EMT_F_6(out_fn, extra_arg, type_a, a, type_b, b, type_c, c, 0);                            \
-        type_x temp = x;                                                                           \
-        EMT_STATIC_ASSERT_INNER(                                                                   \
-            sizeof(type_x) != EMT_NULL_TERMINATED, "Size of type_x is too large"                   \
-        );                                                                                         \
-        EMT_STATIC_ASSERT_INNER(                                                                   \
-            sizeof(type_x) != EMT_LENGTH_PREFIXED, "Size of type_x is too large"                   \
-        );                                                                                         \
-        out_fn((const void*) &temp, sizeof(type_x), extra_arg);                                    \
+        EMT_F_ARG(out_fn, extra_arg, type_x, x);                                                   \
     } while (0)
 #define EMT_F_10(out_fn, extra_arg, type_a, a, type_b, b, type_c, c, type_d, d, type_x, x, dummy)  \
     do {                                                                                           \
         EMT_F_8(out_fn, extra_arg, type_a, a, type_b, b, type_c, c, type_d, d, 0);                 \
-        type_x temp = x;                                                                           \
-        EMT_STATIC_ASSERT_INNER(                                                                   \
-            sizeof(type_x) != EMT_NULL_TERMINATED, "Size of type_x is too large"                   \
-        );                                                                                         \
-        EMT_STATIC_ASSERT_INNER(                                                                   \
-            sizeof(type_x) != EMT_LENGTH_PREFIXED, "Size of type_x is too large"                   \
-        );                                                                                         \
-        out_fn((const void*) &temp, sizeof(type_x), extra_arg);                                    \
+        EMT_F_ARG(out_fn, extra_arg, type_x, x);                                                   \
     } while (0)
 #define EMT_F_12(                                                                                  \
     out_fn, extra_arg, type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_x, x, dummy     \
 )                                                                                                  \
     do {                                                                                           \
         EMT_F_10(out_fn, extra_arg, type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, 0);     \
-        type_x temp = x;                                                                           \
-        EMT_STATIC_ASSERT_INNER(                                                                   \
-            sizeof(type_x) != EMT_NULL_TERMINATED, "Size of type_x is too large"                   \
-        );                                                                                         \
-        EMT_STATIC_ASSERT_INNER(                                                                   \
-            sizeof(type_x) != EMT_LENGTH_PREFIXED, "Size of type_x is too large"                   \
-        );                                                                                         \
-        out_fn((const void*) &temp, sizeof(type_x), extra_arg);                                    \
+        EMT_F_ARG(out_fn, extra_arg, type_x, x);                                                   \
     } while (0)
 #define EMT_F_14(                                                                                  \
     out_fn, extra_arg, type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_x,   \
@@ -202,14 +762,7 @@ EMT_STATIC_ASSERT(
         EMT_F_12(                                                                                  \
             out_fn, extra_arg, type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, 0 \
         );                                                                                         \
-        type_x temp = x;                                                                           \
-        EMT_STATIC_ASSERT_INNER(                                                                   \
-            sizeof(type_x) != EMT_NULL_TERMINATED, "Size of type_x is too large"                   \
-        );                                                                                         \
-        EMT_STATIC_ASSERT_INNER(                                                                   \
-            sizeof(type_x) != EMT_LENGTH_PREFIXED, "Size of type_x is too large"                   \
-        );                                                                                         \
-        out_fn((const void*) &temp, sizeof(type_x), extra_arg);                                    \
+        EMT_F_ARG(out_fn, extra_arg, type_x, x);                                                   \
     } while (0)
 #define EMT_F_16(                                                                                  \
     out_fn, extra_arg, type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g,   \
@@ -220,14 +773,7 @@ EMT_STATIC_ASSERT(
             out_fn, extra_arg, type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f,   \
             type_g, g, 0                                                                           \
         );                                                                                         \
-        type_x temp = x;                                                                           \
-        EMT_STATIC_ASSERT_INNER(                                                                   \
-            sizeof(type_x) != EMT_NULL_TERMINATED, "Size of type_x is too large"                   \
-        );                                                                                         \
-        EMT_STATIC_ASSERT_INNER(                                                                   \
-            sizeof(type_x) != EMT_LENGTH_PREFIXED, "Size of type_x is too large"                   \
-        );                                                                                         \
-        out_fn((const void*) &temp, sizeof(type_x), extra_arg);                                    \
+        EMT_F_ARG(out_fn, extra_arg, type_x, x);                                                   \
     } while (0)
 #define EMT_F_18(                                                                                  \
     out_fn, extra_arg, type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g,   \
@@ -236,16 +782,9 @@ EMT_STATIC_ASSERT(
     do {                                                                                           \
         EMT_F_16(                                                                                  \
             out_fn, extra_arg, type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f,   \
-            type_g, g, 0                                                                           \
-        );                                                                                         \
-        type_x temp = x;                                                                           \
-        EMT_STATIC_ASSERT_INNER(                                                                   \
-            sizeof(type_x) != EMT_NULL_TERMINATED, "Size of type_x is too large"                   \
-        );                                                                                         \
-        EMT_STATIC_ASSERT_INNER(                                                                   \
-            sizeof(type_x) != EMT_LENGTH_PREFIXED, "Size of type_x is too large"                   \
+            type_g, g, type_h, h, 0                                                                \
         );                                                                                         \
-        out_fn((const void*) &temp, sizeof(type_x), extra_arg);                                    \
+        EMT_F_ARG(out_fn, extra_arg, type_x, x);                                                   \
     } while (0)
 #define EMT_F_20(                                                                                  \
     out_fn, extra_arg, type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g,   \
@@ -254,16 +793,9 @@ EMT_STATIC_ASSERT(
     do {                                                                                           \
         EMT_F_18(                                                                                  \
             out_fn, extra_arg, type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f,   \
-            type_g, g, type_h, h, 0                                                                \
-        );                                                                                         \
-        type_x temp = x;                                                                           \
-        EMT_STATIC_ASSERT_INNER(                                                                   \
-            sizeof(type_x) != EMT_NULL_TERMINATED, "Size of type_x is too large"                   \
-        );                                                                                         \
-        EMT_STATIC_ASSERT_INNER(                                                                   \
-            sizeof(type_x) != EMT_LENGTH_PREFIXED, "Size of type_x is too large"                   \
+            type_g, g, type_h, h, type_i, i, 0                                                     \
         );                                                                                         \
-        out_fn((const void*) &temp, sizeof(type_x), extra_arg);                                    \
+        EMT_F_ARG(out_fn, extra_arg, type_x, x);                                                   \
     } while (0)
 #define EMT_F_22(                                                                                  \
     out_fn, extra_arg, type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g,   \
@@ -272,16 +804,9 @@ EMT_STATIC_ASSERT(
     do {                                                                                           \
         EMT_F_20(                                                                                  \
             out_fn, extra_arg, type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f,   \
-            type_g, g, type_h, h, type_i, i, 0                                                     \
-        );                                                                                         \
-        type_x temp = x;                                                                           \
-        EMT_STATIC_ASSERT_INNER(                                                                   \
-            sizeof(type_x) != EMT_NULL_TERMINATED, "Size of type_x is too large"                   \
-        );                                                                                         \
-        EMT_STATIC_ASSERT_INNER(                                                                   \
-            sizeof(type_x) != EMT_LENGTH_PREFIXED, "Size of type_x is too large"                   \
+            type_g, g, type_h, h, type_i, i, type_j, j, 0                                          \
         );                                                                                         \
-        out_fn((const void*) &temp, sizeof(type_x), extra_arg);                                    \
+        EMT_F_ARG(out_fn, extra_arg, type_x, x);                                                   \
     } while (0)
 #define EMT_F_24(                                                                                  \
     out_fn, extra_arg, type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g,   \
@@ -290,16 +815,9 @@ EMT_STATIC_ASSERT(
     do {                                                                                           \
         EMT_F_22(                                                                                  \
             out_fn, extra_arg, type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f,   \
-            type_g, g, type_h, h, type_i, i, type_j, j, 0                                          \
-        );                                                                                         \
-        type_x temp = x;                                                                           \
-        EMT_STATIC_ASSERT_INNER(                                                                   \
-            sizeof(type_x) != EMT_NULL_TERMINATED, "Size of type_x is too large"                   \
-        );                                                                                         \
-        EMT_STATIC_ASSERT_INNER(                                                                   \
-            sizeof(type_x) != EMT_LENGTH_PREFIXED, "Size of type_x is too large"                   \
+            type_g, g, type_h, h, type_i, i, type_j, j, type_k, k, 0                               \
         );                                                                                         \
-        out_fn((const void*) &temp, sizeof(type_x), extra_arg);                                    \
+        EMT_F_ARG(out_fn, extra_arg, type_x, x);                                                   \
     } while (0)
 #define EMT_F_26(                                                                                  \
     out_fn, extra_arg, type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g,   \
@@ -308,16 +826,9 @@ EMT_STATIC_ASSERT(
     do {                                                                                           \
         EMT_F_24(                                                                                  \
             out_fn, extra_arg, type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f,   \
-            type_g, g, type_h, h, type_i, i, type_j, j, type_k, k, 0                               \
-        );                                                                                         \
-        type_x temp = x;                                                                           \
-        EMT_STATIC_ASSERT_INNER(                                                                   \
-            sizeof(type_x) != EMT_NULL_TERMINATED, "Size of type_x is too large"                   \
-        );                                                                                         \
-        EMT_STATIC_ASSERT_INNER(                                                                   \
-            sizeof(type_x) != EMT_LENGTH_PREFIXED, "Size of type_x is too large"                   \
+            type_g, g, type_h, h, type_i, i, type_j, j, type_k, k, type_l, l, 0                    \
         );                                                                                         \
-        out_fn((const void*) &temp, sizeof(type_x), extra_arg);                                    \
+        EMT_F_ARG(out_fn, extra_arg, type_x, x);                                                   \
     } while (0)
 #define EMT_F_28(                                                                                  \
     out_fn, extra_arg, type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g,   \
@@ -326,16 +837,9 @@ EMT_STATIC_ASSERT(
     do {                                                                                           \
         EMT_F_26(                                                                                  \
             out_fn, extra_arg, type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f,   \
-            type_g, g, type_h, h, type_i, i, type_j, j, type_k, k, type_l, l, 0                    \
-        );                                                                                         \
-        type_x temp = x;                                                                           \
-        EMT_STATIC_ASSERT_INNER(                                                                   \
-            sizeof(type_x) != EMT_NULL_TERMINATED, "Size of type_x is too large"                   \
-        );                                                                                         \
-        EMT_STATIC_ASSERT_INNER(                                                                   \
-            sizeof(type_x) != EMT_LENGTH_PREFIXED, "Size of type_x is too large"                   \
+            type_g, g, type_h, h, type_i, i, type_j, j, type_k, k, type_l, l, type_m, m, 0         \
         );                                                                                         \
-        out_fn((const void*) &temp, sizeof(type_x), extra_arg);                                    \
+        EMT_F_ARG(out_fn, extra_arg, type_x, x);                                                   \
     } while (0)
 #define EMT_F_30(                                                                                  \
     out_fn, extra_arg, type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g,   \
@@ -345,16 +849,10 @@ EMT_STATIC_ASSERT(
     do {                                                                                           \
         EMT_F_28(                                                                                  \
             out_fn, extra_arg, type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f,   \
-            type_g, g, type_h, h, type_i, i, type_j, j, type_k, k, type_l, l, type_m, m, 0         \
-        );                                                                                         \
-        type_x temp = x;                                                                           \
-        EMT_STATIC_ASSERT_INNER(                                                                   \
-            sizeof(type_x) != EMT_NULL_TERMINATED, "Size of type_x is too large"                   \
-        );                                                                                         \
-        EMT_STATIC_ASSERT_INNER(                                                                   \
-            sizeof(type_x) != EMT_LENGTH_PREFIXED, "Size of type_x is too large"                   \
+            type_g, g, type_h, h, type_i, i, type_j, j, type_k, k, type_l, l, type_m, m, type_n,   \
+            n, 0                                                                                   \
         );                                                                                         \
-        out_fn((const void*) &temp, sizeof(type_x), extra_arg);                                    \
+        EMT_F_ARG(out_fn, extra_arg, type_x, x);                                                   \
     } while (0)
 #define EMT_F_32(                                                                                  \
     out_fn, extra_arg, type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g,   \
@@ -365,53 +863,47 @@ EMT_STATIC_ASSERT(
         EMT_F_30(                                                                                  \
             out_fn, extra_arg, type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f,   \
             type_g, g, type_h, h, type_i, i, type_j, j, type_k, k, type_l, l, type_m, m, type_n,   \
-            n, 0                                                                                   \
-        );                                                                                         \
-        type_x temp = x;                                                                           \
-        EMT_STATIC_ASSERT_INNER(                                                                   \
-            sizeof(type_x) != EMT_NULL_TERMINATED, "Size of type_x is too large"                   \
-        );                                                                                         \
-        EMT_STATIC_ASSERT_INNER(                                                                   \
-            sizeof(type_x) != EMT_LENGTH_PREFIXED, "Size of type_x is too large"                   \
+            n, type_o, o, 0                                                                        \
         );                                                                                         \
-        out_fn((const void*) &temp, sizeof(type_x), extra_arg);                                    \
+        EMT_F_ARG(out_fn, extra_arg, type_x, x);                                                   \
     } while (0)
 
 #define EMT_F_HELPER(x, ...) EMT_F_HELPER2(x, __VA_ARGS__)
 #define EMT_F_HELPER2(x, ...) EMT_F_##x(__VA_ARGS__)
 
-#define EMT_F_TOTAL_SIZE_0(a, dummy)
-#define EMT_F_TOTAL_SIZE_2(type_x, x, dummy) sizeof(type_x)
+#define EMT_F_TOTAL_SIZE_0(a) 0
+#define EMT_F_TOTAL_SIZE_2(type_x, x, dummy) EMT_F_ARG_SIZE(type_x)
 #define EMT_F_TOTAL_SIZE_4(type_a, a, type_x, x, dummy)                                            \
-    EMT_F_TOTAL_SIZE_2(type_a, a, 0) + sizeof(type_x)
+    EMT_F_TOTAL_SIZE_2(type_a, a, 0) + EMT_F_ARG_SIZE(type_x)
 #define EMT_F_TOTAL_SIZE_6(type_a, a, type_b, b, type_x, x, dummy)                                 \
-    EMT_F_TOTAL_SIZE_4(type_a, a, type_b, b, 0) + sizeof(type_x)
+    EMT_F_TOTAL_SIZE_4(type_a, a, type_b, b, 0) + EMT_F_ARG_SIZE(type_x)
 #define EMT_F_TOTAL_SIZE_8(type_a, a, type_b, b, type_c, c, type_x, x, dummy)                      \
-    EMT_F_TOTAL_SIZE_6(type_a, a, type_b, b, type_c, c, 0) + sizeof(type_x)
+    EMT_F_TOTAL_SIZE_6(type_a, a, type_b, b, type_c, c, 0) + EMT_F_ARG_SIZE(type_x)
 #define EMT_F_TOTAL_SIZE_10(type_a, a, type_b, b, type_c, c, type_d, d, type_x, x, dummy)          \
-    EMT_F_TOTAL_SIZE_8(type_a, a, type_b, b, type_c, c, type_d, d, 0) + sizeof(type_x)
+    EMT_F_TOTAL_SIZE_8(type_a, a, type_b, b, type_c, c, type_d, d, 0) + EMT_F_ARG_SIZE(type_x)
 #define EMT_F_TOTAL_SIZE_12(                                                                       \
     type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_x, x, dummy                        \
 )                                                                                                  \
-    EMT_F_TOTAL_SIZE_10(type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, 0) + sizeof(type_x)
+    EMT_F_TOTAL_SIZE_10(type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, 0) +                \
+        EMT_F_ARG_SIZE(type_x)
 #define EMT_F_TOTAL_SIZE_14(                                                                       \
     type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_x, x, dummy             \
 )                                                                                                  \
     EMT_F_TOTAL_SIZE_12(type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, 0) +     \
-        sizeof(type_x)
+        EMT_F_ARG_SIZE(type_x)
 #define EMT_F_TOTAL_SIZE_16(                                                                       \
     type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_x, x, dummy  \
 )                                                                                                  \
     EMT_F_TOTAL_SIZE_14(                                                                           \
         type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, 0             \
-    ) + sizeof(type_x)
+    ) + EMT_F_ARG_SIZE(type_x)
 #define EMT_F_TOTAL_SIZE_18(                                                                       \
     type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,        \
     type_x, x, dummy                                                                               \
 )                                                                                                  \
     EMT_F_TOTAL_SIZE_16(                                                                           \
         type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h, 0  \
-    ) + sizeof(type_x)
+    ) + EMT_F_ARG_SIZE(type_x)
 #define EMT_F_TOTAL_SIZE_20(                                                                       \
     type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,        \
     type_i, i, type_x, x, dummy                                                                    \
@@ -419,7 +911,7 @@ EMT_STATIC_ASSERT(
     EMT_F_TOTAL_SIZE_18(                                                                           \
         type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,    \
         type_i, i, 0                                                                               \
-    ) + sizeof(type_x)
+    ) + EMT_F_ARG_SIZE(type_x)
 #define EMT_F_TOTAL_SIZE_22(                                                                       \
     type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,        \
     type_i, i, type_j, j, type_x, x, dummy                                                         \
@@ -427,7 +919,7 @@ EMT_STATIC_ASSERT(
     EMT_F_TOTAL_SIZE_20(                                                                           \
         type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,    \
         type_i, i, type_j, j, 0                                                                    \
-    ) + sizeof(type_x)
+    ) + EMT_F_ARG_SIZE(type_x)
 #define EMT_F_TOTAL_SIZE_24(                                                                       \
     type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,        \
     type_i, i, type_j, j, type_k, k, type_x, x, dummy                                              \
@@ -435,7 +927,7 @@ EMT_STATIC_ASSERT(
     EMT_F_TOTAL_SIZE_22(                                                                           \
         type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,    \
         type_i, i, type_j, j, type_k, k, 0                                                         \
-    ) + sizeof(type_x)
+    ) + EMT_F_ARG_SIZE(type_x)
 #define EMT_F_TOTAL_SIZE_26(                                                                       \
     type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,        \
     type_i, i, type_j, j, type_k, k, type_l, l, type_x, x, dummy                                   \
@@ -443,7 +935,7 @@ EMT_STATIC_ASSERT(
     EMT_F_TOTAL_SIZE_24(                                                                           \
         type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,    \
         type_i, i, type_j, j, type_k, k, type_l, l, 0                                              \
-    ) + sizeof(type_x)
+    ) + EMT_F_ARG_SIZE(type_x)
 #define EMT_F_TOTAL_SIZE_28(                                                                       \
     type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,        \
     type_i, i, type_j, j, type_k, k, type_l, l, type_m, m, type_x, x, dummy                        \
@@ -451,7 +943,7 @@ EMT_STATIC_ASSERT(
     EMT_F_TOTAL_SIZE_26(                                                                           \
         type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,    \
         type_i, i, type_j, j, type_k, k, type_l, l, type_m, m, 0                                   \
-    ) + sizeof(type_x)
+    ) + EMT_F_ARG_SIZE(type_x)
 #define EMT_F_TOTAL_SIZE_30(                                                                       \
     type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,        \
     type_i, i, type_j, j, type_k, k, type_l, l, type_m, m, type_n, n, type_x, x, dummy             \
@@ -459,7 +951,7 @@ EMT_STATIC_ASSERT(
     EMT_F_TOTAL_SIZE_28(                                                                           \
         type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,    \
         type_i, i, type_j, j, type_k, k, type_l, l, type_m, m, type_n, n, 0                        \
-    ) + sizeof(type_x)
+    ) + EMT_F_ARG_SIZE(type_x)
 #define EMT_F_TOTAL_SIZE_32(                                                                       \
     type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,        \
     type_i, i, type_j, j, type_k, k, type_l, l, type_m, m, type_n, n, type_o, o, type_x, x, dummy  \
@@ -467,42 +959,229 @@ EMT_STATIC_ASSERT(
     EMT_F_TOTAL_SIZE_30(                                                                           \
         type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,    \
         type_i, i, type_j, j, type_k, k, type_l, l, type_m, m, type_n, n, type_o, o, 0             \
-    ) + sizeof(type_x)
+    ) + EMT_F_ARG_SIZE(type_x)
 
 #define EMT_F_TOTAL_SIZE_HELPER2(n, ...) EMT_F_TOTAL_SIZE_##n(__VA_ARGS__)
 #define EMT_F_TOTAL_SIZE_HELPER(n, ...) EMT_F_TOTAL_SIZE_HELPER2(n, __VA_ARGS__)
 
+#define EMT_F_TOTAL_FLAGS_0(a) 0
+#define EMT_F_TOTAL_FLAGS_2(type_x, x, dummy) EMT_F_ARG_FLAGS(type_x)
+#define EMT_F_TOTAL_FLAGS_4(type_a, a, type_x, x, dummy)                                           \
+    EMT_F_TOTAL_FLAGS_2(type_a, a, 0) | EMT_F_ARG_FLAGS(type_x)
+#define EMT_F_TOTAL_FLAGS_6(type_a, a, type_b, b, type_x, x, dummy)                                \
+    EMT_F_TOTAL_FLAGS_4(type_a, a, type_b, b, 0) | EMT_F_ARG_FLAGS(type_x)
+#define EMT_F_TOTAL_FLAGS_8(type_a, a, type_b, b, type_c, c, type_x, x, dummy)                     \
+    EMT_F_TOTAL_FLAGS_6(type_a, a, type_b, b, type_c, c, 0) | EMT_F_ARG_FLAGS(type_x)
+#define EMT_F_TOTAL_FLAGS_10(type_a, a, type_b, b, type_c, c, type_d, d, type_x, x, dummy)         \
+    EMT_F_TOTAL_FLAGS_8(type_a, a, type_b, b, type_c, c, type_d, d, 0) | EMT_F_ARG_FLAGS(type_x)
+#define EMT_F_TOTAL_FLAGS_12(                                                                      \
+    type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_x, x, dummy                        \
+)                                                                                                  \
+    EMT_F_TOTAL_FLAGS_10(type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, 0) |               \
+        EMT_F_ARG_FLAGS(type_x)
+#define EMT_F_TOTAL_FLAGS_14(                                                                      \
+    type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_x, x, dummy             \
+)                                                                                                  \
+    EMT_F_TOTAL_FLAGS_12(type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, 0) |    \
+        EMT_F_ARG_FLAGS(type_x)
+#define EMT_F_TOTAL_FLAGS_16(                                                                      \
+    type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_x, x, dummy  \
+)                                                                                                  \
+    EMT_F_TOTAL_FLAGS_14(                                                                          \
+        type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, 0             \
+    ) | EMT_F_ARG_FLAGS(type_x)
+#define EMT_F_TOTAL_FLAGS_18(                                                                      \
+    type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,        \
+    type_x, x, dummy                                                                               \
+)                                                                                                  \
+    EMT_F_TOTAL_FLAGS_16(                                                                          \
+        type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h, 0  \
+    ) | EMT_F_ARG_FLAGS(type_x)
+#define EMT_F_TOTAL_FLAGS_20(                                                                      \
+    type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,        \
+    type_i, i, type_x, x, dummy                                                                    \
+)                                                                                                  \
+    EMT_F_TOTAL_FLAGS_18(                                                                          \
+        type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,    \
+        type_i, i, 0                                                                               \
+    ) | EMT_F_ARG_FLAGS(type_x)
+#define EMT_F_TOTAL_FLAGS_22(                                                                      \
+    type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,        \
+    type_i, i, type_j, j, type_x, x, dummy                                                         \
+)                                                                                                  \
+    EMT_F_TOTAL_FLAGS_20(                                                                          \
+        type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,    \
+        type_i, i, type_j, j, 0                                                                    \
+    ) | EMT_F_ARG_FLAGS(type_x)
+#define EMT_F_TOTAL_FLAGS_24(                                                                      \
+    type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,        \
+    type_i, i, type_j, j, type_k, k, type_x, x, dummy                                              \
+)                                                                                                  \
+    EMT_F_TOTAL_FLAGS_22(                                                                          \
+        type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,    \
+        type_i, i, type_j, j, type_k, k, 0                                                         \
+    ) | EMT_F_ARG_FLAGS(type_x)
+#define EMT_F_TOTAL_FLAGS_26(                                                                      \
+    type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,        \
+    type_i, i, type_j, j, type_k, k, type_l, l, type_x, x, dummy                                   \
+)                                                                                                  \
+    EMT_F_TOTAL_FLAGS_24(                                                                          \
+        type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,    \
+        type_i, i, type_j, j, type_k, k, type_l, l, 0                                              \
+    ) | EMT_F_ARG_FLAGS(type_x)
+#define EMT_F_TOTAL_FLAGS_28(                                                                      \
+    type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,        \
+    type_i, i, type_j, j, type_k, k, type_l, l, type_m, m, type_x, x, dummy                        \
+)                                                                                                  \
+    EMT_F_TOTAL_FLAGS_26(                                                                          \
+        type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,    \
+        type_i, i, type_j, j, type_k, k, type_l, l, type_m, m, 0                                   \
+    ) | EMT_F_ARG_FLAGS(type_x)
+#define EMT_F_TOTAL_FLAGS_30(                                                                      \
+    type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,        \
+    type_i, i, type_j, j, type_k, k, type_l, l, type_m, m, type_n, n, type_x, x, dummy             \
+)                                                                                                  \
+    EMT_F_TOTAL_FLAGS_28(                                                                          \
+        type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,    \
+        type_i, i, type_j, j, type_k, k, type_l, l, type_m, m, type_n, n, 0                        \
+    ) | EMT_F_ARG_FLAGS(type_x)
+#define EMT_F_TOTAL_FLAGS_32(                                                                      \
+    type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,        \
+    type_i, i, type_j, j, type_k, k, type_l, l, type_m, m, type_n, n, type_o, o, type_x, x, dummy  \
+)                                                                                                  \
+    EMT_F_TOTAL_FLAGS_30(                                                                          \
+        type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,    \
+        type_i, i, type_j, j, type_k, k, type_l, l, type_m, m, type_n, n, type_o, o, 0             \
+    ) | EMT_F_ARG_FLAGS(type_x)
+
+#define EMT_F_TOTAL_FLAGS_HELPER2(n, ...) EMT_F_TOTAL_FLAGS_##n(__VA_ARGS__)
+#define EMT_F_TOTAL_FLAGS_HELPER(n, ...) EMT_F_TOTAL_FLAGS_HELPER2(n, __VA_ARGS__)
+
+#define EMT_F_LAYOUT_SIZE_0(a) 0
+#define EMT_F_LAYOUT_SIZE_2(type_x, x, dummy) EMT_F_ARG_LAYOUT_SIZE(type_x)
+#define EMT_F_LAYOUT_SIZE_4(type_a, a, type_x, x, dummy)                                           \
+    EMT_F_LAYOUT_SIZE_2(type_a, a, 0) + EMT_F_ARG_LAYOUT_SIZE(type_x)
+#define EMT_F_LAYOUT_SIZE_6(type_a, a, type_b, b, type_x, x, dummy)                                \
+    EMT_F_LAYOUT_SIZE_4(type_a, a, type_b, b, 0) + EMT_F_ARG_LAYOUT_SIZE(type_x)
+#define EMT_F_LAYOUT_SIZE_8(type_a, a, type_b, b, type_c, c, type_x, x, dummy)                     \
+    EMT_F_LAYOUT_SIZE_6(type_a, a, type_b, b, type_c, c, 0) + EMT_F_ARG_LAYOUT_SIZE(type_x)
+#define EMT_F_LAYOUT_SIZE_10(type_a, a, type_b, b, type_c, c, type_d, d, type_x, x, dummy)         \
+    EMT_F_LAYOUT_SIZE_8(type_a, a, type_b, b, type_c, c, type_d, d, 0) +                           \
+        EMT_F_ARG_LAYOUT_SIZE(type_x)
+#define EMT_F_LAYOUT_SIZE_12(                                                                      \
+    type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_x, x, dummy                        \
+)                                                                                                  \
+    EMT_F_LAYOUT_SIZE_10(type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, 0) +               \
+        EMT_F_ARG_LAYOUT_SIZE(type_x)
+#define EMT_F_LAYOUT_SIZE_14(                                                                      \
+    type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_x, x, dummy             \
+)                                                                                                  \
+    EMT_F_LAYOUT_SIZE_12(type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, 0) +    \
+        EMT_F_ARG_LAYOUT_SIZE(type_x)
+#define EMT_F_LAYOUT_SIZE_16(                                                                      \
+    type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_x, x, dummy  \
+)                                                                                                  \
+    EMT_F_LAYOUT_SIZE_14(                                                                          \
+        type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, 0             \
+    ) + EMT_F_ARG_LAYOUT_SIZE(type_x)
+#define EMT_F_LAYOUT_SIZE_18(                                                                      \
+    type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,        \
+    type_x, x, dummy                                                                               \
+)                                                                                                  \
+    EMT_F_LAYOUT_SIZE_16(                                                                          \
+        type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h, 0  \
+    ) + EMT_F_ARG_LAYOUT_SIZE(type_x)
+#define EMT_F_LAYOUT_SIZE_20(                                                                      \
+    type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,        \
+    type_i, i, type_x, x, dummy                                                                    \
+)                                                                                                  \
+    EMT_F_LAYOUT_SIZE_18(                                                                          \
+        type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,    \
+        type_i, i, 0                                                                               \
+    ) + EMT_F_ARG_LAYOUT_SIZE(type_x)
+#define EMT_F_LAYOUT_SIZE_22(                                                                      \
+    type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,        \
+    type_i, i, type_j, j, type_x, x, dummy                                                         \
+)                                                                                                  \
+    EMT_F_LAYOUT_SIZE_20(                                                                          \
+        type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,    \
+        type_i, i, type_j, j, 0                                                                    \
+    ) + EMT_F_ARG_LAYOUT_SIZE(type_x)
+#define EMT_F_LAYOUT_SIZE_24(                                                                      \
+    type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,        \
+    type_i, i, type_j, j, type_k, k, type_x, x, dummy                                              \
+)                                                                                                  \
+    EMT_F_LAYOUT_SIZE_22(                                                                          \
+        type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,    \
+        type_i, i, type_j, j, type_k, k, 0                                                         \
+    ) + EMT_F_ARG_LAYOUT_SIZE(type_x)
+#define EMT_F_LAYOUT_SIZE_26(                                                                      \
+    type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,        \
+    type_i, i, type_j, j, type_k, k, type_l, l, type_x, x, dummy                                   \
+)                                                                                                  \
+    EMT_F_LAYOUT_SIZE_24(                                                                          \
+        type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,    \
+        type_i, i, type_j, j, type_k, k, type_l, l, 0                                              \
+    ) + EMT_F_ARG_LAYOUT_SIZE(type_x)
+#define EMT_F_LAYOUT_SIZE_28(                                                                      \
+    type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,        \
+    type_i, i, type_j, j, type_k, k, type_l, l, type_m, m, type_x, x, dummy                        \
+)                                                                                                  \
+    EMT_F_LAYOUT_SIZE_26(                                                                          \
+        type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,    \
+        type_i, i, type_j, j, type_k, k, type_l, l, type_m, m, 0                                   \
+    ) + EMT_F_ARG_LAYOUT_SIZE(type_x)
+#define EMT_F_LAYOUT_SIZE_30(                                                                      \
+    type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,        \
+    type_i, i, type_j, j, type_k, k, type_l, l, type_m, m, type_n, n, type_x, x, dummy             \
+)                                                                                                  \
+    EMT_F_LAYOUT_SIZE_28(                                                                          \
+        type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,    \
+        type_i, i, type_j, j, type_k, k, type_l, l, type_m, m, type_n, n, 0                        \
+    ) + EMT_F_ARG_LAYOUT_SIZE(type_x)
+#define EMT_F_LAYOUT_SIZE_32(                                                                      \
+    type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,        \
+    type_i, i, type_j, j, type_k, k, type_l, l, type_m, m, type_n, n, type_o, o, type_x, x, dummy  \
+)                                                                                                  \
+    EMT_F_LAYOUT_SIZE_30(                                                                          \
+        type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,    \
+        type_i, i, type_j, j, type_k, k, type_l, l, type_m, m, type_n, n, type_o, o, 0             \
+    ) + EMT_F_ARG_LAYOUT_SIZE(type_x)
+
+#define EMT_F_LAYOUT_SIZE_HELPER2(n, ...) EMT_F_LAYOUT_SIZE_##n(__VA_ARGS__)
+#define EMT_F_LAYOUT_SIZE_HELPER(n, ...) EMT_F_LAYOUT_SIZE_HELPER2(n, __VA_ARGS__)
+
 #define EMT_F_INFO_MEMBER_0(a)
-#define EMT_F_INFO_MEMBER_2(type_x, x, dummy) char type_1[sizeof(#type_x)];
+#define EMT_F_INFO_MEMBER_2(type_x, x, dummy) EMT_F_ARG_INFO_MEMBER(1, type_x)
 #define EMT_F_INFO_MEMBER_4(type_a, a, type_x, x, dummy)                                           \
     EMT_F_INFO_MEMBER_2(type_a, a, 0)                                                              \
-    char type_2[sizeof(#type_x)];
+    EMT_F_ARG_INFO_MEMBER(2, type_x)
 #define EMT_F_INFO_MEMBER_6(type_a, a, type_b, b, type_x, x, dummy)                                \
     EMT_F_INFO_MEMBER_4(type_a, a, type_b, b, 0)                                                   \
-    char type_3[sizeof(#type_x)];
+    EMT_F_ARG_INFO_MEMBER(3, type_x)
 #define EMT_F_INFO_MEMBER_8(type_a, a, type_b, b, type_c, c, type_x, x, dummy)                     \
     EMT_F_INFO_MEMBER_6(type_a, a, type_b, b, type_c, c, 0)                                        \
-    char type_4[sizeof(#type_x)];
+    EMT_F_ARG_INFO_MEMBER(4, type_x)
 #define EMT_F_INFO_MEMBER_10(type_a, a, type_b, b, type_c, c, type_d, d, type_x, x, dummy)         \
     EMT_F_INFO_MEMBER_8(type_a, a, type_b, b, type_c, c, type_d, d, 0)                             \
-    char type_5[sizeof(#type_x)];
+    EMT_F_ARG_INFO_MEMBER(5, type_x)
 #define EMT_F_INFO_MEMBER_12(                                                                      \
     type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_x, x, dummy                        \
 )                                                                                                  \
     EMT_F_INFO_MEMBER_10(type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, 0)                 \
-    char type_6[sizeof(#type_x)];
+    EMT_F_ARG_INFO_MEMBER(6, type_x)
 #define EMT_F_INFO_MEMBER_14(                                                                      \
     type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_x, x, dummy             \
 )                                                                                                  \
     EMT_F_INFO_MEMBER_12(type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, 0)      \
-    char type_7[sizeof(#type_x)];
+    EMT_F_ARG_INFO_MEMBER(7, type_x)
 #define EMT_F_INFO_MEMBER_16(                                                                      \
     type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_x, x, dummy  \
 )                                                                                                  \
     EMT_F_INFO_MEMBER_14(                                                                          \
         type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, 0             \
     )                                                                                              \
-    char type_8[sizeof(#type_x)];
+    EMT_F_ARG_INFO_MEMBER(8, type_x)
 #define EMT_F_INFO_MEMBER_18(                                                                      \
     type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,        \
     type_x, x, dummy                                                                               \
@@ -510,7 +1189,7 @@ EMT_STATIC_ASSERT(
     EMT_F_INFO_MEMBER_16(                                                                          \
         type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h, 0  \
     )                                                                                              \
-    char type_9[sizeof(#type_x)];
+    EMT_F_ARG_INFO_MEMBER(9, type_x)
 #define EMT_F_INFO_MEMBER_20(                                                                      \
     type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,        \
     type_i, i, type_x, x, dummy                                                                    \
@@ -519,7 +1198,7 @@ EMT_STATIC_ASSERT(
         type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,    \
         type_i, i, 0                                                                               \
     )                                                                                              \
-    char type_10[sizeof(#type_x)];
+    EMT_F_ARG_INFO_MEMBER(10, type_x)
 #define EMT_F_INFO_MEMBER_22(                                                                      \
     type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,        \
     type_i, i, type_j, j, type_x, x, dummy                                                         \
@@ -528,7 +1207,7 @@ EMT_STATIC_ASSERT(
         type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,    \
         type_i, i, type_j, j, 0                                                                    \
     )                                                                                              \
-    char type_11[sizeof(#type_x)];
+    EMT_F_ARG_INFO_MEMBER(11, type_x)
 #define EMT_F_INFO_MEMBER_24(                                                                      \
     type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,        \
     type_i, i, type_j, j, type_k, k, type_x, x, dummy                                              \
@@ -537,7 +1216,7 @@ EMT_STATIC_ASSERT(
         type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,    \
         type_i, i, type_j, j, type_k, k, 0                                                         \
     )                                                                                              \
-    char type_12[sizeof(#type_x)];
+    EMT_F_ARG_INFO_MEMBER(12, type_x)
 #define EMT_F_INFO_MEMBER_26(                                                                      \
     type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,        \
     type_i, i, type_j, j, type_k, k, type_l, l, type_x, x, dummy                                   \
@@ -546,7 +1225,7 @@ EMT_STATIC_ASSERT(
         type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,    \
         type_i, i, type_j, j, type_k, k, type_l, l, 0                                              \
     )                                                                                              \
-    char type_13[sizeof(#type_x)];
+    EMT_F_ARG_INFO_MEMBER(13, type_x)
 #define EMT_F_INFO_MEMBER_28(                                                                      \
     type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,        \
     type_i, i, type_j, j, type_k, k, type_l, l, type_m, m, type_x, x, dummy                        \
@@ -555,7 +1234,7 @@ EMT_STATIC_ASSERT(
         type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,    \
         type_i, i, type_j, j, type_k, k, type_l, l, type_m, m, 0                                   \
     )                                                                                              \
-    char type_14[sizeof(#type_x)];
+    EMT_F_ARG_INFO_MEMBER(14, type_x)
 #define EMT_F_INFO_MEMBER_30(                                                                      \
     type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,        \
     type_i, i, type_j, j, type_k, k, type_l, l, type_m, m, type_n, n, type_x, x, dummy             \
@@ -564,7 +1243,7 @@ EMT_STATIC_ASSERT(
         type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,    \
         type_i, i, type_j, j, type_k, k, type_l, l, type_m, m, type_n, n, 0                        \
     )                                                                                              \
-    char type_15[sizeof(#type_x)];
+    EMT_F_ARG_INFO_MEMBER(15, type_x)
 #define EMT_F_INFO_MEMBER_32(                                                                      \
     type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,        \
     type_i, i, type_j, j, type_k, k, type_l, l, type_m, m, type_n, n, type_o, o, type_x, x, dummy  \
@@ -573,33 +1252,33 @@ EMT_STATIC_ASSERT(
         type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,    \
         type_i, i, type_j, j, type_k, k, type_l, l, type_m, m, type_n, n, type_o, o, 0             \
     )                                                                                              \
-    char type_16[sizeof(#type_x)];
+    EMT_F_ARG_INFO_MEMBER(16, type_x)
 
 #define EMT_F_INFO_MEMBER_HELPER2(n, ...) EMT_F_INFO_MEMBER_##n(__VA_ARGS__)
 #define EMT_F_INFO_MEMBER_HELPER(n, ...) EMT_F_INFO_MEMBER_HELPER2(n, __VA_ARGS__)
 
 #define EMT_F_INFO_0(a)
-#define EMT_F_INFO_2(type_x, x, dummy) #type_x,
-#define EMT_F_INFO_4(type_a, a, type_x, x, dummy) EMT_F_INFO_2(type_a, a, 0) #type_x,
+#define EMT_F_INFO_2(type_x, x, dummy) EMT_F_ARG_INFO(type_x)
+#define EMT_F_INFO_4(type_a, a, type_x, x, dummy) EMT_F_INFO_2(type_a, a, 0) EMT_F_ARG_INFO(type_x)
 #define EMT_F_INFO_6(type_a, a, type_b, b, type_x, x, dummy)                                       \
-    EMT_F_INFO_4(type_a, a, type_b, b, 0) #type_x,
+    EMT_F_INFO_4(type_a, a, type_b, b, 0) EMT_F_ARG_INFO(type_x)
 #define EMT_F_INFO_8(type_a, a, type_b, b, type_c, c, type_x, x, dummy)                            \
-    EMT_F_INFO_6(type_a, a, type_b, b, type_c, c, 0) #type_x,
+    EMT_F_INFO_6(type_a, a, type_b, b, type_c, c, 0) EMT_F_ARG_INFO(type_x)
 #define EMT_F_INFO_10(type_a, a, type_b, b, type_c, c, type_d, d, type_x, x, dummy)                \
-    EMT_F_INFO_8(type_a, a, type_b, b, type_c, c, type_d, d, 0) #type_x,
+    EMT_F_INFO_8(type_a, a, type_b, b, type_c, c, type_d, d, 0) EMT_F_ARG_INFO(type_x)
 #define EMT_F_INFO_12(type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_x, x, dummy)     \
     EMT_F_INFO_10(type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, 0)                        \
-    #type_x,
+    EMT_F_ARG_INFO(type_x)
 #define EMT_F_INFO_14(                                                                             \
     type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_x, x, dummy             \
 )                                                                                                  \
     EMT_F_INFO_12(type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, 0)             \
-    #type_x,
+    EMT_F_ARG_INFO(type_x)
 #define EMT_F_INFO_16(                                                                             \
     type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_x, x, dummy  \
 )                                                                                                  \
     EMT_F_INFO_14(type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, 0)  \
-    #type_x,
+    EMT_F_ARG_INFO(type_x)
 #define EMT_F_INFO_18(                                                                             \
     type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,        \
     type_x, x, dummy                                                                               \
@@ -607,7 +1286,7 @@ EMT_STATIC_ASSERT(
     EMT_F_INFO_16(                                                                                 \
         type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h, 0  \
     )                                                                                              \
-    #type_x,
+    EMT_F_ARG_INFO(type_x)
 #define EMT_F_INFO_20(                                                                             \
     type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,        \
     type_i, i, type_x, x, dummy                                                                    \
@@ -616,7 +1295,7 @@ EMT_STATIC_ASSERT(
         type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,    \
         type_i, i, 0                                                                               \
     )                                                                                              \
-    #type_x,
+    EMT_F_ARG_INFO(type_x)
 #define EMT_F_INFO_22(                                                                             \
     type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,        \
     type_i, i, type_j, j, type_x, x, dummy                                                         \
@@ -625,7 +1304,7 @@ EMT_STATIC_ASSERT(
         type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,    \
         type_i, i, type_j, j, 0                                                                    \
     )                                                                                              \
-    #type_x,
+    EMT_F_ARG_INFO(type_x)
 #define EMT_F_INFO_24(                                                                             \
     type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,        \
     type_i, i, type_j, j, type_k, k, type_x, x, dummy                                              \
@@ -634,7 +1313,7 @@ EMT_STATIC_ASSERT(
         type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,    \
         type_i, i, type_j, j, type_k, k, 0                                                         \
     )                                                                                              \
-    #type_x,
+    EMT_F_ARG_INFO(type_x)
 #define EMT_F_INFO_26(                                                                             \
     type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,        \
     type_i, i, type_j, j, type_k, k, type_l, l, type_x, x, dummy                                   \
@@ -643,7 +1322,7 @@ EMT_STATIC_ASSERT(
         type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,    \
         type_i, i, type_j, j, type_k, k, type_l, l, 0                                              \
     )                                                                                              \
-    #type_x,
+    EMT_F_ARG_INFO(type_x)
 #define EMT_F_INFO_28(                                                                             \
     type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,        \
     type_i, i, type_j, j, type_k, k, type_l, l, type_m, m, type_x, x, dummy                        \
@@ -652,7 +1331,7 @@ EMT_STATIC_ASSERT(
         type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,    \
         type_i, i, type_j, j, type_k, k, type_l, l, type_m, m, 0                                   \
     )                                                                                              \
-    #type_x,
+    EMT_F_ARG_INFO(type_x)
 #define EMT_F_INFO_30(                                                                             \
     type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,        \
     type_i, i, type_j, j, type_k, k, type_l, l, type_m, m, type_n, n, type_x, x, dummy             \
@@ -661,7 +1340,7 @@ EMT_STATIC_ASSERT(
         type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,    \
         type_i, i, type_j, j, type_k, k, type_l, l, type_m, m, type_n, n, 0                        \
     )                                                                                              \
-    #type_x,
+    EMT_F_ARG_INFO(type_x)
 #define EMT_F_INFO_32(                                                                             \
     type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,        \
     type_i, i, type_j, j, type_k, k, type_l, l, type_m, m, type_n, n, type_o, o, type_x, x, dummy  \
@@ -670,45 +1349,42 @@ EMT_STATIC_ASSERT(
         type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,    \
         type_i, i, type_j, j, type_k, k, type_l, l, type_m, m, type_n, n, type_o, o, 0             \
     )                                                                                              \
-    #type_x,
+    EMT_F_ARG_INFO(type_x)
 
 #define EMT_F_INFO_HELPER2(n, ...) EMT_F_INFO_##n(__VA_ARGS__)
 #define EMT_F_INFO_HELPER(n, ...) EMT_F_INFO_HELPER2(n, __VA_ARGS__)
 
 #define EMT_F_LAYOUT_0(a)
-#define EMT_F_LAYOUT_2(type_x, x, dummy) , offsetof(info_t, type_1), sizeof(type_x), 0
+#define EMT_F_LAYOUT_2(type_x, x, dummy) EMT_F_ARG_LAYOUT(1, type_x)
 #define EMT_F_LAYOUT_4(type_a, a, type_x, x, dummy)                                                \
-    EMT_F_LAYOUT_2(type_a, a, 0), offsetof(info_t, type_2), sizeof(type_x), 0
+    EMT_F_LAYOUT_2(type_a, a, 0) EMT_F_ARG_LAYOUT(2, type_x)
 #define EMT_F_LAYOUT_6(type_a, a, type_b, b, type_x, x, dummy)                                     \
-    EMT_F_LAYOUT_4(type_a, a, type_b, b, 0), offsetof(info_t, type_3), sizeof(type_x), 0
+    EMT_F_LAYOUT_4(type_a, a, type_b, b, 0) EMT_F_ARG_LAYOUT(3, type_x)
 #define EMT_F_LAYOUT_8(type_a, a, type_b, b, type_c, c, type_x, x, dummy)                          \
-    EMT_F_LAYOUT_6(type_a, a, type_b, b, type_c, c, 0), offsetof(info_t, type_4), sizeof(type_x), 0
+    EMT_F_LAYOUT_6(type_a, a, type_b, b, type_c, c, 0) EMT_F_ARG_LAYOUT(4, type_x)
 #define EMT_F_LAYOUT_10(type_a, a, type_b, b, type_c, c, type_d, d, type_x, x, dummy)              \
-    EMT_F_LAYOUT_8(type_a, a, type_b, b, type_c, c, type_d, d, 0), offsetof(info_t, type_5),       \
-        sizeof(type_x), 0
+    EMT_F_LAYOUT_8(type_a, a, type_b, b, type_c, c, type_d, d, 0) EMT_F_ARG_LAYOUT(5, type_x)
 #define EMT_F_LAYOUT_12(type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_x, x, dummy)   \
-    EMT_F_LAYOUT_10(type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, 0),                     \
-        offsetof(info_t, type_6), sizeof(type_x), 0
+    EMT_F_LAYOUT_10(type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, 0)                      \
+        EMT_F_ARG_LAYOUT(6, type_x)
 #define EMT_F_LAYOUT_14(                                                                           \
     type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_x, x, dummy             \
 )                                                                                                  \
-    EMT_F_LAYOUT_12(type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, 0),          \
-        offsetof(info_t, type_7), sizeof(type_x), 0
+    EMT_F_LAYOUT_12(type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, 0)           \
+        EMT_F_ARG_LAYOUT(7, type_x)
 #define EMT_F_LAYOUT_16(                                                                           \
     type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_x, x, dummy  \
 )                                                                                                  \
     EMT_F_LAYOUT_14(                                                                               \
         type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, 0             \
-    ),                                                                                             \
-        offsetof(info_t, type_8), sizeof(type_x), 0
+    ) EMT_F_ARG_LAYOUT(8, type_x)
 #define EMT_F_LAYOUT_18(                                                                           \
     type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,        \
     type_x, x, dummy                                                                               \
 )                                                                                                  \
     EMT_F_LAYOUT_16(                                                                               \
         type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h, 0  \
-    ),                                                                                             \
-        offsetof(info_t, type_9), sizeof(type_x), 0
+    ) EMT_F_ARG_LAYOUT(9, type_x)
 #define EMT_F_LAYOUT_20(                                                                           \
     type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,        \
     type_i, i, type_x, x, dummy                                                                    \
@@ -716,8 +1392,7 @@ EMT_STATIC_ASSERT(
     EMT_F_LAYOUT_18(                                                                               \
         type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,    \
         type_i, i, 0                                                                               \
-    ),                                                                                             \
-        offsetof(info_t, type_10), sizeof(type_x), 0
+    ) EMT_F_ARG_LAYOUT(10, type_x)
 #define EMT_F_LAYOUT_22(                                                                           \
     type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,        \
     type_i, i, type_j, j, type_x, x, dummy                                                         \
@@ -725,8 +1400,7 @@ EMT_STATIC_ASSERT(
     EMT_F_LAYOUT_20(                                                                               \
         type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,    \
         type_i, i, type_j, j, 0                                                                    \
-    ),                                                                                             \
-        offsetof(info_t, type_11), sizeof(type_x), 0
+    ) EMT_F_ARG_LAYOUT(11, type_x)
 #define EMT_F_LAYOUT_24(                                                                           \
     type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,        \
     type_i, i, type_j, j, type_k, k, type_x, x, dummy                                              \
@@ -734,8 +1408,7 @@ EMT_STATIC_ASSERT(
     EMT_F_LAYOUT_22(                                                                               \
         type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,    \
         type_i, i, type_j, j, type_k, k, 0                                                         \
-    ),                                                                                             \
-        offsetof(info_t, type_12), sizeof(type_x), 0
+    ) EMT_F_ARG_LAYOUT(12, type_x)
 #define EMT_F_LAYOUT_26(                                                                           \
     type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,        \
     type_i, i, type_j, j, type_k, k, type_l, l, type_x, x, dummy                                   \
@@ -743,8 +1416,7 @@ EMT_STATIC_ASSERT(
     EMT_F_LAYOUT_24(                                                                               \
         type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,    \
         type_i, i, type_j, j, type_k, k, type_l, l, 0                                              \
-    ),                                                                                             \
-        offsetof(info_t, type_13), sizeof(type_x), 0
+    ) EMT_F_ARG_LAYOUT(13, type_x)
 #define EMT_F_LAYOUT_28(                                                                           \
     type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,        \
     type_i, i, type_j, j, type_k, k, type_l, l, type_m, m, type_x, x, dummy                        \
@@ -752,8 +1424,7 @@ EMT_STATIC_ASSERT(
     EMT_F_LAYOUT_26(                                                                               \
         type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,    \
         type_i, i, type_j, j, type_k, k, type_l, l, type_m, m, 0                                   \
-    ),                                                                                             \
-        offsetof(info_t, type_14), sizeof(type_x), 0
+    ) EMT_F_ARG_LAYOUT(14, type_x)
 #define EMT_F_LAYOUT_30(                                                                           \
     type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,        \
     type_i, i, type_j, j, type_k, k, type_l, l, type_m, m, type_n, n, type_x, x, dummy             \
@@ -761,8 +1432,7 @@ EMT_STATIC_ASSERT(
     EMT_F_LAYOUT_28(                                                                               \
         type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,    \
         type_i, i, type_j, j, type_k, k, type_l, l, type_m, m, type_n, n, 0                        \
-    ),                                                                                             \
-        offsetof(info_t, type_15), sizeof(type_x), 0
+    ) EMT_F_ARG_LAYOUT(15, type_x)
 #define EMT_F_LAYOUT_32(                                                                           \
     type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,        \
     type_i, i, type_j, j, type_k, k, type_l, l, type_m, m, type_n, n, type_o, o, type_x, x, dummy  \
@@ -770,12 +1440,101 @@ EMT_STATIC_ASSERT(
     EMT_F_LAYOUT_30(                                                                               \
         type_a, a, type_b, b, type_c, c, type_d, d, type_e, e, type_f, f, type_g, g, type_h, h,    \
         type_i, i, type_j, j, type_k, k, type_l, l, type_m, m, type_n, n, type_o, o, 0             \
-    ),                                                                                             \
-        offsetof(info_t, type_16), sizeof(type_x), 0
+    ) EMT_F_ARG_LAYOUT(16, type_x)
 
 #define EMT_F_LAYOUT_HELPER2(n, ...) EMT_F_LAYOUT_##n(__VA_ARGS__)
 #define EMT_F_LAYOUT_HELPER(n, ...) EMT_F_LAYOUT_HELPER2(n, __VA_ARGS__)
 
+/*
+ * Self-instrumentation. If `EMT_OVERHEAD` is defined (GCC/Clang only), `EMT_TRACE_F` reads the
+ * cycle counter before `lock`, after it, after the last `out_fn`, and after `unlock`, and adds up
+ * the differences in a writable `emt_overhead_t` next to the call site, placed in the
+ * `emtrace_overhead` section. `emtrace/overhead.h` emits them as records. Otherwise the hooks
+ * expand to nothing.
+ */
+#if defined(EMT_OVERHEAD)
+
+#if !defined(__GNUC__) && !defined(__clang__)
+#error "EMT_OVERHEAD needs GCC/Clang atomics and section attributes"
+#endif
+#if !defined(EMT_FREESTANDING)
+#include <time.h>
+#endif
+
+/// number of (log2) buckets of the histogram of cycles spent in `lock`
+#define EMT_OVERHEAD_BUCKETS 32
+
+typedef struct {
+    const void* info;       ///< format info of the call site
+    uint64_t count;         ///< times the call site was executed
+    uint64_t lock_cycles;   ///< cycles spent in `lock`
+    uint64_t out_cycles;    ///< cycles spent in the calls of `out_fn`
+    uint64_t unlock_cycles; ///< cycles spent in `unlock`
+    uint64_t max_cycles;    ///< most cycles a single execution took
+    /// executions by cycles spent in `lock`: bucket `i > 0` counts `[2^(i-1), 2^i)` cycles
+    uint64_t lock_wait[EMT_OVERHEAD_BUCKETS];
+} emt_overhead_t;
+
+#define EMT_OVERHEAD_SEC_ATTR                                                                      \
+    __attribute__((used, aligned(8), section("emtrace_overhead"))) static
+
+static inline uint64_t emt_overhead_cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#elif defined(__aarch64__)
+    uint64_t cycles;
+    __asm__ volatile("mrs %0, cntvct_el0" : "=r"(cycles));
+    return cycles;
+#elif !defined(EMT_FREESTANDING)
+    // nanoseconds then
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t) now.tv_sec * 1000000000U) + (uint64_t) now.tv_nsec;
+#else
+    return 0;
+#endif
+}
+
+static inline void emt_overhead_record(
+    emt_overhead_t* site, uint64_t start, uint64_t locked, uint64_t written, uint64_t end
+) {
+    uint64_t lock = locked - start;
+    __atomic_fetch_add(&site->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&site->lock_cycles, lock, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&site->out_cycles, written - locked, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&site->unlock_cycles, end - written, __ATOMIC_RELAXED);
+    unsigned bucket = lock == 0 ? 0 : 64U - (unsigned) __builtin_clzll(lock);
+    if (bucket >= EMT_OVERHEAD_BUCKETS)
+        bucket = EMT_OVERHEAD_BUCKETS - 1;
+    __atomic_fetch_add(&site->lock_wait[bucket], 1, __ATOMIC_RELAXED);
+    uint64_t max = __atomic_load_n(&site->max_cycles, __ATOMIC_RELAXED);
+    while (end - start > max &&
+           !__atomic_compare_exchange_n(
+               &site->max_cycles, &max, end - start, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED
+           )) {
+    }
+}
+
+#define EMT_OVERHEAD_BEGIN(info)                                                                   \
+    EMT_OVERHEAD_SEC_ATTR emt_overhead_t emt_overhead_site = {&(info), 0, 0, 0, 0, 0, {0}};        \
+    const uint64_t emt_overhead_start = emt_overhead_cycles();                                     \
+    uint64_t emt_overhead_locked;                                                                  \
+    uint64_t emt_overhead_written;
+#define EMT_OVERHEAD_LOCKED() emt_overhead_locked = emt_overhead_cycles();
+#define EMT_OVERHEAD_WRITTEN() emt_overhead_written = emt_overhead_cycles();
+#define EMT_OVERHEAD_END()                                                                         \
+    emt_overhead_record(                                                                           \
+        &emt_overhead_site, emt_overhead_start, emt_overhead_locked, emt_overhead_written,         \
+        emt_overhead_cycles()                                                                      \
+    );
+
+#else
+#define EMT_OVERHEAD_BEGIN(info)
+#define EMT_OVERHEAD_LOCKED()
+#define EMT_OVERHEAD_WRITTEN()
+#define EMT_OVERHEAD_END()
+#endif // EMT_OVERHEAD
+
 /**
  * @brief Emit a trace.
  *
@@ -794,11 +1553,13 @@ EMT_STATIC_ASSERT(
  *         - once in the beginning with the address of a pointer to the `info` variable,
  *           the size of a pointer, and the passed-through `extra_arg` parameter
  *         - once more for every format argument with its address, its size,
- *           and the passed-through `extra_arg` parameter.
+ *           and the passed-through `extra_arg` parameter. `EMT_ARRAY` arguments are passed as one
+ *           buffer, `EMT_SPAN` arguments as their element count followed by one buffer.
  * @param lock - Should evaluate to a function or function like macro that takes three arguments. Is
  *     evaluated once in the beginning just before any of the evaluations of `out_fn` with a pointer
  *     to the `info` variable, the total size of all bytes that out_fn is about to be called with,
- *     and the passed-through `extra_arg` parameter.
+ *     and the passed-through `extra_arg` parameter. If an `EMT_SPAN` argument is present the size
+ *     is a lower bound, flagged with `EMT_LENGTH_PREFIXED`.
  * @param unlock - Should evaluate to a function or function like macro that takes three arguments.
  *     Is evaluated once in the end just after any of the evaluations of `out_fn` with a pointer to
  * the `info` variable, the total size of all bytes that out_fn is about to be called with, and the
@@ -811,7 +1572,9 @@ EMT_STATIC_ASSERT(
 #define EMT_TRACE_F(fmt_info_attributes, formatter, out_fn, lock, unlock, extra_arg, postfix, ...) \
     do {                                                                                           \
         typedef struct {                                                                           \
-            emt_size_t layout[((EMT_NUM_ARGS_REST(__VA_ARGS__) * 3 + 1) / 2) + 5];                 \
+            emt_size_t layout[EMT_F_LAYOUT_SIZE_HELPER(                                            \
+                EMT_NUM_ARGS_REST(__VA_ARGS__), EMT_REST_ARGS(__VA_ARGS__, 0)                      \
+            ) + 5];                                                                                \
             char fmt[sizeof(EMT_FIRST_ARG(__VA_ARGS__, 0) postfix)];                               \
             EMT_F_INFO_MEMBER_HELPER(                                                              \
                 EMT_NUM_ARGS_REST(__VA_ARGS__), EMT_REST_ARGS(__VA_ARGS__, 0)                      \
@@ -832,24 +1595,34 @@ EMT_STATIC_ASSERT(
                 __FILE__,                                                                          \
         };                                                                                         \
         emt_ptr_t info_ptr = (emt_ptr_t) ((uintptr_t) &info >> EMT_ALIGNMENT_POWER);               \
+        EMT_OVERHEAD_BEGIN(info)                                                                   \
         lock(                                                                                      \
             (const void*) &info_ptr,                                                               \
-            EMT_F_TOTAL_SIZE_HELPER(                                                               \
-                EMT_NUM_ARGS_REST(__VA_ARGS__), EMT_REST_ARGS(__VA_ARGS__, 0)                      \
-            ) + sizeof(info_ptr),                                                                  \
+            (EMT_F_TOTAL_SIZE_HELPER(                                                              \
+                 EMT_NUM_ARGS_REST(__VA_ARGS__), EMT_REST_ARGS(__VA_ARGS__, 0)                     \
+             ) + sizeof(info_ptr)) |                                                               \
+                EMT_F_TOTAL_FLAGS_HELPER(                                                          \
+                    EMT_NUM_ARGS_REST(__VA_ARGS__), EMT_REST_ARGS(__VA_ARGS__, 0)                  \
+                ),                                                                                 \
             extra_arg                                                                              \
         );                                                                                         \
+        EMT_OVERHEAD_LOCKED()                                                                      \
         out_fn((const void*) &info_ptr, sizeof(info_ptr), extra_arg);                              \
         EMT_F_HELPER(                                                                              \
             EMT_NUM_ARGS_REST(__VA_ARGS__), out_fn, extra_arg, EMT_REST_ARGS(__VA_ARGS__, 0)       \
         );                                                                                         \
+        EMT_OVERHEAD_WRITTEN()                                                                     \
         unlock(                                                                                    \
             (const void*) &info_ptr,                                                               \
-            EMT_F_TOTAL_SIZE_HELPER(                                                               \
-                EMT_NUM_ARGS_REST(__VA_ARGS__), EMT_REST_ARGS(__VA_ARGS__, 0)                      \
-            ) + sizeof(info_ptr),                                                                  \
+            (EMT_F_TOTAL_SIZE_HELPER(                                                              \
+                 EMT_NUM_ARGS_REST(__VA_ARGS__), EMT_REST_ARGS(__VA_ARGS__, 0)                     \
+             ) + sizeof(info_ptr)) |                                                               \
+                EMT_F_TOTAL_FLAGS_HELPER(                                                          \
+                    EMT_NUM_ARGS_REST(__VA_ARGS__), EMT_REST_ARGS(__VA_ARGS__, 0)                  \
+                ),                                                                                 \
             extra_arg                                                                              \
         );                                                                                         \
+        EMT_OVERHEAD_END()                                                                         \
     } while (0)
 
 #define EMT_TRACE(fmt_info_attributes, out_fn, lock, unlock, extra_arg, string)                    \
@@ -941,14 +1714,132 @@ EMT_STATIC_ASSERT(
     __declspec(align(EMT_ALIGNMENT)) __declspec(allocate(".emtrace")) static const
 #endif
 
+#if defined(EMT_FREESTANDING)
+
+/*
+ * Freestanding mode. Defining `EMT_FREESTANDING` drops `<stdio.h>` and the `FILE*` sinks, for
+ * builds with `-ffreestanding -nostdlib` or ones that bring their own `out_fn` anyway. Instead, the
+ * default macros use a buffered sink that collects records in a caller-supplied static buffer, and
+ * writes it to a file descriptor with raw `write` system calls (Linux on x86-64 and AArch64) when
+ * it fills up and on `emt_fd_flush`. The compiler may still expect `memcpy` and `memset` to exist.
+ */
+
+typedef struct {
+    uint8_t* buffer;     ///< caller-supplied buffer records are collected in
+    emt_size_t capacity; ///< size of `buffer`
+    emt_size_t size;     ///< bytes collected in `buffer`
+    int fd;              ///< file descriptor the buffer is written to
+    int locked;          ///< spinlock held while a record is written (atomic)
+} emt_fd_sink_t;
+
+/// Defines `name`, an `emt_fd_sink_t` writing to `fd`, with a static buffer of `capacity` bytes.
+#define EMT_FD_SINK_DEFINE(name, fd, capacity)                                                     \
+    static uint8_t name##_buffer[capacity];                                                        \
+    emt_fd_sink_t name = {name##_buffer, (capacity), 0, (fd), 0}
+
+static inline long emt_sys_write(int fd, const void* data, emt_size_t size) {
+    long result;
+#if defined(__x86_64__)
+    __asm__ volatile("syscall"
+                     : "=a"(result)
+                     : "a"(1L), "D"((long) fd), "S"(data), "d"(size)
+                     : "rcx", "r11", "memory");
+#elif defined(__aarch64__)
+    register long x8 __asm__("x8") = 64;
+    register long x0 __asm__("x0") = fd;
+    register long x1 __asm__("x1") = (long) data;
+    register long x2 __asm__("x2") = (long) size;
+    __asm__ volatile("svc 0" : "+r"(x0) : "r"(x8), "r"(x1), "r"(x2) : "memory");
+    result = x0;
+#else
+#error "EMT_FREESTANDING needs a raw write system call for this architecture"
+#endif
+    return result;
+}
+
+/// Writes all of `data` to `fd`, retrying on `EINTR` and short writes.
+static inline void emt_fd_write(int fd, const uint8_t* data, emt_size_t size) {
+    while (size > 0) {
+        long written = emt_sys_write(fd, data, size);
+        if (written == -4) // -EINTR
+            continue;
+        if (written <= 0)
+            return;
+        data += written;
+        size -= (emt_size_t) written;
+    }
+}
+
+/// Writes out everything collected in the sink's buffer.
+static inline void emt_fd_flush(emt_fd_sink_t* sink) {
+    emt_fd_write(sink->fd, sink->buffer, sink->size);
+    sink->size = 0;
+}
+
+/// `out_fn`, `lock`, and `unlock` for `emt_fd_sink_t`.
+static inline void emt_fd_out(const void* data, emt_size_t size, emt_fd_sink_t* sink) {
+    if (size > sink->capacity - sink->size) {
+        emt_fd_flush(sink);
+        if (size > sink->capacity) {
+            emt_fd_write(sink->fd, (const uint8_t*) data, size);
+            return;
+        }
+    }
+    const uint8_t* bytes = (const uint8_t*) data;
+    for (emt_size_t i = 0; i < size; i++)
+        sink->buffer[sink->size + i] = bytes[i];
+    sink->size += size;
+}
+
+static inline void emt_fd_lock(const void* data, emt_size_t size, emt_fd_sink_t* sink) {
+    (void) data;
+    (void) size;
+    while (__atomic_exchange_n(&sink->locked, 1, __ATOMIC_ACQUIRE))
+        ;
+}
+
+static inline void emt_fd_unlock(const void* data, emt_size_t size, emt_fd_sink_t* sink) {
+    (void) data;
+    (void) size;
+    __atomic_store_n(&sink->locked, 0, __ATOMIC_RELEASE);
+}
+
+#if !defined(EMT_FD_SINK)
+/// Sink of the default macros; define it in one translation unit with `EMT_FD_SINK_DEFINE`.
+extern emt_fd_sink_t emt_stdout_sink;
+#define EMT_FD_SINK (&emt_stdout_sink)
+#endif
+
+#define EMT_FLOCK_FILE emt_fd_lock
+#define EMT_FUNLOCK_FILE emt_fd_unlock
+#define EMT_DEFAULT_OUT emt_fd_out
+#define EMT_DEFAULT_SINK EMT_FD_SINK
+
 // for thread safety we want to lock stdout while writing a trace to it so that data from multiple
 // traces cannot interleave
-#if defined(unix) || defined(__unix) || defined(__unix__) ||                                       \
+#elif defined(unix) || defined(__unix) || defined(__unix__) ||                                     \
     (defined(__APPLE__) && defined(__MACH__))
 
 #define EMT_FLOCK_FILE(x, y, file) flockfile(file)
 #define EMT_FUNLOCK_FILE(x, y, file) funlockfile(file)
 
+/// `out_fn`, `lock`, and `unlock` for `FILE*` streams as `emt_sink_fn_t`; a NULL `arg` is stdout.
+static inline void emt_file_out(const void* data, emt_size_t size, void* arg) {
+    fwrite(data, 1, size, arg == NULL ? stdout : (FILE*) arg);
+}
+
+static inline void emt_file_lock(const void* data, emt_size_t size, void* arg) {
+    (void) data;
+    (void) size;
+    flockfile(arg == NULL ? stdout : (FILE*) arg);
+}
+
+static inline void emt_file_unlock(const void* data, emt_size_t size, void* arg) {
+    (void) data;
+    (void) size;
+    funlockfile(arg == NULL ? stdout : (FILE*) arg);
+}
+
 #elif defined(_WIN32)
 
 #include <windows.h>
@@ -957,34 +1848,46 @@ EMT_STATIC_ASSERT(
 
 #endif
 
+#if !defined(EMT_DEFAULT_OUT)
+#define EMT_DEFAULT_OUT emt_out_file
+#define EMT_DEFAULT_SINK stdout
+#endif
+
 #if defined(EMT_DEFAULT_SEC_ATTR) && defined(EMT_FLOCK_FILE) && defined(EMT_FUNLOCK_FILE)
 
 #define EMTRACE_F(...)                                                                             \
     EMT_TRACE_F(                                                                                   \
-        EMT_DEFAULT_SEC_ATTR, EMT_PY_FORMAT, emt_out_file, EMT_FLOCK_FILE, EMT_FUNLOCK_FILE,       \
-        stdout, "", __VA_ARGS__                                                                    \
+        EMT_DEFAULT_SEC_ATTR, EMT_PY_FORMAT, EMT_DEFAULT_OUT, EMT_FLOCK_FILE, EMT_FUNLOCK_FILE,    \
+        EMT_DEFAULT_SINK, "", __VA_ARGS__                                                          \
     )
 #define EMTRACE(str)                                                                               \
-    EMT_TRACE(EMT_DEFAULT_SEC_ATTR, emt_out_file, EMT_FLOCK_FILE, EMT_FUNLOCK_FILE, stdout, str)
+    EMT_TRACE(                                                                                     \
+        EMT_DEFAULT_SEC_ATTR, EMT_DEFAULT_OUT, EMT_FLOCK_FILE, EMT_FUNLOCK_FILE, EMT_DEFAULT_SINK, \
+        str                                                                                        \
+    )
 #define EMTRACE_S(str)                                                                             \
     EMT_TRACE_S(                                                                                   \
-        EMT_DEFAULT_SEC_ATTR, emt_out_file, EMT_FLOCK_FILE, EMT_FUNLOCK_FILE, stdout, "", str      \
+        EMT_DEFAULT_SEC_ATTR, EMT_DEFAULT_OUT, EMT_FLOCK_FILE, EMT_FUNLOCK_FILE, EMT_DEFAULT_SINK, \
+        "", str                                                                                    \
     )
 
 #define EMTRACELN_F(...)                                                                           \
     EMT_TRACE_F(                                                                                   \
-        EMT_DEFAULT_SEC_ATTR, EMT_PY_FORMAT, emt_out_file, EMT_FLOCK_FILE, EMT_FUNLOCK_FILE,       \
-        stdout, "\n", __VA_ARGS__                                                                  \
+        EMT_DEFAULT_SEC_ATTR, EMT_PY_FORMAT, EMT_DEFAULT_OUT, EMT_FLOCK_FILE, EMT_FUNLOCK_FILE,    \
+        EMT_DEFAULT_SINK, "\n", __VA_ARGS__                                                        \
     )
 #define EMTRACELN(str)                                                                             \
     EMT_TRACE(                                                                                     \
-        EMT_DEFAULT_SEC_ATTR, emt_out_file, EMT_FLOCK_FILE, EMT_FUNLOCK_FILE, stdout, str "\n"     \
+        EMT_DEFAULT_SEC_ATTR, EMT_DEFAULT_OUT, EMT_FLOCK_FILE, EMT_FUNLOCK_FILE, EMT_DEFAULT_SINK, \
+        str "\n"                                                                                   \
     )
 #define EMTRACELN_S(str)                                                                           \
     EMT_TRACE_S(                                                                                   \
-        EMT_DEFAULT_SEC_ATTR, emt_out_file, EMT_FLOCK_FILE, EMT_FUNLOCK_FILE, stdout, "\n", str    \
+        EMT_DEFAULT_SEC_ATTR, EMT_DEFAULT_OUT, EMT_FLOCK_FILE, EMT_FUNLOCK_FILE, EMT_DEFAULT_SINK, \
+        "\n", str                                                                                  \
     )
-#define EMTRACE_INIT() EMT_INIT(EMT_DEFAULT_SEC_ATTR, emt_out_file, stdout)
+#define EMTRACE_INIT() EMT_INIT(EMT_DEFAULT_SEC_ATTR, EMT_DEFAULT_OUT, EMT_DEFAULT_SINK)
+#define EMTRACE_ENUM_TABLE(e) EMT_ENUM_TABLE(EMT_DEFAULT_SEC_ATTR, e)
 
 #endif // EMT_DEFAULT_SEC_ATTR && EMT_FLOCK_FILE && EMT_FUNLOCK_FILE
 
@@ -993,4 +1896,222 @@ EMT_STATIC_ASSERT(
 }
 #endif
 
+#ifdef __cplusplus
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+// C++ overloads used by `EMT_ARRAY`/`EMT_SPAN` arguments, so that besides pointers also contiguous
+// containers (`std::array`, `std::span`, `std::vector`, ...) can be traced directly.
+
+template <typename T>
+inline auto emt_array_data(const T* data) -> const T* {
+    return data;
+}
+
+template <typename C>
+inline auto emt_array_data(const C& container) -> decltype(container.data()) {
+    return container.data();
+}
+
+template <typename T, typename Ptr>
+struct emt_array_elem_matches
+    : std::is_same<
+          typename std::remove_cv<T>::type,
+          typename std::remove_cv<typename std::remove_pointer<Ptr>::type>::type> {};
+
+/// compile time number of elements of an array argument, or 0 if it is only known at runtime
+template <typename C, typename = void>
+struct emt_array_extent_of : std::integral_constant<size_t, 0> {};
+
+template <typename T, size_t N>
+struct emt_array_extent_of<T[N], void> : std::integral_constant<size_t, N> {};
+
+template <typename C>
+struct emt_array_extent_of<C, decltype((void) std::tuple_size<C>::value)>
+    : std::integral_constant<size_t, std::tuple_size<C>::value> {};
+
+template <typename C>
+struct emt_array_extent_of<C, decltype((void) C::extent)>
+    : std::integral_constant<size_t, C::extent == static_cast<size_t>(-1) ? 0 : C::extent> {};
+
+template <typename C>
+struct emt_array_extent
+    : emt_array_extent_of<typename std::remove_cv<typename std::remove_reference<C>::type>::type> {
+};
+
+// The type id `duration:<num>/<den>` of `EMT_DURATION` arguments, spelled out at compile time.
+
+/// a null-terminated string of the characters `C`
+template <char... C>
+struct emt_chars {
+    char str[sizeof...(C) + 1];
+
+    static constexpr emt_chars make() { return {{C..., '\0'}}; }
+};
+
+template <typename S, char D>
+struct emt_chars_append;
+
+template <char... C, char D>
+struct emt_chars_append<emt_chars<C...>, D> {
+    using type = emt_chars<C..., D>;
+};
+
+/// the characters of `S` followed by the decimal digits of `N`
+template <typename S, unsigned long long N, bool = (N < 10)>
+struct emt_chars_decimal {
+    using type = typename emt_chars_append<
+        typename emt_chars_decimal<S, N / 10>::type, (char) ('0' + (N % 10))>::type;
+};
+
+template <typename S, unsigned long long N>
+struct emt_chars_decimal<S, N, true> {
+    using type = typename emt_chars_append<S, (char) ('0' + N)>::type;
+};
+
+template <typename D>
+using emt_duration_id = typename emt_chars_decimal<
+    typename emt_chars_append<
+        typename emt_chars_decimal<
+            emt_chars<'d', 'u', 'r', 'a', 't', 'i', 'o', 'n', ':'>,
+            (unsigned long long) D::period::num>::type,
+        '/'>::type,
+    (unsigned long long) D::period::den>::type;
+
+#if __cplusplus >= 201703L && (defined(__GNUC__) || defined(__clang__))
+#include <array>
+#include <limits>
+#include <string_view>
+
+// Compile time enum tables of scoped enums (see `EMT_ENUM`). The names of the enum type and of its
+// enumerators are taken from `__PRETTY_FUNCTION__` of functions templated on them; values that
+// aren't an enumerator show up there as a cast instead of a name.
+
+#ifndef EMT_ENUM_RANGE_MIN
+#define EMT_ENUM_RANGE_MIN -128
+#endif
+#ifndef EMT_ENUM_RANGE_MAX
+#define EMT_ENUM_RANGE_MAX 127
+#endif
+
+/// The template argument following `key` in a `__PRETTY_FUNCTION__` of GCC or Clang
+constexpr std::string_view emt_pretty_arg(std::string_view pretty, std::string_view key) {
+    size_t start = pretty.find(key) + key.size();
+    size_t end = pretty.find(';', start);
+    if (end == std::string_view::npos)
+        end = pretty.rfind(']');
+    return pretty.substr(start, end - start);
+}
+
+template <typename E>
+constexpr std::string_view emt_enum_type_name() {
+    return emt_pretty_arg(__PRETTY_FUNCTION__, "E = ");
+}
+
+/// unqualified name of the enumerator `V`, or empty if there is none with that value
+template <typename E, E V>
+constexpr std::string_view emt_enum_value_name() {
+    std::string_view name = emt_pretty_arg(__PRETTY_FUNCTION__, "V = ");
+    if (name.empty() || !(name[0] == '_' || (name[0] >= 'a' && name[0] <= 'z') ||
+                          (name[0] >= 'A' && name[0] <= 'Z')))
+        return {};
+    size_t scope = name.rfind("::");
+    if (scope != std::string_view::npos)
+        name.remove_prefix(scope + 2);
+    return name;
+}
+
+template <typename E>
+struct emt_enum_reflection {
+    using underlying = typename std::underlying_type<E>::type;
+    using limits = std::numeric_limits<underlying>;
+
+    // the range, clamped to the values the underlying type can hold
+    static constexpr long long min =
+        (long long) limits::min() > (long long) (EMT_ENUM_RANGE_MIN) ? (long long) limits::min()
+                                                                     : (EMT_ENUM_RANGE_MIN);
+    static constexpr long long max =
+        (unsigned long long) limits::max() < (unsigned long long) (EMT_ENUM_RANGE_MAX)
+            ? (long long) limits::max()
+            : (EMT_ENUM_RANGE_MAX);
+    static constexpr size_t range = (size_t) (max - min + 1);
+
+    template <size_t... I>
+    static constexpr std::array<std::string_view, range> all_names(std::index_sequence<I...>) {
+        return {{emt_enum_value_name<E, static_cast<E>(min + (long long) I)>()...}};
+    }
+
+    static constexpr std::array<std::string_view, range> names =
+        all_names(std::make_index_sequence<range>{});
+    static constexpr std::string_view type_name = emt_enum_type_name<E>();
+
+    static constexpr size_t count() {
+        size_t n = 0;
+        for (std::string_view name : names)
+            n += name.empty() ? 0U : 1U;
+        return n;
+    }
+
+    static constexpr size_t string_size() {
+        size_t n = type_name.size() + 1;
+        for (std::string_view name : names)
+            n += name.empty() ? 0 : name.size() + 1;
+        return n;
+    }
+};
+
+/// Enums that aren't scoped have their table declared by `EMT_ENUM_TABLE` instead.
+template <
+    typename E, bool = !std::is_convertible<E, typename std::underlying_type<E>::type>::value>
+struct emt_enum_table {
+    using type = char;
+    static constexpr type make() { return 0; }
+};
+
+/// The enum table of the scoped enum `E`, with the same layout as those of `EMT_ENUM_TABLE`
+template <typename E>
+struct emt_enum_table<E, true> {
+    using reflection = emt_enum_reflection<E>;
+    static constexpr size_t count = reflection::count();
+
+    struct type {
+        uint8_t magic[16];
+        emt_size_t header[4];
+        int64_t values[count == 0 ? 1 : count];
+        emt_size_t names[count == 0 ? 1 : count];
+        char strings[reflection::string_size()];
+    };
+
+    static constexpr void append(type& t, size_t& pos, std::string_view name) {
+        for (char c : name)
+            t.strings[pos++] = c;
+        t.strings[pos++] = '\0';
+    }
+
+    static constexpr type make() {
+        type t{};
+        constexpr uint8_t magic[16] = {EMT_ENUM_MAGIC};
+        for (size_t i = 0; i < 16; i++)
+            t.magic[i] = magic[i];
+        t.header[0] = (emt_size_t) count;
+        t.header[1] = (emt_size_t) offsetof(type, strings);
+        t.header[2] = (emt_size_t) offsetof(type, values);
+        t.header[3] = (emt_size_t) offsetof(type, names);
+        size_t pos = 0;
+        append(t, pos, reflection::type_name);
+        size_t k = 0;
+        for (size_t i = 0; i < reflection::range; i++) {
+            if (reflection::names[i].empty())
+                continue;
+            t.values[k] = (int64_t) (reflection::min + (long long) i);
+            t.names[k++] = (emt_size_t) (offsetof(type, strings) + pos);
+            append(t, pos, reflection::names[i]);
+        }
+        return t;
+    }
+};
+#endif
+#endif
+
 #endif // EMTRACE_EMTRACE_H
@@ -0,0 +1,238 @@
+#ifndef EMTRACE_MEMORY_H
+#define EMTRACE_MEMORY_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+// NOLINTBEGIN(modernize-use-using,modernize-avoid-c-arrays)
+
+/**
+ * Memory for trace buffers.
+ *
+ * Large buffers are mapped rather than allocated from the heap, so they can be backed by huge pages
+ * (fewer TLB misses when writers are spread across hundreds of MB), locked into memory (no page
+ * faults on the hot path), and placed on the NUMA node of the CPUs writing to them. Every option
+ * is a hint: if the system doesn't provide it, the buffer is mapped without it, and the flags that
+ * were applied are reported back. NUMA topology is read from sysfs and memory is bound with the
+ * `mbind` system call, so libnuma isn't needed.
+ *
+ * Binding and locking must happen in this order, before the pages are first touched:
+ *     emt_mem_map -> emt_mem_bind (per node) -> emt_mem_lock
+ */
+
+/// Back the buffer with pages reserved in the hugetlb pool, falling back to `EMT_MEM_THP`.
+#define EMT_MEM_HUGETLB 0x1
+/// Ask for transparent huge pages.
+#define EMT_MEM_THP 0x2
+/// Lock the buffer into memory, faulting all of it in up front.
+#define EMT_MEM_MLOCK 0x4
+/// Place the buffer on the NUMA node of the CPUs using it.
+#define EMT_MEM_NUMA 0x8
+
+#define EMT_MEM_HUGE_PAGE_SIZE ((size_t) 2 << 20)
+
+#define EMT_MEM_LONG_BITS (8 * sizeof(unsigned long))
+
+#ifndef EMT_MEM_MAX_NODES
+#define EMT_MEM_MAX_NODES 64
+#endif
+
+#ifndef EMT_MEM_MAX_CPUS
+#define EMT_MEM_MAX_CPUS 1024
+#endif
+
+/// Granularity at which a buffer mapped with `flags` can be bound to a node.
+static inline size_t emt_mem_page_size(int flags) {
+    if (flags & (EMT_MEM_HUGETLB | EMT_MEM_THP))
+        return EMT_MEM_HUGE_PAGE_SIZE;
+    long page_size = sysconf(_SC_PAGESIZE);
+    return page_size > 0 ? (size_t) page_size : 4096;
+}
+
+/// `size` rounded up to a whole number of pages of a buffer mapped with `flags`.
+static inline size_t emt_mem_round(size_t size, int flags) {
+    size_t page_size = emt_mem_page_size(flags);
+    return (size + page_size - 1) & ~(page_size - 1);
+}
+
+/**
+ * @brief Map `size` bytes of zeroed memory, with huge pages if `flags` asks for them.
+ *
+ * @param[in,out] flags Cleared of the huge page flags that couldn't be applied.
+ * @return The mapping, or NULL with `errno` set.
+ */
+static inline void* emt_mem_map(size_t size, int* flags) {
+    void* addr = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if (*flags & EMT_MEM_HUGETLB) {
+        addr = mmap(
+            NULL, emt_mem_round(size, EMT_MEM_HUGETLB), PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0
+        );
+    }
+#endif
+    if (addr != MAP_FAILED)
+        return addr;
+    if (*flags & EMT_MEM_HUGETLB) {
+        // no huge pages reserved (or none of this size)
+        *flags = (*flags & ~EMT_MEM_HUGETLB) | EMT_MEM_THP;
+    }
+
+    addr = mmap(
+        NULL, emt_mem_round(size, *flags), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1,
+        0
+    );
+    if (addr == MAP_FAILED)
+        return NULL;
+#ifdef MADV_HUGEPAGE
+    if ((*flags & EMT_MEM_THP) && madvise(addr, emt_mem_round(size, *flags), MADV_HUGEPAGE) != 0)
+        *flags &= ~EMT_MEM_THP;
+#else
+    *flags &= ~EMT_MEM_THP;
+#endif
+    return addr;
+}
+
+/// Unmap a buffer mapped with `emt_mem_map`, with the flags it returned.
+static inline void emt_mem_unmap(void* addr, size_t size, int flags) {
+    if (addr != NULL)
+        (void) munmap(addr, emt_mem_round(size, flags));
+}
+
+/**
+ * @brief Place the pages of `[addr, addr + size)` on `node` once they are touched.
+ *
+ * `addr` and `size` must be multiples of the page size.
+ *
+ * @return 0 on success, -1 on failure with `errno` set.
+ */
+static inline int emt_mem_bind(void* addr, size_t size, uint32_t node) {
+#ifdef SYS_mbind
+    if (node >= EMT_MEM_MAX_NODES) {
+        errno = EINVAL;
+        return -1;
+    }
+    unsigned long nodemask[(EMT_MEM_MAX_NODES + 31) / 32] = {0};
+    nodemask[node / EMT_MEM_LONG_BITS] = 1UL << (node % EMT_MEM_LONG_BITS);
+    const int mpol_bind = 2; // from <numaif.h>
+    // the kernel reads maxnode - 1 bits
+    long result = syscall(SYS_mbind, addr, size, mpol_bind, nodemask, EMT_MEM_MAX_NODES + 1, 0);
+    return result == 0 ? 0 : -1;
+#else
+    (void) addr;
+    (void) size;
+    (void) node;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/**
+ * @brief Lock `size` bytes at `addr` into memory. If that isn't allowed (see `RLIMIT_MEMLOCK`), the
+ * pages are still faulted in, so at least the first write to each doesn't take a fault.
+ *
+ * @return 0 if locked, -1 if only faulted in, with `errno` set.
+ */
+static inline int emt_mem_lock(void* addr, size_t size, int flags) {
+    size = emt_mem_round(size, flags);
+    if (mlock(addr, size) == 0)
+        return 0;
+    int saved_errno = errno;
+    size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+    for (size_t offset = 0; offset < size; offset += page_size)
+        ((volatile uint8_t*) addr)[offset] = 0;
+    errno = saved_errno;
+    return -1;
+}
+
+/// Read a sysfs file into `buffer`, NUL-terminated; 0 on success.
+static inline int emt_mem_read_sysfs(const char* path, char* buffer, size_t size) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    ssize_t length = read(fd, buffer, size - 1);
+    close(fd);
+    if (length < 0)
+        return -1;
+    buffer[length] = '\0';
+    return 0;
+}
+
+/**
+ * @brief Look up the NUMA node of each of the first `num_cpus` CPUs.
+ *
+ * CPUs not listed by any node (and all of them, on systems without NUMA support) are on node 0.
+ *
+ * @return Number of nodes, i.e. the highest node number in use plus one.
+ */
+static inline uint32_t emt_mem_cpu_nodes(uint16_t* nodes, uint32_t num_cpus) {
+    memset(nodes, 0, num_cpus * sizeof(uint16_t));
+    uint32_t num_nodes = 1;
+    for (uint32_t node = 0; node < EMT_MEM_MAX_NODES; node++) {
+        char path[64];
+        char list[4096];
+        (void) snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpulist", node);
+        if (emt_mem_read_sysfs(path, list, sizeof(list)) != 0)
+            continue;
+        // e.g. "0-3,8-11"
+        const char* p = list;
+        while (*p >= '0' && *p <= '9') {
+            char* end;
+            unsigned long first = strtoul(p, &end, 10);
+            unsigned long last = first;
+            if (*end == '-')
+                last = strtoul(end + 1, &end, 10);
+            for (unsigned long cpu = first; cpu <= last && cpu < num_cpus; cpu++)
+                nodes[cpu] = (uint16_t) node;
+            if (node + 1 > num_nodes && first <= last)
+                num_nodes = node + 1;
+            p = *end == ',' ? end + 1 : end;
+        }
+    }
+    return num_nodes;
+}
+
+/**
+ * @brief Restrict the calling thread to the CPUs of `node`, e.g. to drain that node's buffers.
+ *
+ * @return 0 on success, -1 on failure with `errno` set.
+ */
+static inline int emt_mem_pin_node(uint32_t node) {
+    uint16_t nodes[EMT_MEM_MAX_CPUS];
+    long num_cpus = sysconf(_SC_NPROCESSORS_CONF);
+    if (num_cpus < 1 || num_cpus > EMT_MEM_MAX_CPUS)
+        num_cpus = EMT_MEM_MAX_CPUS;
+    (void) emt_mem_cpu_nodes(nodes, (uint32_t) num_cpus);
+
+    unsigned long mask[EMT_MEM_MAX_CPUS / 32] = {0};
+    int any = 0;
+    for (unsigned long cpu = 0; cpu < (unsigned long) num_cpus; cpu++) {
+        if (nodes[cpu] == node) {
+            mask[cpu / EMT_MEM_LONG_BITS] |= 1UL << (cpu % EMT_MEM_LONG_BITS);
+            any = 1;
+        }
+    }
+    if (!any) {
+        errno = EINVAL;
+        return -1;
+    }
+    return syscall(SYS_sched_setaffinity, 0, sizeof(mask), mask) == 0 ? 0 : -1;
+}
+
+// NOLINTEND(modernize-use-using,modernize-avoid-c-arrays)
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EMTRACE_MEMORY_H
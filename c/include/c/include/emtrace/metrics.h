@@ -0,0 +1,391 @@
+#ifndef EMTRACE_METRICS_H
+#define EMTRACE_METRICS_H
+
+#include "emtrace/emtrace.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+// NOLINTBEGIN(modernize-use-using,modernize-avoid-c-arrays)
+
+/**
+ * In-process counters and histograms.
+ *
+ * Instead of one record per event, `EMT_COUNTER` and `EMT_HISTOGRAM` aggregate the values passed
+ * to them in a writable static next to the call site, and `emt_metrics_flush` emits a single
+ * record per metric with what was aggregated since the previous flush.
+ *
+ * The format info of that record is created at the call site like for any other trace (with the
+ * metric's name as the format string and the `EMT_METRIC_FORMAT` formatter), so the decoder knows
+ * the metric's name and source location without any of it being sent. The first time a call site
+ * is executed it captures the address of that info and the `emt_metrics_t` that flushes it.
+ * `emt_metrics_flush` finds the metrics through pointers to them in the `emtrace_metrics` section,
+ * so that, like the per-site statistics of overhead.h, they need no registry. The metrics
+ * themselves stay in `.bss`, where a histogram's buckets take no space in the binary.
+ *
+ * To keep threads from contending on a single cache line, every metric is split into
+ * `EMT_METRIC_SHARDS` shards, and each thread updates the shard it was assigned to. Counters are
+ * updated with relaxed atomics; histogram shards are updated under a lock of their own, which a
+ * flush takes as well, so that every interval's count, buckets, min and max agree. Don't record
+ * into a histogram from a signal handler that may interrupt a recording thread.
+ * Histograms count values in log-linear buckets: values below
+ * `2^EMT_HISTOGRAM_SUB_BITS` get a bucket each, above that every power of two is split into
+ * `2^EMT_HISTOGRAM_SUB_BITS` equally sized buckets. Only the non-empty buckets are sent.
+ *
+ * Records are laid out as
+ * - counter: `uint8_t` kind, `uint64_t` timestamp (ns), `uint64_t` sum of the deltas
+ * - histogram: `uint8_t` kind, `uint64_t` timestamp (ns), `uint64_t` count, sum, min, and max,
+ *   `uint8_t` sub bits, and an `EMT_SPAN(uint64_t, 2 * n)` of (bucket index, count) pairs
+ *
+ * Requires GCC/Clang atomics and section attributes, a linker that defines `__start_`/`__stop_`
+ * symbols for sections named like C identifiers (as ELF linkers do), and `clock_gettime`.
+ */
+
+#ifndef EMT_METRIC_SHARDS
+#define EMT_METRIC_SHARDS 4
+#endif
+
+#ifndef EMT_HISTOGRAM_SUB_BITS
+#define EMT_HISTOGRAM_SUB_BITS 3
+#endif
+
+#define EMT_HISTOGRAM_BUCKETS ((65 - EMT_HISTOGRAM_SUB_BITS) << EMT_HISTOGRAM_SUB_BITS)
+
+#define EMT_METRIC_CACHE_LINE 64
+
+#define EMT_METRIC_COUNTER 0
+#define EMT_METRIC_HISTOGRAM 1
+
+#define EMT_METRIC_UNREGISTERED 0
+#define EMT_METRIC_REGISTERING 1
+#define EMT_METRIC_REGISTERED 2
+
+#ifdef __cplusplus
+#define EMT_METRIC_THREAD_LOCAL thread_local
+#else
+#define EMT_METRIC_THREAD_LOCAL _Thread_local
+#endif
+
+struct emt_metrics;
+
+typedef struct {
+    struct emt_metrics* owner; ///< flushes the metric
+    emt_ptr_t info_ptr;        ///< format info of the aggregate record
+    uint8_t kind;              ///< `EMT_METRIC_COUNTER` or `EMT_METRIC_HISTOGRAM`
+    uint8_t state;             ///< `EMT_METRIC_UNREGISTERED`, `_REGISTERING`, or `_REGISTERED`
+} emt_metric_t;
+
+typedef struct {
+    uint64_t value;
+    uint8_t padding[EMT_METRIC_CACHE_LINE - sizeof(uint64_t)];
+} emt_counter_shard_t;
+
+typedef struct {
+    emt_metric_t metric;
+    emt_counter_shard_t shards[EMT_METRIC_SHARDS];
+} emt_counter_t;
+
+typedef struct {
+    int locked; ///< spinlock held while the shard is updated or flushed (atomic)
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min; ///< only meaningful if `count` isn't 0
+    uint64_t max;
+    uint64_t buckets[EMT_HISTOGRAM_BUCKETS];
+} emt_histogram_shard_t;
+
+typedef struct {
+    emt_metric_t metric;
+    emt_histogram_shard_t shards[EMT_METRIC_SHARDS];
+} emt_histogram_t;
+
+typedef struct emt_metrics {
+    emt_sink_fn_t out;    ///< sink's `out_fn`
+    emt_sink_fn_t lock;   ///< sink's `lock`
+    emt_sink_fn_t unlock; ///< sink's `unlock`
+    void* arg;            ///< sink's `extra_arg`
+    uint64_t interval_ns; ///< minimum time between two flushes by `emt_metrics_maybe_flush`
+
+    uint64_t last_flush; ///< time of the last flush by `emt_metrics_maybe_flush`
+} emt_metrics_t;
+
+// defined by the linker for sections named like C identifiers; weak, in case there is none
+extern emt_metric_t* const __start_emtrace_metrics[] __attribute__((weak, visibility("hidden")));
+extern emt_metric_t* const __stop_emtrace_metrics[] __attribute__((weak, visibility("hidden")));
+
+#define EMT_METRIC_SEC_ATTR                                                                        \
+    __attribute__((used, aligned(sizeof(void*)), section("emtrace_metrics"))) static
+
+/// Static initializer of an `emt_metrics_t` flushing to the given sink.
+#define EMT_METRICS_INITIALIZER(out, lock, unlock, arg, interval_ns)                               \
+    {(out), (lock), (unlock), (arg), (interval_ns), 0}
+/// Static initializer of an `emt_metrics_t` flushing to stdout.
+#define EMT_METRICS_STDOUT_INITIALIZER(interval_ns)                                                \
+    EMT_METRICS_INITIALIZER(emt_file_out, emt_file_lock, emt_file_unlock, NULL, interval_ns)
+
+static inline void emt_metrics_init(
+    emt_metrics_t* metrics, emt_sink_fn_t out, emt_sink_fn_t lock, emt_sink_fn_t unlock, void* arg,
+    uint64_t interval_ns
+) {
+    memset(metrics, 0, sizeof(*metrics));
+    metrics->out = out;
+    metrics->lock = lock;
+    metrics->unlock = unlock;
+    metrics->arg = arg;
+    metrics->interval_ns = interval_ns;
+}
+
+static inline uint64_t emt_metrics_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t) now.tv_sec * 1000000000U) + (uint64_t) now.tv_nsec;
+}
+
+/// Index of the shard the calling thread updates.
+static inline unsigned emt_metric_shard(void) {
+    static EMT_METRIC_THREAD_LOCAL unsigned shard = 0;
+    static unsigned next_shard = 0;
+    if (shard == 0)
+        shard = __atomic_add_fetch(&next_shard, 1, __ATOMIC_RELAXED);
+    return shard % EMT_METRIC_SHARDS;
+}
+
+/// Index of the histogram bucket `value` falls into.
+static inline unsigned emt_histogram_bucket(uint64_t value) {
+    if (value < (1U << EMT_HISTOGRAM_SUB_BITS))
+        return (unsigned) value;
+    unsigned shift = 63U - (unsigned) __builtin_clzll(value) - EMT_HISTOGRAM_SUB_BITS;
+    return ((shift + 1U) << EMT_HISTOGRAM_SUB_BITS) +
+           (unsigned) ((value >> shift) - (1U << EMT_HISTOGRAM_SUB_BITS));
+}
+
+/// Claim the registration of `metric`; only the first caller gets true.
+static inline int emt_metric_claim(emt_metric_t* metric, uint8_t kind) {
+    uint8_t expected = EMT_METRIC_UNREGISTERED;
+    if (!__atomic_compare_exchange_n(
+            &metric->state, &expected, EMT_METRIC_REGISTERING, 0, __ATOMIC_ACQ_REL,
+            __ATOMIC_ACQUIRE
+        ))
+        return 0;
+    metric->kind = kind;
+    return 1;
+}
+
+/// Let `metrics` flush a claimed `metric` whose `info_ptr` has been captured.
+static inline void emt_metric_register(emt_metrics_t* metrics, emt_metric_t* metric) {
+    metric->owner = metrics;
+    __atomic_store_n(&metric->state, EMT_METRIC_REGISTERED, __ATOMIC_RELEASE);
+}
+
+static inline void emt_counter_add(emt_counter_t* counter, uint64_t delta) {
+    __atomic_fetch_add(&counter->shards[emt_metric_shard()].value, delta, __ATOMIC_RELAXED);
+}
+
+static inline void emt_histogram_lock(emt_histogram_shard_t* shard) {
+    while (__atomic_exchange_n(&shard->locked, 1, __ATOMIC_ACQUIRE))
+        ;
+}
+
+static inline void emt_histogram_unlock(emt_histogram_shard_t* shard) {
+    __atomic_store_n(&shard->locked, 0, __ATOMIC_RELEASE);
+}
+
+static inline void emt_histogram_record(emt_histogram_t* histogram, uint64_t value) {
+    emt_histogram_shard_t* shard = &histogram->shards[emt_metric_shard()];
+    const unsigned bucket = emt_histogram_bucket(value);
+    emt_histogram_lock(shard);
+    if (shard->count == 0 || value < shard->min)
+        shard->min = value;
+    if (shard->count == 0 || value > shard->max)
+        shard->max = value;
+    shard->count++;
+    shard->sum += value;
+    shard->buckets[bucket]++;
+    emt_histogram_unlock(shard);
+}
+
+static inline void emt_counter_flush(emt_metrics_t* metrics, emt_counter_t* counter, uint64_t now) {
+    uint64_t value = 0;
+    for (unsigned i = 0; i < EMT_METRIC_SHARDS; i++)
+        value += __atomic_exchange_n(&counter->shards[i].value, 0, __ATOMIC_RELAXED);
+
+    const uint8_t kind = EMT_METRIC_COUNTER;
+    const emt_size_t size = sizeof(emt_ptr_t) + sizeof(kind) + 2 * sizeof(uint64_t);
+    const emt_ptr_t* info_ptr = &counter->metric.info_ptr;
+    metrics->lock(info_ptr, size, metrics->arg);
+    metrics->out(info_ptr, sizeof(*info_ptr), metrics->arg);
+    metrics->out(&kind, sizeof(kind), metrics->arg);
+    metrics->out(&now, sizeof(now), metrics->arg);
+    metrics->out(&value, sizeof(value), metrics->arg);
+    metrics->unlock(info_ptr, size, metrics->arg);
+}
+
+static inline void emt_histogram_flush(
+    emt_metrics_t* metrics, emt_histogram_t* histogram, uint64_t now
+) {
+    uint64_t totals[4] = {0, 0, 0, 0}; // count, sum, min, max
+    uint64_t buckets[EMT_HISTOGRAM_BUCKETS];
+    uint64_t shard_buckets[EMT_HISTOGRAM_BUCKETS];
+    memset(buckets, 0, sizeof(buckets));
+    for (unsigned i = 0; i < EMT_METRIC_SHARDS; i++) {
+        emt_histogram_shard_t* shard = &histogram->shards[i];
+        if (__atomic_load_n(&shard->count, __ATOMIC_RELAXED) == 0)
+            continue;
+        // a snapshot of the whole shard, so that no value is counted in part
+        emt_histogram_lock(shard);
+        const uint64_t count = shard->count;
+        const uint64_t sum = shard->sum;
+        const uint64_t min = shard->min;
+        const uint64_t max = shard->max;
+        memcpy(shard_buckets, shard->buckets, sizeof(shard_buckets));
+        shard->count = 0;
+        shard->sum = 0;
+        memset(shard->buckets, 0, sizeof(shard->buckets));
+        emt_histogram_unlock(shard);
+
+        if (count == 0)
+            continue;
+        totals[2] = totals[0] == 0 || min < totals[2] ? min : totals[2];
+        totals[3] = totals[0] == 0 || max > totals[3] ? max : totals[3];
+        totals[0] += count;
+        totals[1] += sum;
+        for (unsigned b = 0; b < EMT_HISTOGRAM_BUCKETS; b++)
+            buckets[b] += shard_buckets[b];
+    }
+
+    emt_size_t used = 0;
+    for (unsigned b = 0; b < EMT_HISTOGRAM_BUCKETS; b++)
+        used += buckets[b] != 0;
+    const emt_size_t num_pairs = 2 * used;
+
+    const uint8_t kind = EMT_METRIC_HISTOGRAM;
+    const uint8_t sub_bits = EMT_HISTOGRAM_SUB_BITS;
+    const emt_size_t size = sizeof(emt_ptr_t) + sizeof(kind) + sizeof(now) + sizeof(totals) +
+                            sizeof(sub_bits) + sizeof(num_pairs) +
+                            (emt_size_t) (num_pairs * sizeof(uint64_t));
+    const emt_ptr_t* info_ptr = &histogram->metric.info_ptr;
+    metrics->lock(info_ptr, size, metrics->arg);
+    metrics->out(info_ptr, sizeof(*info_ptr), metrics->arg);
+    metrics->out(&kind, sizeof(kind), metrics->arg);
+    metrics->out(&now, sizeof(now), metrics->arg);
+    metrics->out(totals, sizeof(totals), metrics->arg);
+    metrics->out(&sub_bits, sizeof(sub_bits), metrics->arg);
+    metrics->out(&num_pairs, sizeof(num_pairs), metrics->arg);
+    for (unsigned b = 0; b < EMT_HISTOGRAM_BUCKETS; b++) {
+        if (buckets[b] == 0)
+            continue;
+        uint64_t pair[2] = {b, buckets[b]};
+        metrics->out(pair, sizeof(pair), metrics->arg);
+    }
+    metrics->unlock(info_ptr, size, metrics->arg);
+}
+
+/**
+ * Emit one record for every metric flushed by `metrics` that has been used, with what it aggregated
+ * since the last flush, and reset it. The records come in the order the linker placed the metrics'
+ * call sites in.
+ *
+ * Flushing concurrently with updates is fine; an update racing with the flush ends up in either
+ * this or the next interval, as a whole. Concurrent flushes don't lose data either, but split an
+ * interval.
+ */
+static inline void emt_metrics_flush(emt_metrics_t* metrics) {
+    uint64_t now = emt_metrics_now();
+    for (emt_metric_t* const* entry = __start_emtrace_metrics; entry < __stop_emtrace_metrics;
+         entry++) {
+        emt_metric_t* metric = *entry;
+        if (__atomic_load_n(&metric->state, __ATOMIC_ACQUIRE) != EMT_METRIC_REGISTERED ||
+            metric->owner != metrics)
+            continue;
+        if (metric->kind == EMT_METRIC_COUNTER)
+            emt_counter_flush(metrics, (emt_counter_t*) metric, now);
+        else
+            emt_histogram_flush(metrics, (emt_histogram_t*) metric, now);
+    }
+}
+
+/// Flush if at least `interval_ns` have passed since the last flush by this function; cheap enough
+/// to be called from an event loop. Of concurrent callers at most one flushes.
+static inline void emt_metrics_maybe_flush(emt_metrics_t* metrics) {
+    uint64_t now = emt_metrics_now();
+    uint64_t last = __atomic_load_n(&metrics->last_flush, __ATOMIC_RELAXED);
+    if (now - last < metrics->interval_ns)
+        return;
+    if (!__atomic_compare_exchange_n(
+            &metrics->last_flush, &last, now, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED
+        ))
+        return;
+    emt_metrics_flush(metrics);
+}
+
+// `out_fn`, `lock`, and `unlock` with which `EMT_TRACE_F` is used to create the format info of a
+// metric's record and to capture its address, without emitting anything.
+#define EMT_METRIC_DISCARD(data, size, metric) ((void) (data), (void) (size))
+#define EMT_METRIC_CAPTURE(data, size, metric)                                                     \
+    ((void) (size), (metric)->info_ptr = *(const emt_ptr_t*) (data))
+
+#define EMT_METRIC_INIT_OUT(data, size, metrics) (metrics)->out((data), (size), (metrics)->arg)
+
+/**
+ * Add `delta` to the counter `name` (a string literal) that is flushed by `metrics`.
+ */
+#define EMT_COUNTER(fmt_info_attributes, metrics, name, delta)                                     \
+    do {                                                                                           \
+        static emt_counter_t emt_counter;                                                          \
+        EMT_METRIC_SEC_ATTR emt_metric_t* const emt_metric_entry = &emt_counter.metric;            \
+        if (__atomic_load_n(&emt_counter.metric.state, __ATOMIC_ACQUIRE) !=                       \
+                EMT_METRIC_REGISTERED &&                                                           \
+            emt_metric_claim(&emt_counter.metric, EMT_METRIC_COUNTER)) {                           \
+            EMT_TRACE_F(                                                                           \
+                fmt_info_attributes, EMT_METRIC_FORMAT, EMT_METRIC_DISCARD, EMT_METRIC_CAPTURE,    \
+                EMT_METRIC_DISCARD, &emt_counter.metric, "", name, uint8_t, EMT_METRIC_COUNTER,    \
+                uint64_t, 0, uint64_t, 0                                                           \
+            );                                                                                     \
+            emt_metric_register((metrics), &emt_counter.metric);                                   \
+        }                                                                                          \
+        emt_counter_add(&emt_counter, (delta));                                                    \
+    } while (0)
+
+/**
+ * Record `value` in the histogram `name` (a string literal) that is flushed by `metrics`.
+ */
+#define EMT_HISTOGRAM(fmt_info_attributes, metrics, name, value)                                   \
+    do {                                                                                           \
+        static emt_histogram_t emt_histogram;                                                      \
+        EMT_METRIC_SEC_ATTR emt_metric_t* const emt_metric_entry = &emt_histogram.metric;          \
+        if (__atomic_load_n(&emt_histogram.metric.state, __ATOMIC_ACQUIRE) !=                     \
+                EMT_METRIC_REGISTERED &&                                                           \
+            emt_metric_claim(&emt_histogram.metric, EMT_METRIC_HISTOGRAM)) {                       \
+            EMT_TRACE_F(                                                                           \
+                fmt_info_attributes, EMT_METRIC_FORMAT, EMT_METRIC_DISCARD, EMT_METRIC_CAPTURE,    \
+                EMT_METRIC_DISCARD, &emt_histogram.metric, "", name, uint8_t,                      \
+                EMT_METRIC_HISTOGRAM, uint64_t, 0, uint64_t, 0, uint64_t, 0, uint64_t, 0,          \
+                uint64_t, 0, uint8_t, EMT_HISTOGRAM_SUB_BITS, EMT_SPAN(uint64_t, 0),               \
+                (const uint64_t*) NULL                                                             \
+            );                                                                                     \
+            emt_metric_register((metrics), &emt_histogram.metric);                                 \
+        }                                                                                          \
+        emt_histogram_record(&emt_histogram, (value));                                             \
+    } while (0)
+
+#if defined(EMT_DEFAULT_SEC_ATTR)
+
+#define EMTRACE_COUNTER(metrics, name, delta)                                                      \
+    EMT_COUNTER(EMT_DEFAULT_SEC_ATTR, metrics, name, delta)
+#define EMTRACE_HISTOGRAM(metrics, name, value)                                                    \
+    EMT_HISTOGRAM(EMT_DEFAULT_SEC_ATTR, metrics, name, value)
+#define EMTRACE_METRICS_INIT(metrics)                                                              \
+    EMT_INIT(EMT_DEFAULT_SEC_ATTR, EMT_METRIC_INIT_OUT, (metrics))
+
+#endif // EMT_DEFAULT_SEC_ATTR
+
+// NOLINTEND(modernize-use-using,modernize-avoid-c-arrays)
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EMTRACE_METRICS_H
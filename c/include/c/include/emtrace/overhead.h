@@ -0,0 +1,108 @@
+#ifndef EMTRACE_OVERHEAD_H
+#define EMTRACE_OVERHEAD_H
+
+#include "emtrace/emtrace.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+// NOLINTBEGIN(modernize-use-using,modernize-avoid-c-arrays)
+
+/**
+ * The overhead of tracing itself.
+ *
+ * Built with `EMT_OVERHEAD` defined (e.g. `-DEMT_OVERHEAD`, or the `EMTRACE_OVERHEAD` CMake
+ * option), every call site of `EMT_TRACE_F` (and so of `EMTRACE_F` et al.) counts its executions
+ * and the cycles it spent in `lock`, in `out_fn`, and in `unlock`, the most cycles a single
+ * execution took, and a histogram of the cycles spent in `lock`, which is where writers wait for
+ * each other. The statistics live in the writable `emtrace_overhead` section, so call sites need no
+ * registration, and `EMT_OVERHEAD_DUMP` emits one ordinary record per call site that has been
+ * executed, on demand. The record refers to the call site's format info (with the
+ * `EMT_OVERHEAD_FORMAT` formatter), so the decoder shows where and what the call site is.
+ *
+ * Cycles are read with `rdtsc` on x86, from the virtual counter on AArch64, and are nanoseconds
+ * elsewhere. Reading them adds a few cycles to every trace, which is why this is opt-in.
+ *
+ * Call sites in translation units built without `EMT_OVERHEAD` aren't measured; without any,
+ * `EMT_OVERHEAD_DUMP` emits nothing.
+ */
+
+#if defined(EMT_OVERHEAD)
+
+// defined by the linker for sections named like C identifiers; weak, in case there is none
+extern emt_overhead_t __start_emtrace_overhead[] __attribute__((weak, visibility("hidden")));
+extern emt_overhead_t __stop_emtrace_overhead[] __attribute__((weak, visibility("hidden")));
+
+/// Reset the statistics of all call sites. Executions racing with the reset may be counted in part.
+static inline void emt_overhead_reset(void) {
+    for (emt_overhead_t* site = __start_emtrace_overhead; site < __stop_emtrace_overhead; site++) {
+        __atomic_store_n(&site->count, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&site->lock_cycles, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&site->out_cycles, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&site->unlock_cycles, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&site->max_cycles, 0, __ATOMIC_RELAXED);
+        for (unsigned i = 0; i < EMT_OVERHEAD_BUCKETS; i++)
+            __atomic_store_n(&site->lock_wait[i], 0, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * Emit a record with the statistics of every call site that has been executed, through the given
+ * sink (like `EMT_TRACE_F`). The statistics are read with relaxed loads while other threads may
+ * keep tracing, so they needn't add up exactly.
+ */
+#define EMT_OVERHEAD_DUMP(fmt_info_attributes, out_fn, lock, unlock, extra_arg)                    \
+    do {                                                                                           \
+        for (emt_overhead_t* emt_site = __start_emtrace_overhead;                                  \
+             emt_site < __stop_emtrace_overhead; emt_site++) {                                     \
+            const uint64_t emt_count = __atomic_load_n(&emt_site->count, __ATOMIC_RELAXED);        \
+            if (emt_count == 0)                                                                    \
+                continue;                                                                          \
+            uint64_t emt_lock_wait[EMT_OVERHEAD_BUCKETS];                                          \
+            for (unsigned emt_i = 0; emt_i < EMT_OVERHEAD_BUCKETS; emt_i++)                        \
+                emt_lock_wait[emt_i] =                                                             \
+                    __atomic_load_n(&emt_site->lock_wait[emt_i], __ATOMIC_RELAXED);                \
+            EMT_TRACE_F(                                                                           \
+                fmt_info_attributes, EMT_OVERHEAD_FORMAT, out_fn, lock, unlock, extra_arg, "\n",   \
+                "{}: {} calls, {} cycles in lock, {} in out_fn, {} in unlock, at most {} per "     \
+                "call, lock wait by log2(cycles): {}",                                             \
+                uint64_t,                                                                          \
+                (uint64_t) (emt_ptr_t) ((uintptr_t) emt_site->info >> EMT_ALIGNMENT_POWER),        \
+                uint64_t, emt_count, uint64_t,                                                     \
+                __atomic_load_n(&emt_site->lock_cycles, __ATOMIC_RELAXED), uint64_t,               \
+                __atomic_load_n(&emt_site->out_cycles, __ATOMIC_RELAXED), uint64_t,                \
+                __atomic_load_n(&emt_site->unlock_cycles, __ATOMIC_RELAXED), uint64_t,             \
+                __atomic_load_n(&emt_site->max_cycles, __ATOMIC_RELAXED),                          \
+                EMT_ARRAY(uint64_t, EMT_OVERHEAD_BUCKETS), emt_lock_wait                           \
+            );                                                                                     \
+        }                                                                                          \
+    } while (0)
+
+#if defined(EMT_DEFAULT_SEC_ATTR) && defined(EMT_FLOCK_FILE) && defined(EMT_FUNLOCK_FILE)
+#define EMTRACE_OVERHEAD_DUMP()                                                                    \
+    EMT_OVERHEAD_DUMP(                                                                             \
+        EMT_DEFAULT_SEC_ATTR, EMT_DEFAULT_OUT, EMT_FLOCK_FILE, EMT_FUNLOCK_FILE, EMT_DEFAULT_SINK  \
+    )
+#endif
+
+#else
+
+static inline void emt_overhead_reset(void) {}
+
+#define EMT_OVERHEAD_DUMP(fmt_info_attributes, out_fn, lock, unlock, extra_arg)                    \
+    do {                                                                                           \
+    } while (0)
+#define EMTRACE_OVERHEAD_DUMP()                                                                    \
+    do {                                                                                           \
+    } while (0)
+
+#endif // EMT_OVERHEAD
+
+// NOLINTEND(modernize-use-using,modernize-avoid-c-arrays)
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EMTRACE_OVERHEAD_H
@@ -0,0 +1,699 @@
+#ifndef EMTRACE_PERCPU_H
+#define EMTRACE_PERCPU_H
+
+#include "emtrace/drain.h"
+#include "emtrace/emtrace.h"
+#include "emtrace/memory.h"
+#include "emtrace/stage.h"
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#if !defined(EMT_PERCPU_NO_RSEQ) && defined(__linux__) && defined(__x86_64__) &&                   \
+    defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 35))
+#define EMT_PERCPU_RSEQ 1
+#include <sys/rseq.h>
+#else
+#define EMT_PERCPU_RSEQ 0
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+// NOLINTBEGIN(modernize-use-using,modernize-avoid-c-arrays)
+
+/**
+ * Per-CPU sharded buffers.
+ *
+ * Records are assembled on the caller's stack (like with `sigsafe.h`) and then appended to a ring
+ * buffer belonging to the CPU the caller runs on, so memory scales with the number of CPUs rather
+ * than the number of threads. Space in the ring is reserved with a restartable sequence (Linux
+ * `rseq`, as registered by glibc >= 2.35, on x86_64): a store to the CPU's head that the kernel
+ * aborts if the thread is preempted or migrated, so appending takes no locks and no atomic
+ * read-modify-write operations. Elsewhere the head is advanced with a compare-and-swap on the
+ * shard `sched_getcpu` names. The record is then copied into the reserved space, which is private
+ * to the writer even if it migrates meanwhile, and published by storing its header last.
+ *
+ * Each record is preceded by an 8-byte header: a word of its length and its thread's slot, which is
+ * stored last, and a 32-bit sequence number counting the records of its thread. Sequence numbers
+ * are compared modulo 2^32, so a thread may have up to 2^31 - 1 records pending (written or
+ * discarded, but not yet drained) at once. `emt_percpu_drain` passes the records on to a
+ * wrapped sink, holding back those whose predecessors from the same thread (written on another
+ * CPU) haven't been drained yet, so every thread's records keep their order. Slots are handed out
+ * on a thread's first record and returned once the drainer has seen its last one.
+ *
+ * What happens to records that don't fit into their CPU's ring is up to `backpressure`: by default
+ * they are dropped, or the writer waits, or it discards the oldest records in the ring. Either way,
+ * records that are lost are counted in `dropped`. There must be a single drainer, e.g. the drain
+ * engine from `drain.h` (see `emt_percpu_drain_source`) or a thread calling `emt_percpu_drain`
+ * periodically, or one per NUMA node calling `emt_percpu_drain_node`, if the wrapped sink's `lock`
+ * and `unlock` serialize them.
+ *
+ * The rings are mapped with `emt_mem_map`, so they can be backed by huge pages and locked into
+ * memory. With `EMT_MEM_NUMA`, each CPU's ring is placed on the CPU's node, which takes rings of a
+ * whole number of pages (2 MiB with huge pages).
+ */
+
+#ifndef EMT_PERCPU_CAPACITY
+#define EMT_PERCPU_CAPACITY 512
+#endif
+
+#ifndef EMT_PERCPU_MAX_THREADS
+#define EMT_PERCPU_MAX_THREADS 65536
+#endif
+
+#define EMT_PERCPU_HEADER_SIZE 8
+
+/// Pass to `emt_percpu_drain_node` to drain the rings of all nodes.
+#define EMT_PERCPU_ALL_NODES UINT32_MAX
+
+EMT_STATIC_ASSERT(
+    EMT_PERCPU_CAPACITY + EMT_PERCPU_HEADER_SIZE <= 0xffff, "records must fit a 16-bit length"
+);
+EMT_STATIC_ASSERT(EMT_PERCPU_MAX_THREADS <= 0x10000, "thread slots must fit 16 bits");
+
+typedef struct {
+    uint64_t head; ///< bytes ever reserved by writers
+    uint8_t pad0[56];
+    uint64_t tail;      ///< bytes ever drained
+    uint32_t consuming; ///< lock of `tail` with `EMT_BACKPRESSURE_OVERWRITE_OLDEST`
+    uint8_t pad1[52];
+} emt_percpu_shard_t;
+
+typedef struct {
+    emt_sink_fn_t out;    ///< wrapped sink's `out_fn`
+    emt_sink_fn_t lock;   ///< wrapped sink's `lock`
+    emt_sink_fn_t unlock; ///< wrapped sink's `unlock`
+    void* arg;            ///< wrapped sink's `extra_arg`
+
+    emt_percpu_shard_t* shards; ///< one per CPU
+    uint8_t* data;              ///< the rings, `mask + 1` bytes each
+    uint32_t num_cpus;
+    uint64_t mask;
+    int use_rseq;      ///< whether the heads are advanced by restartable sequences
+    int mem_flags;     ///< `EMT_MEM_*` flags that were applied to the rings
+    uint16_t* cpu_node; ///< per CPU, its NUMA node
+    uint32_t num_nodes;
+    uint64_t dropped;  ///< records that didn't fit into their ring (atomic)
+    int backpressure;  ///< `EMT_BACKPRESSURE_*`, set after opening and before tracing
+    void (*on_full)(void* arg); ///< called with `arg` while waiting for room, e.g. `emt_drain_wake`
+    uint32_t* discarded; ///< per slot, discarded records the drainer hasn't skipped yet (atomic)
+    uint64_t* slots;   ///< bitmap of the thread slots in use (atomic)
+    uint32_t* next_seq; ///< per slot, the sequence number the drainer expects next
+    pthread_key_t key;
+} emt_percpu_t;
+
+/// Per-thread writer state. Lives on the heap and is owned by the thread it belongs to.
+typedef struct {
+    emt_percpu_t* percpu;
+    uint32_t slot;
+    uint32_t seq;
+} emt_percpu_thread_t;
+
+/// A record being assembled; lives on the stack of the tracing call.
+typedef struct {
+    emt_percpu_t* sink;
+    emt_stage_t stage;
+    uint8_t data[EMT_PERCPU_CAPACITY];
+} emt_percpu_record_t;
+
+#if EMT_PERCPU_RSEQ
+
+static inline struct rseq* emt_percpu_rseq_area(void) {
+    char* thread_pointer;
+    __asm__("movq %%fs:0, %0" : "=r"(thread_pointer));
+    return (struct rseq*) (thread_pointer + __rseq_offset);
+}
+
+/**
+ * `*v = newv` if the thread is still on `cpu` and `*v == expect`, as a restartable sequence.
+ *
+ * @return 0 if stored, 1 if `*v` changed, -1 if the sequence was aborted or the thread isn't on
+ * `cpu`.
+ */
+static inline int emt_percpu_rseq_cmpeqv_storev(
+    struct rseq* rseq, uint32_t cpu, uint64_t* v, uint64_t expect, uint64_t newv
+) {
+    __asm__ goto(
+        ".pushsection __rseq_cs, \"aw\"\n\t"
+        ".balign 32\n\t"
+        "3:\n\t"
+        ".long 0x0, 0x0\n\t"
+        ".quad 1f, (2f - 1f), 4f\n\t"
+        ".popsection\n\t"
+        "leaq 3b(%%rip), %%rax\n\t"
+        "movq %%rax, %[rseq_cs]\n\t"
+        "1:\n\t"
+        "cmpl %[cpu], %[current_cpu]\n\t"
+        "jnz %l[aborted]\n\t"
+        "cmpq %[v], %[expect]\n\t"
+        "jnz %l[changed]\n\t"
+        "movq %[newv], %[v]\n\t"
+        "2:\n\t"
+        ".pushsection __rseq_failure, \"ax\"\n\t"
+        ".long 0x53053053\n\t" // RSEQ_SIG
+        "4:\n\t"
+        "jmp %l[aborted]\n\t"
+        ".popsection\n\t"
+        :
+        : [cpu] "r"(cpu), [current_cpu] "m"(rseq->cpu_id), [rseq_cs] "m"(rseq->rseq_cs),
+          [v] "m"(*v), [expect] "r"(expect), [newv] "r"(newv)
+        : "memory", "cc", "rax"
+        : aborted, changed
+    );
+    return 0;
+aborted:
+    return -1;
+changed:
+    return 1;
+}
+
+#endif // EMT_PERCPU_RSEQ
+
+static inline uint64_t emt_percpu_padded(uint64_t size) {
+    return (size + EMT_PERCPU_HEADER_SIZE - 1) & ~(uint64_t) (EMT_PERCPU_HEADER_SIZE - 1);
+}
+
+/**
+ * Reserve `size` bytes (a multiple of the header size) in the ring of the calling thread's CPU.
+ *
+ * @return 0 on success with the ring in `*cpu` and the position in `*pos`, -1 if it is full (with
+ * the ring in `*cpu`).
+ */
+static inline int
+emt_percpu_reserve(emt_percpu_t* percpu, uint64_t size, uint32_t* cpu, uint64_t* pos) {
+#if EMT_PERCPU_RSEQ
+    if (percpu->use_rseq) {
+        struct rseq* rseq = emt_percpu_rseq_area();
+        for (;;) {
+            uint32_t current = __atomic_load_n(&rseq->cpu_id_start, __ATOMIC_RELAXED);
+            *cpu = current % percpu->num_cpus;
+            if (current >= percpu->num_cpus)
+                return -1;
+            emt_percpu_shard_t* shard = &percpu->shards[current];
+            uint64_t head = __atomic_load_n(&shard->head, __ATOMIC_RELAXED);
+            uint64_t tail = __atomic_load_n(&shard->tail, __ATOMIC_ACQUIRE);
+            if (head + size - tail > percpu->mask + 1)
+                return -1;
+            if (emt_percpu_rseq_cmpeqv_storev(rseq, current, &shard->head, head, head + size) ==
+                0) {
+                *cpu = current;
+                *pos = head;
+                return 0;
+            }
+        }
+    }
+#endif
+#if defined(_GNU_SOURCE)
+    int current = sched_getcpu();
+#else
+    unsigned current = 0;
+    if (syscall(SYS_getcpu, &current, NULL, NULL) != 0)
+        current = 0;
+#endif
+    *cpu = (int) current < 0 ? 0 : (uint32_t) current % percpu->num_cpus;
+    emt_percpu_shard_t* shard = &percpu->shards[*cpu];
+    uint64_t head = __atomic_load_n(&shard->head, __ATOMIC_RELAXED);
+    do {
+        if (head + size - __atomic_load_n(&shard->tail, __ATOMIC_ACQUIRE) > percpu->mask + 1)
+            return -1;
+    } while (!__atomic_compare_exchange_n(
+        &shard->head, &head, head + size, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED
+    ));
+    *pos = head;
+    return 0;
+}
+
+/// Take the lock of a shard's tail, which writers discarding records share with the drainer.
+static inline void emt_percpu_lock_tail(emt_percpu_t* percpu, emt_percpu_shard_t* shard) {
+    if (percpu->backpressure != EMT_BACKPRESSURE_OVERWRITE_OLDEST)
+        return;
+    while (__atomic_exchange_n(&shard->consuming, 1, __ATOMIC_ACQUIRE) != 0)
+        (void) sched_yield();
+}
+
+static inline void emt_percpu_unlock_tail(emt_percpu_t* percpu, emt_percpu_shard_t* shard) {
+    if (percpu->backpressure == EMT_BACKPRESSURE_OVERWRITE_OLDEST)
+        __atomic_store_n(&shard->consuming, 0, __ATOMIC_RELEASE);
+}
+
+/// Free the `padded` bytes of the record at `tail`; returns the new tail.
+static inline uint64_t emt_percpu_consume(
+    emt_percpu_t* percpu, emt_percpu_shard_t* shard, uint8_t* ring, uint64_t tail, uint64_t padded
+) {
+    // writers rely on unwritten headers reading as 0
+    uint64_t size = percpu->mask + 1;
+    uint64_t offset = tail & percpu->mask;
+    uint64_t before_end = size - offset < padded ? size - offset : padded;
+    memset(ring + offset, 0, (size_t) before_end);
+    memset(ring, 0, (size_t) (padded - before_end));
+    tail += padded;
+    __atomic_store_n(&shard->tail, tail, __ATOMIC_RELEASE);
+    return tail;
+}
+
+/**
+ * Discard the oldest records in the ring of `cpu` until there is room for `size` more bytes. Stops
+ * at records that haven't been written completely, and at the ends of threads.
+ *
+ * @return 0 if there is room now, -1 if not.
+ */
+static inline int emt_percpu_discard(emt_percpu_t* percpu, uint32_t cpu, uint64_t size) {
+    emt_percpu_shard_t* shard = &percpu->shards[cpu];
+    uint8_t* ring = percpu->data + ((size_t) cpu * (percpu->mask + 1));
+    emt_percpu_lock_tail(percpu, shard);
+    uint64_t tail = shard->tail;
+    uint64_t head = __atomic_load_n(&shard->head, __ATOMIC_ACQUIRE);
+    while (tail < head && head + size - tail > percpu->mask + 1) {
+        uint32_t header =
+            __atomic_load_n((uint32_t*) (ring + (tail & percpu->mask)), __ATOMIC_ACQUIRE);
+        uint64_t length = (header & 0xffff) - EMT_PERCPU_HEADER_SIZE;
+        if (header == 0 || length == 0)
+            break;
+        uint32_t slot = header >> 16;
+        // so the drainer doesn't wait for it
+        __atomic_fetch_add(&percpu->discarded[slot], 1, __ATOMIC_RELEASE);
+        __atomic_fetch_add(&percpu->dropped, 1, __ATOMIC_RELAXED);
+        tail = emt_percpu_consume(
+            percpu, shard, ring, tail, emt_percpu_padded(EMT_PERCPU_HEADER_SIZE + length)
+        );
+    }
+    int result = head + size - tail <= percpu->mask + 1 ? 0 : -1;
+    emt_percpu_unlock_tail(percpu, shard);
+    return result;
+}
+
+/// Wait a little longer on every `attempt` for the drainer to make room.
+static inline void emt_percpu_backoff(emt_percpu_t* percpu, unsigned attempt) {
+    if (percpu->on_full != NULL)
+        percpu->on_full(percpu->arg);
+    if (attempt < 64) {
+        (void) sched_yield();
+    } else {
+        struct timespec pause = {0, 50000};
+        (void) nanosleep(&pause, NULL);
+    }
+}
+
+/// Append a record (empty ones mark the end of a thread) to the ring of the calling thread's CPU.
+static inline int
+emt_percpu_append(emt_percpu_thread_t* thread, const uint8_t* data, emt_size_t size) {
+    emt_percpu_t* percpu = thread->percpu;
+    uint64_t padded = emt_percpu_padded(EMT_PERCPU_HEADER_SIZE + size);
+    uint32_t cpu = 0;
+    uint64_t pos = 0;
+    for (unsigned attempt = 0; emt_percpu_reserve(percpu, padded, &cpu, &pos) != 0; attempt++) {
+        if (padded > percpu->mask + 1) {
+            // never fits
+        } else if (percpu->backpressure == EMT_BACKPRESSURE_BLOCK ||
+                   (size == 0 && attempt < 256)) {
+            // the end of a thread is worth waiting for a while, or its slot would be lost
+            emt_percpu_backoff(percpu, attempt);
+            continue;
+        } else if (percpu->backpressure == EMT_BACKPRESSURE_OVERWRITE_OLDEST &&
+                   emt_percpu_discard(percpu, cpu, padded) == 0) {
+            continue;
+        }
+        __atomic_fetch_add(&percpu->dropped, 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+    uint8_t* ring = percpu->data + ((size_t) cpu * (percpu->mask + 1));
+    uint64_t start = pos & percpu->mask;
+    memcpy(ring + start + 4, &thread->seq, sizeof(thread->seq));
+    start = (start + EMT_PERCPU_HEADER_SIZE) & percpu->mask;
+    uint64_t first = percpu->mask + 1 - start;
+    if (first >= size) {
+        memcpy(ring + start, data, size);
+    } else {
+        memcpy(ring + start, data, (size_t) first);
+        memcpy(ring, data + first, (size_t) (size - first));
+    }
+    uint32_t header = (uint32_t) (EMT_PERCPU_HEADER_SIZE + size) | (thread->slot << 16);
+    __atomic_store_n((uint32_t*) (ring + (pos & percpu->mask)), header, __ATOMIC_RELEASE);
+    thread->seq++;
+    return 0;
+}
+
+static inline void emt_percpu_thread_destroy(void* arg) {
+    emt_percpu_thread_t* thread = (emt_percpu_thread_t*) arg;
+    // the slot is returned by the drainer once it has seen this
+    (void) emt_percpu_append(thread, NULL, 0);
+    free(thread);
+}
+
+static inline emt_percpu_thread_t* emt_percpu_thread(emt_percpu_t* percpu) {
+    emt_percpu_thread_t* thread = (emt_percpu_thread_t*) pthread_getspecific(percpu->key);
+    if (thread != NULL)
+        return thread;
+
+    for (uint32_t word = 0; word < EMT_PERCPU_MAX_THREADS / 64; word++) {
+        uint64_t bits = __atomic_load_n(&percpu->slots[word], __ATOMIC_RELAXED);
+        while (bits != UINT64_MAX) {
+            uint64_t bit = ~bits & (bits + 1);
+            if (!__atomic_compare_exchange_n(
+                    &percpu->slots[word], &bits, bits | bit, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED
+                ))
+                continue;
+            thread = (emt_percpu_thread_t*) malloc(sizeof(emt_percpu_thread_t));
+            if (thread == NULL) {
+                __atomic_fetch_and(&percpu->slots[word], ~bit, __ATOMIC_RELEASE);
+                return NULL;
+            }
+            thread->percpu = percpu;
+            thread->slot = (word * 64) + (uint32_t) __builtin_ctzll(bit);
+            thread->seq = 0;
+            (void) pthread_setspecific(percpu->key, thread);
+            return thread;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Set up per-CPU rings of `ring_size` bytes each, draining into the given sink.
+ *
+ * @param mem_flags `EMT_MEM_*` flags for the rings; see `mem_flags` for the ones that were applied.
+ * @return 0 on success, -1 on failure with `errno` set.
+ */
+static inline int emt_percpu_open_flags(
+    emt_percpu_t* percpu, uint64_t ring_size, int mem_flags, emt_sink_fn_t out, emt_sink_fn_t lock,
+    emt_sink_fn_t unlock, void* arg
+) {
+    if (ring_size < EMT_PERCPU_HEADER_SIZE || (ring_size & (ring_size - 1)) != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    long num_cpus = sysconf(_SC_NPROCESSORS_CONF);
+    percpu->num_cpus = num_cpus < 1 ? 1 : (uint32_t) num_cpus;
+    percpu->out = out;
+    percpu->lock = lock;
+    percpu->unlock = unlock;
+    percpu->arg = arg;
+    percpu->mask = ring_size - 1;
+    percpu->dropped = 0;
+    percpu->backpressure = EMT_BACKPRESSURE_DROP_NEWEST;
+    percpu->on_full = NULL;
+    percpu->mem_flags = mem_flags;
+    percpu->shards = (emt_percpu_shard_t*) calloc(percpu->num_cpus, sizeof(emt_percpu_shard_t));
+    percpu->data = (uint8_t*) emt_mem_map(percpu->num_cpus * ring_size, &percpu->mem_flags);
+    percpu->slots = (uint64_t*) calloc(EMT_PERCPU_MAX_THREADS / 64, sizeof(uint64_t));
+    percpu->next_seq = (uint32_t*) calloc(EMT_PERCPU_MAX_THREADS, sizeof(uint32_t));
+    percpu->cpu_node = (uint16_t*) calloc(percpu->num_cpus, sizeof(uint16_t));
+    percpu->discarded = (uint32_t*) calloc(EMT_PERCPU_MAX_THREADS, sizeof(uint32_t));
+    if (percpu->shards == NULL || percpu->data == NULL || percpu->slots == NULL ||
+        percpu->next_seq == NULL || percpu->cpu_node == NULL || percpu->discarded == NULL ||
+        pthread_key_create(&percpu->key, emt_percpu_thread_destroy)) {
+        free(percpu->shards);
+        emt_mem_unmap(percpu->data, percpu->num_cpus * ring_size, percpu->mem_flags);
+        free(percpu->slots);
+        free(percpu->next_seq);
+        free(percpu->cpu_node);
+        free(percpu->discarded);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    percpu->num_nodes = emt_mem_cpu_nodes(percpu->cpu_node, percpu->num_cpus);
+    if (percpu->mem_flags & EMT_MEM_NUMA) {
+        // pages can only be bound as a whole
+        int bound = ring_size % emt_mem_page_size(percpu->mem_flags) == 0;
+        for (uint32_t cpu = 0; bound && cpu < percpu->num_cpus; cpu++) {
+            bound = emt_mem_bind(
+                        percpu->data + ((size_t) cpu * ring_size), ring_size, percpu->cpu_node[cpu]
+                    ) == 0;
+        }
+        if (!bound)
+            percpu->mem_flags &= ~EMT_MEM_NUMA;
+    }
+    if ((percpu->mem_flags & EMT_MEM_MLOCK) &&
+        emt_mem_lock(percpu->data, percpu->num_cpus * ring_size, percpu->mem_flags) != 0)
+        percpu->mem_flags &= ~EMT_MEM_MLOCK;
+
+    percpu->use_rseq = 0;
+#if EMT_PERCPU_RSEQ
+    // glibc registers every thread or none
+    percpu->use_rseq = __rseq_size > 0 && (int32_t) emt_percpu_rseq_area()->cpu_id >= 0;
+#endif
+    return 0;
+}
+
+/// `emt_percpu_open_flags` without any `EMT_MEM_*` flags.
+static inline int emt_percpu_open(
+    emt_percpu_t* percpu, uint64_t ring_size, emt_sink_fn_t out, emt_sink_fn_t lock,
+    emt_sink_fn_t unlock, void* arg
+) {
+    return emt_percpu_open_flags(percpu, ring_size, 0, out, lock, unlock, arg);
+}
+
+/// Free the rings. Drain them first; records still in them are lost.
+static inline void emt_percpu_close(emt_percpu_t* percpu) {
+    emt_percpu_thread_t* thread = (emt_percpu_thread_t*) pthread_getspecific(percpu->key);
+    free(thread);
+    (void) pthread_setspecific(percpu->key, NULL);
+    (void) pthread_key_delete(percpu->key);
+    free(percpu->shards);
+    emt_mem_unmap(percpu->data, percpu->num_cpus * (percpu->mask + 1), percpu->mem_flags);
+    free(percpu->slots);
+    free(percpu->next_seq);
+    free(percpu->cpu_node);
+    free(percpu->discarded);
+    percpu->shards = NULL;
+    percpu->data = NULL;
+}
+
+/// Number of records dropped so far.
+static inline uint64_t emt_percpu_dropped(emt_percpu_t* percpu) {
+    return __atomic_load_n(&percpu->dropped, __ATOMIC_RELAXED);
+}
+
+/// What `emt_percpu_drain_one` did.
+typedef enum {
+    EMT_PERCPU_STALLED, ///< nothing, the ring is empty or its oldest record has to wait
+    EMT_PERCPU_PASSED,  ///< passed a record on
+    EMT_PERCPU_SKIPPED, ///< freed the slot of a thread that ended, or skipped a discarded record
+} emt_percpu_progress_t;
+
+/**
+ * Move the sequence number of `slot` from `seq` on to the next record. Returns 0 if another drainer
+ * got there first, by skipping a discarded record in place of the one at `seq`.
+ */
+static inline int emt_percpu_advance(emt_percpu_t* percpu, uint32_t slot, uint32_t seq) {
+    return __atomic_compare_exchange_n(
+        &percpu->next_seq[slot], &seq, seq + 1, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED
+    );
+}
+
+/// Pass a record on to the sink; it wraps around after `first` bytes, to `wrapped`.
+static inline void emt_percpu_pass(
+    emt_percpu_t* percpu, const uint8_t* data, uint64_t first, const uint8_t* wrapped,
+    uint64_t length
+) {
+    percpu->lock(data, (emt_size_t) length, percpu->arg);
+    percpu->out(data, (emt_size_t) first, percpu->arg);
+    if (first < length)
+        percpu->out(wrapped, (emt_size_t) (length - first), percpu->arg);
+    percpu->unlock(data, (emt_size_t) length, percpu->arg);
+}
+
+/// Pass on the oldest record in the ring of `cpu`, if it is its thread's turn.
+static inline emt_percpu_progress_t emt_percpu_drain_one(emt_percpu_t* percpu, uint32_t cpu) {
+    uint64_t size = percpu->mask + 1;
+    emt_percpu_shard_t* shard = &percpu->shards[cpu];
+    uint8_t* ring = percpu->data + ((size_t) cpu * size);
+    emt_percpu_lock_tail(percpu, shard);
+    uint64_t tail = shard->tail;
+    uint32_t header = 0;
+    if (tail != __atomic_load_n(&shard->head, __ATOMIC_ACQUIRE))
+        header = __atomic_load_n((uint32_t*) (ring + (tail & percpu->mask)), __ATOMIC_ACQUIRE);
+    if (header == 0) {
+        // empty, or reserved but not written yet
+        emt_percpu_unlock_tail(percpu, shard);
+        return EMT_PERCPU_STALLED;
+    }
+
+    uint32_t slot = header >> 16;
+    uint32_t record_seq;
+    memcpy(&record_seq, ring + (tail & percpu->mask) + 4, sizeof(record_seq));
+    // the sequence number is advanced by whichever drainer holds the thread's next record, so
+    // drainers of different nodes hand it over with release and acquire
+    uint32_t seq = __atomic_load_n(&percpu->next_seq[slot], __ATOMIC_ACQUIRE);
+    int32_t ahead = (int32_t) (record_seq - seq);
+    if (ahead > 0) {
+        // an earlier record of the thread is still in another ring, or it was discarded; drainers
+        // of other nodes may race for the same discarded record, so only one of them takes it
+        emt_percpu_unlock_tail(percpu, shard);
+        uint32_t discarded = __atomic_load_n(&percpu->discarded[slot], __ATOMIC_ACQUIRE);
+        do {
+            if (discarded == 0)
+                return EMT_PERCPU_STALLED;
+        } while (!__atomic_compare_exchange_n(
+            &percpu->discarded[slot], &discarded, discarded - 1, 1, __ATOMIC_ACQUIRE,
+            __ATOMIC_ACQUIRE
+        ));
+        if (!emt_percpu_advance(percpu, slot, seq))
+            __atomic_fetch_add(&percpu->discarded[slot], 1, __ATOMIC_RELAXED);
+        return EMT_PERCPU_SKIPPED;
+    }
+    if (ahead < 0) {
+        // this one was skipped in place of a discarded one while it was still in another ring; it
+        // is passed on late, and the discarded one still needs skipping
+        __atomic_fetch_add(&percpu->discarded[slot], 1, __ATOMIC_RELAXED);
+    }
+
+    uint64_t length = (header & 0xffff) - EMT_PERCPU_HEADER_SIZE;
+    uint64_t padded = emt_percpu_padded(EMT_PERCPU_HEADER_SIZE + length);
+    if (length == 0) {
+        // end of the thread
+        __atomic_store_n(&percpu->next_seq[slot], 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&percpu->discarded[slot], 0, __ATOMIC_RELAXED);
+        __atomic_fetch_and(
+            &percpu->slots[slot / 64], ~((uint64_t) 1 << (slot % 64)), __ATOMIC_RELEASE
+        );
+        (void) emt_percpu_consume(percpu, shard, ring, tail, padded);
+        emt_percpu_unlock_tail(percpu, shard);
+        return EMT_PERCPU_SKIPPED;
+    }
+
+    uint64_t start = (tail + EMT_PERCPU_HEADER_SIZE) & percpu->mask;
+    uint64_t first = size - start < length ? size - start : length;
+    if (percpu->backpressure == EMT_BACKPRESSURE_OVERWRITE_OLDEST) {
+        // writers discarding records wait for the tail lock, so it isn't held while the sink
+        // (which may block on I/O) has the record; the sink gets a copy
+        uint8_t copy[EMT_PERCPU_CAPACITY];
+        memcpy(copy, ring + start, (size_t) first);
+        memcpy(copy + first, ring, (size_t) (length - first));
+        (void) emt_percpu_consume(percpu, shard, ring, tail, padded);
+        emt_percpu_unlock_tail(percpu, shard);
+        emt_percpu_pass(percpu, copy, length, copy, length);
+    } else {
+        emt_percpu_pass(percpu, ring + start, first, ring, length);
+        (void) emt_percpu_consume(percpu, shard, ring, tail, padded);
+        emt_percpu_unlock_tail(percpu, shard);
+    }
+    // if a drainer skipped a discarded record in place of this one meanwhile, it was passed on
+    // late, and the discarded one still needs skipping
+    if (record_seq == seq && !emt_percpu_advance(percpu, slot, seq))
+        __atomic_fetch_add(&percpu->discarded[slot], 1, __ATOMIC_RELAXED);
+    return EMT_PERCPU_PASSED;
+}
+
+/**
+ * Pass on the records that have been published so far to the rings of the CPUs on `node` (or of
+ * all CPUs, with `EMT_PERCPU_ALL_NODES`), in per-thread order. A record whose predecessor from the
+ * same thread is on another node is held back until that node has been drained. Must not be called
+ * for the same node from more than one thread at a time.
+ *
+ * @return Number of records passed on.
+ */
+static inline uint64_t emt_percpu_drain_node(emt_percpu_t* percpu, uint32_t node) {
+    uint64_t drained = 0;
+    int progress = 1;
+    while (progress) {
+        progress = 0;
+        for (uint32_t cpu = 0; cpu < percpu->num_cpus; cpu++) {
+            if (node != EMT_PERCPU_ALL_NODES && percpu->cpu_node[cpu] != node)
+                continue;
+            emt_percpu_progress_t result;
+            while ((result = emt_percpu_drain_one(percpu, cpu)) != EMT_PERCPU_STALLED) {
+                drained += result == EMT_PERCPU_PASSED;
+                progress = 1;
+            }
+        }
+    }
+    return drained;
+}
+
+/// Pass on the records of all rings, see `emt_percpu_drain_node`.
+static inline uint64_t emt_percpu_drain(emt_percpu_t* percpu) {
+    return emt_percpu_drain_node(percpu, EMT_PERCPU_ALL_NODES);
+}
+
+/// Use as the `drain` of an `emt_drain_config_t`, with the buffers as `source`.
+static inline uint64_t emt_percpu_drain_source(void* source) {
+    return emt_percpu_drain((emt_percpu_t*) source);
+}
+
+/// Use as the `dropped` of an `emt_drain_config_t`, with the buffers as `source`.
+static inline uint64_t emt_percpu_dropped_source(void* source) {
+    return emt_percpu_dropped((emt_percpu_t*) source);
+}
+
+/// Use as the `lock` argument of `EMT_TRACE_F` et al., with a record as `extra_arg`.
+static inline void
+emt_percpu_lock(const void* info, emt_size_t size, emt_percpu_record_t* record) {
+    (void) info;
+    emt_stage_lock(&record->stage, size, EMT_PERCPU_CAPACITY);
+}
+
+/// Use as the `out` argument of `EMT_TRACE_F` et al., with a record as `extra_arg`.
+static inline void
+emt_percpu_out(const void* data, emt_size_t size, emt_percpu_record_t* record) {
+    emt_stage_out(&record->stage, record->data, EMT_PERCPU_CAPACITY, data, size);
+}
+
+/// Use as the `unlock` argument of `EMT_TRACE_F` et al., with a record as `extra_arg`.
+static inline void
+emt_percpu_unlock(const void* info, emt_size_t size, emt_percpu_record_t* record) {
+    (void) info;
+    (void) size;
+    emt_percpu_thread_t* thread = emt_percpu_thread(record->sink);
+    if (record->stage.dropping || thread == NULL) {
+        __atomic_fetch_add(&record->sink->dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    (void) emt_percpu_append(thread, record->data, record->stage.size);
+}
+
+/// Like `EMT_TRACE_F`, but appending the record to the ring of the caller's CPU in `percpu`.
+#define EMT_PERCPU_TRACE_F(fmt_info_attributes, formatter, percpu, postfix, ...)                   \
+    do {                                                                                           \
+        emt_percpu_record_t emt_record;                                                            \
+        emt_record.sink = (percpu);                                                                \
+        EMT_TRACE_F(                                                                               \
+            fmt_info_attributes, formatter, emt_percpu_out, emt_percpu_lock, emt_percpu_unlock,    \
+            &emt_record, postfix, __VA_ARGS__                                                      \
+        );                                                                                         \
+    } while (0)
+
+/// Like `EMT_TRACE_S`, but appending the record to the ring of the caller's CPU in `percpu`.
+#define EMT_PERCPU_TRACE_S(fmt_info_attributes, percpu, postfix, str)                              \
+    do {                                                                                           \
+        emt_percpu_record_t emt_record;                                                            \
+        emt_record.sink = (percpu);                                                                \
+        EMT_TRACE_S(                                                                               \
+            fmt_info_attributes, emt_percpu_out, emt_percpu_lock, emt_percpu_unlock, &emt_record,  \
+            postfix, str                                                                           \
+        );                                                                                         \
+    } while (0)
+
+#define EMT_PERCPU_INIT_OUT(data, size, percpu) (percpu)->out((data), (size), (percpu)->arg)
+
+#if defined(EMT_DEFAULT_SEC_ATTR)
+
+#define EMTRACE_PERCPU_F(percpu, ...)                                                              \
+    EMT_PERCPU_TRACE_F(EMT_DEFAULT_SEC_ATTR, EMT_PY_FORMAT, (percpu), "", __VA_ARGS__)
+#define EMTRACE_PERCPU(percpu, str)                                                                \
+    EMT_PERCPU_TRACE_F(EMT_DEFAULT_SEC_ATTR, EMT_NO_FORMAT, (percpu), "", str)
+#define EMTRACE_PERCPU_S(percpu, str) EMT_PERCPU_TRACE_S(EMT_DEFAULT_SEC_ATTR, (percpu), "", str)
+#define EMTRACELN_PERCPU_F(percpu, ...)                                                            \
+    EMT_PERCPU_TRACE_F(EMT_DEFAULT_SEC_ATTR, EMT_PY_FORMAT, (percpu), "\n", __VA_ARGS__)
+#define EMTRACELN_PERCPU(percpu, str)                                                              \
+    EMT_PERCPU_TRACE_F(EMT_DEFAULT_SEC_ATTR, EMT_NO_FORMAT, (percpu), "", str "\n")
+#define EMTRACELN_PERCPU_S(percpu, str)                                                            \
+    EMT_PERCPU_TRACE_S(EMT_DEFAULT_SEC_ATTR, (percpu), "\n", str)
+#define EMTRACE_PERCPU_INIT(percpu) EMT_INIT(EMT_DEFAULT_SEC_ATTR, EMT_PERCPU_INIT_OUT, (percpu))
+
+#endif // EMT_DEFAULT_SEC_ATTR
+
+// NOLINTEND(modernize-use-using,modernize-avoid-c-arrays)
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EMTRACE_PERCPU_H
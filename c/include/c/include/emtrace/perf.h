@@ -0,0 +1,222 @@
+#ifndef EMTRACE_PERF_H
+#define EMTRACE_PERF_H
+
+#include "emtrace/emtrace.h"
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+// NOLINTBEGIN(modernize-use-using,modernize-avoid-c-arrays)
+
+/**
+ * Hardware performance counters between two trace points.
+ *
+ * `emt_perf_open` opens a group of counters for the calling thread with `perf_event_open`: cycles,
+ * instructions retired, cache misses, and branch mispredictions, in user space only.
+ * `emt_perf_snapshot` reads them together with a timestamp, and `EMT_PERF_TRACE_F` emits a record
+ * with what they counted since a previous snapshot. The record carries the arguments of the trace
+ * followed by the elapsed nanoseconds and an `EMT_SPAN(uint64_t, n)` of the counter deltas, with
+ * the `EMT_PERF_FORMAT` formatter, so the decoder renders them after the formatted message.
+ * Afterwards the snapshot is taken again, so a sequence of trace points with the same snapshot
+ * measures the spans between them without the cost of tracing.
+ *
+ * Where the kernel allows it (`cap_user_rdpmc` in the counters' mmapped pages, on x86), the
+ * counters are read with `rdpmc` without a system call; otherwise the group is read with `read`.
+ * If the counters can't be opened at all (no permission, no PMU in a VM, seccomp), `n` is 0 and
+ * only the elapsed time is traced.
+ *
+ * An `emt_perf_t` counts the thread that opened it only; use one per thread (e.g. `_Thread_local`)
+ * and close it before the thread exits. Counts are not scaled when the kernel multiplexes the
+ * group with other events.
+ *
+ * Linux only.
+ */
+
+#define EMT_PERF_CYCLES 0
+#define EMT_PERF_INSTRUCTIONS 1
+#define EMT_PERF_CACHE_MISSES 2
+#define EMT_PERF_BRANCH_MISSES 3
+#define EMT_PERF_COUNTERS 4
+
+typedef struct {
+    int fds[EMT_PERF_COUNTERS]; ///< counters, the group leader first
+    const struct perf_event_mmap_page* pages[EMT_PERF_COUNTERS]; ///< `NULL` where not mapped
+    unsigned num_counters; ///< `EMT_PERF_COUNTERS` if the group is open, else 0
+    int rdpmc;             ///< whether every counter may be read with `rdpmc`
+} emt_perf_t;
+
+typedef struct {
+    uint64_t ns;                         ///< `CLOCK_MONOTONIC`
+    uint64_t counts[EMT_PERF_COUNTERS]; ///< as many as the group has counters
+} emt_perf_snapshot_t;
+
+static inline int emt_perf_event_open(uint64_t config, int group_fd) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = config;
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, PERF_FLAG_FD_CLOEXEC);
+}
+
+/// Close the counters; `perf` then only traces timestamps.
+static inline void emt_perf_close(emt_perf_t* perf) {
+    const long page_size = sysconf(_SC_PAGESIZE);
+    for (unsigned i = EMT_PERF_COUNTERS; i-- > 0;) {
+        if (perf->pages[i] != NULL)
+            munmap((void*) perf->pages[i], (size_t) page_size);
+        if (perf->fds[i] >= 0)
+            close(perf->fds[i]);
+        perf->pages[i] = NULL;
+        perf->fds[i] = -1;
+    }
+    perf->num_counters = 0;
+    perf->rdpmc = 0;
+}
+
+/**
+ * Open the counters of the calling thread. Returns 0, or the negated `errno` of the counter that
+ * couldn't be opened, in which case `perf` is still usable but traces timestamps only.
+ */
+static inline int emt_perf_open(emt_perf_t* perf) {
+    static const uint64_t configs[EMT_PERF_COUNTERS] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES
+    };
+    for (unsigned i = 0; i < EMT_PERF_COUNTERS; i++) {
+        perf->fds[i] = -1;
+        perf->pages[i] = NULL;
+    }
+    perf->num_counters = 0;
+    perf->rdpmc = 0;
+    for (unsigned i = 0; i < EMT_PERF_COUNTERS; i++) {
+        perf->fds[i] = emt_perf_event_open(configs[i], i == 0 ? -1 : perf->fds[0]);
+        if (perf->fds[i] < 0) {
+            const int err = errno;
+            emt_perf_close(perf);
+            return -err;
+        }
+    }
+    perf->num_counters = EMT_PERF_COUNTERS;
+
+#if defined(__x86_64__) || defined(__i386__)
+    const long page_size = sysconf(_SC_PAGESIZE);
+    perf->rdpmc = 1;
+    for (unsigned i = 0; i < EMT_PERF_COUNTERS; i++) {
+        void* page = mmap(NULL, (size_t) page_size, PROT_READ, MAP_SHARED, perf->fds[i], 0);
+        if (page == MAP_FAILED) {
+            perf->rdpmc = 0;
+            break;
+        }
+        perf->pages[i] = (const struct perf_event_mmap_page*) page;
+        if (!perf->pages[i]->cap_user_rdpmc)
+            perf->rdpmc = 0;
+    }
+#endif
+    return 0;
+}
+
+static inline uint64_t emt_perf_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t) now.tv_sec * 1000000000U) + (uint64_t) now.tv_nsec;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/// Read a counter from its mmapped page; false if it isn't on a PMU right now.
+static inline int emt_perf_rdpmc(const struct perf_event_mmap_page* page, uint64_t* count) {
+    uint32_t seq = 0;
+    uint32_t index = 0;
+    do {
+        seq = __atomic_load_n(&page->lock, __ATOMIC_ACQUIRE);
+        index = page->index;
+        int64_t value = page->offset;
+        if (index != 0) {
+            uint32_t low = 0;
+            uint32_t high = 0;
+            __asm__ volatile("rdpmc" : "=a"(low), "=d"(high) : "c"(index - 1));
+            // the counter is `pmc_width` bits wide; sign extend it
+            const unsigned shift = 64U - page->pmc_width;
+            value += (int64_t) ((((uint64_t) high << 32) | low) << shift) >> shift;
+        }
+        *count = (uint64_t) value;
+        __atomic_signal_fence(__ATOMIC_ACQ_REL);
+    } while (__atomic_load_n(&page->lock, __ATOMIC_ACQUIRE) != seq);
+    return index != 0;
+}
+#endif
+
+/// Read the time and the counters of `perf`, which must have been opened by the calling thread.
+static inline void emt_perf_snapshot(const emt_perf_t* perf, emt_perf_snapshot_t* snapshot) {
+    snapshot->ns = emt_perf_now();
+    if (perf->num_counters == 0)
+        return;
+#if defined(__x86_64__) || defined(__i386__)
+    if (perf->rdpmc) {
+        unsigned i = 0;
+        while (i < perf->num_counters && emt_perf_rdpmc(perf->pages[i], &snapshot->counts[i]))
+            i++;
+        if (i == perf->num_counters)
+            return;
+    }
+#endif
+    uint64_t values[1 + EMT_PERF_COUNTERS] = {0};
+    if (read(perf->fds[0], values, sizeof(values)) < (ssize_t) sizeof(uint64_t))
+        return;
+    for (unsigned i = 0; i < perf->num_counters && i < values[0]; i++)
+        snapshot->counts[i] = values[1 + i];
+}
+
+/**
+ * Emit a trace with the time and the counter deltas since `*start`, then take a new snapshot into
+ * `*start`. The other parameters and the variadic arguments are the ones of `EMT_TRACE_F`.
+ */
+#define EMT_PERF_TRACE_F(                                                                          \
+    fmt_info_attributes, out_fn, lock, unlock, extra_arg, perf, start, postfix, ...                \
+)                                                                                                  \
+    do {                                                                                           \
+        emt_perf_snapshot_t emt_perf_end;                                                          \
+        emt_perf_snapshot((perf), &emt_perf_end);                                                  \
+        uint64_t emt_perf_deltas[EMT_PERF_COUNTERS];                                               \
+        for (unsigned emt_i = 0; emt_i < (perf)->num_counters; emt_i++)                            \
+            emt_perf_deltas[emt_i] = emt_perf_end.counts[emt_i] - (start)->counts[emt_i];          \
+        EMT_TRACE_F(                                                                               \
+            fmt_info_attributes, EMT_PERF_FORMAT, out_fn, lock, unlock, extra_arg, postfix,        \
+            __VA_ARGS__, uint64_t, emt_perf_end.ns - (start)->ns,                                  \
+            EMT_SPAN(uint64_t, (perf)->num_counters), emt_perf_deltas                              \
+        );                                                                                         \
+        emt_perf_snapshot((perf), (start));                                                        \
+    } while (0)
+
+#if defined(EMT_DEFAULT_SEC_ATTR) && defined(EMT_FLOCK_FILE) && defined(EMT_FUNLOCK_FILE)
+#define EMTRACE_PERF_F(perf, start, ...)                                                           \
+    EMT_PERF_TRACE_F(                                                                              \
+        EMT_DEFAULT_SEC_ATTR, EMT_DEFAULT_OUT, EMT_FLOCK_FILE, EMT_FUNLOCK_FILE, EMT_DEFAULT_SINK, \
+        perf, start, "", __VA_ARGS__                                                               \
+    )
+#define EMTRACELN_PERF_F(perf, start, ...)                                                         \
+    EMT_PERF_TRACE_F(                                                                              \
+        EMT_DEFAULT_SEC_ATTR, EMT_DEFAULT_OUT, EMT_FLOCK_FILE, EMT_FUNLOCK_FILE, EMT_DEFAULT_SINK, \
+        perf, start, "\n", __VA_ARGS__                                                             \
+    )
+#endif
+
+// NOLINTEND(modernize-use-using,modernize-avoid-c-arrays)
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EMTRACE_PERF_H
@@ -0,0 +1,223 @@
+#ifndef EMTRACE_REPEAT_H
+#define EMTRACE_REPEAT_H
+
+#include "emtrace/emtrace.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+// NOLINTBEGIN(modernize-use-using,modernize-avoid-c-arrays)
+
+/**
+ * Repeat collapsing.
+ *
+ * Wraps another sink (given as function pointers) and suppresses records that are byte-for-byte
+ * identical to the one before them, i.e. that come from the same call site with the same argument
+ * values. Instead of the duplicates, a single "last message repeated N times" record is emitted
+ * once a different record comes along, once the run has lasted `timeout_ns`, or when
+ * `emt_repeat_flush` is called. The timeout is checked on every duplicate and by
+ * `emt_repeat_maybe_flush`, which should be called periodically if a run may be the last record
+ * for a while. The summary ends in a newline if the repeated record does, i.e. if it was traced
+ * with the `EMTRACELN_REPEAT` variants or with `emt_repeat_lock_ln` as `lock`.
+ *
+ * To be compared, each record is staged in a buffer of `EMT_REPEAT_CAPACITY` bytes before it is
+ * passed on to the wrapped sink. Larger records are passed through as they come and are never
+ * collapsed.
+ *
+ * An `emt_repeat_t` is not thread safe; use one per thread (e.g. `_Thread_local`) or per stream
+ * that is otherwise serialized. The wrapped sink's `lock` and `unlock` are called around every
+ * record that is passed on.
+ */
+
+#ifndef EMT_REPEAT_CAPACITY
+#define EMT_REPEAT_CAPACITY 256
+#endif
+
+typedef struct {
+    emt_sink_fn_t out;    ///< wrapped sink's `out_fn`
+    emt_sink_fn_t lock;   ///< wrapped sink's `lock`
+    emt_sink_fn_t unlock; ///< wrapped sink's `unlock`
+    void* arg;            ///< wrapped sink's `extra_arg`
+    uint64_t timeout_ns;  ///< maximum duration of a collapsed run, 0 for no limit
+
+    uint8_t staged[2][EMT_REPEAT_CAPACITY]; ///< the current and the last record
+    emt_size_t size[2];                     ///< sizes of the records in `staged`
+    unsigned current;                       ///< index of the record being staged
+    uint8_t newline[2];                     ///< whether the records in `staged` end in a newline
+    int has_last;                           ///< whether the other record is valid
+    int passthrough;                        ///< set while passing on a large record
+    emt_size_t locked;                      ///< size given to `lock` for the record
+    uint64_t repeats;                       ///< suppressed duplicates of the last one
+    uint64_t run_start;                     ///< time of the first suppressed one
+} emt_repeat_t;
+
+/// Static initializer of an `emt_repeat_t` wrapping the given sink.
+#define EMT_REPEAT_INITIALIZER(out, lock, unlock, arg, timeout_ns)                                 \
+    {(out), (lock), (unlock), (arg), (timeout_ns), {{0}}, {0, 0}, 0, {0, 0}, 0, 0, 0, 0, 0}
+/// Static initializer of an `emt_repeat_t` wrapping stdout.
+#define EMT_REPEAT_STDOUT_INITIALIZER(timeout_ns)                                                  \
+    EMT_REPEAT_INITIALIZER(emt_file_out, emt_file_lock, emt_file_unlock, NULL, timeout_ns)
+
+static inline void emt_repeat_init(
+    emt_repeat_t* repeat, emt_sink_fn_t out, emt_sink_fn_t lock, emt_sink_fn_t unlock, void* arg,
+    uint64_t timeout_ns
+) {
+    memset(repeat, 0, sizeof(*repeat));
+    repeat->out = out;
+    repeat->lock = lock;
+    repeat->unlock = unlock;
+    repeat->arg = arg;
+    repeat->timeout_ns = timeout_ns;
+}
+
+static inline uint64_t emt_repeat_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t) now.tv_sec * 1000000000U) + (uint64_t) now.tv_nsec;
+}
+
+#define EMT_REPEAT_SINK_OUT(data, size, repeat) (repeat)->out((data), (size), (repeat)->arg)
+#define EMT_REPEAT_SINK_LOCK(data, size, repeat) (repeat)->lock((data), (size), (repeat)->arg)
+#define EMT_REPEAT_SINK_UNLOCK(data, size, repeat) (repeat)->unlock((data), (size), (repeat)->arg)
+
+/// Emit the "repeated" record for the current run of suppressed duplicates, if there is one.
+static inline void emt_repeat_flush(emt_repeat_t* repeat) {
+    uint64_t repeats = repeat->repeats;
+    if (repeats == 0)
+        return;
+    repeat->repeats = 0;
+    // the repeated record is the one staged before the current one
+    if (repeat->newline[repeat->current ^ 1U]) {
+        EMT_TRACE_F(
+            EMT_DEFAULT_SEC_ATTR, EMT_PY_FORMAT, EMT_REPEAT_SINK_OUT, EMT_REPEAT_SINK_LOCK,
+            EMT_REPEAT_SINK_UNLOCK, repeat, "\n", "last message repeated {} times", uint64_t,
+            repeats
+        );
+    } else {
+        EMT_TRACE_F(
+            EMT_DEFAULT_SEC_ATTR, EMT_PY_FORMAT, EMT_REPEAT_SINK_OUT, EMT_REPEAT_SINK_LOCK,
+            EMT_REPEAT_SINK_UNLOCK, repeat, "", "last message repeated {} times", uint64_t, repeats
+        );
+    }
+}
+
+/// Flush the current run if it has lasted `timeout_ns`; cheap enough to be called from an event
+/// loop, so that the summary of a run isn't held back until the next record.
+static inline void emt_repeat_maybe_flush(emt_repeat_t* repeat) {
+    if (repeat->timeout_ns != 0 && repeat->repeats != 0 &&
+        emt_repeat_now() - repeat->run_start >= repeat->timeout_ns)
+        emt_repeat_flush(repeat);
+}
+
+/// Stop staging the current record: flush the run it interrupts, and pass on what was staged.
+static inline void emt_repeat_begin_passthrough(emt_repeat_t* repeat) {
+    emt_repeat_flush(repeat);
+    repeat->passthrough = 1;
+    repeat->has_last = 0;
+    unsigned current = repeat->current;
+    repeat->lock(repeat->staged[current], repeat->locked, repeat->arg);
+    if (repeat->size[current] > 0)
+        repeat->out(repeat->staged[current], repeat->size[current], repeat->arg);
+}
+
+/// Use as the `lock` argument of `EMT_TRACE_F` et al.
+static inline void emt_repeat_lock(const void* info, emt_size_t size, emt_repeat_t* repeat) {
+    (void) info;
+    repeat->size[repeat->current] = 0;
+    repeat->newline[repeat->current] = 0;
+    repeat->passthrough = 0;
+    repeat->locked = size;
+    if ((size & (emt_size_t) ~(EMT_NULL_TERMINATED | EMT_LENGTH_PREFIXED)) > EMT_REPEAT_CAPACITY)
+        emt_repeat_begin_passthrough(repeat);
+}
+
+/// Use as the `lock` argument of `EMT_TRACE_F` et al. if the format string ends in a newline.
+static inline void emt_repeat_lock_ln(const void* info, emt_size_t size, emt_repeat_t* repeat) {
+    emt_repeat_lock(info, size, repeat);
+    repeat->newline[repeat->current] = 1;
+}
+
+/// Use as the `out` argument of `EMT_TRACE_F` et al.
+static inline void emt_repeat_out(const void* data, emt_size_t size, emt_repeat_t* repeat) {
+    unsigned current = repeat->current;
+    if (!repeat->passthrough && repeat->size[current] + size > EMT_REPEAT_CAPACITY)
+        emt_repeat_begin_passthrough(repeat);
+    if (repeat->passthrough) {
+        repeat->out(data, size, repeat->arg);
+        return;
+    }
+    memcpy(repeat->staged[current] + repeat->size[current], data, size);
+    repeat->size[current] += size;
+}
+
+/// Use as the `unlock` argument of `EMT_TRACE_F` et al.
+static inline void emt_repeat_unlock(const void* info, emt_size_t size, emt_repeat_t* repeat) {
+    (void) info;
+    (void) size;
+    if (repeat->passthrough) {
+        repeat->unlock(repeat->staged[repeat->current], repeat->locked, repeat->arg);
+        repeat->passthrough = 0;
+        return;
+    }
+
+    unsigned current = repeat->current;
+    unsigned last = current ^ 1U;
+    emt_size_t record_size = repeat->size[current];
+    if (repeat->has_last && repeat->size[last] == record_size &&
+        memcmp(repeat->staged[current], repeat->staged[last], record_size) == 0) {
+        if (repeat->timeout_ns == 0) {
+            repeat->repeats++;
+        } else if (repeat->repeats++ == 0) {
+            repeat->run_start = emt_repeat_now();
+        } else if (emt_repeat_now() - repeat->run_start >= repeat->timeout_ns) {
+            emt_repeat_flush(repeat);
+        }
+        return;
+    }
+
+    emt_repeat_flush(repeat);
+    repeat->lock(repeat->staged[current], record_size, repeat->arg);
+    repeat->out(repeat->staged[current], record_size, repeat->arg);
+    repeat->unlock(repeat->staged[current], record_size, repeat->arg);
+    repeat->has_last = 1;
+    repeat->current = last;
+}
+
+#define EMT_REPEAT_INIT_OUT(data, size, repeat) (repeat)->out((data), (size), (repeat)->arg)
+
+#if defined(EMT_DEFAULT_SEC_ATTR)
+
+#define EMTRACE_REPEAT_F(repeat, ...)                                                              \
+    EMT_TRACE_F(                                                                                   \
+        EMT_DEFAULT_SEC_ATTR, EMT_PY_FORMAT, emt_repeat_out, emt_repeat_lock, emt_repeat_unlock,   \
+        (repeat), "", __VA_ARGS__                                                                  \
+    )
+#define EMTRACE_REPEAT(repeat, str)                                                                \
+    EMT_TRACE(                                                                                     \
+        EMT_DEFAULT_SEC_ATTR, emt_repeat_out, emt_repeat_lock, emt_repeat_unlock, (repeat), str    \
+    )
+#define EMTRACELN_REPEAT_F(repeat, ...)                                                            \
+    EMT_TRACE_F(                                                                                   \
+        EMT_DEFAULT_SEC_ATTR, EMT_PY_FORMAT, emt_repeat_out, emt_repeat_lock_ln,                   \
+        emt_repeat_unlock, (repeat), "\n", __VA_ARGS__                                             \
+    )
+#define EMTRACELN_REPEAT(repeat, str)                                                              \
+    EMT_TRACE(                                                                                     \
+        EMT_DEFAULT_SEC_ATTR, emt_repeat_out, emt_repeat_lock_ln, emt_repeat_unlock, (repeat),     \
+        str "\n"                                                                                   \
+    )
+#define EMTRACE_REPEAT_INIT(repeat) EMT_INIT(EMT_DEFAULT_SEC_ATTR, EMT_REPEAT_INIT_OUT, (repeat))
+
+#endif // EMT_DEFAULT_SEC_ATTR
+
+// NOLINTEND(modernize-use-using,modernize-avoid-c-arrays)
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EMTRACE_REPEAT_H
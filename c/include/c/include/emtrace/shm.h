@@ -0,0 +1,378 @@
+#ifndef EMTRACE_SHM_H
+#define EMTRACE_SHM_H
+
+#include "emtrace/emtrace.h"
+#include "emtrace/memory.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+// NOLINTBEGIN(modernize-use-using,modernize-avoid-c-arrays)
+
+/**
+ * Shared-memory transport.
+ *
+ * A named POSIX shared-memory region is split into a fixed number of rings. Every producing thread
+ * (of any process attached to the region) claims a ring of its own, so each ring has exactly one
+ * producer and one consumer (the decoder), and neither side needs locks or system calls on the hot
+ * path. A record is only published once it has been written completely, so the decoder never sees
+ * partial records. If a ring is full the record is dropped and counted in the ring's header.
+ *
+ * Memory layout of the region:
+ *     emt_shm_header_t | emt_shm_ring_t * num_rings | ring data (ring_size bytes) * num_rings
+ *
+ * The layout is mirrored by `parser/emtrace/shm.py`; keep both in sync.
+ */
+
+#define EMT_SHM_MAGIC ((uint64_t) 0x31304d4853544d45) ///< "EMTSHM01" read as little-endian
+#define EMT_SHM_VERSION 1
+#define EMT_SHM_EXE_PATH_MAX 224
+
+/// Ring is not owned by any thread.
+#define EMT_SHM_RING_FREE 0
+/// A thread is in the middle of claiming the ring; the header is not valid yet.
+#define EMT_SHM_RING_CLAIMING 1
+/// Ring is owned by a live thread and its header is valid.
+#define EMT_SHM_RING_ACTIVE 2
+/// Owner is gone; the decoder frees the ring once it has drained it.
+#define EMT_SHM_RING_CLOSED 3
+
+typedef struct {
+    uint64_t magic;     ///< EMT_SHM_MAGIC, written last by the creator of the region
+    uint32_t version;   ///< EMT_SHM_VERSION
+    uint32_t num_rings; ///< number of rings in the region
+    uint64_t ring_size; ///< size of each ring's data area in bytes (a power of two)
+    uint8_t reserved[40];
+} emt_shm_header_t;
+
+typedef struct {
+    uint64_t head; ///< bytes ever published by the producer
+    uint8_t pad0[56];
+    uint64_t tail; ///< bytes ever consumed by the decoder
+    uint8_t pad1[56];
+    uint32_t state;      ///< one of EMT_SHM_RING_*
+    int32_t pid;         ///< process id of the owner
+    int32_t tid;         ///< thread id of the owner
+    uint32_t generation; ///< incremented whenever the ring is claimed
+    uint64_t magic_ptr;  ///< the owner's `EMT_INIT` magic pointer
+    uint64_t dropped;    ///< number of records dropped because the ring was full
+    char exe[EMT_SHM_EXE_PATH_MAX]; ///< path of the owner's executable
+} emt_shm_ring_t;
+
+EMT_STATIC_ASSERT(sizeof(emt_shm_header_t) == 64, "emt_shm_header_t layout is broken");
+EMT_STATIC_ASSERT(sizeof(emt_shm_ring_t) == 384, "emt_shm_ring_t layout is broken");
+EMT_STATIC_ASSERT(offsetof(emt_shm_ring_t, tail) == 64, "emt_shm_ring_t layout is broken");
+EMT_STATIC_ASSERT(offsetof(emt_shm_ring_t, state) == 128, "emt_shm_ring_t layout is broken");
+EMT_STATIC_ASSERT(offsetof(emt_shm_ring_t, exe) == 160, "emt_shm_ring_t layout is broken");
+
+/// Per-thread producer state. Lives on the heap and is owned by the thread it belongs to.
+typedef struct {
+    emt_shm_ring_t* ring;
+    uint8_t* data;
+    uint64_t mask;
+    uint64_t cursor;   ///< write position of the record currently being emitted
+    uint64_t limit;    ///< position at which the ring would overrun the decoder
+    int dropping;      ///< set if the record currently being emitted does not fit
+    uint32_t* writers; ///< the count of the `emt_shm_t` the writer is attached through
+} emt_shm_writer_t;
+
+/// Per-process handle to an attached region.
+typedef struct {
+    emt_shm_header_t* header;
+    size_t map_size;
+    uint64_t magic_ptr;
+    pthread_key_t key;
+    int mem_flags;    ///< `EMT_MEM_*` flags that were applied to this process's mapping
+    uint32_t writers; ///< threads of this process that own a ring (atomic)
+} emt_shm_t;
+
+static inline emt_shm_ring_t* emt_shm_rings(const emt_shm_t* shm) {
+    return (emt_shm_ring_t*) (shm->header + 1);
+}
+
+static inline uint8_t* emt_shm_ring_data(const emt_shm_t* shm, uint32_t index) {
+    return (uint8_t*) (emt_shm_rings(shm) + shm->header->num_rings) +
+           ((size_t) index * shm->header->ring_size);
+}
+
+static inline void emt_shm_writer_destroy(void* arg) {
+    emt_shm_writer_t* writer = (emt_shm_writer_t*) arg;
+    __atomic_store_n(&writer->ring->state, EMT_SHM_RING_CLOSED, __ATOMIC_RELEASE);
+    __atomic_fetch_sub(writer->writers, 1, __ATOMIC_RELEASE);
+    free(writer);
+}
+
+/**
+ * @brief Create or attach to the shared-memory region `name`.
+ *
+ * The first process to open the region creates it with `num_rings` rings of `ring_size` bytes
+ * each; later processes attach to the existing region and ignore both parameters.
+ *
+ * @param mem_flags `EMT_MEM_THP` and `EMT_MEM_MLOCK` apply to the mapping. POSIX shared memory
+ * can't come from the hugetlb pool, so `EMT_MEM_HUGETLB` asks for transparent huge pages instead
+ * (which also depends on `/sys/kernel/mm/transparent_hugepage/shmem_enabled`). `EMT_MEM_NUMA` is
+ * ignored, as rings are claimed by threads rather than CPUs.
+ * @return 0 on success, -1 on failure with `errno` set.
+ */
+static inline int emt_shm_open_flags(
+    emt_shm_t* shm, const char* name, uint32_t num_rings, uint64_t ring_size, int mem_flags
+) {
+    if (num_rings == 0 || ring_size == 0 || (ring_size & (ring_size - 1)) != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    size_t map_size = sizeof(emt_shm_header_t) +
+                      ((size_t) num_rings * (sizeof(emt_shm_ring_t) + (size_t) ring_size));
+    int created = 1;
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0 && errno == EEXIST) {
+        created = 0;
+        fd = shm_open(name, O_RDWR, 0600);
+    }
+    if (fd < 0)
+        return -1;
+
+    if (created) {
+        if (ftruncate(fd, (off_t) map_size) != 0) {
+            close(fd);
+            (void) shm_unlink(name);
+            return -1;
+        }
+    } else {
+        // wait for the creator to size the region
+        struct stat st;
+        do {
+            if (fstat(fd, &st) != 0) {
+                close(fd);
+                return -1;
+            }
+        } while (st.st_size < (off_t) sizeof(emt_shm_header_t) && sched_yield() == 0);
+        map_size = (size_t) st.st_size;
+    }
+
+    void* base = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return -1;
+
+    shm->header = (emt_shm_header_t*) base;
+    shm->map_size = map_size;
+    shm->magic_ptr = 0;
+    shm->mem_flags = 0;
+    shm->writers = 0;
+#ifdef MADV_HUGEPAGE
+    if ((mem_flags & (EMT_MEM_HUGETLB | EMT_MEM_THP)) &&
+        madvise(base, map_size, MADV_HUGEPAGE) == 0)
+        shm->mem_flags |= EMT_MEM_THP;
+#endif
+    // no fallback to faulting pages in by writing, the region may be in use already
+    if ((mem_flags & EMT_MEM_MLOCK) && mlock(base, map_size) == 0)
+        shm->mem_flags |= EMT_MEM_MLOCK;
+    if (created) {
+        shm->header->version = EMT_SHM_VERSION;
+        shm->header->num_rings = num_rings;
+        shm->header->ring_size = ring_size;
+        __atomic_store_n(&shm->header->magic, EMT_SHM_MAGIC, __ATOMIC_RELEASE);
+    } else {
+        while (__atomic_load_n(&shm->header->magic, __ATOMIC_ACQUIRE) != EMT_SHM_MAGIC)
+            (void) sched_yield();
+        if (shm->header->version != EMT_SHM_VERSION) {
+            munmap(base, map_size);
+            errno = EPROTO;
+            return -1;
+        }
+    }
+
+    if (pthread_key_create(&shm->key, emt_shm_writer_destroy) != 0) {
+        munmap(base, map_size);
+        errno = EAGAIN;
+        return -1;
+    }
+    return 0;
+}
+
+/// `emt_shm_open_flags` without any `EMT_MEM_*` flags.
+static inline int emt_shm_open(
+    emt_shm_t* shm, const char* name, uint32_t num_rings, uint64_t ring_size
+) {
+    return emt_shm_open_flags(shm, name, num_rings, ring_size, 0);
+}
+
+/**
+ * @brief Detach from the region. Rings claimed by threads of this process are left for the decoder
+ * to drain and free.
+ *
+ * The calling thread's ring is released right away, but every other thread that traced through
+ * `shm` must have exited first (which releases its ring), as the region is unmapped. No thread may
+ * trace through `shm` afterwards.
+ *
+ * @return 0 on success, -1 with `errno` set to `EBUSY` if other threads still own a ring, in which
+ * case the region stays attached and closing can be retried once they have exited.
+ */
+static inline int emt_shm_close(emt_shm_t* shm) {
+    emt_shm_writer_t* writer = (emt_shm_writer_t*) pthread_getspecific(shm->key);
+    if (writer != NULL) {
+        emt_shm_writer_destroy(writer);
+        (void) pthread_setspecific(shm->key, NULL);
+    }
+    if (__atomic_load_n(&shm->writers, __ATOMIC_ACQUIRE) != 0) {
+        errno = EBUSY;
+        return -1;
+    }
+    (void) pthread_key_delete(shm->key);
+    munmap(shm->header, shm->map_size);
+    shm->header = NULL;
+    return 0;
+}
+
+/// Use as the `out` argument of `EMT_INIT`. Records the magic pointer, which is copied into the
+/// header of every ring a thread of this process claims.
+static inline void emt_shm_init_out(const void* data, emt_size_t size, emt_shm_t* shm) {
+    emt_ptr_t magic_ptr;
+    (void) size;
+    memcpy(&magic_ptr, data, sizeof(magic_ptr));
+    shm->magic_ptr = (uint64_t) magic_ptr;
+}
+
+static inline emt_shm_writer_t* emt_shm_claim(emt_shm_t* shm) {
+    emt_shm_writer_t* writer = (emt_shm_writer_t*) malloc(sizeof(emt_shm_writer_t));
+    if (writer == NULL)
+        return NULL;
+
+    emt_shm_ring_t* rings = emt_shm_rings(shm);
+    for (uint32_t i = 0; i < shm->header->num_rings; i++) {
+        uint32_t expected = EMT_SHM_RING_FREE;
+        if (!__atomic_compare_exchange_n(
+                &rings[i].state, &expected, EMT_SHM_RING_CLAIMING, 0, __ATOMIC_ACQUIRE,
+                __ATOMIC_RELAXED
+            ))
+            continue;
+
+        emt_shm_ring_t* ring = &rings[i];
+        ring->pid = (int32_t) getpid();
+        ring->tid = (int32_t) syscall(SYS_gettid);
+        ring->generation++;
+        ring->magic_ptr = shm->magic_ptr;
+        ring->dropped = 0;
+        ssize_t len = readlink("/proc/self/exe", ring->exe, sizeof(ring->exe) - 1);
+        ring->exe[len < 0 ? 0 : len] = 0;
+        ring->head = 0;
+        ring->tail = 0;
+        __atomic_store_n(&ring->state, EMT_SHM_RING_ACTIVE, __ATOMIC_RELEASE);
+
+        writer->ring = ring;
+        writer->data = emt_shm_ring_data(shm, i);
+        writer->mask = shm->header->ring_size - 1;
+        writer->cursor = 0;
+        writer->limit = shm->header->ring_size;
+        writer->dropping = 0;
+        writer->writers = &shm->writers;
+        __atomic_fetch_add(&shm->writers, 1, __ATOMIC_RELAXED);
+        (void) pthread_setspecific(shm->key, writer);
+        return writer;
+    }
+
+    free(writer);
+    return NULL;
+}
+
+static inline emt_shm_writer_t* emt_shm_writer(emt_shm_t* shm) {
+    emt_shm_writer_t* writer = (emt_shm_writer_t*) pthread_getspecific(shm->key);
+    if (writer == NULL)
+        writer = emt_shm_claim(shm);
+    return writer;
+}
+
+/// Use as the `lock` argument of `EMT_TRACE_F` et al. Reserves the record in the calling thread's
+/// ring, claiming one first if the thread doesn't own a ring yet.
+static inline void emt_shm_lock(const void* info, emt_size_t size, emt_shm_t* shm) {
+    (void) info;
+    emt_shm_writer_t* writer = emt_shm_writer(shm);
+    if (writer == NULL)
+        return;
+    size &= (emt_size_t) ~(EMT_NULL_TERMINATED | EMT_LENGTH_PREFIXED);
+    writer->cursor = writer->ring->head;
+    writer->limit = __atomic_load_n(&writer->ring->tail, __ATOMIC_ACQUIRE) + writer->mask + 1;
+    writer->dropping = writer->cursor + size > writer->limit;
+}
+
+/// Use as the `out` argument of `EMT_TRACE_F` et al.
+static inline void emt_shm_out(const void* data, emt_size_t size, emt_shm_t* shm) {
+    emt_shm_writer_t* writer = (emt_shm_writer_t*) pthread_getspecific(shm->key);
+    if (writer == NULL || writer->dropping)
+        return;
+    if (writer->cursor + size > writer->limit) {
+        // the decoder may have made progress since the record was reserved
+        writer->limit = __atomic_load_n(&writer->ring->tail, __ATOMIC_ACQUIRE) + writer->mask + 1;
+        if (writer->cursor + size > writer->limit) {
+            writer->dropping = 1;
+            return;
+        }
+    }
+    uint64_t start = writer->cursor & writer->mask;
+    uint64_t first = writer->mask + 1 - start;
+    if (first >= size) {
+        memcpy(writer->data + start, data, size);
+    } else {
+        memcpy(writer->data + start, data, (size_t) first);
+        memcpy(writer->data, (const uint8_t*) data + first, (size_t) (size - first));
+    }
+    writer->cursor += size;
+}
+
+/// Use as the `unlock` argument of `EMT_TRACE_F` et al. Publishes the record to the decoder.
+static inline void emt_shm_unlock(const void* info, emt_size_t size, emt_shm_t* shm) {
+    (void) info;
+    (void) size;
+    emt_shm_writer_t* writer = (emt_shm_writer_t*) pthread_getspecific(shm->key);
+    if (writer == NULL)
+        return;
+    if (writer->dropping) {
+        __atomic_fetch_add(&writer->ring->dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    __atomic_store_n(&writer->ring->head, writer->cursor, __ATOMIC_RELEASE);
+}
+
+#if defined(EMT_DEFAULT_SEC_ATTR)
+
+#define EMTRACE_SHM_F(shm, ...)                                                                    \
+    EMT_TRACE_F(                                                                                   \
+        EMT_DEFAULT_SEC_ATTR, EMT_PY_FORMAT, emt_shm_out, emt_shm_lock, emt_shm_unlock, (shm), "", \
+        __VA_ARGS__                                                                                \
+    )
+#define EMTRACE_SHM(shm, str)                                                                      \
+    EMT_TRACE(EMT_DEFAULT_SEC_ATTR, emt_shm_out, emt_shm_lock, emt_shm_unlock, (shm), str)
+#define EMTRACE_SHM_S(shm, str)                                                                    \
+    EMT_TRACE_S(EMT_DEFAULT_SEC_ATTR, emt_shm_out, emt_shm_lock, emt_shm_unlock, (shm), "", str)
+#define EMTRACELN_SHM_F(shm, ...)                                                                  \
+    EMT_TRACE_F(                                                                                   \
+        EMT_DEFAULT_SEC_ATTR, EMT_PY_FORMAT, emt_shm_out, emt_shm_lock, emt_shm_unlock, (shm),     \
+        "\n", __VA_ARGS__                                                                          \
+    )
+#define EMTRACELN_SHM(shm, str)                                                                    \
+    EMT_TRACE(EMT_DEFAULT_SEC_ATTR, emt_shm_out, emt_shm_lock, emt_shm_unlock, (shm), str "\n")
+#define EMTRACELN_SHM_S(shm, str)                                                                  \
+    EMT_TRACE_S(EMT_DEFAULT_SEC_ATTR, emt_shm_out, emt_shm_lock, emt_shm_unlock, (shm), "\n", str)
+#define EMTRACE_SHM_INIT(shm) EMT_INIT(EMT_DEFAULT_SEC_ATTR, emt_shm_init_out, (shm))
+
+#endif // EMT_DEFAULT_SEC_ATTR
+
+// NOLINTEND(modernize-use-using,modernize-avoid-c-arrays)
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EMTRACE_SHM_H
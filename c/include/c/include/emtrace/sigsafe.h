@@ -0,0 +1,145 @@
+#ifndef EMTRACE_SIGSAFE_H
+#define EMTRACE_SIGSAFE_H
+
+#include "emtrace/emtrace.h"
+#include "emtrace/stage.h"
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+// NOLINTBEGIN(modernize-use-using,modernize-avoid-c-arrays)
+
+/**
+ * Async-signal-safe tracing.
+ *
+ * The default sinks lock and write to a `FILE*`, neither of which may be done from a signal
+ * handler. The macros below instead assemble each record in a buffer of `EMT_SIGSAFE_CAPACITY`
+ * bytes on the caller's stack, and pass it to a single `write(2)` to the sink's file descriptor
+ * once it is complete. No locks are taken, so they can be used from signal handlers and fatal
+ * error paths, including ones that interrupted a trace on the same thread: the interrupted record
+ * is completed (and written) after the handler returns, and the handler's own record can't end up
+ * in the middle of it.
+ *
+ * Records larger than the buffer are dropped and counted in `dropped`. Writes to a pipe are atomic
+ * for records of up to `PIPE_BUF` bytes, so several threads (or processes) can share one.
+ */
+
+#ifndef EMT_SIGSAFE_CAPACITY
+#define EMT_SIGSAFE_CAPACITY 512
+#endif
+
+typedef struct {
+    int fd;           ///< file descriptor the records are written to
+    uint64_t dropped; ///< records that were too large or couldn't be written (atomic)
+} emt_sigsafe_t;
+
+/// Static initializer of an `emt_sigsafe_t` writing to `fd`.
+#define EMT_SIGSAFE_INITIALIZER(fd) {(fd), 0}
+
+/// A record being assembled; lives on the stack of the tracing call.
+typedef struct {
+    emt_sigsafe_t* sink;
+    emt_stage_t stage;
+    uint8_t data[EMT_SIGSAFE_CAPACITY];
+} emt_sigsafe_record_t;
+
+/// `write(2)` all of `data`, retrying on `EINTR` and short writes; leaves `errno` untouched.
+static inline int emt_sigsafe_write(int fd, const void* data, emt_size_t size) {
+    int saved_errno = errno;
+    const uint8_t* bytes = (const uint8_t*) data;
+    int result = 0;
+    while (size > 0) {
+        ssize_t written = write(fd, bytes, size);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0) {
+            result = -1;
+            break;
+        }
+        bytes += written;
+        size -= (emt_size_t) written;
+    }
+    errno = saved_errno;
+    return result;
+}
+
+/// Number of records dropped so far.
+static inline uint64_t emt_sigsafe_dropped(emt_sigsafe_t* sink) {
+    return __atomic_load_n(&sink->dropped, __ATOMIC_RELAXED);
+}
+
+/// Use as the `lock` argument of `EMT_TRACE_F` et al., with a record as `extra_arg`.
+static inline void
+emt_sigsafe_lock(const void* info, emt_size_t size, emt_sigsafe_record_t* record) {
+    (void) info;
+    emt_stage_lock(&record->stage, size, EMT_SIGSAFE_CAPACITY);
+}
+
+/// Use as the `out` argument of `EMT_TRACE_F` et al., with a record as `extra_arg`.
+static inline void
+emt_sigsafe_out(const void* data, emt_size_t size, emt_sigsafe_record_t* record) {
+    emt_stage_out(&record->stage, record->data, EMT_SIGSAFE_CAPACITY, data, size);
+}
+
+/// Use as the `unlock` argument of `EMT_TRACE_F` et al., with a record as `extra_arg`.
+static inline void
+emt_sigsafe_unlock(const void* info, emt_size_t size, emt_sigsafe_record_t* record) {
+    (void) info;
+    (void) size;
+    if (record->stage.dropping ||
+        emt_sigsafe_write(record->sink->fd, record->data, record->stage.size) != 0)
+        __atomic_fetch_add(&record->sink->dropped, 1, __ATOMIC_RELAXED);
+}
+
+/// Like `EMT_TRACE_F`, but assembling the record on the stack and writing it to `sigsafe` at once.
+#define EMT_SIGSAFE_TRACE_F(fmt_info_attributes, formatter, sigsafe, postfix, ...)                 \
+    do {                                                                                           \
+        emt_sigsafe_record_t emt_record;                                                           \
+        emt_record.sink = (sigsafe);                                                               \
+        EMT_TRACE_F(                                                                               \
+            fmt_info_attributes, formatter, emt_sigsafe_out, emt_sigsafe_lock, emt_sigsafe_unlock, \
+            &emt_record, postfix, __VA_ARGS__                                                      \
+        );                                                                                         \
+    } while (0)
+
+/// Like `EMT_TRACE_S`, but assembling the record on the stack and writing it to `sigsafe` at once.
+#define EMT_SIGSAFE_TRACE_S(fmt_info_attributes, sigsafe, postfix, str)                            \
+    do {                                                                                           \
+        emt_sigsafe_record_t emt_record;                                                           \
+        emt_record.sink = (sigsafe);                                                               \
+        EMT_TRACE_S(                                                                               \
+            fmt_info_attributes, emt_sigsafe_out, emt_sigsafe_lock, emt_sigsafe_unlock,            \
+            &emt_record, postfix, str                                                              \
+        );                                                                                         \
+    } while (0)
+
+#define EMT_SIGSAFE_INIT_OUT(data, size, sink) emt_sigsafe_write((sink)->fd, (data), (size))
+
+#if defined(EMT_DEFAULT_SEC_ATTR)
+
+#define EMTRACE_SIGSAFE_F(sink, ...)                                                               \
+    EMT_SIGSAFE_TRACE_F(EMT_DEFAULT_SEC_ATTR, EMT_PY_FORMAT, (sink), "", __VA_ARGS__)
+#define EMTRACE_SIGSAFE(sink, str)                                                                 \
+    EMT_SIGSAFE_TRACE_F(EMT_DEFAULT_SEC_ATTR, EMT_NO_FORMAT, (sink), "", str)
+#define EMTRACE_SIGSAFE_S(sink, str) EMT_SIGSAFE_TRACE_S(EMT_DEFAULT_SEC_ATTR, (sink), "", str)
+#define EMTRACELN_SIGSAFE_F(sink, ...)                                                             \
+    EMT_SIGSAFE_TRACE_F(EMT_DEFAULT_SEC_ATTR, EMT_PY_FORMAT, (sink), "\n", __VA_ARGS__)
+#define EMTRACELN_SIGSAFE(sink, str)                                                               \
+    EMT_SIGSAFE_TRACE_F(EMT_DEFAULT_SEC_ATTR, EMT_NO_FORMAT, (sink), "", str "\n")
+#define EMTRACELN_SIGSAFE_S(sink, str)                                                             \
+    EMT_SIGSAFE_TRACE_S(EMT_DEFAULT_SEC_ATTR, (sink), "\n", str)
+#define EMTRACE_SIGSAFE_INIT(sink) EMT_INIT(EMT_DEFAULT_SEC_ATTR, EMT_SIGSAFE_INIT_OUT, (sink))
+
+#endif // EMT_DEFAULT_SEC_ATTR
+
+// NOLINTEND(modernize-use-using,modernize-avoid-c-arrays)
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EMTRACE_SIGSAFE_H
@@ -0,0 +1,55 @@
+#ifndef EMTRACE_STAGE_H
+#define EMTRACE_STAGE_H
+
+#include "emtrace/emtrace.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+// NOLINTBEGIN(modernize-use-using,modernize-avoid-c-arrays)
+
+/**
+ * Records staged on the stack.
+ *
+ * Sinks that have to pass on each record in one piece, like a single `write(2)` or a single
+ * reservation in a ring, first assemble it in a buffer on the stack of the tracing call. Their
+ * `lock` and `out` functions forward to the ones below, with the buffer and its capacity. A record
+ * that turns out not to fit is dropped as a whole: `dropping` is set, and nothing more is staged.
+ */
+
+/// Progress of a record being staged; lives next to its buffer.
+typedef struct {
+    emt_size_t size; ///< bytes staged so far
+    int dropping;    ///< set once the record doesn't fit into the buffer
+} emt_stage_t;
+
+/// Start staging a record of `size` bytes, as given to `lock`, into a buffer of `capacity` bytes.
+static inline void emt_stage_lock(emt_stage_t* stage, emt_size_t size, emt_size_t capacity) {
+    size &= (emt_size_t) ~(EMT_NULL_TERMINATED | EMT_LENGTH_PREFIXED);
+    stage->size = 0;
+    stage->dropping = size > capacity;
+}
+
+/// Append the bytes given to `out` to the buffer of `capacity` bytes, unless the record is dropped.
+static inline void emt_stage_out(
+    emt_stage_t* stage, uint8_t* buffer, emt_size_t capacity, const void* data, emt_size_t size
+) {
+    if (stage->dropping)
+        return;
+    if (size > capacity - stage->size) {
+        stage->dropping = 1;
+        return;
+    }
+    memcpy(buffer + stage->size, data, size);
+    stage->size += size;
+}
+
+// NOLINTEND(modernize-use-using,modernize-avoid-c-arrays)
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EMTRACE_STAGE_H
@@ -0,0 +1,197 @@
+#ifndef EMTRACE_TRANSACTION_H
+#define EMTRACE_TRANSACTION_H
+
+#include "emtrace/emtrace.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+// NOLINTBEGIN(modernize-use-using,modernize-avoid-c-arrays)
+
+/**
+ * Transaction buffers.
+ *
+ * Wraps another sink (given as function pointers). Outside of a transaction, records are passed on
+ * as they come. Between `emt_txn_begin` and `emt_txn_commit` or `emt_txn_discard`, they are
+ * collected in a buffer of `EMT_TXN_CAPACITY` bytes instead, and only passed on if the transaction
+ * is committed, e.g. because the request it covers turned out to be slow or failed. The committed
+ * bytes are exactly those the records would have produced if passed on directly, and they reach
+ * the wrapped sink in a single `lock`/`out`/`unlock` sequence.
+ *
+ * Records that don't fit into what is left of the buffer are dropped; on commit their number is
+ * reported in a record of its own after the collected ones.
+ *
+ * An `emt_txn_t` is not thread safe; use one per thread (e.g. `_Thread_local`). Transactions
+ * don't nest.
+ */
+
+#ifndef EMT_TXN_CAPACITY
+#define EMT_TXN_CAPACITY 4096
+#endif
+
+typedef struct {
+    emt_sink_fn_t out;    ///< wrapped sink's `out_fn`
+    emt_sink_fn_t lock;   ///< wrapped sink's `lock`
+    emt_sink_fn_t unlock; ///< wrapped sink's `unlock`
+    void* arg;            ///< wrapped sink's `extra_arg`
+
+    uint8_t buffer[EMT_TXN_CAPACITY]; ///< records collected in the current transaction
+    emt_size_t size;                  ///< bytes of complete records in `buffer`
+    emt_size_t pending;               ///< bytes of the record being collected
+    int active;                       ///< whether a transaction is open
+    int dropping;                     ///< set while the record being collected doesn't fit
+    uint64_t dropped;                 ///< records dropped from the current transaction
+} emt_txn_t;
+
+/// Static initializer of an `emt_txn_t` wrapping the given sink.
+#define EMT_TXN_INITIALIZER(out, lock, unlock, arg)                                                \
+    {(out), (lock), (unlock), (arg), {0}, 0, 0, 0, 0, 0}
+/// Static initializer of an `emt_txn_t` wrapping stdout.
+#define EMT_TXN_STDOUT_INITIALIZER                                                                 \
+    EMT_TXN_INITIALIZER(emt_file_out, emt_file_lock, emt_file_unlock, NULL)
+
+static inline void emt_txn_init(
+    emt_txn_t* txn, emt_sink_fn_t out, emt_sink_fn_t lock, emt_sink_fn_t unlock, void* arg
+) {
+    txn->out = out;
+    txn->lock = lock;
+    txn->unlock = unlock;
+    txn->arg = arg;
+    txn->size = 0;
+    txn->pending = 0;
+    txn->active = 0;
+    txn->dropping = 0;
+    txn->dropped = 0;
+}
+
+/// Start collecting records instead of passing them on.
+static inline void emt_txn_begin(emt_txn_t* txn) {
+    txn->size = 0;
+    txn->dropped = 0;
+    txn->active = 1;
+}
+
+/// End the transaction without passing on anything it collected.
+static inline void emt_txn_discard(emt_txn_t* txn) {
+    txn->active = 0;
+    txn->size = 0;
+    txn->dropped = 0;
+}
+
+#define EMT_TXN_SINK_OUT(data, size, txn) (txn)->out((data), (size), (txn)->arg)
+#define EMT_TXN_SINK_LOCK(data, size, txn) (txn)->lock((data), (size), (txn)->arg)
+#define EMT_TXN_SINK_UNLOCK(data, size, txn) (txn)->unlock((data), (size), (txn)->arg)
+
+/// End the transaction and pass on everything it collected.
+static inline void emt_txn_commit(emt_txn_t* txn) {
+    if (!txn->active)
+        return;
+    txn->active = 0;
+    if (txn->size > 0) {
+        txn->lock(txn->buffer, txn->size, txn->arg);
+        txn->out(txn->buffer, txn->size, txn->arg);
+        txn->unlock(txn->buffer, txn->size, txn->arg);
+        txn->size = 0;
+    }
+    uint64_t dropped = txn->dropped;
+    if (dropped == 0)
+        return;
+    txn->dropped = 0;
+    EMT_TRACE_F(
+        EMT_DEFAULT_SEC_ATTR, EMT_PY_FORMAT, EMT_TXN_SINK_OUT, EMT_TXN_SINK_LOCK,
+        EMT_TXN_SINK_UNLOCK, txn, "\n", "{} records didn't fit into the transaction buffer",
+        uint64_t, dropped
+    );
+}
+
+/// Use as the `lock` argument of `EMT_TRACE_F` et al.
+static inline void emt_txn_lock(const void* info, emt_size_t size, emt_txn_t* txn) {
+    if (!txn->active) {
+        txn->lock(info, size, txn->arg);
+        return;
+    }
+    size &= (emt_size_t) ~(EMT_NULL_TERMINATED | EMT_LENGTH_PREFIXED);
+    txn->pending = 0;
+    txn->dropping = size > EMT_TXN_CAPACITY - txn->size;
+}
+
+/// Use as the `out` argument of `EMT_TRACE_F` et al.
+static inline void emt_txn_out(const void* data, emt_size_t size, emt_txn_t* txn) {
+    if (!txn->active) {
+        txn->out(data, size, txn->arg);
+        return;
+    }
+    if (txn->dropping)
+        return;
+    if (size > EMT_TXN_CAPACITY - txn->size - txn->pending) {
+        txn->dropping = 1;
+        return;
+    }
+    memcpy(txn->buffer + txn->size + txn->pending, data, size);
+    txn->pending += size;
+}
+
+/// Use as the `unlock` argument of `EMT_TRACE_F` et al.
+static inline void emt_txn_unlock(const void* info, emt_size_t size, emt_txn_t* txn) {
+    if (!txn->active) {
+        txn->unlock(info, size, txn->arg);
+        return;
+    }
+    if (txn->dropping)
+        txn->dropped++;
+    else
+        txn->size += txn->pending;
+    txn->pending = 0;
+    txn->dropping = 0;
+}
+
+#define EMT_TXN_INIT_OUT(data, size, txn) (txn)->out((data), (size), (txn)->arg)
+
+#if defined(EMT_DEFAULT_SEC_ATTR)
+
+#define EMTRACE_TXN_F(txn, ...)                                                                    \
+    EMT_TRACE_F(                                                                                   \
+        EMT_DEFAULT_SEC_ATTR, EMT_PY_FORMAT, emt_txn_out, emt_txn_lock, emt_txn_unlock, (txn), "", \
+        __VA_ARGS__                                                                                \
+    )
+#define EMTRACE_TXN(txn, str)                                                                      \
+    EMT_TRACE(EMT_DEFAULT_SEC_ATTR, emt_txn_out, emt_txn_lock, emt_txn_unlock, (txn), str)
+#define EMTRACE_TXN_S(txn, str)                                                                    \
+    EMT_TRACE_S(EMT_DEFAULT_SEC_ATTR, emt_txn_out, emt_txn_lock, emt_txn_unlock, (txn), "", str)
+#define EMTRACELN_TXN_F(txn, ...)                                                                  \
+    EMT_TRACE_F(                                                                                   \
+        EMT_DEFAULT_SEC_ATTR, EMT_PY_FORMAT, emt_txn_out, emt_txn_lock, emt_txn_unlock, (txn),     \
+        "\n", __VA_ARGS__                                                                          \
+    )
+#define EMTRACELN_TXN(txn, str)                                                                    \
+    EMT_TRACE(EMT_DEFAULT_SEC_ATTR, emt_txn_out, emt_txn_lock, emt_txn_unlock, (txn), str "\n")
+#define EMTRACELN_TXN_S(txn, str)                                                                  \
+    EMT_TRACE_S(EMT_DEFAULT_SEC_ATTR, emt_txn_out, emt_txn_lock, emt_txn_unlock, (txn), "\n", str)
+#define EMTRACE_TXN_INIT(txn) EMT_INIT(EMT_DEFAULT_SEC_ATTR, EMT_TXN_INIT_OUT, (txn))
+
+#endif // EMT_DEFAULT_SEC_ATTR
+
+// NOLINTEND(modernize-use-using,modernize-avoid-c-arrays)
+#ifdef __cplusplus
+}
+
+/// Discards the transaction it began when it goes out of scope, unless it was committed.
+class emt_txn_scope {
+  public:
+    explicit emt_txn_scope(emt_txn_t* txn) : txn_(txn) { emt_txn_begin(txn_); }
+    emt_txn_scope(const emt_txn_scope&) = delete;
+    auto operator=(const emt_txn_scope&) -> emt_txn_scope& = delete;
+    ~emt_txn_scope() { emt_txn_discard(txn_); }
+
+    void commit() { emt_txn_commit(txn_); }
+
+  private:
+    emt_txn_t* txn_;
+};
+#endif
+
+#endif // EMTRACE_TRANSACTION_H
@@ -9,6 +9,20 @@ test_fn_t* emt_get_integer_tests(size_t* count);
 test_fn_t* emt_get_double_tests(size_t* count);
 test_fn_t* emt_get_string_tests(size_t* count);
 test_fn_t* emt_get_mixed_tests(size_t* count);
+test_fn_t* emt_get_shm_tests(size_t* count);
+test_fn_t* emt_get_array_tests(size_t* count);
+test_fn_t* emt_get_blob_tests(size_t* count);
+test_fn_t* emt_get_stack_tests(size_t* count);
+test_fn_t* emt_get_struct_tests(size_t* count);
+test_fn_t* emt_get_enum_tests(size_t* count);
+test_fn_t* emt_get_repeat_tests(size_t* count);
+test_fn_t* emt_get_metrics_tests(size_t* count);
+test_fn_t* emt_get_transaction_tests(size_t* count);
+test_fn_t* emt_get_sigsafe_tests(size_t* count);
+test_fn_t* emt_get_percpu_tests(size_t* count);
+test_fn_t* emt_get_drain_tests(size_t* count);
+test_fn_t* emt_get_overhead_tests(size_t* count);
+test_fn_t* emt_get_perf_tests(size_t* count);
 
 #ifdef __cplusplus
 }
@@ -11,10 +11,12 @@ typedef struct {
     uint8_t* data;
     size_t capacity;
     size_t size;
+    size_t records; // number of records, counted by emt_test_lock
+    size_t locked;  // sum of the record sizes passed to emt_test_lock
 } test_buffer_t;
 
 // The custom output function that writes to our buffer
-static inline void to_buffer(const void* data, size_t size, void* extra_arg) {
+static inline void to_buffer(const void* data, emt_size_t size, void* extra_arg) {
     test_buffer_t* buffer = (test_buffer_t*) extra_arg;
     if (buffer->size + size > buffer->capacity) {
         // For simplicity, we'll just fail if the buffer is too small.
@@ -25,13 +27,21 @@ static inline void to_buffer(const void* data, size_t size, void* extra_arg) {
     buffer->size += size;
 }
 
-// Dummy lock/unlock functions, as we are single-threaded in tests
-static inline void emt_test_lock(const void* a, size_t b, void* c) {
+// Reads the (unaligned) 64-bit value at `offset` in the buffer
+static inline uint64_t test_buffer_u64(const test_buffer_t* buffer, size_t offset) {
+    uint64_t value;
+    memcpy(&value, buffer->data + offset, sizeof(value));
+    return value;
+}
+
+// Lock/unlock functions that only count, as we are single-threaded in tests
+static inline void emt_test_lock(const void* a, emt_size_t b, void* c) {
     (void) a;
-    (void) b;
-    (void) c;
+    test_buffer_t* buffer = (test_buffer_t*) c;
+    buffer->records++;
+    buffer->locked += b;
 }
-static inline void emt_test_unlock(const void* a, size_t b, void* c) {
+static inline void emt_test_unlock(const void* a, emt_size_t b, void* c) {
     (void) a;
     (void) b;
     (void) c;
@@ -41,6 +41,126 @@ int main(void) {
     total_result.passed += result.passed;
     total_result.failed += result.failed;
 
+    const char* test_names_shm[] = {
+        "test_shm_round_trip", "test_shm_full_ring_drops", "test_shm_close_with_producers"
+    };
+    tests = emt_get_shm_tests(&count);
+    result = run_tests(&ctx, tests, count, test_names_shm);
+    total_result.total += result.total;
+    total_result.passed += result.passed;
+    total_result.failed += result.failed;
+
+    const char* test_names_array[] = {
+        "test_array_trace", "test_span_trace", "test_array_single_copy"
+    };
+    tests = emt_get_array_tests(&count);
+    result = run_tests(&ctx, tests, count, test_names_array);
+    total_result.total += result.total;
+    total_result.passed += result.passed;
+    total_result.failed += result.failed;
+
+    const char* test_names_blob[] = {"test_blob_trace"};
+    tests = emt_get_blob_tests(&count);
+    result = run_tests(&ctx, tests, count, test_names_blob);
+    total_result.total += result.total;
+    total_result.passed += result.passed;
+    total_result.failed += result.failed;
+
+    const char* test_names_stack[] = {"test_stack_trace"};
+    tests = emt_get_stack_tests(&count);
+    result = run_tests(&ctx, tests, count, test_names_stack);
+    total_result.total += result.total;
+    total_result.passed += result.passed;
+    total_result.failed += result.failed;
+
+    const char* test_names_struct[] = {"test_struct_trace", "test_struct_single_copy"};
+    tests = emt_get_struct_tests(&count);
+    result = run_tests(&ctx, tests, count, test_names_struct);
+    total_result.total += result.total;
+    total_result.passed += result.passed;
+    total_result.failed += result.failed;
+
+    const char* test_names_enum[] = {"test_enum_table"};
+    tests = emt_get_enum_tests(&count);
+    result = run_tests(&ctx, tests, count, test_names_enum);
+    total_result.total += result.total;
+    total_result.passed += result.passed;
+    total_result.failed += result.failed;
+
+    const char* test_names_repeat[] = {
+        "test_repeat_collapse", "test_repeat_passthrough", "test_repeat_timeout",
+        "test_repeat_newline"
+    };
+    tests = emt_get_repeat_tests(&count);
+    result = run_tests(&ctx, tests, count, test_names_repeat);
+    total_result.total += result.total;
+    total_result.passed += result.passed;
+    total_result.failed += result.failed;
+
+    const char* test_names_metrics[] = {
+        "test_histogram_buckets", "test_metrics_flush", "test_metrics_flush_concurrently"
+    };
+    tests = emt_get_metrics_tests(&count);
+    result = run_tests(&ctx, tests, count, test_names_metrics);
+    total_result.total += result.total;
+    total_result.passed += result.passed;
+    total_result.failed += result.failed;
+
+    const char* test_names_transaction[] = {
+        "test_transaction_commit", "test_transaction_overflow"
+    };
+    tests = emt_get_transaction_tests(&count);
+    result = run_tests(&ctx, tests, count, test_names_transaction);
+    total_result.total += result.total;
+    total_result.passed += result.passed;
+    total_result.failed += result.failed;
+
+    const char* test_names_sigsafe[] = {"test_sigsafe_reentrant", "test_sigsafe_overflow"};
+    tests = emt_get_sigsafe_tests(&count);
+    result = run_tests(&ctx, tests, count, test_names_sigsafe);
+    total_result.total += result.total;
+    total_result.passed += result.passed;
+    total_result.failed += result.failed;
+
+    const char* test_names_percpu[] = {
+        "test_percpu_round_trip",        "test_percpu_full_ring_drops",
+        "test_percpu_order_across_cpus", "test_percpu_drain_per_node",
+        "test_percpu_sequence_range",    "test_percpu_memory_flags",
+        "test_percpu_threads"
+    };
+    tests = emt_get_percpu_tests(&count);
+    result = run_tests(&ctx, tests, count, test_names_percpu);
+    total_result.total += result.total;
+    total_result.passed += result.passed;
+    total_result.failed += result.failed;
+
+    const char* test_names_drain[] = {
+        "test_drain_batches", "test_drain_idle_flush", "test_drain_drop_newest",
+        "test_drain_overwrite_oldest", "test_drain_block", "test_drain_vmsplice",
+        "test_drain_vmsplice_late_reader"
+    };
+    tests = emt_get_drain_tests(&count);
+    result = run_tests(&ctx, tests, count, test_names_drain);
+    total_result.total += result.total;
+    total_result.passed += result.passed;
+    total_result.failed += result.failed;
+
+    const char* test_names_overhead[] = {"test_overhead_counts", "test_overhead_dump"};
+    tests = emt_get_overhead_tests(&count);
+    result = run_tests(&ctx, tests, count, test_names_overhead);
+    total_result.total += result.total;
+    total_result.passed += result.passed;
+    total_result.failed += result.failed;
+
+    const char* test_names_perf[] = {
+        "test_perf_snapshot", "test_perf_trace", "test_perf_timestamps_only"
+    };
+    tests = emt_get_perf_tests(&count);
+    result = run_tests(&ctx, tests, count, test_names_perf);
+    total_result.total += result.total;
+    total_result.passed += result.passed;
+    total_result.failed += result.failed;
+
     printf("\n========================================\n");
     printf("Test Results: %zu/%zu passed", total_result.passed, total_result.total);
     if (total_result.failed > 0) {
@@ -0,0 +1,116 @@
+#include "emtrace/test_framework.h"
+#include "emtrace/test_suites.h"
+#include "emtrace/test_utils.h"
+#include <emtrace/emtrace.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef struct {
+    size_t calls;
+    emt_size_t locked_size;
+} call_counter_t;
+
+static inline void count_out(const void* data, emt_size_t size, call_counter_t* counter) {
+    (void) data;
+    (void) size;
+    counter->calls++;
+}
+
+static inline void count_lock(const void* data, emt_size_t size, call_counter_t* counter) {
+    (void) data;
+    counter->locked_size = size;
+}
+
+static inline void count_unlock(const void* data, emt_size_t size, call_counter_t* counter) {
+    (void) data;
+    (void) size;
+    (void) counter;
+}
+
+static bool test_array_trace(test_context_t* ctx) {
+    uint8_t raw_buffer[128];
+    test_buffer_t buffer = {.data = raw_buffer, .capacity = sizeof(raw_buffer), .size = 0};
+
+    uint16_t values[5] = {1, 2, 3, 4, 5};
+    EMT_TEST_TRACE_F(buffer, EMT_PY_FORMAT, "{} {}", EMT_ARRAY(uint16_t, 5), values, int, 6);
+
+    TEST_ASSERT_EQ(
+        ctx, buffer.size, sizeof(emt_ptr_t) + sizeof(values) + sizeof(int),
+        "buffer size should match pointer + array + integer size"
+    );
+    TEST_ASSERT(
+        ctx, memcmp(buffer.data + sizeof(emt_ptr_t), values, sizeof(values)) == 0,
+        "array elements should be traced contiguously"
+    );
+
+    int value;
+    memcpy(&value, buffer.data + sizeof(emt_ptr_t) + sizeof(values), sizeof(int));
+    TEST_ASSERT_EQ(ctx, value, 6, "argument after the array should follow it");
+
+    return true;
+}
+
+static bool test_span_trace(test_context_t* ctx) {
+    uint8_t raw_buffer[128];
+    test_buffer_t buffer = {.data = raw_buffer, .capacity = sizeof(raw_buffer), .size = 0};
+
+    double values[3] = {0.5, 1.5, 2.5};
+    size_t count = 2;
+    EMT_TEST_TRACE_F(buffer, EMT_PY_FORMAT, "{}", EMT_SPAN(double, count), values);
+
+    TEST_ASSERT_EQ(
+        ctx, buffer.size, sizeof(emt_ptr_t) + sizeof(emt_size_t) + 2 * sizeof(double),
+        "buffer size should match pointer + count + elements"
+    );
+
+    emt_size_t traced_count;
+    memcpy(&traced_count, buffer.data + sizeof(emt_ptr_t), sizeof(emt_size_t));
+    TEST_ASSERT_EQ(ctx, traced_count, 2, "element count should prefix the elements");
+    TEST_ASSERT(
+        ctx,
+        memcmp(
+            buffer.data + sizeof(emt_ptr_t) + sizeof(emt_size_t), values, 2 * sizeof(double)
+        ) == 0,
+        "span elements should be traced contiguously"
+    );
+
+    return true;
+}
+
+static bool test_array_single_copy(test_context_t* ctx) {
+    call_counter_t counter = {0, 0};
+    uint32_t histogram[64] = {0};
+    size_t n = 64;
+
+    EMT_TRACE_F(
+        static const, EMT_PY_FORMAT, count_out, count_lock, count_unlock, &counter, "", "{}",
+        EMT_ARRAY(uint32_t, 64), histogram
+    );
+    TEST_ASSERT_EQ(ctx, counter.calls, 2, "fixed array should be sent with a single out_fn call");
+    TEST_ASSERT_EQ(
+        ctx, counter.locked_size, sizeof(emt_ptr_t) + sizeof(histogram),
+        "lock should be given the exact record size"
+    );
+
+    counter.calls = 0;
+    EMT_TRACE_F(
+        static const, EMT_PY_FORMAT, count_out, count_lock, count_unlock, &counter, "", "{}",
+        EMT_SPAN(uint32_t, n), histogram
+    );
+    TEST_ASSERT_EQ(ctx, counter.calls, 3, "span should be sent as count + single buffer");
+    TEST_ASSERT_EQ(
+        ctx, counter.locked_size, (sizeof(emt_ptr_t) + sizeof(emt_size_t)) | EMT_LENGTH_PREFIXED,
+        "lock should be given the minimum record size, flagged as variable"
+    );
+
+    return true;
+}
+
+test_fn_t* emt_get_array_tests(size_t* count) {
+    static test_fn_t tests[] = {
+        test_array_trace, test_span_trace, test_array_single_copy
+    };
+    *count = sizeof(tests) / sizeof(tests[0]);
+    return tests;
+}
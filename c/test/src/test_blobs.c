@@ -0,0 +1,44 @@
+#include "emtrace/test_framework.h"
+#include "emtrace/test_suites.h"
+#include "emtrace/test_utils.h"
+#include <emtrace/emtrace.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+static bool test_blob_trace(test_context_t* ctx) {
+    uint8_t raw_buffer[64];
+    test_buffer_t buffer = {.data = raw_buffer, .capacity = sizeof(raw_buffer), .size = 0};
+
+    const char packet[] = "0123456789";
+    size_t length = 10;
+    EMT_TEST_TRACE_F(buffer, EMT_PY_FORMAT, "{}", EMT_BLOB_MAX(length, 4), packet);
+
+    TEST_ASSERT_EQ(
+        ctx, buffer.size, sizeof(emt_ptr_t) + sizeof(emt_size_t) + 4,
+        "blob should be capped at its maximum"
+    );
+
+    emt_size_t traced_count;
+    memcpy(&traced_count, buffer.data + sizeof(emt_ptr_t), sizeof(emt_size_t));
+    TEST_ASSERT_EQ(ctx, traced_count, 4, "byte count should prefix the bytes");
+    TEST_ASSERT(
+        ctx, memcmp(buffer.data + sizeof(emt_ptr_t) + sizeof(emt_size_t), "0123", 4) == 0,
+        "blob should contain the first bytes"
+    );
+
+    buffer.size = 0;
+    EMT_TEST_TRACE_F(buffer, EMT_PY_FORMAT, "{}", EMT_BLOB(length), packet);
+    TEST_ASSERT_EQ(
+        ctx, buffer.size, sizeof(emt_ptr_t) + sizeof(emt_size_t) + 10,
+        "uncapped blob should contain all bytes"
+    );
+
+    return true;
+}
+
+test_fn_t* emt_get_blob_tests(size_t* count) {
+    static test_fn_t tests[] = {test_blob_trace};
+    *count = sizeof(tests) / sizeof(tests[0]);
+    return tests;
+}
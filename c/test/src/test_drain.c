@@ -0,0 +1,408 @@
+#include "emtrace/test_framework.h"
+#include "emtrace/test_suites.h"
+#include <emtrace/drain.h>
+#include <emtrace/emtrace.h>
+#include <emtrace/percpu.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/// one call site, so that all traced records share their info pointer
+static void emt_test_drain_trace(emt_percpu_t* percpu, uint64_t value) {
+    EMT_PERCPU_TRACE_F(static const, EMT_PY_FORMAT, percpu, "", "{}", uint64_t, value);
+}
+
+#define EMT_TEST_DRAIN_RECORD_SIZE (sizeof(emt_ptr_t) + sizeof(uint64_t))
+#define EMT_TEST_DRAIN_PADDED_SIZE                                                                 \
+    emt_percpu_padded(EMT_PERCPU_HEADER_SIZE + EMT_TEST_DRAIN_RECORD_SIZE)
+#define EMT_TEST_DRAIN_THREADS 4
+#define EMT_TEST_DRAIN_RECORDS 5000
+
+/// the records written by an engine, split into the traced values and the synthetic ones
+typedef struct {
+    uint64_t values[EMT_TEST_DRAIN_THREADS * EMT_TEST_DRAIN_RECORDS];
+    size_t count;
+    uint64_t dropped; ///< sum of the synthetic records
+    size_t dropped_records;
+    size_t size;
+} emt_test_drain_output_t;
+
+static emt_test_drain_output_t emt_test_drain_output;
+
+typedef struct {
+    emt_percpu_t percpu;
+    emt_drain_t drain;
+    emt_drain_config_t config;
+    FILE* file;
+} emt_test_drain_setup_t;
+
+static int emt_test_drain_open(emt_test_drain_setup_t* setup, uint64_t ring_size, int policy) {
+    setup->file = tmpfile();
+    if (setup->file == NULL)
+        return -1;
+    if (emt_percpu_open(
+            &setup->percpu, ring_size, emt_drain_out, emt_drain_lock, emt_drain_unlock,
+            &setup->drain
+        ) != 0)
+        return -1;
+    setup->percpu.backpressure = policy;
+    setup->percpu.on_full = emt_drain_wake;
+    emt_drain_config_t config = EMT_DRAIN_CONFIG_DEFAULT(fileno(setup->file));
+    config.drain = emt_percpu_drain_source;
+    config.dropped = emt_percpu_dropped_source;
+    config.source = &setup->percpu;
+    setup->config = config;
+    return 0;
+}
+
+/// read back what was written so far; all records but the synthetic ones come from one call site
+static void emt_test_drain_read(emt_test_drain_setup_t* setup) {
+    emt_test_drain_output_t* output = &emt_test_drain_output;
+    memset(output, 0, sizeof(*output));
+    int fd = fileno(setup->file);
+    off_t size = lseek(fd, 0, SEEK_END);
+    uint8_t* data = (uint8_t*) malloc((size_t) size + 1);
+    (void) lseek(fd, 0, SEEK_SET);
+    ssize_t length = read(fd, data, (size_t) size);
+    output->size = length < 0 ? 0 : (size_t) length;
+
+    emt_ptr_t traced = 0;
+    for (size_t pos = 0; pos + EMT_TEST_DRAIN_RECORD_SIZE <= output->size;
+         pos += EMT_TEST_DRAIN_RECORD_SIZE) {
+        emt_ptr_t info;
+        uint64_t value;
+        memcpy(&info, data + pos, sizeof(info));
+        memcpy(&value, data + pos + sizeof(info), sizeof(value));
+        if (traced == 0 && output->dropped_records == 0 && output->count == 0)
+            traced = info;
+        if (info == traced) {
+            if (output->count < sizeof(output->values) / sizeof(output->values[0]))
+                output->values[output->count] = value;
+            output->count++;
+        } else {
+            output->dropped += value;
+            output->dropped_records++;
+        }
+    }
+    free(data);
+}
+
+/// wait up to a second for a running engine to have written `size` bytes
+static void emt_test_drain_wait(emt_drain_t* drain, uint64_t size) {
+    for (int i = 0; i < 1000 && __atomic_load_n(&drain->written, __ATOMIC_RELAXED) < size; i++) {
+        struct timespec pause = {0, 1000000};
+        (void) nanosleep(&pause, NULL);
+    }
+}
+
+static void emt_test_drain_close(emt_test_drain_setup_t* setup) {
+    emt_percpu_close(&setup->percpu);
+    (void) fclose(setup->file);
+}
+
+static bool test_drain_batches(test_context_t* ctx) {
+    emt_test_drain_setup_t setup;
+    TEST_ASSERT_EQ(
+        ctx, emt_test_drain_open(&setup, 4096, EMT_BACKPRESSURE_DROP_NEWEST), 0,
+        "buffers should be set up"
+    );
+    for (uint64_t i = 0; i < 10; i++) {
+        emt_test_drain_trace(&setup.percpu, i);
+    }
+    setup.config.batch_size = 4 * EMT_TEST_DRAIN_RECORD_SIZE;
+    TEST_ASSERT_EQ(ctx, emt_drain_start(&setup.drain, &setup.config), 0, "engine should start");
+    emt_drain_stop(&setup.drain);
+
+    emt_test_drain_read(&setup);
+    TEST_ASSERT_EQ(ctx, emt_test_drain_output.count, 10, "all records should be written");
+    for (uint64_t i = 0; i < 10; i++) {
+        TEST_ASSERT_EQ(ctx, emt_test_drain_output.values[i], i, "records should keep their order");
+    }
+    TEST_ASSERT_EQ(ctx, setup.drain.batches, 3, "batches should be at most batch_size long");
+    TEST_ASSERT_EQ(ctx, emt_test_drain_output.dropped_records, 0, "nothing was dropped");
+
+    emt_test_drain_close(&setup);
+    return true;
+}
+
+static bool test_drain_idle_flush(test_context_t* ctx) {
+    emt_test_drain_setup_t setup;
+    TEST_ASSERT_EQ(
+        ctx, emt_test_drain_open(&setup, 4096, EMT_BACKPRESSURE_DROP_NEWEST), 0,
+        "buffers should be set up"
+    );
+    TEST_ASSERT_EQ(ctx, emt_drain_start(&setup.drain, &setup.config), 0, "engine should start");
+    emt_test_drain_trace(&setup.percpu, 42);
+    // far less than a batch, so only running dry (or the deadline) writes it
+    emt_test_drain_wait(&setup.drain, EMT_TEST_DRAIN_RECORD_SIZE);
+    TEST_ASSERT_EQ(
+        ctx, __atomic_load_n(&setup.drain.written, __ATOMIC_RELAXED), EMT_TEST_DRAIN_RECORD_SIZE,
+        "the record should be written while the engine is running"
+    );
+    emt_drain_stop(&setup.drain);
+
+    emt_test_drain_close(&setup);
+    return true;
+}
+
+static bool test_drain_drop_newest(test_context_t* ctx) {
+    emt_test_drain_setup_t setup;
+    TEST_ASSERT_EQ(
+        ctx, emt_test_drain_open(&setup, 256, EMT_BACKPRESSURE_DROP_NEWEST), 0,
+        "buffers should be set up"
+    );
+    // overload: the engine isn't running yet
+    for (uint64_t i = 0; i < 100; i++) {
+        emt_test_drain_trace(&setup.percpu, i);
+    }
+    const uint64_t fit = 256 / EMT_TEST_DRAIN_PADDED_SIZE;
+    TEST_ASSERT_EQ(ctx, emt_percpu_dropped(&setup.percpu), 100 - fit, "the rest is dropped");
+    TEST_ASSERT_EQ(ctx, emt_drain_start(&setup.drain, &setup.config), 0, "engine should start");
+    emt_drain_stop(&setup.drain);
+
+    emt_test_drain_read(&setup);
+    TEST_ASSERT_EQ(ctx, emt_test_drain_output.count, fit, "the records that fit are written");
+    TEST_ASSERT_EQ(ctx, emt_test_drain_output.values[0], 0, "the oldest records are kept");
+    TEST_ASSERT_EQ(ctx, emt_test_drain_output.dropped_records, 1, "drops are reported once");
+    TEST_ASSERT_EQ(ctx, emt_test_drain_output.dropped, 100 - fit, "with their number");
+
+    emt_test_drain_close(&setup);
+    return true;
+}
+
+static bool test_drain_overwrite_oldest(test_context_t* ctx) {
+    emt_test_drain_setup_t setup;
+    TEST_ASSERT_EQ(
+        ctx, emt_test_drain_open(&setup, 256, EMT_BACKPRESSURE_OVERWRITE_OLDEST), 0,
+        "buffers should be set up"
+    );
+    for (uint64_t i = 0; i < 100; i++) {
+        emt_test_drain_trace(&setup.percpu, i);
+    }
+    const uint64_t fit = 256 / EMT_TEST_DRAIN_PADDED_SIZE;
+    TEST_ASSERT_EQ(ctx, emt_percpu_dropped(&setup.percpu), 100 - fit, "the oldest are discarded");
+    TEST_ASSERT_EQ(ctx, emt_drain_start(&setup.drain, &setup.config), 0, "engine should start");
+    emt_test_drain_wait(&setup.drain, fit * EMT_TEST_DRAIN_RECORD_SIZE);
+    // the drainer must not wait for the discarded records
+    emt_test_drain_trace(&setup.percpu, 100);
+    emt_drain_stop(&setup.drain);
+
+    emt_test_drain_read(&setup);
+    TEST_ASSERT_EQ(ctx, emt_test_drain_output.count, fit + 1, "the newest records are written");
+    for (uint64_t i = 0; i <= fit; i++) {
+        TEST_ASSERT_EQ(
+            ctx, emt_test_drain_output.values[i], 100 - fit + i, "records should keep their order"
+        );
+    }
+    TEST_ASSERT_EQ(ctx, emt_test_drain_output.dropped, 100 - fit, "discarded records are reported");
+
+    emt_test_drain_close(&setup);
+    return true;
+}
+
+typedef struct {
+    emt_percpu_t* percpu;
+    uint64_t index;
+} emt_test_drain_producer_t;
+
+static void* emt_test_drain_produce(void* arg) {
+    emt_test_drain_producer_t* producer = (emt_test_drain_producer_t*) arg;
+    for (uint64_t i = 0; i < EMT_TEST_DRAIN_RECORDS; i++) {
+        emt_test_drain_trace(producer->percpu, (producer->index << 32) | i);
+    }
+    return NULL;
+}
+
+static bool test_drain_block(test_context_t* ctx) {
+    emt_test_drain_setup_t setup;
+    TEST_ASSERT_EQ(
+        ctx, emt_test_drain_open(&setup, 1024, EMT_BACKPRESSURE_BLOCK), 0,
+        "buffers should be set up"
+    );
+    TEST_ASSERT_EQ(ctx, emt_drain_start(&setup.drain, &setup.config), 0, "engine should start");
+    // overload: the ring holds a few dozen records, the producers write thousands
+    pthread_t threads[EMT_TEST_DRAIN_THREADS];
+    emt_test_drain_producer_t producers[EMT_TEST_DRAIN_THREADS];
+    for (uint64_t i = 0; i < EMT_TEST_DRAIN_THREADS; i++) {
+        producers[i].percpu = &setup.percpu;
+        producers[i].index = i;
+        TEST_ASSERT_EQ(
+            ctx, pthread_create(&threads[i], NULL, emt_test_drain_produce, &producers[i]), 0,
+            "producer should start"
+        );
+    }
+    for (uint64_t i = 0; i < EMT_TEST_DRAIN_THREADS; i++) {
+        (void) pthread_join(threads[i], NULL);
+    }
+    emt_drain_stop(&setup.drain);
+
+    TEST_ASSERT_EQ(ctx, emt_percpu_dropped(&setup.percpu), 0, "producers wait instead of dropping");
+    emt_test_drain_read(&setup);
+    TEST_ASSERT_EQ(
+        ctx, emt_test_drain_output.count, EMT_TEST_DRAIN_THREADS * EMT_TEST_DRAIN_RECORDS,
+        "all records should be written"
+    );
+    uint64_t next[EMT_TEST_DRAIN_THREADS] = {0};
+    for (size_t i = 0; i < emt_test_drain_output.count; i++) {
+        uint64_t value = emt_test_drain_output.values[i];
+        TEST_ASSERT(ctx, (value >> 32) < EMT_TEST_DRAIN_THREADS, "thread index should be valid");
+        TEST_ASSERT_EQ(ctx, value & 0xffffffff, next[value >> 32], "records keep their order");
+        next[value >> 32]++;
+    }
+
+    emt_test_drain_close(&setup);
+    return true;
+}
+
+typedef struct {
+    int fd;
+    uint8_t* data;
+    size_t size;
+    size_t capacity;
+    long delay_ns; ///< before reading anything
+} emt_test_drain_reader_t;
+
+/// reads the pipe slowly, so that the engine has to wait for its buffers
+static void* emt_test_drain_read_pipe(void* arg) {
+    emt_test_drain_reader_t* reader = (emt_test_drain_reader_t*) arg;
+    struct timespec delay = {0, reader->delay_ns};
+    (void) nanosleep(&delay, NULL);
+    for (;;) {
+        size_t chunk = reader->capacity - reader->size < 1000 ? reader->capacity - reader->size
+                                                              : 1000;
+        ssize_t length = read(reader->fd, reader->data + reader->size, chunk);
+        if (length <= 0)
+            break;
+        reader->size += (size_t) length;
+        struct timespec pause = {0, 100000};
+        (void) nanosleep(&pause, NULL);
+    }
+    return NULL;
+}
+
+static bool test_drain_vmsplice(test_context_t* ctx) {
+    int fds[2];
+    TEST_ASSERT_EQ(ctx, pipe(fds), 0, "pipe should be created");
+    emt_test_drain_reader_t reader = {fds[0], NULL, 0, 0, 0};
+    reader.capacity = 2 * (size_t) EMT_TEST_DRAIN_RECORDS * EMT_TEST_DRAIN_RECORD_SIZE;
+    reader.data = (uint8_t*) malloc(reader.capacity);
+    pthread_t thread;
+    TEST_ASSERT_EQ(
+        ctx, pthread_create(&thread, NULL, emt_test_drain_read_pipe, &reader), 0,
+        "reader should start"
+    );
+
+    emt_test_drain_setup_t setup;
+    TEST_ASSERT_EQ(
+        ctx, emt_test_drain_open(&setup, 4096, EMT_BACKPRESSURE_BLOCK), 0,
+        "buffers should be set up"
+    );
+    setup.config.fd = fds[1];
+    setup.config.flags = EMT_DRAIN_VMSPLICE;
+    TEST_ASSERT_EQ(ctx, emt_drain_start(&setup.drain, &setup.config), 0, "engine should start");
+    TEST_ASSERT(
+        ctx, setup.drain.applied & EMT_DRAIN_APPLIED_VMSPLICE, "batches should be spliced"
+    );
+    // many times what the pipe holds, so the buffers are reused, and in bursts, so that most
+    // batches take up far less than the pipe
+    for (uint64_t i = 0; i < 2 * EMT_TEST_DRAIN_RECORDS; i++) {
+        emt_test_drain_trace(&setup.percpu, i);
+        if (i % 64 == 63) {
+            struct timespec pause = {0, 50000};
+            (void) nanosleep(&pause, NULL);
+        }
+    }
+    emt_drain_stop(&setup.drain);
+    (void) close(fds[1]);
+    (void) pthread_join(thread, NULL);
+    (void) close(fds[0]);
+
+    TEST_ASSERT_EQ(ctx, reader.size, reader.capacity, "all records should be read");
+    bool intact = true;
+    for (uint64_t i = 0; i < 2 * EMT_TEST_DRAIN_RECORDS; i++) {
+        uint64_t value;
+        memcpy(&value, reader.data + (i * EMT_TEST_DRAIN_RECORD_SIZE) + sizeof(emt_ptr_t), 8);
+        intact &= value == i;
+    }
+    free(reader.data);
+    TEST_ASSERT(ctx, intact, "records shouldn't be overwritten before they were read");
+
+    emt_test_drain_close(&setup);
+    return true;
+}
+
+#define EMT_TEST_DRAIN_PREFIX_SIZE 4000
+
+static bool test_drain_vmsplice_late_reader(test_context_t* ctx) {
+    int fds[2];
+    TEST_ASSERT_EQ(ctx, pipe(fds), 0, "pipe should be created");
+    // like the init record, written to the pipe before the engine starts
+    uint8_t prefix[EMT_TEST_DRAIN_PREFIX_SIZE];
+    for (size_t i = 0; i < sizeof(prefix); i++)
+        prefix[i] = (uint8_t) i;
+    TEST_ASSERT_EQ(
+        ctx, write(fds[1], prefix, sizeof(prefix)), (ssize_t) sizeof(prefix),
+        "the prefix should be written"
+    );
+
+    emt_test_drain_setup_t setup;
+    TEST_ASSERT_EQ(
+        ctx, emt_test_drain_open(&setup, 4096, EMT_BACKPRESSURE_BLOCK), 0,
+        "buffers should be set up"
+    );
+    setup.config.fd = fds[1];
+    setup.config.flags = EMT_DRAIN_VMSPLICE;
+    TEST_ASSERT_EQ(ctx, emt_drain_start(&setup.drain, &setup.config), 0, "engine should start");
+
+    // the reader starts once the engine has gone through its buffers many times, each time with
+    // less spliced than the prefix left unread
+    emt_test_drain_reader_t reader = {fds[0], NULL, 0, 0, 20000000};
+    reader.capacity =
+        sizeof(prefix) + ((size_t) EMT_TEST_DRAIN_RECORDS * EMT_TEST_DRAIN_RECORD_SIZE);
+    reader.data = (uint8_t*) malloc(reader.capacity);
+    pthread_t thread;
+    TEST_ASSERT_EQ(
+        ctx, pthread_create(&thread, NULL, emt_test_drain_read_pipe, &reader), 0,
+        "reader should start"
+    );
+    for (uint64_t i = 0; i < EMT_TEST_DRAIN_RECORDS; i++) {
+        emt_test_drain_trace(&setup.percpu, i);
+        if (i % 8 == 7) {
+            struct timespec pause = {0, 50000};
+            (void) nanosleep(&pause, NULL);
+        }
+    }
+    emt_drain_stop(&setup.drain);
+    (void) close(fds[1]);
+    (void) pthread_join(thread, NULL);
+    (void) close(fds[0]);
+
+    TEST_ASSERT_EQ(ctx, reader.size, reader.capacity, "everything should be read");
+    bool intact = memcmp(reader.data, prefix, sizeof(prefix)) == 0;
+    for (uint64_t i = 0; i < EMT_TEST_DRAIN_RECORDS; i++) {
+        uint64_t value;
+        const size_t offset = sizeof(prefix) + (i * EMT_TEST_DRAIN_RECORD_SIZE) + sizeof(emt_ptr_t);
+        memcpy(&value, reader.data + offset, sizeof(value));
+        intact &= value == i;
+    }
+    free(reader.data);
+    TEST_ASSERT(ctx, intact, "batches shouldn't be overwritten while the pipe holds them");
+
+    emt_test_drain_close(&setup);
+    return true;
+}
+
+test_fn_t* emt_get_drain_tests(size_t* count) {
+    static test_fn_t tests[] = {
+        test_drain_batches, test_drain_idle_flush, test_drain_drop_newest,
+        test_drain_overwrite_oldest, test_drain_block, test_drain_vmsplice,
+        test_drain_vmsplice_late_reader
+    };
+    *count = sizeof(tests) / sizeof(tests[0]);
+    return tests;
+}
@@ -0,0 +1,45 @@
+#include "emtrace/test_framework.h"
+#include "emtrace/test_suites.h"
+#include "emtrace/test_utils.h"
+#include <emtrace/emtrace.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef enum { PHASE_INIT, PHASE_RUN = 5, PHASE_DONE = -1 } phase_t;
+#define EMT_ENUM_phase_t(entry, ctx)                                                               \
+    entry(ctx, PHASE_INIT) entry(ctx, PHASE_RUN) entry(ctx, PHASE_DONE)
+EMTRACE_ENUM_TABLE(phase_t);
+
+static bool test_enum_table(test_context_t* ctx) {
+    uint8_t raw_buffer[64];
+    test_buffer_t buffer = {.data = raw_buffer, .capacity = sizeof(raw_buffer), .size = 0};
+
+    phase_t phase = PHASE_RUN;
+    EMT_TEST_TRACE_F(buffer, EMT_PY_FORMAT, "{}", EMT_ENUM(phase_t), phase);
+    TEST_ASSERT_EQ(
+        ctx, buffer.size, sizeof(emt_ptr_t) + sizeof(phase_t), "enum should be traced as its value"
+    );
+
+    const uint8_t magic[16] = {EMT_ENUM_MAGIC};
+    const emt_enum_table_phase_t_t* table = &emt_enum_table_phase_t;
+    const char* base = (const char*) table;
+    TEST_ASSERT(
+        ctx, memcmp(table->magic, magic, sizeof(magic)) == 0, "table should start with the magic"
+    );
+    TEST_ASSERT_EQ(ctx, table->header[0], 3, "table should have an entry per enumerator");
+    TEST_ASSERT(ctx, strcmp(base + table->header[1], "phase_t") == 0, "table should name the enum");
+    const int64_t* values = (const int64_t*) (const void*) (base + table->header[2]);
+    const emt_size_t* names = (const emt_size_t*) (const void*) (base + table->header[3]);
+    TEST_ASSERT_EQ(ctx, values[1], 5, "values should be in declaration order");
+    TEST_ASSERT_EQ(ctx, values[2], -1, "negative values should be sign extended");
+    TEST_ASSERT(ctx, strcmp(base + names[2], "PHASE_DONE") == 0, "names should match the values");
+
+    return true;
+}
+
+test_fn_t* emt_get_enum_tests(size_t* count) {
+    static test_fn_t tests[] = {test_enum_table};
+    *count = sizeof(tests) / sizeof(tests[0]);
+    return tests;
+}
@@ -0,0 +1,195 @@
+#include "emtrace/test_framework.h"
+#include "emtrace/test_suites.h"
+#include "emtrace/test_utils.h"
+#include <emtrace/emtrace.h>
+#include <emtrace/metrics.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/// Offset of the first record of `kind` in `buffer`, or its size if there is none.
+static size_t emt_test_metrics_find(const test_buffer_t* buffer, uint8_t kind) {
+    size_t pos = 0;
+    while (pos < buffer->size && buffer->data[pos + sizeof(emt_ptr_t)] != kind) {
+        pos += sizeof(emt_ptr_t) + 1 + sizeof(uint64_t);
+        if (buffer->data[pos - sizeof(uint64_t) - 1] == EMT_METRIC_COUNTER) {
+            pos += sizeof(uint64_t);
+            continue;
+        }
+        emt_size_t num_pairs;
+        memcpy(&num_pairs, buffer->data + pos + (4 * sizeof(uint64_t)) + 1, sizeof(num_pairs));
+        pos += (4 * sizeof(uint64_t)) + 1 + sizeof(num_pairs) + (num_pairs * sizeof(uint64_t));
+    }
+    return pos;
+}
+
+static bool test_histogram_buckets(test_context_t* ctx) {
+    const unsigned exact = 1U << EMT_HISTOGRAM_SUB_BITS;
+    for (unsigned v = 0; v < exact; v++) {
+        TEST_ASSERT_EQ(ctx, emt_histogram_bucket(v), v, "small values should be exact");
+    }
+    TEST_ASSERT_EQ(ctx, emt_histogram_bucket(exact), exact, "buckets should be contiguous");
+    TEST_ASSERT_EQ(
+        ctx, emt_histogram_bucket(2 * exact), 2 * exact, "each octave should have sub-buckets"
+    );
+    TEST_ASSERT_EQ(
+        ctx, emt_histogram_bucket(2 * exact + 1), 2 * exact, "values should share sub-buckets"
+    );
+    TEST_ASSERT_EQ(
+        ctx, emt_histogram_bucket(UINT64_MAX), EMT_HISTOGRAM_BUCKETS - 1,
+        "the largest value should fall into the last bucket"
+    );
+    return true;
+}
+
+static bool test_metrics_flush(test_context_t* ctx) {
+    uint8_t raw_buffer[1024];
+    test_buffer_t buffer = {.data = raw_buffer, .capacity = sizeof(raw_buffer), .size = 0};
+    emt_metrics_t metrics;
+    emt_metrics_init(&metrics, to_buffer, emt_test_lock, emt_test_unlock, &buffer, 0);
+
+    for (uint64_t i = 0; i < 1000; i++) {
+        EMT_COUNTER(static const, &metrics, "events", 2);
+        EMT_HISTOGRAM(static const, &metrics, "sizes", i % 4);
+    }
+    TEST_ASSERT_EQ(ctx, buffer.size, 0, "nothing should be written before flushing");
+
+    emt_metrics_flush(&metrics);
+    TEST_ASSERT_EQ(ctx, buffer.locked, buffer.size, "lock should be given the exact record sizes");
+
+    // the records come in the order of the metrics in their section
+    const size_t histogram_start = emt_test_metrics_find(&buffer, EMT_METRIC_HISTOGRAM);
+    TEST_ASSERT(ctx, histogram_start < buffer.size, "the histogram should be flushed");
+    size_t pos = histogram_start + sizeof(emt_ptr_t);
+    pos += 1 + sizeof(uint64_t);
+    TEST_ASSERT_EQ(ctx, test_buffer_u64(&buffer, pos), 1000, "histogram count");
+    TEST_ASSERT_EQ(ctx, test_buffer_u64(&buffer, pos + 8), 1500, "histogram sum");
+    TEST_ASSERT_EQ(ctx, test_buffer_u64(&buffer, pos + 16), 0, "histogram min");
+    TEST_ASSERT_EQ(ctx, test_buffer_u64(&buffer, pos + 24), 3, "histogram max");
+    pos += 4 * sizeof(uint64_t);
+    TEST_ASSERT_EQ(ctx, buffer.data[pos], EMT_HISTOGRAM_SUB_BITS, "sub bits should be sent");
+    pos += 1;
+    emt_size_t num_pairs;
+    memcpy(&num_pairs, buffer.data + pos, sizeof(num_pairs));
+    TEST_ASSERT_EQ(ctx, num_pairs, 8, "only the four used buckets should be sent");
+    pos += sizeof(num_pairs);
+    for (uint64_t b = 0; b < 4; b++) {
+        TEST_ASSERT_EQ(ctx, test_buffer_u64(&buffer, pos), b, "bucket index");
+        TEST_ASSERT_EQ(ctx, test_buffer_u64(&buffer, pos + 8), 250, "bucket count");
+        pos += 2 * sizeof(uint64_t);
+    }
+
+    const size_t histogram_size = pos - histogram_start;
+
+    pos = emt_test_metrics_find(&buffer, EMT_METRIC_COUNTER) + sizeof(emt_ptr_t);
+    TEST_ASSERT(ctx, pos < buffer.size, "the counter should be flushed");
+    pos += 1 + sizeof(uint64_t);
+    TEST_ASSERT_EQ(ctx, test_buffer_u64(&buffer, pos), 2000, "counter value");
+    const size_t counter_size = sizeof(emt_ptr_t) + 1 + (2 * sizeof(uint64_t));
+    TEST_ASSERT_EQ(
+        ctx, buffer.size, histogram_size + counter_size, "nothing else should be written"
+    );
+
+    emt_metrics_t other;
+    emt_metrics_init(&other, to_buffer, emt_test_lock, emt_test_unlock, &buffer, 0);
+    buffer.size = 0;
+    emt_metrics_flush(&other);
+    TEST_ASSERT_EQ(ctx, buffer.size, 0, "metrics are only flushed by their own emt_metrics_t");
+
+    emt_metrics_flush(&metrics);
+    pos = emt_test_metrics_find(&buffer, EMT_METRIC_HISTOGRAM) + sizeof(emt_ptr_t) + 1 + 8;
+    TEST_ASSERT_EQ(ctx, test_buffer_u64(&buffer, pos), 0, "the histogram should be reset");
+    pos = emt_test_metrics_find(&buffer, EMT_METRIC_COUNTER) + sizeof(emt_ptr_t) + 1 + 8;
+    TEST_ASSERT_EQ(ctx, test_buffer_u64(&buffer, pos), 0, "the counter should be reset");
+    return true;
+}
+
+#define EMT_TEST_METRICS_THREADS 4
+#define EMT_TEST_METRICS_VALUES 1000000
+#define EMT_TEST_METRICS_VALUE 3
+
+/// Checks every histogram record on `unlock`, as it is written by a concurrent flush.
+typedef struct {
+    test_buffer_t record; ///< first, so that `to_buffer` writes into it
+    uint64_t counted;
+    bool consistent;
+} emt_test_metrics_check_t;
+
+static void emt_test_metrics_check_lock(const void* data, emt_size_t size, void* arg) {
+    (void) data;
+    (void) size;
+    ((emt_test_metrics_check_t*) arg)->record.size = 0;
+}
+
+static void emt_test_metrics_check_unlock(const void* data, emt_size_t size, void* arg) {
+    (void) data;
+    (void) size;
+    emt_test_metrics_check_t* check = (emt_test_metrics_check_t*) arg;
+    const size_t start = sizeof(emt_ptr_t) + 1 + sizeof(uint64_t);
+    const uint64_t count = test_buffer_u64(&check->record, start);
+    emt_size_t num_pairs;
+    memcpy(&num_pairs, check->record.data + start + (4 * sizeof(uint64_t)) + 1, sizeof(num_pairs));
+    const size_t pair = start + (4 * sizeof(uint64_t)) + 1 + sizeof(num_pairs);
+    const uint64_t value = EMT_TEST_METRICS_VALUE;
+    const bool consistent =
+        count == 0 ? num_pairs == 0
+                   : test_buffer_u64(&check->record, start + 8) == value * count &&
+                         test_buffer_u64(&check->record, start + 16) == value &&
+                         test_buffer_u64(&check->record, start + 24) == value && num_pairs == 2 &&
+                         test_buffer_u64(&check->record, pair) == emt_histogram_bucket(value) &&
+                         test_buffer_u64(&check->record, pair + 8) == count;
+    check->consistent = check->consistent && consistent;
+    check->counted += count;
+}
+
+static emt_metrics_t emt_test_metrics_concurrent;
+static unsigned emt_test_metrics_done;
+
+static void* emt_test_metrics_record(void* arg) {
+    (void) arg;
+    for (unsigned i = 0; i < EMT_TEST_METRICS_VALUES; i++)
+        EMT_HISTOGRAM(static const, &emt_test_metrics_concurrent, "values", EMT_TEST_METRICS_VALUE);
+    __atomic_add_fetch(&emt_test_metrics_done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static bool test_metrics_flush_concurrently(test_context_t* ctx) {
+    uint8_t raw_record[256];
+    emt_test_metrics_check_t check = {
+        .record = {.data = raw_record, .capacity = sizeof(raw_record), .size = 0},
+        .counted = 0,
+        .consistent = true,
+    };
+    emt_metrics_init(
+        &emt_test_metrics_concurrent, to_buffer, emt_test_metrics_check_lock,
+        emt_test_metrics_check_unlock, &check, 0
+    );
+    pthread_t threads[EMT_TEST_METRICS_THREADS];
+    for (unsigned i = 0; i < EMT_TEST_METRICS_THREADS; i++)
+        TEST_ASSERT_EQ(
+            ctx, pthread_create(&threads[i], NULL, emt_test_metrics_record, NULL), 0,
+            "should start a thread"
+        );
+    // flush while the threads record, so that flushes race with updates
+    while (__atomic_load_n(&emt_test_metrics_done, __ATOMIC_ACQUIRE) < EMT_TEST_METRICS_THREADS)
+        emt_metrics_flush(&emt_test_metrics_concurrent);
+    for (unsigned i = 0; i < EMT_TEST_METRICS_THREADS; i++)
+        (void) pthread_join(threads[i], NULL);
+    emt_metrics_flush(&emt_test_metrics_concurrent);
+
+    TEST_ASSERT(ctx, check.consistent, "every interval's count, sum, min, max and buckets agree");
+    TEST_ASSERT_EQ(
+        ctx, check.counted, (uint64_t) EMT_TEST_METRICS_THREADS * EMT_TEST_METRICS_VALUES,
+        "every value should be counted in exactly one interval"
+    );
+    return true;
+}
+
+test_fn_t* emt_get_metrics_tests(size_t* count) {
+    static test_fn_t tests[] = {
+        test_histogram_buckets, test_metrics_flush, test_metrics_flush_concurrently
+    };
+    *count = sizeof(tests) / sizeof(tests[0]);
+    return tests;
+}
@@ -0,0 +1,110 @@
+#ifndef EMT_OVERHEAD
+#define EMT_OVERHEAD
+#endif
+#include "emtrace/test_framework.h"
+#include "emtrace/test_suites.h"
+#include "emtrace/test_utils.h"
+#include <emtrace/emtrace.h>
+#include <emtrace/overhead.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define EMT_TEST_OVERHEAD_SPIN 4096
+
+/// room for the statistics of every call site of the tests
+static uint8_t emt_test_overhead_data[1 << 16];
+
+/// takes a while, like waiting for another writer
+static void emt_test_overhead_slow_lock(const void* data, emt_size_t size, void* arg) {
+    (void) data;
+    (void) size;
+    (void) arg;
+    const uint64_t start = emt_overhead_cycles();
+    while (emt_overhead_cycles() - start < EMT_TEST_OVERHEAD_SPIN) {
+    }
+}
+
+#define EMT_TEST_OVERHEAD_TRACE(lock, buffer, fmt, value)                                          \
+    EMT_TRACE_F(                                                                                   \
+        EMT_DEFAULT_SEC_ATTR, EMT_PY_FORMAT, to_buffer, lock, emt_test_unlock, (buffer), "", fmt,  \
+        uint32_t, (value)                                                                          \
+    )
+
+/// the statistics of the call site with the given format string
+static emt_overhead_t* emt_test_overhead_find(const char* fmt) {
+    for (emt_overhead_t* site = __start_emtrace_overhead; site < __stop_emtrace_overhead; site++) {
+        const emt_size_t fmt_offset = ((const emt_size_t*) site->info)[1];
+        if (strcmp((const char*) site->info + fmt_offset, fmt) == 0)
+            return site;
+    }
+    return NULL;
+}
+
+static bool test_overhead_counts(test_context_t* ctx) {
+    test_buffer_t buffer = {
+        .data = emt_test_overhead_data, .capacity = sizeof(emt_test_overhead_data), .size = 0
+    };
+    for (uint32_t i = 0; i < 5; i++) {
+        EMT_TEST_OVERHEAD_TRACE(emt_test_overhead_slow_lock, &buffer, "slow lock {}", i);
+    }
+    emt_overhead_t* site = emt_test_overhead_find("slow lock {}");
+    TEST_ASSERT(ctx, site != NULL, "the call site should have statistics");
+    TEST_ASSERT_EQ(ctx, site->count, 5, "every execution should be counted");
+    TEST_ASSERT(ctx, site->lock_cycles >= 5 * EMT_TEST_OVERHEAD_SPIN, "lock cycles should add up");
+    TEST_ASSERT(ctx, site->max_cycles >= EMT_TEST_OVERHEAD_SPIN, "the slowest execution is kept");
+    const uint64_t total = site->lock_cycles + site->out_cycles + site->unlock_cycles;
+    TEST_ASSERT(ctx, site->max_cycles <= total, "max can't exceed the total");
+    uint64_t slow = 0;
+    for (unsigned i = 13; i < EMT_OVERHEAD_BUCKETS; i++)
+        slow += site->lock_wait[i];
+    TEST_ASSERT_EQ(ctx, slow, 5, "lock waits should fall into the buckets of >= 4096 cycles");
+    return true;
+}
+
+static bool test_overhead_dump(test_context_t* ctx) {
+    test_buffer_t buffer = {
+        .data = emt_test_overhead_data, .capacity = sizeof(emt_test_overhead_data), .size = 0
+    };
+    for (uint32_t i = 0; i < 3; i++) {
+        EMT_TEST_OVERHEAD_TRACE(emt_test_lock, &buffer, "fast lock {}", i);
+    }
+    emt_overhead_t* site = emt_test_overhead_find("fast lock {}");
+    TEST_ASSERT(ctx, site != NULL, "the call site should have statistics");
+    const uint64_t expected_ptr =
+        (uint64_t) (emt_ptr_t) ((uintptr_t) site->info >> EMT_ALIGNMENT_POWER);
+
+    buffer.size = 0;
+    EMT_OVERHEAD_DUMP(EMT_DEFAULT_SEC_ATTR, to_buffer, emt_test_lock, emt_test_unlock, &buffer);
+    const size_t record_size =
+        sizeof(emt_ptr_t) + (6 * sizeof(uint64_t)) + (EMT_OVERHEAD_BUCKETS * sizeof(uint64_t));
+    TEST_ASSERT_EQ(ctx, buffer.size % record_size, 0, "the dump should consist of whole records");
+    bool found = false;
+    for (size_t offset = 0; offset < buffer.size; offset += record_size) {
+        uint64_t fields[6];
+        memcpy(fields, buffer.data + offset + sizeof(emt_ptr_t), sizeof(fields));
+        if (fields[0] != expected_ptr)
+            continue;
+        found = true;
+        TEST_ASSERT_EQ(ctx, fields[1], 3, "the record should carry the count");
+        uint64_t lock_wait[EMT_OVERHEAD_BUCKETS];
+        const size_t histogram_offset = offset + sizeof(emt_ptr_t) + sizeof(fields);
+        memcpy(lock_wait, buffer.data + histogram_offset, sizeof(lock_wait));
+        uint64_t total = 0;
+        for (unsigned i = 0; i < EMT_OVERHEAD_BUCKETS; i++)
+            total += lock_wait[i];
+        TEST_ASSERT_EQ(ctx, total, 3, "and the histogram");
+    }
+    TEST_ASSERT(ctx, found, "the call site should be dumped");
+
+    emt_overhead_reset();
+    TEST_ASSERT_EQ(ctx, site->count, 0, "statistics should be reset");
+    TEST_ASSERT_EQ(ctx, site->max_cycles, 0, "all of them");
+    return true;
+}
+
+test_fn_t* emt_get_overhead_tests(size_t* count) {
+    static test_fn_t tests[] = {test_overhead_counts, test_overhead_dump};
+    *count = sizeof(tests) / sizeof(tests[0]);
+    return tests;
+}
@@ -0,0 +1,298 @@
+#include "emtrace/test_framework.h"
+#include "emtrace/test_suites.h"
+#include "emtrace/test_utils.h"
+#include <emtrace/emtrace.h>
+#include <emtrace/percpu.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define EMT_TEST_PERCPU_TRACE_F(percpu, ...)                                                       \
+    EMT_PERCPU_TRACE_F(static const, EMT_PY_FORMAT, (percpu), "", __VA_ARGS__)
+
+#define EMT_TEST_PERCPU_THREADS 4
+#define EMT_TEST_PERCPU_RECORDS 2000
+
+/// collects what the drainer passes on
+static uint8_t emt_test_percpu_data[1 << 18];
+static test_buffer_t emt_test_percpu_capture;
+
+static void emt_test_percpu_reset(void) {
+    emt_test_percpu_capture = (test_buffer_t) {
+        .data = emt_test_percpu_data, .capacity = sizeof(emt_test_percpu_data), .size = 0
+    };
+}
+
+static int emt_test_percpu_open(emt_percpu_t* percpu, uint64_t ring_size) {
+    emt_test_percpu_reset();
+    return emt_percpu_open(
+        percpu, ring_size, to_buffer, emt_test_lock, emt_test_unlock, &emt_test_percpu_capture
+    );
+}
+
+static bool emt_test_percpu_slots_free(emt_percpu_t* percpu) {
+    for (size_t i = 0; i < EMT_PERCPU_MAX_THREADS / 64; i++) {
+        if (percpu->slots[i] != 0)
+            return false;
+    }
+    return true;
+}
+
+static bool test_percpu_round_trip(test_context_t* ctx) {
+    emt_percpu_t percpu;
+    TEST_ASSERT_EQ(ctx, emt_test_percpu_open(&percpu, 1024), 0, "rings should be set up");
+
+    EMT_TEST_PERCPU_TRACE_F(&percpu, "{} {}", int, 42, uint16_t, 7);
+    EMT_TEST_PERCPU_TRACE_F(&percpu, "{}", uint64_t, (uint64_t) 0x1122334455667788);
+    TEST_ASSERT_EQ(ctx, emt_test_percpu_capture.size, 0, "nothing is passed on before draining");
+
+    TEST_ASSERT_EQ(ctx, emt_percpu_drain(&percpu), 2, "both records should be drained");
+    TEST_ASSERT_EQ(ctx, emt_test_percpu_capture.records, 2, "each record is passed on alone");
+    TEST_ASSERT_EQ(
+        ctx, emt_test_percpu_capture.size,
+        (2 * sizeof(emt_ptr_t)) + sizeof(int) + sizeof(uint16_t) + sizeof(uint64_t),
+        "records should be passed on without their headers"
+    );
+
+    const uint8_t* data = emt_test_percpu_capture.data;
+    int int_val;
+    uint16_t short_val;
+    uint64_t long_val;
+    memcpy(&int_val, data + sizeof(emt_ptr_t), sizeof(int));
+    memcpy(&short_val, data + sizeof(emt_ptr_t) + sizeof(int), sizeof(uint16_t));
+    memcpy(&long_val, data + (2 * sizeof(emt_ptr_t)) + sizeof(int) + sizeof(uint16_t), 8);
+    TEST_ASSERT_EQ(ctx, int_val, 42, "traced int value should be 42");
+    TEST_ASSERT_EQ(ctx, short_val, 7, "traced uint16_t value should be 7");
+    TEST_ASSERT_EQ(ctx, long_val, 0x1122334455667788, "traced uint64_t value should match");
+    TEST_ASSERT_EQ(ctx, emt_percpu_drain(&percpu), 0, "nothing is left to drain");
+
+    emt_percpu_close(&percpu);
+    return true;
+}
+
+static bool test_percpu_full_ring_drops(test_context_t* ctx) {
+    emt_percpu_t percpu;
+    TEST_ASSERT_EQ(ctx, emt_test_percpu_open(&percpu, 64), 0, "rings should be set up");
+
+    const uint64_t padded = emt_percpu_padded(EMT_PERCPU_HEADER_SIZE + sizeof(emt_ptr_t) + 8);
+    for (int i = 0; i < 8; i++) {
+        EMT_TEST_PERCPU_TRACE_F(&percpu, "{}", uint64_t, (uint64_t) i);
+    }
+    TEST_ASSERT_EQ(ctx, emt_percpu_dropped(&percpu), 8 - (64 / padded), "the rest is dropped");
+    TEST_ASSERT_EQ(ctx, emt_percpu_drain(&percpu), 64 / padded, "only whole records fit");
+
+    // writing continues across the end of the ring once it has been drained
+    for (int i = 0; i < 8; i++) {
+        EMT_TEST_PERCPU_TRACE_F(&percpu, "{}", uint64_t, (uint64_t) i);
+        TEST_ASSERT_EQ(ctx, emt_percpu_drain(&percpu), 1, "record should be drained");
+    }
+    TEST_ASSERT_EQ(
+        ctx, test_buffer_u64(&emt_test_percpu_capture, emt_test_percpu_capture.size - 8), 7,
+        "the last record should be intact"
+    );
+
+    emt_percpu_close(&percpu);
+    return true;
+}
+
+/// place a record of `size` bytes of `fill` from thread `slot` in the ring of `cpu`
+static void emt_test_percpu_place(
+    emt_percpu_t* percpu, uint32_t cpu, uint32_t slot, uint32_t seq, uint8_t fill, size_t size
+) {
+    emt_percpu_shard_t* shard = &percpu->shards[cpu];
+    uint8_t* ring = percpu->data + ((size_t) cpu * (percpu->mask + 1));
+    uint8_t* record = ring + (shard->head & percpu->mask);
+    uint32_t header = (uint32_t) (EMT_PERCPU_HEADER_SIZE + size) | (slot << 16);
+    memcpy(record, &header, sizeof(header));
+    memcpy(record + 4, &seq, sizeof(seq));
+    memset(record + EMT_PERCPU_HEADER_SIZE, fill, size);
+    shard->head += emt_percpu_padded(EMT_PERCPU_HEADER_SIZE + size);
+}
+
+/// pretend there are two CPUs on nodes `node0` and `node1`, whatever this machine has
+static bool emt_test_percpu_fake_cpus(emt_percpu_t* percpu, uint16_t node0, uint16_t node1) {
+    free(percpu->shards);
+    emt_mem_unmap(percpu->data, percpu->num_cpus * (percpu->mask + 1), percpu->mem_flags);
+    free(percpu->cpu_node);
+    percpu->num_cpus = 2;
+    percpu->num_nodes = (node0 > node1 ? node0 : node1) + 1;
+    percpu->shards = (emt_percpu_shard_t*) calloc(2, sizeof(emt_percpu_shard_t));
+    percpu->data = (uint8_t*) emt_mem_map(2 * (percpu->mask + 1), &percpu->mem_flags);
+    percpu->cpu_node = (uint16_t*) calloc(2, sizeof(uint16_t));
+    if (percpu->shards == NULL || percpu->data == NULL || percpu->cpu_node == NULL)
+        return false;
+    percpu->cpu_node[0] = node0;
+    percpu->cpu_node[1] = node1;
+    return true;
+}
+
+static bool test_percpu_order_across_cpus(test_context_t* ctx) {
+    emt_percpu_t percpu;
+    TEST_ASSERT_EQ(ctx, emt_test_percpu_open(&percpu, 256), 0, "rings should be set up");
+    TEST_ASSERT(ctx, emt_test_percpu_fake_cpus(&percpu, 0, 0), "rings should be allocated");
+
+    // thread 0 wrote 'a' on CPU 1, then migrated and wrote 'b' on CPU 0 after thread 1's 'c'
+    percpu.slots[0] = 3;
+    emt_test_percpu_place(&percpu, 0, 1, 0, 'c', 3);
+    emt_test_percpu_place(&percpu, 0, 0, 1, 'b', 3);
+    emt_test_percpu_place(&percpu, 1, 0, 0, 'a', 3);
+    // thread 1 ends
+    emt_test_percpu_place(&percpu, 0, 1, 1, 0, 0);
+
+    TEST_ASSERT_EQ(ctx, emt_percpu_drain(&percpu), 3, "all records should be drained");
+    TEST_ASSERT(
+        ctx, memcmp(emt_test_percpu_capture.data, "cccaaabbb", 9) == 0,
+        "thread 0's records should keep their order"
+    );
+    TEST_ASSERT_EQ(ctx, percpu.slots[0], 1, "thread 1's slot should be returned");
+    TEST_ASSERT_EQ(ctx, percpu.next_seq[1], 0, "thread 1's sequence should be reset");
+
+    emt_percpu_close(&percpu);
+    return true;
+}
+
+static bool test_percpu_drain_per_node(test_context_t* ctx) {
+    emt_percpu_t percpu;
+    TEST_ASSERT_EQ(ctx, emt_test_percpu_open(&percpu, 256), 0, "rings should be set up");
+    TEST_ASSERT(ctx, emt_test_percpu_fake_cpus(&percpu, 0, 1), "rings should be allocated");
+
+    // thread 0 wrote 'a' on node 0, then migrated and wrote 'b' on node 1
+    percpu.slots[0] = 1;
+    emt_test_percpu_place(&percpu, 0, 0, 0, 'a', 3);
+    emt_test_percpu_place(&percpu, 1, 0, 1, 'b', 3);
+
+    TEST_ASSERT_EQ(ctx, emt_percpu_drain_node(&percpu, 1), 0, "'b' should wait for 'a'");
+    TEST_ASSERT_EQ(ctx, emt_percpu_drain_node(&percpu, 0), 1, "node 0 drains 'a'");
+    TEST_ASSERT_EQ(ctx, emt_percpu_drain_node(&percpu, 1), 1, "then node 1 drains 'b'");
+    TEST_ASSERT(
+        ctx, memcmp(emt_test_percpu_capture.data, "aaabbb", 6) == 0,
+        "thread 0's records should keep their order"
+    );
+
+    emt_percpu_close(&percpu);
+    return true;
+}
+
+static bool test_percpu_sequence_range(test_context_t* ctx) {
+    emt_percpu_t percpu;
+    TEST_ASSERT_EQ(ctx, emt_test_percpu_open(&percpu, 256), 0, "rings should be set up");
+    TEST_ASSERT(ctx, emt_test_percpu_fake_cpus(&percpu, 0, 0), "rings should be allocated");
+
+    // thread 0's 'a' follows 40000 records that were discarded before the drainer saw them
+    percpu.slots[0] = 3;
+    percpu.discarded[0] = 40000;
+    emt_test_percpu_place(&percpu, 0, 0, 40000, 'a', 3);
+    // thread 1's sequence numbers wrap around: 'b' on CPU 1 comes before 'c' on CPU 0
+    percpu.next_seq[1] = UINT32_MAX;
+    emt_test_percpu_place(&percpu, 0, 1, 0, 'c', 3);
+    emt_test_percpu_place(&percpu, 1, 1, UINT32_MAX, 'b', 3);
+
+    TEST_ASSERT_EQ(ctx, emt_percpu_drain(&percpu), 3, "all records should be drained");
+    TEST_ASSERT(
+        ctx, memcmp(emt_test_percpu_capture.data, "aaabbbccc", 9) == 0,
+        "thread 1's records should keep their order across the wrap-around"
+    );
+    TEST_ASSERT_EQ(ctx, percpu.discarded[0], 0, "every discarded record should be skipped");
+    TEST_ASSERT_EQ(ctx, percpu.next_seq[0], 40001, "thread 0's sequence should be past 'a'");
+    TEST_ASSERT_EQ(ctx, percpu.next_seq[1], 1, "thread 1's sequence should be past 'c'");
+
+    emt_percpu_close(&percpu);
+    return true;
+}
+
+static bool test_percpu_memory_flags(test_context_t* ctx) {
+    const int flags = EMT_MEM_HUGETLB | EMT_MEM_MLOCK | EMT_MEM_NUMA;
+    emt_percpu_t percpu;
+    emt_test_percpu_reset();
+    TEST_ASSERT_EQ(
+        ctx,
+        emt_percpu_open_flags(
+            &percpu, EMT_MEM_HUGE_PAGE_SIZE, flags, to_buffer, emt_test_lock, emt_test_unlock,
+            &emt_test_percpu_capture
+        ),
+        0, "rings should be set up, whichever flags the system supports"
+    );
+    TEST_ASSERT_EQ(
+        ctx, percpu.mem_flags & ~(flags | EMT_MEM_THP), 0, "only requested flags are applied"
+    );
+    TEST_ASSERT(ctx, percpu.num_nodes >= 1, "there is at least one node");
+
+    EMT_TEST_PERCPU_TRACE_F(&percpu, "{}", uint64_t, (uint64_t) 42);
+    TEST_ASSERT_EQ(ctx, emt_percpu_drain(&percpu), 1, "record should be drained");
+    TEST_ASSERT_EQ(
+        ctx, test_buffer_u64(&emt_test_percpu_capture, sizeof(emt_ptr_t)), 42,
+        "traced value should be 42"
+    );
+
+    emt_percpu_close(&percpu);
+    return true;
+}
+
+typedef struct {
+    emt_percpu_t* percpu;
+    uint32_t index;
+} emt_test_percpu_producer_t;
+
+static void* emt_test_percpu_produce(void* arg) {
+    emt_test_percpu_producer_t* producer = (emt_test_percpu_producer_t*) arg;
+    for (uint32_t i = 0; i < EMT_TEST_PERCPU_RECORDS; i++) {
+        EMT_TEST_PERCPU_TRACE_F(producer->percpu, "{} {}", uint32_t, producer->index, uint32_t, i);
+    }
+    return NULL;
+}
+
+static bool test_percpu_threads(test_context_t* ctx) {
+    emt_percpu_t percpu;
+    TEST_ASSERT_EQ(ctx, emt_test_percpu_open(&percpu, 1 << 20), 0, "rings should be set up");
+
+    pthread_t threads[EMT_TEST_PERCPU_THREADS];
+    emt_test_percpu_producer_t producers[EMT_TEST_PERCPU_THREADS];
+    for (uint32_t i = 0; i < EMT_TEST_PERCPU_THREADS; i++) {
+        producers[i].percpu = &percpu;
+        producers[i].index = i;
+        TEST_ASSERT_EQ(
+            ctx, pthread_create(&threads[i], NULL, emt_test_percpu_produce, &producers[i]), 0,
+            "producer should start"
+        );
+    }
+    // drain while the producers are running
+    for (int i = 0; i < 100; i++) {
+        (void) emt_percpu_drain(&percpu);
+        (void) sched_yield();
+    }
+    for (uint32_t i = 0; i < EMT_TEST_PERCPU_THREADS; i++) {
+        (void) pthread_join(threads[i], NULL);
+    }
+    (void) emt_percpu_drain(&percpu);
+
+    TEST_ASSERT_EQ(ctx, emt_percpu_dropped(&percpu), 0, "no record should be dropped");
+    TEST_ASSERT_EQ(
+        ctx, emt_test_percpu_capture.records,
+        (size_t) EMT_TEST_PERCPU_THREADS * EMT_TEST_PERCPU_RECORDS, "all records should arrive"
+    );
+    uint32_t next[EMT_TEST_PERCPU_THREADS] = {0};
+    const size_t record_size = sizeof(emt_ptr_t) + (2 * sizeof(uint32_t));
+    for (size_t pos = 0; pos + record_size <= emt_test_percpu_capture.size; pos += record_size) {
+        uint32_t values[2];
+        memcpy(values, emt_test_percpu_capture.data + pos + sizeof(emt_ptr_t), sizeof(values));
+        TEST_ASSERT(ctx, values[0] < EMT_TEST_PERCPU_THREADS, "thread index should be valid");
+        TEST_ASSERT_EQ(ctx, values[1], next[values[0]], "each thread's records keep their order");
+        next[values[0]]++;
+    }
+    TEST_ASSERT(ctx, emt_test_percpu_slots_free(&percpu), "slots should be returned");
+
+    emt_percpu_close(&percpu);
+    return true;
+}
+
+test_fn_t* emt_get_percpu_tests(size_t* count) {
+    static test_fn_t tests[] = {
+        test_percpu_round_trip,     test_percpu_full_ring_drops, test_percpu_order_across_cpus,
+        test_percpu_drain_per_node, test_percpu_sequence_range,  test_percpu_memory_flags,
+        test_percpu_threads
+    };
+    *count = sizeof(tests) / sizeof(tests[0]);
+    return tests;
+}
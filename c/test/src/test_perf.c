@@ -0,0 +1,94 @@
+#include "emtrace/test_framework.h"
+#include "emtrace/test_suites.h"
+#include "emtrace/test_utils.h"
+#include <emtrace/emtrace.h>
+#include <emtrace/perf.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/// something for the counters to count
+static uint64_t emt_test_perf_work(void) {
+    volatile uint64_t sum = 0;
+    for (uint64_t i = 0; i < 100000; i++)
+        sum += i;
+    return sum;
+}
+
+static bool test_perf_snapshot(test_context_t* ctx) {
+    emt_perf_t perf;
+    const int result = emt_perf_open(&perf);
+    // without a PMU (or permission) the counters are unavailable, but timestamps still work
+    TEST_ASSERT_EQ(
+        ctx, perf.num_counters, result == 0 ? EMT_PERF_COUNTERS : 0,
+        "counters are either all open or none"
+    );
+    emt_perf_snapshot_t start;
+    emt_perf_snapshot_t end;
+    emt_perf_snapshot(&perf, &start);
+    (void) emt_test_perf_work();
+    emt_perf_snapshot(&perf, &end);
+    TEST_ASSERT(ctx, end.ns > start.ns, "time should pass");
+    if (perf.num_counters > 0) {
+        const uint64_t instructions =
+            end.counts[EMT_PERF_INSTRUCTIONS] - start.counts[EMT_PERF_INSTRUCTIONS];
+        TEST_ASSERT(ctx, instructions >= 100000, "every iteration retires instructions");
+        TEST_ASSERT(ctx, end.counts[EMT_PERF_CYCLES] > start.counts[EMT_PERF_CYCLES], "cycles");
+    }
+    emt_perf_close(&perf);
+    TEST_ASSERT_EQ(ctx, perf.num_counters, 0, "closed counters are unavailable");
+    TEST_ASSERT_EQ(ctx, perf.fds[0], -1, "and their file descriptors closed");
+    return true;
+}
+
+/// trace with `perf` and check the record carries its counters
+static bool emt_test_perf_trace(test_context_t* ctx, const emt_perf_t* perf) {
+    uint8_t raw_buffer[256];
+    test_buffer_t buffer = {.data = raw_buffer, .capacity = sizeof(raw_buffer), .size = 0};
+    emt_perf_snapshot_t start;
+    emt_perf_snapshot(perf, &start);
+    const uint64_t begin = start.ns;
+    (void) emt_test_perf_work();
+    EMT_PERF_TRACE_F(
+        EMT_DEFAULT_SEC_ATTR, to_buffer, emt_test_lock, emt_test_unlock, &buffer, perf, &start, "",
+        "perf {}", uint32_t, 7
+    );
+
+    const size_t header = sizeof(emt_ptr_t) + sizeof(uint32_t) + sizeof(uint64_t);
+    TEST_ASSERT_EQ(
+        ctx, buffer.size, header + sizeof(emt_size_t) + (perf->num_counters * sizeof(uint64_t)),
+        "the record should carry the arguments, the time and the counters"
+    );
+    uint32_t value = 0;
+    uint64_t ns = 0;
+    emt_size_t num_counters = 0;
+    memcpy(&value, buffer.data + sizeof(emt_ptr_t), sizeof(value));
+    memcpy(&ns, buffer.data + sizeof(emt_ptr_t) + sizeof(value), sizeof(ns));
+    memcpy(&num_counters, buffer.data + header, sizeof(num_counters));
+    TEST_ASSERT_EQ(ctx, value, 7, "the arguments come first");
+    TEST_ASSERT(ctx, ns > 0, "then the elapsed time");
+    TEST_ASSERT_EQ(ctx, num_counters, perf->num_counters, "then the counter deltas");
+    TEST_ASSERT(ctx, start.ns >= begin + ns, "the snapshot should be taken again after the trace");
+    return true;
+}
+
+static bool test_perf_trace(test_context_t* ctx) {
+    emt_perf_t perf;
+    (void) emt_perf_open(&perf);
+    const bool result = emt_test_perf_trace(ctx, &perf);
+    emt_perf_close(&perf);
+    return result;
+}
+
+static bool test_perf_timestamps_only(test_context_t* ctx) {
+    emt_perf_t perf;
+    (void) emt_perf_open(&perf);
+    emt_perf_close(&perf);
+    return emt_test_perf_trace(ctx, &perf);
+}
+
+test_fn_t* emt_get_perf_tests(size_t* count) {
+    static test_fn_t tests[] = {test_perf_snapshot, test_perf_trace, test_perf_timestamps_only};
+    *count = sizeof(tests) / sizeof(tests[0]);
+    return tests;
+}
@@ -0,0 +1,138 @@
+#include "emtrace/test_framework.h"
+#include "emtrace/test_suites.h"
+#include "emtrace/test_utils.h"
+#include <emtrace/emtrace.h>
+#include <emtrace/repeat.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define EMT_TEST_REPEAT_TRACE_F(repeat, ...)                                                       \
+    EMT_TRACE_F(                                                                                   \
+        static const, EMT_PY_FORMAT, emt_repeat_out, emt_repeat_lock, emt_repeat_unlock,           \
+        (repeat), "", __VA_ARGS__                                                                  \
+    )
+
+static bool test_repeat_collapse(test_context_t* ctx) {
+    uint8_t raw_buffer[1024];
+    test_buffer_t buffer = {.data = raw_buffer, .capacity = sizeof(raw_buffer), .size = 0};
+    emt_repeat_t repeat;
+    emt_repeat_init(&repeat, to_buffer, emt_test_lock, emt_test_unlock, &buffer, 0);
+
+    for (int i = 0; i < 6; i++) {
+        EMT_TEST_REPEAT_TRACE_F(&repeat, "retry {}", uint64_t, (uint64_t) (i < 5 ? 3 : 4));
+        if (i == 4) {
+            TEST_ASSERT_EQ(ctx, buffer.records, 1, "only the first duplicate should be passed on");
+            TEST_ASSERT_EQ(ctx, repeat.repeats, 4, "the others should be counted");
+        }
+    }
+    TEST_ASSERT_EQ(ctx, buffer.records, 3, "a different record should flush the run");
+    TEST_ASSERT_EQ(ctx, repeat.repeats, 0, "the run should be reset");
+
+    const emt_size_t record_size = sizeof(emt_ptr_t) + sizeof(uint64_t);
+    TEST_ASSERT_EQ(ctx, buffer.size, 3 * record_size, "three records should have been written");
+    TEST_ASSERT_EQ(
+        ctx, test_buffer_u64(&buffer, sizeof(emt_ptr_t)), 3, "first record should be intact"
+    );
+    TEST_ASSERT(
+        ctx, memcmp(buffer.data, buffer.data + record_size, sizeof(emt_ptr_t)) != 0,
+        "second record should come from a different call site"
+    );
+    TEST_ASSERT_EQ(
+        ctx, test_buffer_u64(&buffer, record_size + sizeof(emt_ptr_t)), 4,
+        "second record should carry the number of repeats"
+    );
+    TEST_ASSERT(
+        ctx, memcmp(buffer.data, buffer.data + 2 * record_size, sizeof(emt_ptr_t)) == 0,
+        "third record should come from the original call site"
+    );
+    TEST_ASSERT_EQ(
+        ctx, test_buffer_u64(&buffer, 2 * record_size + sizeof(emt_ptr_t)), 4,
+        "third record should carry its own value"
+    );
+
+    emt_repeat_flush(&repeat);
+    TEST_ASSERT_EQ(ctx, buffer.records, 3, "flushing without a run should write nothing");
+    return true;
+}
+
+static bool test_repeat_passthrough(test_context_t* ctx) {
+    uint8_t raw_buffer[1024];
+    test_buffer_t buffer = {.data = raw_buffer, .capacity = sizeof(raw_buffer), .size = 0};
+    emt_repeat_t repeat;
+    emt_repeat_init(&repeat, to_buffer, emt_test_lock, emt_test_unlock, &buffer, 0);
+
+    uint8_t large[EMT_REPEAT_CAPACITY];
+    memset(large, 0xab, sizeof(large));
+    for (int i = 0; i < 3; i++) {
+        EMT_TEST_REPEAT_TRACE_F(&repeat, "{}", EMT_ARRAY(uint8_t, EMT_REPEAT_CAPACITY), large);
+    }
+    TEST_ASSERT_EQ(ctx, buffer.records, 3, "records larger than the stage are never collapsed");
+    TEST_ASSERT_EQ(
+        ctx, buffer.size, 3 * (sizeof(emt_ptr_t) + EMT_REPEAT_CAPACITY),
+        "large records should be passed through whole"
+    );
+    TEST_ASSERT_EQ(ctx, buffer.data[buffer.size - 1], 0xab, "payload should be passed through");
+    return true;
+}
+
+static bool test_repeat_timeout(test_context_t* ctx) {
+    uint8_t raw_buffer[1024];
+    test_buffer_t buffer = {.data = raw_buffer, .capacity = sizeof(raw_buffer), .size = 0};
+    emt_repeat_t repeat;
+    emt_repeat_init(&repeat, to_buffer, emt_test_lock, emt_test_unlock, &buffer, UINT64_MAX);
+
+    for (int i = 0; i < 3; i++) {
+        EMT_TEST_REPEAT_TRACE_F(&repeat, "poll {}", uint64_t, (uint64_t) 1);
+    }
+    emt_repeat_maybe_flush(&repeat);
+    TEST_ASSERT_EQ(ctx, buffer.records, 1, "a run shouldn't be flushed before its timeout");
+    TEST_ASSERT_EQ(ctx, repeat.repeats, 2, "the duplicates should still be counted");
+
+    repeat.timeout_ns = 1;
+    emt_repeat_maybe_flush(&repeat);
+    TEST_ASSERT_EQ(ctx, buffer.records, 2, "a run should be flushed once it has timed out");
+    TEST_ASSERT_EQ(ctx, repeat.repeats, 0, "without waiting for another record");
+    TEST_ASSERT_EQ(
+        ctx, test_buffer_u64(&buffer, buffer.size - sizeof(uint64_t)), 2,
+        "the summary should carry the number of repeats"
+    );
+    return true;
+}
+
+static bool test_repeat_newline(test_context_t* ctx) {
+    uint8_t raw_buffer[1024];
+    test_buffer_t buffer = {.data = raw_buffer, .capacity = sizeof(raw_buffer), .size = 0};
+    emt_repeat_t repeat;
+    emt_repeat_init(&repeat, to_buffer, emt_test_lock, emt_test_unlock, &buffer, 0);
+
+    emt_ptr_t summaries[2];
+    for (int ln = 0; ln < 2; ln++) {
+        for (int i = 0; i < 2; i++) {
+            if (ln) {
+                EMT_TRACE_F(
+                    static const, EMT_PY_FORMAT, emt_repeat_out, emt_repeat_lock_ln,
+                    emt_repeat_unlock, &repeat, "\n", "line"
+                );
+            } else {
+                EMT_TEST_REPEAT_TRACE_F(&repeat, "text");
+            }
+        }
+        emt_repeat_flush(&repeat);
+        TEST_ASSERT_EQ(ctx, buffer.records, 2 * (size_t) (ln + 1), "each run should be summarized");
+        const size_t summary = buffer.size - sizeof(uint64_t) - sizeof(emt_ptr_t);
+        memcpy(&summaries[ln], buffer.data + summary, sizeof(emt_ptr_t));
+    }
+    TEST_ASSERT(
+        ctx, summaries[0] != summaries[1], "the summary should take the repeated record's postfix"
+    );
+    return true;
+}
+
+test_fn_t* emt_get_repeat_tests(size_t* count) {
+    static test_fn_t tests[] = {
+        test_repeat_collapse, test_repeat_passthrough, test_repeat_timeout, test_repeat_newline
+    };
+    *count = sizeof(tests) / sizeof(tests[0]);
+    return tests;
+}
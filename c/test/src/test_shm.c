@@ -0,0 +1,147 @@
+#include "emtrace/test_framework.h"
+#include "emtrace/test_suites.h"
+#include <emtrace/emtrace.h>
+#include <emtrace/shm.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define EMT_TEST_SHM_TRACE_F(shm, ...)                                                             \
+    EMT_TRACE_F(                                                                                   \
+        static const, EMT_PY_FORMAT, emt_shm_out, emt_shm_lock, emt_shm_unlock, (shm), "",         \
+        __VA_ARGS__                                                                                \
+    )
+
+static void emt_test_shm_name(char* name, size_t size, const char* test) {
+    (void) snprintf(name, size, "/emtrace_test_%s_%d", test, (int) getpid());
+}
+
+static bool test_shm_round_trip(test_context_t* ctx) {
+    char name[64];
+    emt_test_shm_name(name, sizeof(name), "round_trip");
+    emt_shm_t shm;
+    TEST_ASSERT_EQ(ctx, emt_shm_open(&shm, name, 2, 256), 0, "region should open");
+    (void) shm_unlink(name);
+
+    EMT_INIT(static const, emt_shm_init_out, &shm);
+    TEST_ASSERT(ctx, shm.magic_ptr != 0, "magic pointer should be recorded");
+
+    EMT_TEST_SHM_TRACE_F(&shm, "{} {}", int, 42, uint16_t, 7);
+
+    emt_shm_ring_t* ring = &emt_shm_rings(&shm)[0];
+    uint8_t* data = emt_shm_ring_data(&shm, 0);
+    TEST_ASSERT_EQ(ctx, ring->state, EMT_SHM_RING_ACTIVE, "first ring should be claimed");
+    TEST_ASSERT_EQ(ctx, ring->pid, (int32_t) getpid(), "ring should record the owner's pid");
+    TEST_ASSERT_EQ(ctx, ring->magic_ptr, shm.magic_ptr, "ring should record the magic pointer");
+    TEST_ASSERT_EQ(
+        ctx, ring->head, sizeof(emt_ptr_t) + sizeof(int) + sizeof(uint16_t),
+        "whole record should be published"
+    );
+    TEST_ASSERT_EQ(ctx, emt_shm_rings(&shm)[1].state, EMT_SHM_RING_FREE, "second ring is free");
+
+    int int_val;
+    uint16_t short_val;
+    memcpy(&int_val, data + sizeof(emt_ptr_t), sizeof(int));
+    memcpy(&short_val, data + sizeof(emt_ptr_t) + sizeof(int), sizeof(uint16_t));
+    TEST_ASSERT_EQ(ctx, int_val, 42, "traced int value should be 42");
+    TEST_ASSERT_EQ(ctx, short_val, 7, "traced uint16_t value should be 7");
+
+    TEST_ASSERT_EQ(ctx, emt_shm_close(&shm), 0, "region should close");
+    return true;
+}
+
+static bool test_shm_full_ring_drops(test_context_t* ctx) {
+    char name[64];
+    emt_test_shm_name(name, sizeof(name), "full");
+    emt_shm_t shm;
+    TEST_ASSERT_EQ(ctx, emt_shm_open(&shm, name, 1, 64), 0, "region should open");
+    (void) shm_unlink(name);
+    EMT_INIT(static const, emt_shm_init_out, &shm);
+
+    const uint64_t record_size = sizeof(emt_ptr_t) + sizeof(uint64_t);
+    for (int i = 0; i < 16; i++) {
+        EMT_TEST_SHM_TRACE_F(&shm, "{}", uint64_t, (uint64_t) i);
+    }
+    emt_shm_ring_t* ring = &emt_shm_rings(&shm)[0];
+    TEST_ASSERT_EQ(ctx, ring->head, (64 / record_size) * record_size, "only whole records fit");
+    TEST_ASSERT_EQ(ctx, ring->dropped, 16 - (64 / record_size), "the rest should be dropped");
+
+    // consume everything and check that writing continues across the end of the ring
+    ring->tail = ring->head;
+    EMT_TEST_SHM_TRACE_F(&shm, "{}", uint64_t, (uint64_t) 0x1122334455667788);
+    TEST_ASSERT_EQ(ctx, ring->head, ring->tail + record_size, "record should be published");
+
+    uint8_t* data = emt_shm_ring_data(&shm, 0);
+    uint8_t record[sizeof(emt_ptr_t) + sizeof(uint64_t)];
+    for (uint64_t i = 0; i < record_size; i++) {
+        record[i] = data[(ring->tail + i) % 64];
+    }
+    uint64_t value;
+    memcpy(&value, record + sizeof(emt_ptr_t), sizeof(value));
+    TEST_ASSERT_EQ(ctx, value, 0x1122334455667788, "wrapped record should be intact");
+
+    TEST_ASSERT_EQ(ctx, emt_shm_close(&shm), 0, "region should close");
+    return true;
+}
+
+typedef struct {
+    emt_shm_t* shm;
+    int release; ///< (atomic)
+} emt_test_shm_producer_t;
+
+/// traces once, then keeps its ring until released
+static void* emt_test_shm_produce(void* arg) {
+    emt_test_shm_producer_t* producer = (emt_test_shm_producer_t*) arg;
+    EMT_TEST_SHM_TRACE_F(producer->shm, "{}", int, 1);
+    while (!__atomic_load_n(&producer->release, __ATOMIC_ACQUIRE))
+        (void) sched_yield();
+    return NULL;
+}
+
+static bool test_shm_close_with_producers(test_context_t* ctx) {
+    char name[64];
+    emt_test_shm_name(name, sizeof(name), "close");
+    emt_shm_t shm;
+    TEST_ASSERT_EQ(ctx, emt_shm_open(&shm, name, 2, 256), 0, "region should open");
+    (void) shm_unlink(name);
+    EMT_INIT(static const, emt_shm_init_out, &shm);
+    EMT_TEST_SHM_TRACE_F(&shm, "{}", int, 0);
+
+    emt_test_shm_producer_t producer = {&shm, 0};
+    pthread_t thread;
+    TEST_ASSERT_EQ(
+        ctx, pthread_create(&thread, NULL, emt_test_shm_produce, &producer), 0,
+        "producer should start"
+    );
+    while (__atomic_load_n(&shm.writers, __ATOMIC_ACQUIRE) < 2)
+        (void) sched_yield();
+    TEST_ASSERT_EQ(ctx, emt_shm_close(&shm), -1, "closing should be refused while it traces");
+    TEST_ASSERT_EQ(ctx, errno, EBUSY, "because the region is busy");
+    TEST_ASSERT(ctx, shm.header != NULL, "the region should stay attached");
+    TEST_ASSERT_EQ(
+        ctx, emt_shm_rings(&shm)[0].state, EMT_SHM_RING_CLOSED,
+        "the caller's own ring should be released anyway"
+    );
+
+    __atomic_store_n(&producer.release, 1, __ATOMIC_RELEASE);
+    (void) pthread_join(thread, NULL);
+    TEST_ASSERT_EQ(
+        ctx, emt_shm_rings(&shm)[1].state, EMT_SHM_RING_CLOSED,
+        "the producer's ring should be released when it exits"
+    );
+    TEST_ASSERT_EQ(ctx, emt_shm_close(&shm), 0, "then the region should close");
+    return true;
+}
+
+test_fn_t* emt_get_shm_tests(size_t* count) {
+    static test_fn_t tests[] = {
+        test_shm_round_trip, test_shm_full_ring_drops, test_shm_close_with_producers
+    };
+    *count = sizeof(tests) / sizeof(tests[0]);
+    return tests;
+}
@@ -0,0 +1,117 @@
+#include "emtrace/test_framework.h"
+#include "emtrace/test_suites.h"
+#include <emtrace/emtrace.h>
+#include <emtrace/sigsafe.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+static emt_sigsafe_t emt_test_sigsafe_sink = EMT_SIGSAFE_INITIALIZER(-1);
+static volatile sig_atomic_t emt_test_sigsafe_interrupt = 0;
+
+/// the record traced from the signal handler
+static void emt_test_sigsafe_trace_handler(void) {
+    EMT_SIGSAFE_TRACE_F(
+        static const, EMT_PY_FORMAT, &emt_test_sigsafe_sink, "", "signal {}", int, SIGUSR1
+    );
+}
+
+static void emt_test_sigsafe_handler(int sig) {
+    (void) sig;
+    emt_test_sigsafe_trace_handler();
+}
+
+/// raises the signal after the first chunk of a record if asked to
+static void
+emt_test_sigsafe_out(const void* data, emt_size_t size, emt_sigsafe_record_t* record) {
+    emt_sigsafe_out(data, size, record);
+    if (emt_test_sigsafe_interrupt) {
+        emt_test_sigsafe_interrupt = 0;
+        raise(SIGUSR1);
+    }
+}
+
+/// the record that may be interrupted
+static void emt_test_sigsafe_trace_main(void) {
+    emt_sigsafe_record_t record;
+    record.sink = &emt_test_sigsafe_sink;
+    EMT_TRACE_F(
+        static const, EMT_PY_FORMAT, emt_test_sigsafe_out, emt_sigsafe_lock, emt_sigsafe_unlock,
+        &record, "", "{} {} {}", int, 1, double, 2.5, uint64_t, 3
+    );
+}
+
+static bool test_sigsafe_reentrant(test_context_t* ctx) {
+    int fds[2];
+    TEST_ASSERT_EQ(ctx, pipe(fds), 0, "pipe should be created");
+    emt_test_sigsafe_sink.fd = fds[1];
+
+    struct sigaction action;
+    struct sigaction previous;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = emt_test_sigsafe_handler;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGUSR1, &action, &previous);
+
+    uint8_t direct[256];
+    emt_test_sigsafe_trace_handler();
+    emt_test_sigsafe_trace_main();
+    const ssize_t direct_size = read(fds[0], direct, sizeof(direct));
+
+    uint8_t interrupted[256];
+    emt_test_sigsafe_interrupt = 1;
+    emt_test_sigsafe_trace_main();
+    const ssize_t interrupted_size = read(fds[0], interrupted, sizeof(interrupted));
+
+    sigaction(SIGUSR1, &previous, NULL);
+    close(fds[0]);
+    close(fds[1]);
+
+    TEST_ASSERT_EQ(ctx, emt_test_sigsafe_interrupt, 0, "the signal should have been raised");
+    TEST_ASSERT_EQ(
+        ctx, (size_t) direct_size,
+        2 * sizeof(emt_ptr_t) + sizeof(int) * 2 + sizeof(double) + sizeof(uint64_t),
+        "both records should be written"
+    );
+    TEST_ASSERT_EQ(
+        ctx, interrupted_size, direct_size, "the interrupted record should still be written"
+    );
+    TEST_ASSERT(
+        ctx, memcmp(direct, interrupted, (size_t) direct_size) == 0,
+        "the handler's record should precede the interrupted one, and neither be torn"
+    );
+    TEST_ASSERT_EQ(ctx, emt_sigsafe_dropped(&emt_test_sigsafe_sink), 0, "nothing should drop");
+    return true;
+}
+
+static bool test_sigsafe_overflow(test_context_t* ctx) {
+    int fds[2];
+    TEST_ASSERT_EQ(ctx, pipe(fds), 0, "pipe should be created");
+    emt_sigsafe_t sink = EMT_SIGSAFE_INITIALIZER(fds[1]);
+
+    uint8_t large[EMT_SIGSAFE_CAPACITY];
+    memset(large, 0x5a, sizeof(large));
+    EMT_SIGSAFE_TRACE_F(
+        static const, EMT_PY_FORMAT, &sink, "", "{}", EMT_ARRAY(uint8_t, sizeof(large)), large
+    );
+    EMT_SIGSAFE_TRACE_F(static const, EMT_PY_FORMAT, &sink, "", "{}", int, 4);
+
+    uint8_t buffer[EMT_SIGSAFE_CAPACITY * 2];
+    const ssize_t size = read(fds[0], buffer, sizeof(buffer));
+    close(fds[0]);
+    close(fds[1]);
+
+    TEST_ASSERT_EQ(ctx, emt_sigsafe_dropped(&sink), 1, "records that don't fit should be dropped");
+    TEST_ASSERT_EQ(
+        ctx, (size_t) size, sizeof(emt_ptr_t) + sizeof(int), "only whole records should be written"
+    );
+    return true;
+}
+
+test_fn_t* emt_get_sigsafe_tests(size_t* count) {
+    static test_fn_t tests[] = {test_sigsafe_reentrant, test_sigsafe_overflow};
+    *count = sizeof(tests) / sizeof(tests[0]);
+    return tests;
+}
@@ -0,0 +1,47 @@
+#include "emtrace/test_framework.h"
+#include "emtrace/test_suites.h"
+#include "emtrace/test_utils.h"
+#include <emtrace/emtrace.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+__attribute__((noinline)) static void emt_test_trace_stack(test_buffer_t* buffer, unsigned skip) {
+    EMT_TEST_TRACE_F((*buffer), EMT_PY_FORMAT, "{}", EMT_STACK(2), skip);
+}
+
+static bool test_stack_trace(test_context_t* ctx) {
+    uint8_t raw_buffer[64];
+    test_buffer_t buffer = {.data = raw_buffer, .capacity = sizeof(raw_buffer), .size = 0};
+
+    emt_test_trace_stack(&buffer, 1);
+    emt_size_t traced_count;
+    memcpy(&traced_count, buffer.data + sizeof(emt_ptr_t), sizeof(emt_size_t));
+    TEST_ASSERT_EQ(ctx, traced_count, 2, "stack should be captured up to its maximum");
+    TEST_ASSERT_EQ(
+        ctx, buffer.size, sizeof(emt_ptr_t) + sizeof(emt_size_t) + 2 * sizeof(void*),
+        "return addresses should be sent as raw pointers"
+    );
+
+    // with the helper's frame skipped, the first address returns into this function
+    uintptr_t innermost;
+    memcpy(&innermost, buffer.data + sizeof(emt_ptr_t) + sizeof(emt_size_t), sizeof(innermost));
+    uintptr_t self = (uintptr_t) &test_stack_trace;
+    TEST_ASSERT(
+        ctx, innermost > self && innermost < self + 4096,
+        "innermost frame should be the caller of the helper"
+    );
+
+    buffer.size = 0;
+    emt_test_trace_stack(&buffer, 1000);
+    memcpy(&traced_count, buffer.data + sizeof(emt_ptr_t), sizeof(emt_size_t));
+    TEST_ASSERT_EQ(ctx, traced_count, 0, "skipping all frames should leave none");
+
+    return true;
+}
+
+test_fn_t* emt_get_stack_tests(size_t* count) {
+    static test_fn_t tests[] = {test_stack_trace};
+    *count = sizeof(tests) / sizeof(tests[0]);
+    return tests;
+}
@@ -0,0 +1,80 @@
+#include "emtrace/test_framework.h"
+#include "emtrace/test_suites.h"
+#include "emtrace/test_utils.h"
+#include <emtrace/emtrace.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef struct {
+    uint16_t a;
+    uint64_t b;
+    uint8_t c[3];
+} padded_t;
+#define EMT_STRUCT_padded_t(field, ctx)                                                            \
+    field(ctx, uint16_t, a) field(ctx, uint64_t, b) field(ctx, EMT_ARRAY(uint8_t, 3), c)
+
+typedef struct {
+    size_t calls;
+    emt_size_t last_size;
+} struct_counter_t;
+
+static inline void struct_count_out(const void* data, emt_size_t size, struct_counter_t* counter) {
+    (void) data;
+    counter->calls++;
+    counter->last_size = size;
+}
+
+static inline void struct_nop(const void* data, emt_size_t size, struct_counter_t* counter) {
+    (void) data;
+    (void) size;
+    (void) counter;
+}
+
+static bool test_struct_trace(test_context_t* ctx) {
+    uint8_t raw_buffer[128];
+    test_buffer_t buffer = {.data = raw_buffer, .capacity = sizeof(raw_buffer), .size = 0};
+
+    padded_t value;
+    memset(&value, 0, sizeof(value));
+    value.a = 1;
+    value.b = 2;
+    value.c[2] = 3;
+    EMT_TEST_TRACE_F(buffer, EMT_PY_FORMAT, "{} {}", EMT_STRUCT(padded_t), value, int, 4);
+
+    TEST_ASSERT_EQ(
+        ctx, buffer.size, sizeof(emt_ptr_t) + sizeof(padded_t) + sizeof(int),
+        "struct should be traced with its padding"
+    );
+    TEST_ASSERT(
+        ctx, memcmp(buffer.data + sizeof(emt_ptr_t), &value, sizeof(value)) == 0,
+        "struct should be traced as its raw bytes"
+    );
+
+    int after;
+    memcpy(&after, buffer.data + sizeof(emt_ptr_t) + sizeof(padded_t), sizeof(int));
+    TEST_ASSERT_EQ(ctx, after, 4, "argument after the struct should follow it");
+
+    return true;
+}
+
+static bool test_struct_single_copy(test_context_t* ctx) {
+    struct_counter_t counter = {0, 0};
+    padded_t value;
+    memset(&value, 0, sizeof(value));
+
+    EMT_TRACE_F(
+        static const, EMT_PY_FORMAT, struct_count_out, struct_nop, struct_nop, &counter, "", "{}",
+        EMT_STRUCT(padded_t), value
+    );
+    TEST_ASSERT_EQ(ctx, counter.calls, 2, "struct should be sent with a single out_fn call");
+    TEST_ASSERT_EQ(ctx, counter.last_size, sizeof(padded_t), "whole struct should be sent");
+
+    return true;
+}
+
+test_fn_t* emt_get_struct_tests(size_t* count) {
+    static test_fn_t tests[] = {test_struct_trace, test_struct_single_copy};
+    *count = sizeof(tests) / sizeof(tests[0]);
+    return tests;
+}
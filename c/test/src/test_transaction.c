@@ -0,0 +1,83 @@
+#include "emtrace/test_framework.h"
+#include "emtrace/test_suites.h"
+#include "emtrace/test_utils.h"
+#include <emtrace/emtrace.h>
+#include <emtrace/transaction.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/// two records through `txn`; outside of a transaction they are passed on as they come
+static void emt_test_txn_trace(emt_txn_t* txn, int value) {
+    const char* name = "request";
+    EMT_TRACE_F(
+        static const, EMT_PY_FORMAT, emt_txn_out, emt_txn_lock, emt_txn_unlock, txn, "", "{} {}",
+        EMT_SPAN(char, strlen(name)), name, int, value
+    );
+    EMT_TRACE_F(
+        static const, EMT_PY_FORMAT, emt_txn_out, emt_txn_lock, emt_txn_unlock, txn, "",
+        "done {}", double, 1.5
+    );
+}
+
+static bool test_transaction_commit(test_context_t* ctx) {
+    static emt_txn_t txn;
+    static uint8_t raw_buffer[EMT_TXN_CAPACITY * 2];
+    test_buffer_t buffer = {.data = raw_buffer, .capacity = sizeof(raw_buffer), .size = 0};
+    emt_txn_init(&txn, to_buffer, emt_test_lock, emt_test_unlock, &buffer);
+
+    emt_test_txn_trace(&txn, 7);
+    TEST_ASSERT_EQ(ctx, buffer.records, 2, "records outside a transaction should be passed on");
+    const size_t direct_size = buffer.size;
+
+    emt_txn_begin(&txn);
+    emt_test_txn_trace(&txn, 7);
+    TEST_ASSERT_EQ(ctx, buffer.size, direct_size, "nothing should be passed on before the commit");
+    emt_txn_commit(&txn);
+    TEST_ASSERT_EQ(ctx, buffer.records, 3, "the transaction should be passed on in one piece");
+    TEST_ASSERT_EQ(ctx, buffer.size, 2 * direct_size, "committed records should keep their size");
+    TEST_ASSERT(
+        ctx, memcmp(buffer.data, buffer.data + direct_size, direct_size) == 0,
+        "committed records should be byte-identical to direct ones"
+    );
+
+    emt_txn_begin(&txn);
+    emt_test_txn_trace(&txn, 8);
+    emt_txn_discard(&txn);
+    TEST_ASSERT_EQ(ctx, buffer.size, 2 * direct_size, "discarded records are never passed on");
+    TEST_ASSERT_EQ(ctx, buffer.records, 3, "discarding should not touch the wrapped sink");
+    return true;
+}
+
+static bool test_transaction_overflow(test_context_t* ctx) {
+    static emt_txn_t txn;
+    static uint8_t raw_buffer[EMT_TXN_CAPACITY * 2];
+    test_buffer_t buffer = {.data = raw_buffer, .capacity = sizeof(raw_buffer), .size = 0};
+    emt_txn_init(&txn, to_buffer, emt_test_lock, emt_test_unlock, &buffer);
+
+    static uint8_t large[EMT_TXN_CAPACITY / 2];
+    emt_txn_begin(&txn);
+    for (int i = 0; i < 3; i++) {
+        EMT_TRACE_F(
+            static const, EMT_PY_FORMAT, emt_txn_out, emt_txn_lock, emt_txn_unlock, &txn, "", "{}",
+            EMT_ARRAY(uint8_t, sizeof(large)), large
+        );
+    }
+    TEST_ASSERT_EQ(ctx, txn.dropped, 2, "records that don't fit should be dropped");
+    TEST_ASSERT_EQ(
+        ctx, txn.size, sizeof(emt_ptr_t) + sizeof(large), "only whole records should be kept"
+    );
+    emt_txn_commit(&txn);
+    TEST_ASSERT_EQ(ctx, buffer.records, 2, "the drop count should follow the kept records");
+    TEST_ASSERT_EQ(
+        ctx, buffer.size, 2 * sizeof(emt_ptr_t) + sizeof(large) + sizeof(uint64_t),
+        "the drop count should be a record of its own"
+    );
+    return true;
+}
+
+test_fn_t* emt_get_transaction_tests(size_t* count) {
+    static test_fn_t tests[] = {test_transaction_commit, test_transaction_overflow};
+    *count = sizeof(tests) / sizeof(tests[0]);
+    return tests;
+}
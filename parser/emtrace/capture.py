@@ -0,0 +1,53 @@
+"""Capturing the raw trace stream into a file, to be decoded later.
+
+When the input is a pipe, its contents are moved into the file with `splice(2)`, so they aren't
+copied through the decoder's memory. Together with a producer that hands its pages to the pipe
+with `vmsplice` (`EMT_DRAIN_VMSPLICE`), the page cache copy is the only one. Elsewhere, the input
+is copied in large chunks.
+"""
+
+from __future__ import annotations
+from typing import Callable
+from pathlib import Path
+import errno
+import os
+import stat
+
+CHUNK_SIZE = 1 << 20
+
+
+def splice_all(source: int, destination: int) -> int | None:
+    """Move everything from the pipe `source` to `destination`, or None if splice isn't supported."""
+    splice = getattr(os, "splice", None)
+    if splice is None:
+        return None
+    total = 0
+    while True:
+        try:
+            moved = splice(source, destination, CHUNK_SIZE)
+        except OSError as err:
+            if err.errno == errno.EINTR:
+                continue
+            if total == 0 and err.errno in (errno.EINVAL, errno.ENOSYS):
+                return None
+            raise
+        if moved == 0:
+            return total
+        total += moved
+
+
+def capture(path: Path, read: Callable[[int], bytes], source: int | None = None) -> int:
+    """Write the input into `path`, without decoding it. Returns the number of bytes captured.
+
+    `source` is the file descriptor that `read` reads from, if it has one.
+    """
+    with path.open("wb", buffering=0) as out:
+        if source is not None and stat.S_ISFIFO(os.fstat(source).st_mode):
+            total = splice_all(source, out.fileno())
+            if total is not None:
+                return total
+        total = 0
+        while chunk := read(CHUNK_SIZE):
+            _ = out.write(chunk)
+            total += len(chunk)
+        return total
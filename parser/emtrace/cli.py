@@ -1,12 +1,18 @@
 from . import emtrace
+from .shm import ShmInput, emtrace_shm
+from .follow import FileInput, FollowInput
+from .capture import capture
+from .inventory import emtrace_inventory
+from .query import Query
 from argparse import ArgumentParser, ArgumentTypeError
 from typing import Callable, Any
+import re
 import sys
 import socket
 from pathlib import Path
 
 
-def get_input_stream(x: str) -> Callable[[int], bytes]:
+def get_input_stream(x: str) -> Callable[[int], bytes] | FileInput | ShmInput:
     """Get a function that reads bytes from an input stream."""
     parts = x.split("://", 1)
     if not parts:
@@ -17,23 +23,25 @@ def get_input_stream(x: str) -> Callable[[int], bytes]:
         stream_id = parts[0]
         match stream_id.split(":"):
             case ["stdin"]:
-                return sys.stdin.buffer.read
+                # whatever is there, rather than waiting for all that was asked for
+                return sys.stdin.buffer.read1
             case parts if len(parts) in [2, 9]:
                 stream_type = "tcp"
             case _:
                 stream_type = "file"
     else:
         stream_type = parts[0]
-        if stream_type not in ["tcp", "unix", "file"]:
+        if stream_type not in ["tcp", "unix", "file", "shm"]:
             raise ArgumentTypeError(
-                f"Bad input stream type {stream_type}: has to either be file, tcp or unix."
+                f"Bad input stream type {stream_type}: has to either be file, tcp, unix or shm."
             )
         stream_id = parts[1]
 
     match stream_type:
+        case "shm":
+            return ShmInput(stream_id)
         case "file":
-            with Path(stream_id).open("rb") as f:
-                return f.read
+            return FileInput(stream_id)
         case "unix":
             family = socket.AF_UNIX
             address = stream_id
@@ -80,7 +88,7 @@ def main():
         nargs="?",
         default=get_input_stream("stdin"),
         type=get_input_stream,
-        help="Where to get the bytes from that the traced binary produced. If not supplied it reads from stdin, otherwise it defaults to interpreting the argument as a file path from which the data will be read. It can also read from either an IP- or a unix-socket by specifying either tcp://<ip>:<port> or unix://path/to/unix/socket",
+        help="Where to get the bytes from that the traced binary produced. If not supplied it reads from stdin, otherwise it defaults to interpreting the argument as a file path from which the data will be read. It can also read from either an IP- or a unix-socket by specifying either tcp://<ip>:<port> or unix://path/to/unix/socket, or tail all rings of an emtrace shared-memory region with shm://<name>.",
     )
     _ = parser.add_argument(
         "--dump-input",
@@ -122,8 +130,141 @@ def main():
         help="Run emtrace in test mode. This will read the expected output from the ELF section specified (default: .emtrace.test.expected), and will compare it against the actual output. A non-zero exit code is returned, and a diff is written to stdout in case of failure.",
     )
 
+    _ = parser.add_argument(
+        "--metrics",
+        default="lines",
+        choices=["lines", "table", "csv"],
+        help="How to render the records of counters and histograms: one line per record (lines), a summary over all of them at the end of the input (table), or a CSV time series (csv).",
+    )
+
+    _ = parser.add_argument(
+        "--stats",
+        nargs="?",
+        const="table",
+        default=None,
+        choices=["table", "csv", "json"],
+        help="Instead of formatting the records, report per call site how many were received, how many bytes they took, their average argument size, rate, and share of the stream. Records of a fixed size are skipped without being parsed. Output as an aligned table (default), CSV, or JSON.",
+    )
+    _ = parser.add_argument(
+        "--stats-sort",
+        default="bytes",
+        choices=["bytes", "records", "rate", "avg"],
+        help="Order of the call sites in --stats mode, heaviest first: by total bytes (default), record count, rate, or average argument bytes.",
+    )
+
+    _ = parser.add_argument(
+        "--site",
+        action="append",
+        metavar="GLOB",
+        help="Only decode records from call sites whose location matches the glob, e.g. 'net.c:*' or '*/src/*'. It is matched against file:line and the file, both with the full path and with just the file name. Records from other call sites are skipped without being formatted (or even parsed, if their size is fixed). Can be given more than once, to match any of them.",
+    )
+    _ = parser.add_argument(
+        "--grep",
+        action="append",
+        metavar="REGEX",
+        help="Only decode records whose format string contains a match of the regular expression. Records from other call sites are skipped like with --site. If given more than once, all of them have to match.",
+    )
+    _ = parser.add_argument(
+        "--where",
+        action="append",
+        metavar="PREDICATE",
+        help="Only format records whose arguments satisfy the predicate, of the form arg<N>[.field] <op> <value>, with <op> one of < <= > >= == !=, e.g. 'arg0 > 1000' or \"arg1 == 'RUNNING'\". Strings are compared against the rendered argument. If given more than once, all of them have to hold.",
+    )
+
+    _ = parser.add_argument(
+        "--jobs",
+        "-j",
+        default=1,
+        type=int,
+        help="Format the records with this many worker processes, keeping their order. Pays off for large captures; counters and histograms are still formatted by the main process.",
+    )
+
+    _ = parser.add_argument(
+        "--inventory",
+        nargs="?",
+        const="table",
+        default=None,
+        choices=["table", "csv", "json"],
+        help="Don't read any input; instead list every call site described in the section, grouped by source file, with its format string, argument types, record size (N+ for records of variable size), and the bytes it takes up in the section. Output as a table (default), CSV, or JSON.",
+    )
+
+    _ = parser.add_argument(
+        "--export",
+        metavar="DIR",
+        default=None,
+        type=Path,
+        help="Instead of printing the records, write their arguments into DIR as typed columns, one table per call site (<file>_<line>), without formatting them. DIR/sites.csv lists the tables.",
+    )
+
+    _ = parser.add_argument(
+        "--follow",
+        "-f",
+        action="store_true",
+        help="Keep reading the input file as it grows, like tail -F, until interrupted. Waits for the file to be created, and continues with the new file when it is rotated.",
+    )
+
+    _ = parser.add_argument(
+        "--capture",
+        metavar="FILE",
+        default=None,
+        type=Path,
+        help="Don't decode anything; just write the input into FILE, to be decoded later with -i FILE. When reading from a pipe (like stdin of ./a.out | emtrace a.out --capture FILE), the bytes are moved into the file with splice(2), without being copied through the decoder.",
+    )
+
+    _ = parser.add_argument(
+        "--exit-when-idle",
+        action="store_true",
+        help="When reading from a shared-memory region, exit once every ring that was in use has been drained and released by its owner, instead of waiting for new producers.",
+    )
+
     args = parser.parse_args()
 
+    if args.inventory is not None:
+        emtrace_inventory(
+            Path(args.elf),
+            sys.stdout.buffer.write,
+            args.section_name,
+            args.inventory,
+            args.debug_script,
+        )
+        return
+
+    if args.capture is not None:
+        if isinstance(args.input, ShmInput):
+            parser.error("--capture needs a stream as --input")
+        # the bytes from stdin are spliced, the others copied
+        source = sys.stdin.fileno() if args.input == sys.stdin.buffer.read1 else None
+        _ = capture(args.capture, args.input, source)
+        return
+
+    if isinstance(args.input, ShmInput):
+        emtrace_shm(
+            args.input.name,
+            Path(args.elf),
+            sys.stdout.buffer.write,
+            args.section_name,
+            args.with_src_loc,
+            args.debug_script,
+            args.exit_when_idle,
+            flush=sys.stdout.buffer.flush,
+        )
+        return
+
+    if args.follow:
+        if not isinstance(args.input, FileInput):
+            parser.error("--follow needs a file as --input")
+        if args.jobs > 1:
+            # the workers can't start over on a rotated or truncated file
+            parser.error("--follow decodes with a single job")
+        args.input = FollowInput(str(args.input.path))
+
+    query = None
+    if args.site is not None or args.grep is not None or args.where is not None:
+        try:
+            query = Query(args.site, args.grep, args.where)
+        except (ValueError, re.error) as err:
+            parser.error(str(err))
+
     # lazy evaluate the default option ('emtrace_input.bin') of the argument
     if type(args.dump_input) is str:
         args.dump_input = dump(args.dump_input)
@@ -133,16 +274,28 @@ def main():
         args.dump_input[0](b)
         return b
 
-    emtrace(
-        Path(args.elf),
-        patched_input,
-        sys.stdout.buffer.write,
-        args.section_name,
-        args.with_src_loc,
-        args.src_hyperlinks,
-        args.debug_script,
-        args.test,
-    )
+    try:
+        emtrace(
+            Path(args.elf),
+            patched_input,
+            sys.stdout.buffer.write,
+            args.section_name,
+            args.with_src_loc,
+            args.src_hyperlinks,
+            args.debug_script,
+            args.test,
+            args.metrics,
+            args.stats,
+            args.stats_sort,
+            query,
+            args.jobs,
+            sys.stdout.buffer.flush,
+            args.export,
+        )
+    except KeyboardInterrupt:
+        # the way to stop following a file
+        if not args.follow:
+            raise
     # flush
     _ = args.dump_input[1]()
 
@@ -4,11 +4,19 @@ from __future__ import annotations
 from typing import Callable, Literal, Any, override
 from pathlib import Path
 from dataclasses import dataclass
+from enum import IntEnum
 import sys
 import re
 import os
 import socket
+from string import Formatter
 import struct
+import time
+
+from .metrics import Metrics
+from .stats import Stats, StatsFormat, StatsSort, record_size
+from .query import Query
+from .symbols import Symbolizer
 
 try:
     from elftools.elf.elffile import ELFFile
@@ -91,6 +99,227 @@ class Char:
         return f"char({hex(self.value)})"
 
 
+class Blob:
+    """Raw bytes, formatted as hex.
+
+    Format specs: empty for space separated bytes, `x`/`X` for a contiguous hex string, prefixed with
+    a separator character (e.g. `:x`) to separate the bytes with it, and `xxd` or `hexdump` for a
+    multi-line dump in the style of the respective tool (`hexdump -C`).
+    """
+
+    def __init__(self, value: bytes) -> None:
+        self.value: bytes = value
+
+    @staticmethod
+    def _printable(chunk: bytes) -> str:
+        return "".join(chr(b) if 0x20 <= b < 0x7F else "." for b in chunk)
+
+    def xxd(self) -> str:
+        lines: list[str] = []
+        for offset in range(0, len(self.value), 16):
+            chunk = self.value[offset : offset + 16]
+            groups = " ".join(chunk[i : i + 2].hex() for i in range(0, len(chunk), 2))
+            lines.append(f"{offset:08x}: {groups:<39}  {self._printable(chunk)}")
+        return "\n".join(lines)
+
+    def hexdump(self) -> str:
+        lines: list[str] = []
+        for offset in range(0, len(self.value), 16):
+            chunk = self.value[offset : offset + 16]
+            halves = f"{chunk[:8].hex(' '):<23}  {chunk[8:].hex(' '):<23}"
+            lines.append(f"{offset:08x}  {halves}  |{self._printable(chunk)}|")
+        return "\n".join(lines)
+
+    @override
+    def __format__(self, format_spec: str, /) -> str:
+        match format_spec:
+            case "":
+                return self.value.hex(" ")
+            case "xxd":
+                return self.xxd()
+            case "hexdump":
+                return self.hexdump()
+            case _ if len(format_spec) <= 2 and format_spec[-1] in "xX":
+                sep = format_spec[:-1]
+                formatted = self.value.hex(sep) if len(sep) > 0 else self.value.hex()
+                return formatted.upper() if format_spec[-1] == "X" else formatted
+            case _:
+                raise ValueError(f"Invalid format specifier '{format_spec}' for blob")
+
+    @override
+    def __repr__(self) -> str:
+        return f"blob({self.value.hex()})"
+
+
+class Stack:
+    """Return addresses captured by an `EMT_STACK` argument, innermost first.
+
+    Format specs: empty for one indented line per frame (each starting with a newline), `oneline`
+    for all frames on one line, and `depth` for the number of frames.
+    """
+
+    def __init__(self, addresses: list[int], resolve: Callable[[int], str] | None) -> None:
+        self.addresses: list[int] = addresses
+        self.resolve: Callable[[int], str] | None = resolve
+
+    def frames(self) -> list[str]:
+        if self.resolve is None:
+            return [hex(address) for address in self.addresses]
+        return [self.resolve(address) for address in self.addresses]
+
+    @override
+    def __format__(self, format_spec: str, /) -> str:
+        match format_spec:
+            case "":
+                return "".join(f"\n    #{i} {frame}" for i, frame in enumerate(self.frames()))
+            case "oneline":
+                return " <- ".join(self.frames())
+            case "depth":
+                return str(len(self.addresses))
+            case _:
+                raise ValueError(f"Invalid format specifier '{format_spec}' for stack")
+
+    @override
+    def __repr__(self) -> str:
+        return f"stack({', '.join(hex(address) for address in self.addresses)})"
+
+
+class EnumValue:
+    """A value of a traced enum, formatted as the name of its enumerator.
+
+    Format specs: empty for the name (or `<enum>(<value>)` for values without one); any other spec
+    formats the integer value.
+    """
+
+    def __init__(self, enum: str, value: int, name: str | None) -> None:
+        self.enum: str = enum
+        self.value: int = value
+        self.name: str | None = name
+
+    def __int__(self) -> int:
+        return self.value
+
+    @override
+    def __format__(self, format_spec: str, /) -> str:
+        if len(format_spec) == 0:
+            return str(self)
+        return self.value.__format__(format_spec)
+
+    @override
+    def __str__(self) -> str:
+        return self.name if self.name is not None else f"{self.enum}({self.value})"
+
+    @override
+    def __repr__(self) -> str:
+        return f"{self.enum}::{self.name}" if self.name is not None else str(self)
+
+
+class Optional:
+    """A traced `std::optional`, formatted as its value, or as `nullopt` if it has none."""
+
+    def __init__(self, value: Any | None) -> None:
+        self.value: Any | None = value
+
+    @override
+    def __format__(self, format_spec: str, /) -> str:
+        if self.value is None:
+            return "nullopt"
+        return self.value.__format__(format_spec)
+
+    @override
+    def __repr__(self) -> str:
+        return "nullopt" if self.value is None else f"optional({self.value!r})"
+
+
+class Variant:
+    """A traced `std::variant`, formatted as the value of the alternative it holds."""
+
+    def __init__(self, index: int, value: Any | None) -> None:
+        self.index: int = index
+        self.value: Any | None = value
+
+    @override
+    def __format__(self, format_spec: str, /) -> str:
+        if self.value is None:
+            return "valueless"
+        return self.value.__format__(format_spec)
+
+    @override
+    def __repr__(self) -> str:
+        return f"variant<{self.index}>({self.value!r})"
+
+
+class Duration:
+    """A traced `std::chrono::duration`: its tick count and the period of a tick in seconds.
+
+    Format specs: empty for the ticks followed by the unit (e.g. `15ms`), `s` for the duration in
+    seconds; any other spec formats the ticks.
+    """
+
+    UNITS: dict[tuple[int, int], str] = {
+        (1, 10**9): "ns",
+        (1, 10**6): "us",
+        (1, 10**3): "ms",
+        (1, 1): "s",
+        (60, 1): "min",
+        (3600, 1): "h",
+        (86400, 1): "d",
+    }
+
+    def __init__(self, ticks: int | float, num: int, den: int) -> None:
+        self.ticks: int | float = ticks
+        self.num: int = num
+        self.den: int = den
+
+    @property
+    def seconds(self) -> float:
+        return self.ticks * self.num / self.den
+
+    @override
+    def __format__(self, format_spec: str, /) -> str:
+        match format_spec:
+            case "":
+                unit = self.UNITS.get((self.num, self.den), f"*{self.num}/{self.den}s")
+                return f"{self.ticks}{unit}"
+            case "s":
+                return f"{self.seconds}s"
+            case _:
+                return self.ticks.__format__(format_spec)
+
+    @override
+    def __repr__(self) -> str:
+        return f"duration({self.ticks}*{self.num}/{self.den}s)"
+
+
+class Struct:
+    """The declared fields of a traced struct, accessible as attributes or by name."""
+
+    def __init__(self, name: str, fields: dict[str, Any]) -> None:
+        self.name: str = name
+        self.fields: dict[str, Any] = fields
+
+    def __getattr__(self, name: str) -> Any:
+        try:
+            return self.__dict__["fields"][name]
+        except KeyError:
+            raise AttributeError(name) from None
+
+    def __getitem__(self, name: str) -> Any:
+        return self.fields[name]
+
+    @override
+    def __format__(self, format_spec: str, /) -> str:
+        if len(format_spec) == 0:
+            return repr(self)
+        fields = ", ".join(f"{k}: {v.__format__(format_spec)}" for k, v in self.fields.items())
+        return f"{self.name} {{ {fields} }}"
+
+    @override
+    def __repr__(self) -> str:
+        fields = ", ".join(f"{k}: {v!r}" for k, v in self.fields.items())
+        return f"{self.name} {{ {fields} }}"
+
+
 class MyList[T]:
     def __init__(self, list_arg: list[T]) -> None:
         self.list: list[T] = list_arg
@@ -111,6 +340,22 @@ class MyList[T]:
         return self.list.__repr__()
 
 
+class FormatterId(IntEnum):
+    """The `EMT_*_FORMAT` formatters of emtrace.h."""
+
+    PY = 0
+    NONE = 1
+    C_STYLE = 2
+    METRIC = 3
+    DROPPED = 4
+    OVERHEAD = 5
+    PERF = 6
+
+
+# the counters of `EMT_PERF_FORMAT` records, in the order of perf.h
+PERF_COUNTERS = ["cycles", "instructions", "cache misses", "branch misses"]
+
+
 def _py_formatter(fmt: str, args: list[Any]) -> str:
     return fmt.format(*args)
 
@@ -133,6 +378,12 @@ class FmtInfo:
         self.type_infos: list[tuple[str, TypeInfo]] = []
         self.file: str = ""
         self.line: int = -1
+        self.is_metric: bool = False
+        self.unpacker: struct.Struct | None = None
+        self.wrappers: list[Callable[[Any], Any] | None] | None = None
+        # unpacks the arguments as plain values that `direct_fmt` formats like the wrapped ones
+        self.direct_unpacker: struct.Struct | None = None
+        self.direct_fmt: str | None = None
 
     def add_source_info(self, file: str, line: int) -> None:
         """Add source location information to the format info."""
@@ -143,11 +394,93 @@ class FmtInfo:
         """Add a parameter to the format info."""
         self.type_infos.append((id, type_info))
 
-    def format(self, parser: Parser) -> str | list[Any] | tuple[list[Any], bytes]:
-        """Format the trace message from the stream."""
-        args: list[Any] = []
+    def compile(self, translation: dict[str, Callable[[Parser, TypeInfo], Any]]) -> None:
+        """Precompile a `struct.Struct` unpacking all arguments at once, if they are all scalars."""
+        prefix = "<" if self.size_t_byteorder == "little" else ">"
+        codes: list[str] = []
+        wrappers: list[Callable[[Any], Any] | None] = []
         for id, type_info in self.type_infos:
-            args.append(parser.parse(id, type_info))
+            size = type_info.size
+            if size.length_prefixed or size.null_terminated:
+                return
+            decode = translation.get(id)
+            packed = _PACKED_ELEMENTS.get(decode) if decode is not None else None
+            if packed is not None and packed[0] == prefix and size.min_size in packed[1]:
+                codes.append(packed[1][size.min_size])
+                wrappers.append(None)
+            elif decode in (char, signed_char) and size.min_size == 1:
+                codes.append("c")
+                wrappers.append(Char if decode is char else SChar)
+            elif decode is to_bool and size.min_size == 1:
+                codes.append("?")
+                wrappers.append(None)
+            else:
+                return
+        self.unpacker = struct.Struct(prefix + "".join(codes))
+        self.wrappers = wrappers if any(w is not None for w in wrappers) else None
+        if self.wrappers is None:
+            self.direct_unpacker = self.unpacker
+            self.direct_fmt = self.fmt_string
+            return
+        direct_fmt = self._unwrapped_fmt(wrappers)
+        if direct_fmt is not None:
+            chars = {Char: "B", SChar: "b"}
+            self.direct_unpacker = struct.Struct(
+                prefix + "".join(c if w is None else chars[w] for c, w in zip(codes, wrappers))
+            )
+            self.direct_fmt = direct_fmt
+
+    def _unwrapped_fmt(self, wrappers: list[Callable[[Any], Any] | None]) -> str | None:
+        """The format string with the specs of `Char`s rewritten to format their integer values.
+
+        None if a field does more than format an argument by position, e.g. converts it or
+        accesses its attributes.
+        """
+        parts: list[str] = []
+        next_index = 0
+        try:
+            fields = list(Formatter().parse(self.fmt_string))
+        except ValueError:
+            return None
+        for literal, name, spec, conversion in fields:
+            parts.append(literal.replace("{", "{{").replace("}", "}}"))
+            if name is None:
+                continue
+            if name == "":
+                index = next_index
+                next_index += 1
+            elif name.isdigit():
+                index = int(name)
+            else:
+                return None
+            if spec is None or "{" in spec or index >= len(wrappers):
+                return None
+            if wrappers[index] is not None:
+                if conversion is not None:
+                    return None
+                # what `Char.__format__` does
+                if len(spec) == 0 or not spec[-1].isalpha():
+                    spec += "c"
+            parts.append(
+                "{" + name + ("" if conversion is None else "!" + conversion) + ":" + spec + "}"
+            )
+        return "".join(parts)
+
+    def parse_args(self, parser: Parser) -> list[Any]:
+        """Parse the arguments of the trace message from the stream."""
+        if self.unpacker is not None:
+            values = parser.unpack(self.unpacker)
+            if self.wrappers is None:
+                return list(values)
+            return [v if w is None else w(v) for v, w in zip(values, self.wrappers)]
+        return [parser.parse(id, type_info) for id, type_info in self.type_infos]
+
+    def format(
+        self, parser: Parser, args: list[Any] | None = None
+    ) -> str | list[Any] | tuple[list[Any], bytes]:
+        """Format the trace message from the stream, or from `args` if they were already parsed."""
+        if args is None:
+            args = self.parse_args(parser)
 
         try:
             formatted = self.formatter(self.fmt_string, args)
@@ -167,6 +500,8 @@ class Size:
 class TypeInfo:
     size: Size
     children: dict[int | str, tuple[str, TypeInfo]]
+    fields: list[tuple[str, str, TypeInfo]]
+    """All children (name, type id, type info) in the order they were described."""
 
     def __init__(
         self, size: Size, children: dict[int | str, tuple[str, TypeInfo]] | None = None
@@ -176,12 +511,94 @@ class TypeInfo:
             self.children = {}
         else:
             self.children = children
+        self.fields = [(str(name), id, info) for name, (id, info) in self.children.items()]
+
+    def add_child(self, name: str, id: str, info: TypeInfo) -> None:
+        self.children[name] = (id, info)
+        self.fields.append((name, id, info))
 
 
 class EndOfStreamException(Exception):
     pass
 
 
+class StreamRestarted(Exception):
+    """Raised by an input stream that starts over with a new capture, which begins with its own
+    magic address, e.g. a followed file that was rotated or truncated."""
+
+
+class BufferedInput:
+    """Serves reads of any size from large chunks of an input stream.
+
+    `istream` may return fewer bytes than asked for (like `recv` or `read1`), and is only called
+    once the buffer runs dry. `before_wait` is called before that, so that output can be flushed
+    before blocking on a live stream.
+    """
+
+    CHUNK_SIZE: int = 1 << 16
+
+    def __init__(
+        self, istream: Callable[[int], bytes], before_wait: Callable[[], None] = lambda: None
+    ) -> None:
+        self.istream: Callable[[int], bytes] = istream
+        self.before_wait: Callable[[], None] = before_wait
+        self.buffer: bytes = b""
+        self.pos: int = 0
+        self.eof: bool = False
+
+    def _fill(self, n: int) -> bool:
+        """Make `n` bytes available, False if the stream ends before that."""
+        available = len(self.buffer) - self.pos
+        if available >= n:
+            return True
+        chunks = [self.buffer[self.pos :]]
+        while available < n and not self.eof:
+            self.before_wait()
+            chunk = self.istream(max(self.CHUNK_SIZE, n - available))
+            if len(chunk) == 0:
+                self.eof = True
+                break
+            chunks.append(chunk)
+            available += len(chunk)
+        self.buffer = b"".join(chunks)
+        self.pos = 0
+        return available >= n
+
+    def reset(self) -> None:
+        """Drop what is buffered, for a stream that starts over."""
+        self.buffer = b""
+        self.pos = 0
+        self.eof = False
+
+    def read(self, n: int) -> bytes:
+        """Up to `n` bytes; fewer only at the end of the stream."""
+        _ = self._fill(n)
+        b = self.buffer[self.pos : self.pos + n]
+        self.pos += len(b)
+        return b
+
+    def read_until(self, delimiter: bytes = b"\x00") -> bytes:
+        """The bytes up to `delimiter`, which is consumed but not returned."""
+        start = self.pos
+        while (end := self.buffer.find(delimiter, start)) == -1:
+            # only what arrives next has to be searched
+            searched = max(len(self.buffer) - self.pos - len(delimiter) + 1, 0)
+            if not self._fill(len(self.buffer) - self.pos + 1):
+                raise EndOfStreamException
+            start = self.pos + searched
+        b = self.buffer[self.pos : end]
+        self.pos = end + len(delimiter)
+        return b
+
+    def unpack(self, unpacker: struct.Struct) -> tuple[Any, ...]:
+        """Unpack the next `unpacker.size` bytes in place."""
+        if not self._fill(unpacker.size):
+            raise EndOfStreamException
+        values = unpacker.unpack_from(self.buffer, self.pos)
+        self.pos += unpacker.size
+        return values
+
+
 class Parser:
     translation: dict[str, Callable[[Parser, TypeInfo], Any]]
     _istream: Callable[[int], bytes]
@@ -190,6 +607,10 @@ class Parser:
     ptr_size: int
     size_t_byteorder: Literal["big", "little"]
     ptr_byteorder: Literal["big", "little"]
+    resolve_frame: Callable[[int], str] | None = None
+    enums: dict[str, dict[int, str]] = {}
+    # the buffer behind `_istream`, if it has one, to search and unpack in place
+    buffered: BufferedInput | None = None
 
     def __init__(
         self,
@@ -211,8 +632,36 @@ class Parser:
         pass
 
     def parse(self, id: str, info: TypeInfo):
+        if id.startswith("struct ") and id not in self.translation:
+            return to_struct(self, id.removeprefix("struct "), info)
+        if id.startswith("enum:") and id not in self.translation:
+            return to_enum(self, id.removeprefix("enum:"), info)
+        if id.startswith("duration:") and id not in self.translation:
+            return to_duration(self, id.removeprefix("duration:"), info)
         return self.translation[id](self, info)
 
+    def from_bytes(self, data: bytes) -> Parser:
+        """A parser with the same configuration, reading from `data` instead."""
+        pos = 0
+
+        def read(n: int) -> bytes:
+            nonlocal pos
+            pos += n
+            return data[pos - n : pos]
+
+        parser = Parser(
+            self.translation,
+            read,
+            self.debug_trace,
+            self.size_t_size,
+            self.ptr_size,
+            self.size_t_byteorder,
+            self.ptr_byteorder,
+        )
+        parser.resolve_frame = self.resolve_frame
+        parser.enums = self.enums
+        return parser
+
     def read(self, amount: int):
         b = self._istream(amount)
         if len(b) < amount:
@@ -230,7 +679,14 @@ class Parser:
             self.read(self.size_t_size), byteorder=self.size_t_byteorder, signed=False
         )
 
+    def unpack(self, unpacker: struct.Struct) -> tuple[Any, ...]:
+        if self.buffered is not None:
+            return self.buffered.unpack(unpacker)
+        return unpacker.unpack(self.read(unpacker.size))
+
     def read_until(self, b: bytes = b"\x00") -> bytes:
+        if self.buffered is not None:
+            return self.buffered.read_until(b)
         bs = bytearray(self.read(len(b)))
         while bytes(bs[-len(b) :]) != b:
             bs.extend(self.read(1))
@@ -370,6 +826,16 @@ def char(parser: Parser, info: TypeInfo):
     return Char(parser.read(info.size.min_size))
 
 
+# struct format characters of list elements that can be unpacked in bulk, by decoding function
+_PACKED_ELEMENTS: dict[Callable[[Parser, TypeInfo], Any], tuple[str, dict[int, str]]] = {
+    signed_le: ("<", {1: "b", 2: "h", 4: "i", 8: "q"}),
+    signed_be: (">", {1: "b", 2: "h", 4: "i", 8: "q"}),
+    unsigned_le: ("<", {1: "B", 2: "H", 4: "I", 8: "Q"}),
+    float_le: ("<", {2: "e", 4: "f", 8: "d"}),
+    float_be: (">", {2: "e", 4: "f", 8: "d"}),
+}
+
+
 def to_list(parser: Parser, info: TypeInfo) -> MyList[Any]:
     parser.debug_trace(info.size)
     if info.size.length_prefixed:
@@ -379,14 +845,110 @@ def to_list(parser: Parser, info: TypeInfo) -> MyList[Any]:
 
     parser.debug_trace(f"{size=}")
 
+    child_id, child_info = info.children[""]
+    child_size = child_info.size
+    packed = _PACKED_ELEMENTS.get(parser.translation.get(child_id, to_list))
+    if (
+        packed is not None
+        and not child_size.length_prefixed
+        and not child_size.null_terminated
+        and child_size.min_size in packed[1]
+    ):
+        # the elements of arrays of numbers are all read at once
+        fmt = f"{packed[0]}{size}{packed[1][child_size.min_size]}"
+        return MyList(list(struct.unpack(fmt, parser.read(size * child_size.min_size))))
+
     parsed = []
     for _ in range(size):
-        child_id, child_info = info.children[""]
         parsed.append(parser.parse(child_id, child_info))
 
     return MyList(parsed)
 
 
+def to_struct(parser: Parser, name: str, info: TypeInfo) -> Struct:
+    """Pick the declared fields out of the raw bytes of a struct.
+
+    Each field is preceded by a child of type `offset`, whose size is the offset of the field.
+    """
+    data = parser.read(info.size.min_size)
+    fields: dict[str, Any] = {}
+    offset = 0
+    for field_name, field_id, field_info in info.fields:
+        if field_id == "offset":
+            offset = field_info.size.min_size
+            continue
+        fields[field_name] = parser.from_bytes(data[offset:]).parse(field_id, field_info)
+
+    return Struct(name, fields)
+
+
+def to_enum(parser: Parser, name: str, info: TypeInfo) -> EnumValue:
+    """Look up the name of an enum value in the enum tables found in `.emtrace`.
+
+    C++ tables are named by the compiler, with all enclosing namespaces, so if there is no table of
+    that exact name, one whose name ends in `::<name>` is used.
+    """
+    data = parser.read(info.size.min_size)
+    table = parser.enums.get(name)
+    if table is None:
+        table = next((t for n, t in parser.enums.items() if n.endswith(f"::{name}")), {})
+    value = int.from_bytes(data, byteorder=parser.size_t_byteorder, signed=True)
+    if value not in table:
+        # enums with an unsigned underlying type
+        unsigned = int.from_bytes(data, byteorder=parser.size_t_byteorder)
+        if unsigned in table:
+            value = unsigned
+    return EnumValue(name, value, table.get(value))
+
+
+def to_optional(parser: Parser, info: TypeInfo) -> Optional:
+    present = parser.read(1)[0]
+    if present == 0:
+        return Optional(None)
+    _, child_id, child_info = info.fields[0]
+    return Optional(parser.parse(child_id, child_info))
+
+
+def to_variant(parser: Parser, info: TypeInfo) -> Variant:
+    index = parser.read(1)[0]
+    if index >= len(info.fields):
+        # valueless by exception
+        return Variant(index, None)
+    _, child_id, child_info = info.fields[index]
+    return Variant(index, parser.parse(child_id, child_info))
+
+
+def to_duration(parser: Parser, period: str, info: TypeInfo) -> Duration:
+    """Ticks of a duration whose period is `num/den` seconds, as given by its type id."""
+    num, den = (int(part) for part in period.split("/"))
+    ticks_id, ticks_info = info.children["ticks"]
+    return Duration(parser.parse(ticks_id, ticks_info), num, den)
+
+
+def to_blob(parser: Parser, info: TypeInfo) -> Blob:
+    assert not info.size.null_terminated
+
+    if info.size.length_prefixed:
+        size = parser.read_size_t()
+    else:
+        size = info.size.min_size
+
+    return Blob(parser.read(size))
+
+
+def to_stack(parser: Parser, info: TypeInfo) -> Stack:
+    assert info.size.length_prefixed
+
+    count = parser.read_size_t()
+    width = info.size.min_size
+    data = parser.read(count * width)
+    addresses = [
+        int.from_bytes(data[i : i + width], byteorder=parser.ptr_byteorder)
+        for i in range(0, len(data), width)
+    ]
+    return Stack(addresses, parser.resolve_frame)
+
+
 translation_le: dict[str, Callable[[Parser, TypeInfo], Any]] = {
     # signed
     "signed": signed_le,
@@ -432,6 +994,13 @@ translation_le: dict[str, Callable[[Parser, TypeInfo], Any]] = {
     "double": float_le,
     # list
     "list": to_list,
+    # raw bytes
+    "blob": to_blob,
+    # return addresses
+    "stack": to_stack,
+    # C++ vocabulary types
+    "optional": to_optional,
+    "variant": to_variant,
 }
 
 translation_be: dict[str, Callable[[Parser, TypeInfo], Any]] = {
@@ -479,6 +1048,13 @@ translation_be: dict[str, Callable[[Parser, TypeInfo], Any]] = {
     "double": float_be,
     # list
     "list": to_list,
+    # raw bytes
+    "blob": to_blob,
+    # return addresses
+    "stack": to_stack,
+    # C++ vocabulary types
+    "optional": to_optional,
+    "variant": to_variant,
 }
 
 
@@ -513,19 +1089,78 @@ class Emtrace:
 
         self.data: bytes = data
         self.offset: int = 0
+        self.magic_offset: int = 0
+        self.alignment_power: int = 0
         self.byteorder: Literal["little", "big"] = byteorder
         self.debug_trace: Callable[[*tuple[Any, ...]], None] = debug_trace
+        self.metrics: Metrics = Metrics()
+        self.dropped: int = 0
+        self.symbolizer: Symbolizer | None = None
+        self.runtime_magic_address: int | None = None
+        self.enums: dict[str, dict[int, str]] = {}
 
     def set_offset(self, offset: int) -> None:
         """Set the offset for parsing format info."""
         self.offset = offset
 
+    def set_magic_address(self, magic_address: int) -> None:
+        """Set the offset for parsing format info from the runtime address of the magic constant."""
+        self.runtime_magic_address = magic_address * 2**self.alignment_power
+        self.set_offset(self.magic_offset - self.runtime_magic_address)
+
+    def resolve_frame(self, address: int) -> str:
+        """Describe a captured return address, symbolized if the ELF file is available.
+
+        The load bias of position independent executables is undone using the runtime address of
+        the magic constant. Since that address is truncated to the size of `emt_ptr_t`, so is the
+        result, which is fine as long as the executable's code is linked below that limit.
+        """
+        if self.symbolizer is None or self.runtime_magic_address is None:
+            return hex(address)
+        mask = 2 ** (8 * self.ptr_size + self.alignment_power) - 1
+        magic_link_address = self.symbolizer.section_address + self.magic_offset
+        link_address = (address - self.runtime_magic_address + magic_link_address) & mask
+        # a return address points behind the call, which may be the start of the next line
+        symbol = self.symbolizer.lookup(link_address - 1)
+        if symbol is None:
+            return hex(address)
+        return f"{hex(link_address)} {symbol}"
+
     def _c_style_formatter(self, fmt: str, args: list[Any]) -> str:
         return fmt % tuple(x for x in args)
 
     def _no_format_formatter(self, fmt: str, _: list[Any]) -> str:
         return fmt
 
+    def _dropped_formatter(self, fmt: str, args: list[Any]) -> str:
+        """Formatter for `EMT_DROPPED_FORMAT` records, which a buffered sink inserts for lost ones."""
+        self.dropped += args[0]
+        return f"[emtrace] {fmt.format(*args)}\n"
+
+    def _overhead_formatter(self, fmt: str, args: list[Any]) -> str:
+        """Formatter for `EMT_OVERHEAD_FORMAT` records, whose first argument refers to the format
+        info of the call site that was measured."""
+        site = self.parse_fmt_info(args[0] << self.alignment_power)
+        location = f"{site.file}:{site.line} {site.fmt_string.rstrip(chr(10))!r}"
+        # without the empty buckets of the longest waits
+        lock_wait = list(args[6].list)
+        while len(lock_wait) > 0 and lock_wait[-1] == 0:
+            _ = lock_wait.pop()
+        return f"[overhead] {fmt.format(location, *args[1:6], lock_wait)}"
+
+    def _perf_formatter(self, fmt: str, args: list[Any]) -> str:
+        """Formatter for `EMT_PERF_FORMAT` records, whose last two arguments are the nanoseconds
+        and the counter deltas (none if the counters were unavailable) since the previous
+        snapshot, which are appended to the message."""
+        message = fmt.format(*args[:-2])
+        body = message.rstrip("\n")
+        counts = list(args[-1].list)
+        deltas = [f"{Duration(args[-2], 1, 10**9)}"]
+        deltas += [f"{count} {name}" for count, name in zip(counts, PERF_COUNTERS)]
+        if len(counts) > 1 and counts[0] > 0:
+            deltas.append(f"{counts[1] / counts[0]:.2f} IPC")
+        return f"{body} [{', '.join(deltas)}]{message[len(body) :]}"
+
     def size_from_raw_size(self, raw_size: int):
         return Size(
             raw_size & ~(self.null_terminated | self.length_prefixed),
@@ -602,7 +1237,7 @@ class Emtrace:
                 )
                 child_type_info = TypeInfo(child_size)
 
-                stack[0][-1].children[child_name] = (child_type_id, child_type_info)
+                stack[0][-1].add_child(child_name, child_type_id, child_type_info)
                 stack[1][-1] -= 1
 
                 if stack[1][-1] == 0:
@@ -617,11 +1252,19 @@ class Emtrace:
 
         formatter_id = consume_size_t()
         match formatter_id:
-            case 0:
+            case FormatterId.PY:
                 formatter = _py_formatter
-            case 2:
+            case FormatterId.C_STYLE:
                 formatter = self._c_style_formatter
-            case 1 | _:
+            case FormatterId.METRIC:
+                formatter = self.metrics.format
+            case FormatterId.DROPPED:
+                formatter = self._dropped_formatter
+            case FormatterId.OVERHEAD:
+                formatter = self._overhead_formatter
+            case FormatterId.PERF:
+                formatter = self._perf_formatter
+            case FormatterId.NONE | _:
                 formatter = self._no_format_formatter
 
         if with_src_loc:
@@ -634,6 +1277,7 @@ class Emtrace:
 
         info: FmtInfo = FmtInfo(fmt_string, self.size_t_size, self.byteorder, formatter)
         info.add_source_info(file, line)
+        info.is_metric = formatter_id == FormatterId.METRIC
 
         for type_id, type_info in type_infos:
             info.add_param(type_id, type_info)
@@ -656,26 +1300,14 @@ def error(*args: Any, **kwargs: Any):
     )
 
 
-def emtrace(
-    elf: Path,
-    istream: Callable[[int], bytes] = sys.stdin.buffer.read,
-    ostream: Callable[[bytes], Any] = sys.stdin.buffer.write,
-    section_name: str = ".emtrace",
-    with_src_loc: Literal["none", "absolute", "relative"] = "none",
-    src_hyperlinks: bool = False,
-    debug_script: bool = False,
-    test_section_name: str | None = None,
-) -> None:
-    """Main function for the emtrace script."""
-
-    captured_output: None | bytearray = None
-    if test_section_name is not None:
-        captured_output = bytearray()
+def no_trace(*args: Any, **kwargs: Any) -> None:
+    pass
 
-        def test_ostream(b: bytes):
-            captured_output.extend(b)
 
-        ostream = test_ostream
+def make_trace(debug_script: bool) -> Callable[[*tuple[Any, ...]], None]:
+    """Get a function that prints debug trace information to stderr if `debug_script` is set."""
+    if not debug_script:
+        return no_trace
 
     def trace(*args: Any, **kwargs: Any):
         if debug_script:
@@ -690,10 +1322,19 @@ def emtrace(
                 **kwargs,
             )
 
-    trace(
-        f"Main args: {elf=} {istream=} {ostream=} {section_name=} {with_src_loc=} {src_hyperlinks=} {debug_script=} {test_section_name=}"
-    )
+    return trace
+
 
+def read_section(
+    elf: Path,
+    section_name: str = ".emtrace",
+    test_section_name: str | None = None,
+    trace: Callable[[*tuple[Any, ...]], None] = lambda *args: None,
+) -> tuple[bytes, bytes | None]:
+    """Read the format info section (and optionally the expected test output) from `elf`.
+
+    Falls back to interpreting the whole file as the section's bytes, if it isn't an ELF file.
+    """
     expected_output: bytes | None = None
     test_section = None
     with elf.open("rb") as fd:
@@ -722,10 +1363,53 @@ def emtrace(
         error(f"Section '{test_section_name}' not found in {elf}")
         sys.exit(1)
 
-    magic_constant = bytes.fromhex(
-        "d197f522d9269fd1ad703392f659dfd0fbecbd60971325e89201b25a385d9ec7"
-    )
-    magic_offset = data.find(magic_constant)
+    return data, expected_output
+
+
+MAGIC_CONSTANT = bytes.fromhex(
+    "d197f522d9269fd1ad703392f659dfd0fbecbd60971325e89201b25a385d9ec7"
+)
+
+
+ENUM_TABLE_MAGIC = bytes.fromhex("3e9a51c40d7be28614f96ca3582fd097")
+
+
+def find_enum_tables(
+    data: bytes, size_t_size: int, byteorder: Literal["little", "big"]
+) -> dict[str, dict[int, str]]:
+    """Collect the enum tables (see `EMT_ENUM` in emtrace.h) in `data`, by enum name.
+
+    The same enum may have several tables (e.g. one per call site or translation unit); their
+    entries are merged.
+    """
+
+    def size_t(at: int) -> int:
+        return int.from_bytes(data[at : at + size_t_size], byteorder=byteorder)
+
+    def c_string(at: int) -> str:
+        return data[at : data.index(b"\0", at)].decode()
+
+    tables: dict[str, dict[int, str]] = {}
+    start = data.find(ENUM_TABLE_MAGIC)
+    while start != -1:
+        header = start + len(ENUM_TABLE_MAGIC)
+        count, name_offset, values_offset, names_offset = (
+            size_t(header + i * size_t_size) for i in range(4)
+        )
+        table = tables.setdefault(c_string(start + name_offset), {})
+        for i in range(count):
+            value_at = start + values_offset + 8 * i
+            value = int.from_bytes(data[value_at : value_at + 8], byteorder=byteorder, signed=True)
+            table[value] = c_string(start + size_t(start + names_offset + i * size_t_size))
+        start = data.find(ENUM_TABLE_MAGIC, start + 1)
+    return tables
+
+
+def open_emtrace(
+    data: bytes, trace: Callable[[*tuple[Any, ...]], None] = lambda *args: None
+) -> Emtrace:
+    """Create an Emtrace instance from the configuration stored next to the magic constant."""
+    magic_offset = data.find(MAGIC_CONSTANT)
     trace(f"{magic_offset=}")
     if magic_offset == -1:
         trace(
@@ -766,116 +1450,443 @@ def emtrace(
         size_t_size,
         null_terminated,
         length_prefixed,
+        byteorder,
         debug_trace=trace,
     )
+    emtrace.magic_offset = magic_offset
+    emtrace.alignment_power = alignment_power
+    emtrace.enums = find_enum_tables(data, size_t_size, byteorder)
+    trace(f"enum tables: {list(emtrace.enums)}")
+    return emtrace
 
-    magic_address = int.from_bytes(istream(ptr_size), byteorder=byteorder)
-    trace(f"{hex(magic_address)=}")
-    magic_address *= 2**alignment_power
-    emtrace.set_offset(magic_offset - magic_address)
 
-    cache: dict[int, FmtInfo] = {}
-    min_path_length: int = 0
-    new_line_missing = True
+class Decoder:
+    """Decodes the records of a single trace stream."""
 
-    parser = Parser(
-        translation_le if byteorder == "little" else translation_be,
-        istream,
-        trace,
-        size_t_size,
-        ptr_size,
-        byteorder,
-        byteorder,
-    )
-    while True:
-        trace("")
-        b = istream(ptr_size)
+    def __init__(
+        self,
+        emtrace: Emtrace,
+        istream: Callable[[int], bytes],
+        trace: Callable[[*tuple[Any, ...]], None] = lambda *args: None,
+    ) -> None:
+        self.emtrace: Emtrace = emtrace
+        self.istream: Callable[[int], bytes] = istream
+        self.trace: Callable[[*tuple[Any, ...]], None] = trace
+        # spares the per-record trace messages from being formatted when nobody reads them
+        self.tracing: bool = trace is not no_trace
+        self.cache: dict[int, FmtInfo] = {}
+        self.sizes: dict[int, int | None] = {}
+        # by the stored (unshifted) address: what `format_fixed` needs of a site, or None if the
+        # site can't be formatted there
+        self.fixed: dict[
+            int, tuple[Callable[..., tuple[Any, ...]], int, Callable[..., str]] | None
+        ] = {}
+        self.address_unpacker: struct.Struct | None = (
+            struct.Struct("<" + {2: "H", 4: "I", 8: "Q"}[emtrace.ptr_size])
+            if emtrace.ptr_size in (2, 4, 8)
+            else None
+        )
+        self.parser: Parser = Parser(
+            translation_le if emtrace.byteorder == "little" else translation_be,
+            istream,
+            trace,
+            emtrace.size_t_size,
+            emtrace.ptr_size,
+            emtrace.byteorder,
+            emtrace.byteorder,
+        )
+        self.parser.resolve_frame = emtrace.resolve_frame
+        self.parser.enums = emtrace.enums
+
+    def read_magic_address(self) -> None:
+        """Consume the magic address at the start of the stream."""
+        magic_address = int.from_bytes(
+            self.istream(self.emtrace.ptr_size), byteorder=self.emtrace.byteorder
+        )
+        self.trace(f"{hex(magic_address)=}")
+        self.emtrace.set_magic_address(magic_address)
+
+    def restart(self) -> None:
+        """Start over on a new capture after `StreamRestarted`.
+
+        A partly read record of the old capture is dropped, and the cached format infos too, as the
+        new producer may have been loaded at a different address.
+        """
+        while True:
+            if self.parser.buffered is not None:
+                self.parser.buffered.reset()
+            self.cache.clear()
+            self.sizes.clear()
+            self.fixed.clear()
+            try:
+                self.read_magic_address()
+                return
+            except StreamRestarted:
+                continue
+
+    def read_address(self) -> int | None:
+        """Read the location of the next record's format info, None at the end of the stream."""
+        ptr_size = self.emtrace.ptr_size
+        b = self.istream(ptr_size)
         if len(b) == 0:
-            break
+            return None
         if len(b) < ptr_size:
             error(
                 "Stream ended in the middle of reading the bytes for the next format info location.",
             )
             error(f"Leftover bytes: {b}")
             sys.exit(1)
-        trace(f"Next format info location bytes: {b}")
-        address = int.from_bytes(b, byteorder="little")
-        trace(f"as address: {hex(address)}")
-        address *= 2**alignment_power
-        trace(f"adjusted address: {hex(address)}")
-        if address in cache:
-            trace("Associated format info already parsed into cache.")
-            info = cache[address]
-        else:
-            trace("Not cached yet.")
-            info = emtrace.parse_fmt_info(address)
-            cache[address] = info
-
-        trace(hex(address))
-        formatted = info.format(parser)
-        match formatted:
-            case tuple():
-                error(
-                    f"Stream ended in the middle of parsing bytes associated with format string {info.fmt_string}.",
-                )
-                error(f"from {info.file}:{info.line}")
-                error("successfully parsed arguments: ", *formatted[0])
-                error(f"Leftover bytes: {formatted[1]}")
-                sys.exit(1)
-            case list():
-                error("Failed to format")
-                error(f"```\n{info.fmt_string}\n```")
-                error(f"from {info.file}:{info.line}")
-                error("with arguments")
-                error("    ", *formatted[:-1])
-                error(formatted[-1])
+        address = int.from_bytes(b, byteorder="little") << self.emtrace.alignment_power
+        if self.tracing:
+            self.trace(f"Next format info location bytes: {b}")
+            self.trace(f"adjusted address: {hex(address)}")
+        return address
+
+    def info_at(self, address: int) -> FmtInfo:
+        """Get the format info at `address`, parsing it on first use."""
+        info = self.cache.get(address)
+        if info is not None:
+            if self.tracing:
+                self.trace("Associated format info already parsed into cache.")
+            return info
+
+        self.trace("Not cached yet.")
+        info = self.emtrace.parse_fmt_info(address)
+        info.compile(self.parser.translation)
+        self.cache[address] = info
+        return info
+
+    def next(
+        self, query: Query | None = None
+    ) -> tuple[FmtInfo, str | list[Any] | tuple[list[Any], bytes]] | None:
+        """Decode and format the next record (matching `query`), None at the end of the stream."""
+        while True:
+            address = self.read_address()
+            if address is None:
+                return None
+            info = self.info_at(address)
+            if self.tracing:
+                self.trace(hex(address))
+            if query is None:
+                return info, info.format(self.parser)
+
+            if not query.matches_site(address, info):
+                _ = self.skip_args(address, info)
                 continue
-            case str():
-                pass
+            args = info.parse_args(self.parser)
+            if query.matches_args(args):
+                return info, info.format(self.parser, args)
+
+    def fixed_site(
+        self, stored: int
+    ) -> tuple[Callable[..., tuple[Any, ...]], int, Callable[..., str]] | None:
+        """The unpacker, argument size and format function of the site at `stored`."""
+        info = self.info_at(stored << self.emtrace.alignment_power)
+        site = None
+        unpacker = info.direct_unpacker
+        if unpacker is not None and info.direct_fmt is not None:
+            if info.formatter is _py_formatter and not info.is_metric:
+                site = (unpacker.unpack_from, unpacker.size, info.direct_fmt.format)
+        self.fixed[stored] = site
+        return site
+
+    def format_fixed(self) -> list[str]:
+        """Format the records already buffered whose arguments are all fixed-size scalars.
+
+        Stops before the first record that is incomplete, needs a different formatter, has
+        arguments of other types, or fails to format, and leaves it to `next`. Records are read
+        straight from the input buffer, without going through `FmtInfo.format`, so this only
+        applies to a stream with a buffered parser, without a query and with tracing off.
+        """
+        source = self.parser.buffered
+        assert source is not None and self.address_unpacker is not None
+        buffer = source.buffer
+        pos = source.pos
+        end = len(buffer)
+        unpack_address = self.address_unpacker.unpack_from
+        address_size = self.address_unpacker.size
+        fixed = self.fixed
+        out: list[str] = []
+        append = out.append
+        while pos + address_size <= end:
+            (stored,) = unpack_address(buffer, pos)
+            site = fixed[stored] if stored in fixed else self.fixed_site(stored)
+            if site is None:
+                break
+            unpack, size, format = site
+            start = pos + address_size
+            if start + size > end:
+                break
+            try:
+                append(format(*unpack(buffer, start)))
+            except Exception:
+                # `next` reports it
+                break
+            pos = start + size
+        source.pos = pos
+        return out
+
+    def skip(self) -> tuple[int, FmtInfo, int] | None:
+        """Consume the next record without formatting it, None at the end of the stream.
+
+        Returns the record's address, format info and size in bytes. Records of a fixed size are
+        skipped without parsing their arguments.
+        """
+        address = self.read_address()
+        if address is None:
+            return None
+        info = self.info_at(address)
+        return address, info, self.emtrace.ptr_size + self.skip_args(address, info)
+
+    def skip_args(self, address: int, info: FmtInfo) -> int:
+        """Consume the arguments of a record from `address`, returning how many bytes they took."""
+        if address not in self.sizes:
+            self.sizes[address] = record_size(info, self.emtrace.ptr_size)
+        size = self.sizes[address]
+        if size is not None:
+            size -= self.emtrace.ptr_size
+            if len(self.istream(size)) < size:
+                raise EndOfStreamException
+            return size
+
+        size = 0
+
+        def counting(n: int) -> bytes:
+            nonlocal size
+            b = self.istream(n)
+            size += len(b)
+            return b
+
+        buffered = self.parser.buffered
+        self.parser._istream = counting
+        self.parser.buffered = None
+        try:
+            for id, type_info in info.type_infos:
+                _ = self.parser.parse(id, type_info)
+        finally:
+            self.parser._istream = self.istream
+            self.parser.buffered = buffered
+        return size
 
-        assert isinstance(formatted, str)
 
+def report_format_error(
+    info: FmtInfo, formatted: list[Any] | tuple[list[Any], bytes]
+) -> None:
+    """Report a record that could not be formatted, exiting if the stream is unusable."""
+    match formatted:
+        case tuple():
+            error(
+                f"Stream ended in the middle of parsing bytes associated with format string {info.fmt_string}.",
+            )
+            error(f"from {info.file}:{info.line}")
+            error("successfully parsed arguments: ", *formatted[0])
+            error(f"Leftover bytes: {formatted[1]}")
+            sys.exit(1)
+        case list():
+            error("Failed to format")
+            error(f"```\n{info.fmt_string}\n```")
+            error(f"from {info.file}:{info.line}")
+            error("with arguments")
+            error("    ", *formatted[:-1])
+            error(formatted[-1])
+
+
+class LineWriter:
+    """Writes formatted records, optionally prefixing every line with its source location.
+
+    Output is collected and passed on to `ostream` in blocks of about `BLOCK_SIZE` bytes; call
+    `flush` to pass on the rest, e.g. before waiting for more input.
+    """
+
+    BLOCK_SIZE: int = 1 << 16
+
+    def __init__(
+        self,
+        ostream: Callable[[bytes], Any],
+        with_src_loc: Literal["none", "absolute", "relative"] = "none",
+    ) -> None:
+        self.ostream: Callable[[bytes], Any] = ostream
+        self.with_src_loc: Literal["none", "absolute", "relative"] = with_src_loc
+        self.min_path_length: int = 0
+        self.new_line_missing: bool = True
+        self.pending: list[str] = []
+        self.pending_size: int = 0
+
+    def flush(self) -> None:
+        if len(self.pending) > 0:
+            _ = self.ostream("".join(self.pending).encode("utf-8"))
+            self.pending.clear()
+            self.pending_size = 0
+
+    def write_all(self, formatted: list[str]) -> None:
+        """Write records without a source location, whatever `with_src_loc` is."""
+        self.pending.extend(formatted)
+        self.pending_size += sum(map(len, formatted))
+        if self.pending_size >= self.BLOCK_SIZE:
+            self.flush()
+
+    def write(self, info: FmtInfo, formatted: str) -> None:
+        out = self.pending.append
+        self.pending_size += len(formatted)
+        if self.pending_size >= self.BLOCK_SIZE:
+            self.flush()
         path = None
-        if with_src_loc == "absolute":
+        if self.with_src_loc == "absolute":
             path = info.file
-        elif with_src_loc == "relative":
+        elif self.with_src_loc == "relative":
             path = os.path.relpath(info.file, os.getcwd())
 
         if path is None:
-            _ = ostream(formatted.encode("utf-8"))
-            continue
+            out(formatted)
+            return
 
         location_string = f"{path}:{info.line}"
-        min_path_length = max(min_path_length, len(location_string))
+        self.min_path_length = max(self.min_path_length, len(location_string))
 
         location_string = location_string + " " * (
-            min_path_length - len(location_string)
+            self.min_path_length - len(location_string)
         )
-        if new_line_missing:
-            _ = ostream(f"{location_string}: ".encode("utf-8"))
+        if self.new_line_missing:
+            out(f"{location_string}: ")
             location_missing = False
         else:
             location_missing = True
 
         lines = formatted.split("\n")
 
-        new_line_missing = False
+        self.new_line_missing = False
         if lines[-1] == "":
             lines = lines[:-1]
-            new_line_missing = True
+            self.new_line_missing = True
 
         for i, line in enumerate(lines):
             if i == 0:
                 pass
             elif location_missing and i == 1:
-                _ = ostream(f"\n{location_string}: ".encode("utf-8"))
+                out(f"\n{location_string}: ")
             else:
-                _ = ostream(("\n" + " " * (2 + min_path_length)).encode("utf-8"))
+                out("\n" + " " * (2 + self.min_path_length))
+
+            out(line)
+
+        if self.new_line_missing:
+            out("\n")
+
+
+def emtrace(
+    elf: Path,
+    istream: Callable[[int], bytes] = sys.stdin.buffer.read,
+    ostream: Callable[[bytes], Any] = sys.stdin.buffer.write,
+    section_name: str = ".emtrace",
+    with_src_loc: Literal["none", "absolute", "relative"] = "none",
+    src_hyperlinks: bool = False,
+    debug_script: bool = False,
+    test_section_name: str | None = None,
+    metrics: Literal["lines", "table", "csv"] = "lines",
+    stats: StatsFormat | None = None,
+    stats_sort: StatsSort = "bytes",
+    query: Query | None = None,
+    jobs: int = 1,
+    flush: Callable[[], Any] = lambda: None,
+    export_dir: Path | None = None,
+) -> None:
+    """Main function for the emtrace script.
+
+    `istream` may return fewer bytes than asked for; `flush` is called with all decoded output
+    passed to `ostream` whenever the decoder is about to wait for more input.
+    """
+
+    captured_output: None | bytearray = None
+    if test_section_name is not None:
+        captured_output = bytearray()
+
+        def test_ostream(b: bytes):
+            captured_output.extend(b)
+
+        ostream = test_ostream
+
+    trace = make_trace(debug_script)
+
+    trace(
+        f"Main args: {elf=} {istream=} {ostream=} {section_name=} {with_src_loc=} {src_hyperlinks=} {debug_script=} {test_section_name=}"
+    )
+
+    data, expected_output = read_section(elf, section_name, test_section_name, trace)
+    writer = LineWriter(ostream, with_src_loc)
+    source = BufferedInput(istream)
+    decoder = Decoder(open_emtrace(data, trace), source.read, trace)
+    decoder.parser.buffered = source
+    decoder.emtrace.metrics.mode = metrics
+    decoder.emtrace.symbolizer = Symbolizer.open(elf, section_name, trace)
+    decoder.read_magic_address()
+
+    def before_wait() -> None:
+        writer.flush()
+        flush()
+
+    if jobs <= 1:
+        # the parallel decoder reads on a thread of its own, and flushes as its batches complete
+        source.before_wait = before_wait
+
+    if stats is not None:
+        profile = Stats(decoder.emtrace.ptr_size)
+        try:
+            while (record := decoder.skip()) is not None:
+                profile.add(*record, time.monotonic())
+        except EndOfStreamException:
+            error("Stream ended in the middle of a record.")
+        _ = ostream(profile.render(stats, stats_sort).encode("utf-8"))
+        return
+
+    if export_dir is not None:
+        # imported here, as it builds on this module
+        from .export import export
+
+        export(decoder, export_dir, query)
+        return
+
+    if jobs > 1:
+        # imported here, as it builds on this module
+        from .parallel import decode_parallel
+
+        decode_parallel(decoder, elf, section_name, writer, jobs, query, debug_script)
+
+    # runs of fixed-size records are formatted straight from the input buffer
+    fast = (
+        query is None
+        and not decoder.tracing
+        and with_src_loc == "none"
+        and decoder.address_unpacker is not None
+    )
+    while jobs <= 1:
+        if fast:
+            writer.write_all(decoder.format_fixed())
+        try:
+            record = decoder.next(query)
+        except EndOfStreamException:
+            error("Stream ended in the middle of a record.")
+            break
+        except StreamRestarted:
+            writer.flush()
+            decoder.restart()
+            continue
+        if record is None:
+            break
+        info, formatted = record
+        if not isinstance(formatted, str):
+            writer.flush()
+            report_format_error(info, formatted)
+            continue
+        if info.is_metric and formatted == "":
+            continue
 
-            _ = ostream(line.encode("utf-8"))
+        writer.write(info, formatted)
 
-        if new_line_missing:
-            _ = ostream(b"\n")
+    writer.flush()
+    if metrics == "table" and len(decoder.emtrace.metrics.series) > 0:
+        _ = ostream(decoder.emtrace.metrics.table().encode("utf-8"))
+    if decoder.emtrace.dropped > 0:
+        error(f"{decoder.emtrace.dropped} records dropped in total")
 
     if test_section_name is not None:
         assert expected_output is not None
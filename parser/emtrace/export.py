@@ -0,0 +1,272 @@
+"""Columnar export of the decoded arguments, one table per call site.
+
+The columns of a call site's table follow from its format info: one per argument (or per field of
+a struct argument), typed by how the argument is decoded, after a `seq` column with the record's
+position in the stream. Counter and histogram records carry a timestamp, which gets a column of
+its own. Records are never formatted.
+
+Tables are written as CSV, passed on to their files in groups of `ROW_GROUP_SIZE` rows.
+`sites.csv` lists the table of every call site, with the types of its columns.
+"""
+
+from __future__ import annotations
+from typing import TYPE_CHECKING, Any, Callable, Literal
+from pathlib import Path
+import csv
+import os
+import re
+
+from .emtrace import (
+    Decoder,
+    EndOfStreamException,
+    FmtInfo,
+    TypeInfo,
+    char,
+    error,
+    float_be,
+    float_le,
+    signed_be,
+    signed_char,
+    signed_le,
+    string,
+    to_bool,
+    to_duration,
+    to_list,
+    to_optional,
+    unsigned_be,
+    unsigned_le,
+)
+
+if TYPE_CHECKING:
+    from .query import Query
+
+Kind = Literal["int64", "uint64", "double", "bool", "string"]
+
+ROW_GROUP_SIZE = 1 << 17
+
+_KINDS: dict[Callable[..., Any], Kind] = {
+    signed_le: "int64",
+    signed_be: "int64",
+    signed_char: "int64",
+    unsigned_le: "uint64",
+    unsigned_be: "uint64",
+    char: "uint64",
+    float_le: "double",
+    float_be: "double",
+    to_bool: "bool",
+    string: "string",
+    to_duration: "double",
+}
+
+
+def _integer(value: Any) -> int:
+    return int(getattr(value, "value", value))
+
+
+def _convert(kind: Kind, decode: Callable[..., Any] | None) -> Callable[[Any], Any]:
+    match kind:
+        case "int64" | "uint64":
+            return _integer
+        case "double":
+            return (lambda value: value.seconds) if decode is to_duration else float
+        case "bool":
+            return bool
+        case "string":
+            return (lambda value: value) if decode is string else format
+
+
+class Column:
+    """A column of a call site's table, and how to get its value out of the record's arguments."""
+
+    def __init__(self, name: str, kind: Kind, get: Callable[[list[Any]], Any]) -> None:
+        self.name: str = name
+        self.kind: Kind = kind
+        self.get: Callable[[list[Any]], Any] = get
+
+
+def columns(
+    name: str,
+    id: str,
+    info: TypeInfo,
+    translation: dict[str, Callable[..., Any]],
+    get: Callable[[list[Any]], Any],
+) -> list[Column]:
+    """The columns of an argument of type `id`, which `get` picks out of the arguments."""
+    if id.startswith("struct ") and id not in translation:
+        result: list[Column] = []
+        for field_name, field_id, field_info in info.fields:
+            if field_id == "offset":
+                continue
+
+            def field(args: list[Any], name: str = field_name) -> Any:
+                value = get(args)
+                return None if value is None else value.fields[name]
+
+            result += columns(f"{name}.{field_name}", field_id, field_info, translation, field)
+        return result
+    if id.startswith("enum:") and id not in translation:
+        return [Column(name, "string", lambda args: _none_or(str, get(args)))]
+
+    decode = translation.get(id)
+    if id.startswith("duration:") and decode is None:
+        decode = to_duration
+    if decode is to_optional:
+        child_id, child_info = info.children[""]
+        return columns(
+            name, child_id, child_info, translation, lambda args: _none_or(_value, get(args))
+        )
+    if decode is to_list:
+        convert = _element_list(*info.children[""], translation)
+        return [Column(name, "string", lambda args: _none_or(convert, get(args)))]
+    kind = _kind(decode, info)
+    convert = _convert(kind, decode)
+    return [Column(name, kind, lambda args: _none_or(convert, get(args)))]
+
+
+def _kind(decode: Callable[..., Any] | None, info: TypeInfo) -> Kind:
+    kind = _KINDS.get(decode, "string") if decode is not None else "string"
+    if kind in ("int64", "uint64") and info.size.min_size > 8:
+        # 128 bit integers don't fit
+        return "string"
+    return kind
+
+
+def _element_list(
+    id: str, info: TypeInfo, translation: dict[str, Callable[..., Any]]
+) -> Callable[[Any], str]:
+    """Render lists as `[1, 2, 3]`, with their elements converted like columns of their type."""
+    decode = translation.get(id)
+    convert = _convert(_kind(decode, info), decode)
+    if decode is None or decode is to_list:
+        convert = format
+    return lambda value: "[" + ", ".join(str(convert(element)) for element in value.list) + "]"
+
+
+def _value(optional: Any) -> Any:
+    return optional.value
+
+
+def _none_or(convert: Callable[[Any], Any], value: Any) -> Any:
+    return None if value is None else convert(value)
+
+
+def site_columns(info: FmtInfo, translation: dict[str, Callable[..., Any]]) -> list[Column]:
+    result: list[Column] = []
+    for i, (id, type_info) in enumerate(info.type_infos):
+        name = f"arg{i}"
+        if info.is_metric and i == 1:
+            name = "timestamp"
+        result += columns(name, id, type_info, translation, lambda args, i=i: args[i])
+    return result
+
+
+def table_name(info: FmtInfo, taken: set[str]) -> str:
+    """A file name for the table of `info`'s call site, like `main_c_42`."""
+    base = re.sub(r"[^A-Za-z0-9]+", "_", os.path.basename(info.file)).strip("_") or "site"
+    name = f"{base}_{info.line}"
+    suffix = 1
+    while name in taken:
+        suffix += 1
+        name = f"{base}_{info.line}_{suffix}"
+    taken.add(name)
+    return name
+
+
+class Table:
+    """The rows of one call site, passed on to the file in row groups."""
+
+    def __init__(self, name: str, info: FmtInfo, columns: list[Column]) -> None:
+        self.name: str = name
+        self.info: FmtInfo = info
+        self.columns: list[Column] = columns
+        self.seq: list[int] = []
+        self.values: list[list[Any]] = [[] for _ in columns]
+        self.records: int = 0
+
+    def add(self, seq: int, args: list[Any]) -> bool:
+        """Add a row; True once a row group is full."""
+        self.seq.append(seq)
+        for column, values in zip(self.columns, self.values):
+            values.append(column.get(args))
+        self.records += 1
+        return len(self.seq) >= ROW_GROUP_SIZE
+
+    def take(self) -> tuple[list[int], list[list[Any]]]:
+        seq, values = self.seq, self.values
+        self.seq = []
+        self.values = [[] for _ in self.columns]
+        return seq, values
+
+
+class CsvWriter:
+    def __init__(self, path: Path, table: Table) -> None:
+        self.file = path.with_suffix(".csv").open("w", newline="")
+        self.writer = csv.writer(self.file)
+        self.writer.writerow(["seq"] + [column.name for column in table.columns])
+
+    def write(self, seq: list[int], values: list[list[Any]]) -> None:
+        self.writer.writerows(zip(seq, *values))
+
+    def close(self) -> None:
+        self.file.close()
+
+
+def export(
+    decoder: Decoder,
+    directory: Path,
+    query: Query | None = None,
+) -> None:
+    """Export the arguments of every record (matching `query`) into `directory`."""
+    directory.mkdir(parents=True, exist_ok=True)
+    translation = decoder.parser.translation
+    tables: dict[int, Table] = {}
+    writers: dict[int, CsvWriter] = {}
+    taken: set[str] = set()
+
+    def flush(address: int) -> None:
+        table = tables[address]
+        writer = writers.get(address)
+        if writer is None:
+            writer = CsvWriter(directory / table.name, table)
+            writers[address] = writer
+        writer.write(*table.take())
+
+    seq = 0
+    try:
+        while (address := decoder.read_address()) is not None:
+            seq += 1
+            info = decoder.info_at(address)
+            if query is not None and not query.matches_site(address, info):
+                _ = decoder.skip_args(address, info)
+                continue
+            args = info.parse_args(decoder.parser)
+            if query is not None and not query.matches_args(args):
+                continue
+            table = tables.get(address)
+            if table is None:
+                table = Table(table_name(info, taken), info, site_columns(info, translation))
+                tables[address] = table
+            if table.add(seq - 1, args):
+                flush(address)
+    except EndOfStreamException:
+        error("Stream ended in the middle of a record.")
+
+    for address, table in tables.items():
+        if len(table.seq) > 0 or address not in writers:
+            flush(address)
+        writers[address].close()
+
+    with (directory / "sites.csv").open("w", newline="") as f:
+        index = csv.writer(f)
+        index.writerow(["table", "file", "line", "format", "records", "columns"])
+        for table in sorted(tables.values(), key=lambda t: t.name):
+            index.writerow(
+                [
+                    f"{table.name}.csv",
+                    table.info.file,
+                    table.info.line,
+                    table.info.fmt_string,
+                    table.records,
+                    " ".join(f"{c.name}:{c.kind}" for c in table.columns),
+                ]
+            )
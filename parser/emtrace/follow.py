@@ -0,0 +1,157 @@
+"""Input from capture files, optionally followed as they grow (like `tail -F`).
+
+A followed file is read up to its current end, after which reads block until it grows. On Linux
+the wait is on inotify, so new data is picked up as soon as it has been written; elsewhere the file
+is polled. The decoder keeps its state across waits, including a record that has only been written
+in part.
+
+If the file is replaced (renamed or deleted and created anew, as by log rotation), the rest of the
+old file is read, and the stream continues with the new one. If it is truncated, it is read again
+from the start. Either way the new content is a capture of its own, starting with a magic address;
+`StreamRestarted` tells the decoder to drop what it has of the old one and read that address.
+"""
+
+from __future__ import annotations
+from typing import BinaryIO
+from pathlib import Path
+import ctypes
+import ctypes.util
+import os
+import select
+import time
+
+from .emtrace import StreamRestarted
+
+# from <sys/inotify.h>
+IN_MODIFY = 0x00000002
+IN_ATTRIB = 0x00000004
+IN_CLOSE_WRITE = 0x00000008
+IN_MOVED_TO = 0x00000080
+IN_CREATE = 0x00000100
+IN_DELETE_SELF = 0x00000400
+IN_MOVE_SELF = 0x00000800
+IN_NONBLOCK = 0o4000
+IN_CLOEXEC = 0o2000000
+
+FILE_EVENTS = IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF
+DIRECTORY_EVENTS = IN_CREATE | IN_MOVED_TO
+
+# how long to wait before checking on the file anyway, in case an event was missed
+POLL_INTERVAL = 0.01
+WATCH_INTERVAL = 1.0
+
+
+class FileInput:
+    """Reads a capture file up to its current end."""
+
+    def __init__(self, path: str) -> None:
+        self.path: Path = Path(path)
+        self.file: BinaryIO | None = None
+
+    def __call__(self, n: int) -> bytes:
+        if self.file is None:
+            self.file = self.path.open("rb", buffering=0)
+        return self.file.read(n)
+
+
+class Inotify:
+    """The minimum of inotify needed to wait for changes to a file, through libc."""
+
+    def __init__(self) -> None:
+        libc = ctypes.CDLL(ctypes.util.find_library("c"), use_errno=True)
+        self.add_watch = libc.inotify_add_watch
+        self.add_watch.argtypes = [ctypes.c_int, ctypes.c_char_p, ctypes.c_uint32]
+        self.rm_watch = libc.inotify_rm_watch
+        self.rm_watch.argtypes = [ctypes.c_int, ctypes.c_int]
+        self.fd: int = libc.inotify_init1(IN_NONBLOCK | IN_CLOEXEC)
+        if self.fd < 0:
+            raise OSError(ctypes.get_errno(), os.strerror(ctypes.get_errno()))
+        self.watches: dict[str, int] = {}
+
+    @staticmethod
+    def open() -> Inotify | None:
+        try:
+            return Inotify()
+        except (OSError, AttributeError, TypeError):
+            return None
+
+    def watch(self, key: str, path: Path, mask: int) -> None:
+        """Watch `path` (replacing the previous watch under `key`), if it exists."""
+        old = self.watches.pop(key, None)
+        if old is not None:
+            _ = self.rm_watch(self.fd, old)
+        wd = self.add_watch(self.fd, os.fsencode(path), mask)
+        if wd >= 0:
+            self.watches[key] = wd
+
+    def wait(self, timeout: float) -> None:
+        """Wait for any event (or `timeout` seconds), and discard the events."""
+        readable, _, _ = select.select([self.fd], [], [], timeout)
+        if len(readable) > 0:
+            try:
+                while len(os.read(self.fd, 4096)) > 0:
+                    pass
+            except BlockingIOError:
+                pass
+
+
+class FollowInput:
+    """Reads a capture file that is still being written, blocking at its end until it grows."""
+
+    def __init__(self, path: str) -> None:
+        self.path: Path = Path(path)
+        self.fd: int | None = None
+        self.inode: tuple[int, int] | None = None
+        self.pos: int = 0
+        self.inotify: Inotify | None = Inotify.open()
+        if self.inotify is not None:
+            self.inotify.watch("directory", self.path.parent, DIRECTORY_EVENTS)
+
+    def _open(self) -> bool:
+        try:
+            fd = os.open(self.path, os.O_RDONLY | getattr(os, "O_CLOEXEC", 0))
+        except FileNotFoundError:
+            return False
+        if self.fd is not None:
+            os.close(self.fd)
+        self.fd = fd
+        stat = os.fstat(fd)
+        self.inode = (stat.st_dev, stat.st_ino)
+        self.pos = 0
+        if self.inotify is not None:
+            self.inotify.watch("file", self.path, FILE_EVENTS)
+        return True
+
+    def _replaced(self) -> bool:
+        try:
+            stat = os.stat(self.path)
+        except FileNotFoundError:
+            return False
+        return (stat.st_dev, stat.st_ino) != self.inode
+
+    def _wait(self) -> None:
+        if self.inotify is not None:
+            self.inotify.wait(WATCH_INTERVAL)
+        else:
+            time.sleep(POLL_INTERVAL)
+
+    def __call__(self, n: int) -> bytes:
+        while True:
+            if self.fd is None:
+                if not self._open():
+                    self._wait()
+                    continue
+            assert self.fd is not None
+            b = os.read(self.fd, n)
+            if len(b) > 0:
+                self.pos += len(b)
+                return b
+            # at the end of what has been written; the old file is drained before switching over
+            if self._replaced():
+                _ = self._open()
+                raise StreamRestarted
+            if os.fstat(self.fd).st_size < self.pos:
+                _ = os.lseek(self.fd, 0, os.SEEK_SET)
+                self.pos = 0
+                raise StreamRestarted
+            self._wait()
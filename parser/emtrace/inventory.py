@@ -0,0 +1,288 @@
+"""Offline inventory of the call sites described in the `.emtrace` section of a binary.
+
+The section isn't indexed; its format infos are found by walking it in steps of the alignment
+they all share (see `EMT_ALIGNMENT` in emtrace.h), and checking whether a plausible `layout`
+starts at each offset. A recognized format info is skipped as a whole, so that its strings are not
+mistaken for another one.
+"""
+
+from __future__ import annotations
+from typing import Any, Callable, Literal
+from pathlib import Path
+import csv
+import io
+import json
+
+from .emtrace import (
+    ENUM_TABLE_MAGIC,
+    MAGIC_CONSTANT,
+    Emtrace,
+    FormatterId,
+    make_trace,
+    open_emtrace,
+    read_section,
+)
+from .stats import fixed_size, record_size
+
+InventoryFormat = Literal["table", "csv", "json"]
+
+# limits beyond which a candidate layout is assumed to be something else
+MAX_ARGS = 64
+MAX_NODES = 4096
+MAX_OFFSET = 1 << 20
+MAX_FORMATTER = max(FormatterId)
+MAX_LINE = 1 << 24
+
+
+class Site:
+    """One call site, as described by its format info."""
+
+    def __init__(
+        self,
+        offset: int,
+        section_bytes: int,
+        file: str,
+        line: int,
+        fmt: str,
+        args: list[str],
+        record_size: int | None,
+        min_record_size: int,
+    ) -> None:
+        self.offset: int = offset
+        self.section_bytes: int = section_bytes
+        self.file: str = file
+        self.line: int = line
+        self.fmt: str = fmt
+        self.args: list[str] = args
+        self.record_size: int | None = record_size
+        self.min_record_size: int = min_record_size
+
+    def as_dict(self) -> dict[str, Any]:
+        return {
+            "file": self.file,
+            "line": self.line,
+            "format": self.fmt,
+            "args": self.args,
+            "record_size": self.record_size,
+            "min_record_size": self.min_record_size,
+            "section_bytes": self.section_bytes,
+        }
+
+
+def _c_string(data: bytes, at: int) -> str | None:
+    end = data.find(b"\0", at)
+    if at >= len(data) or end == -1:
+        return None
+    try:
+        return data[at:end].decode("utf-8")
+    except UnicodeDecodeError:
+        return None
+
+
+def probe_info(emtrace: Emtrace, pos: int) -> int | None:
+    """The end of the format info starting at `pos` in the section, None if there is none.
+
+    Checks that the layout is well-formed and that every offset in it points past the layout, at a
+    null-terminated UTF-8 string inside the section.
+    """
+    data = emtrace.data
+    width = emtrace.size_t_size
+    cursor = pos
+
+    def size_t() -> int | None:
+        nonlocal cursor
+        if cursor + width > len(data):
+            return None
+        value = int.from_bytes(data[cursor : cursor + width], byteorder=emtrace.byteorder)
+        cursor += width
+        return value
+
+    num_args = size_t()
+    if num_args is None or num_args > MAX_ARGS:
+        return None
+    fmt_offset = size_t()
+    if fmt_offset is None:
+        return None
+    string_offsets = [fmt_offset]
+    pending = [num_args]
+    nodes = 0
+    while len(pending) > 0:
+        if pending[-1] == 0:
+            _ = pending.pop()
+            continue
+        pending[-1] -= 1
+        nodes += 1
+        if nodes > MAX_NODES:
+            return None
+        top_level = len(pending) == 1
+        if top_level:
+            fields = [size_t() for _ in range(3)]
+            if fields[0] is None or fields[2] is None:
+                return None
+            string_offsets.append(fields[0])
+            children = fields[2]
+        else:
+            fields = [size_t() for _ in range(4)]
+            if fields[0] is None or fields[2] is None or fields[3] is None:
+                return None
+            string_offsets.extend((fields[0], fields[3]))
+            children = fields[2]
+        if children > MAX_NODES:
+            return None
+        if children > 0:
+            pending.append(children)
+
+    formatter = size_t()
+    file_offset = size_t()
+    line = size_t()
+    if formatter is None or file_offset is None or line is None or formatter > MAX_FORMATTER:
+        return None
+    if line == 0 or line > MAX_LINE:
+        return None
+    string_offsets.append(file_offset)
+
+    layout_size = cursor - pos
+    end = cursor
+    for offset in string_offsets:
+        if offset < layout_size or offset > MAX_OFFSET:
+            return None
+        string = _c_string(data, pos + offset)
+        if string is None:
+            return None
+        end = max(end, pos + offset + len(string.encode("utf-8")) + 1)
+    file = _c_string(data, pos + file_offset)
+    if file is None or file == "" or not file.isprintable():
+        return None
+    return end
+
+
+def _describe(id: str, info: Any) -> str:
+    if id == "list":
+        child_id, child_info = info.children[""]
+        return f"{_describe(child_id, child_info)}[]"
+    return id
+
+
+def _min_size(id: str, info: Any, emtrace: Emtrace) -> int:
+    size = fixed_size(id, info)
+    if size is not None:
+        return size
+    if info.size.length_prefixed:
+        return emtrace.size_t_size
+    # null-terminated strings, and the presence byte or index of optionals and variants
+    return 1
+
+
+def inventory(emtrace: Emtrace) -> list[Site]:
+    """Every call site with a format info in the section, in the order they appear."""
+    data = emtrace.data
+    step = 2**emtrace.alignment_power
+    sites: list[Site] = []
+    pos = 0
+    while pos < len(data):
+        if data.startswith(MAGIC_CONSTANT, pos):
+            pos += len(MAGIC_CONSTANT) + 4 + 4 * emtrace.size_t_size
+            pos = -(-pos // step) * step
+            continue
+        if data.startswith(ENUM_TABLE_MAGIC, pos):
+            pos += len(ENUM_TABLE_MAGIC)
+            continue
+        end = probe_info(emtrace, pos)
+        if end is None:
+            pos += step
+            continue
+
+        info = emtrace.parse_fmt_info(pos, offset=0)
+        min_record_size = emtrace.ptr_size + sum(
+            _min_size(id, type_info, emtrace) for id, type_info in info.type_infos
+        )
+        aligned_end = -(-end // step) * step
+        sites.append(
+            Site(
+                pos,
+                aligned_end - pos,
+                info.file,
+                info.line,
+                info.fmt_string,
+                [_describe(id, type_info) for id, type_info in info.type_infos],
+                record_size(info, emtrace.ptr_size),
+                min_record_size,
+            )
+        )
+        pos = aligned_end
+    return sites
+
+
+def render(sites: list[Site], section_size: int, format: InventoryFormat = "table") -> str:
+    """The call sites sorted by file and line, grouped by file for `table`."""
+    sites = sorted(sites, key=lambda site: (site.file, site.line, site.offset))
+    match format:
+        case "json":
+            return (
+                json.dumps(
+                    {
+                        "section_bytes": section_size,
+                        "sites": [site.as_dict() for site in sites],
+                    },
+                    indent=2,
+                )
+                + "\n"
+            )
+        case "csv":
+            out = io.StringIO()
+            columns = ["file", "line", "format", "args", "record_size", "min_record_size"]
+            columns.append("section_bytes")
+            writer = csv.DictWriter(out, columns, lineterminator="\n")
+            writer.writeheader()
+            for site in sites:
+                row = site.as_dict()
+                row["args"] = " ".join(site.args)
+                writer.writerow(row)
+            return out.getvalue()
+        case "table":
+            files: dict[str, list[Site]] = {}
+            for site in sites:
+                files.setdefault(site.file, []).append(site)
+
+            lines: list[str] = []
+            for file, file_sites in files.items():
+                total = sum(site.section_bytes for site in file_sites)
+                lines.append(f"{file} ({len(file_sites)} call sites, {total} bytes)\n")
+                cells = [["line", "record", "section", "format", "args"]]
+                for site in file_sites:
+                    record = (
+                        str(site.record_size)
+                        if site.record_size is not None
+                        else f"{site.min_record_size}+"
+                    )
+                    args = ", ".join(site.args)
+                    cells.append(
+                        [str(site.line), record, str(site.section_bytes), repr(site.fmt), args]
+                    )
+                widths = [max(len(row[i]) for row in cells) for i in range(4)]
+                for row in cells:
+                    padded = [
+                        cell.ljust(width) if i == 3 else cell.rjust(width)
+                        for i, (cell, width) in enumerate(zip(row, widths))
+                    ]
+                    lines.append(("  " + "  ".join(padded + [row[4]])).rstrip() + "\n")
+            used = sum(site.section_bytes for site in sites)
+            lines.append(
+                f"total: {len(sites)} call sites, {used} of {section_size} section bytes\n"
+            )
+            return "".join(lines)
+
+
+def emtrace_inventory(
+    elf: Path,
+    ostream: Callable[[bytes], Any],
+    section_name: str = ".emtrace",
+    format: InventoryFormat = "table",
+    debug_script: bool = False,
+) -> None:
+    """Write the inventory of `elf`'s call sites to `ostream`."""
+    trace = make_trace(debug_script)
+    data, _ = read_section(elf, section_name, None, trace)
+    emtrace = open_emtrace(data, trace)
+    sites = inventory(emtrace)
+    _ = ostream(render(sites, len(data), format).encode("utf-8"))
@@ -0,0 +1,182 @@
+"""Decoder side of in-process counters and histograms.
+
+Mirrors the record layout defined in `c/include/c/include/emtrace/metrics.h`; keep both in sync.
+"""
+
+from __future__ import annotations
+from typing import Any, Literal
+import math
+
+METRIC_COUNTER = 0
+METRIC_HISTOGRAM = 1
+
+PERCENTILES = (0.5, 0.9, 0.99)
+
+
+def bucket_bounds(index: int, sub_bits: int) -> tuple[int, int]:
+    """Smallest and largest value that fall into histogram bucket `index`."""
+    if index < 1 << sub_bits:
+        return index, index
+    shift = (index >> sub_bits) - 1
+    lower = ((1 << sub_bits) + (index & ((1 << sub_bits) - 1))) << shift
+    return lower, lower + (1 << shift) - 1
+
+
+class Series:
+    """Everything received for one metric so far."""
+
+    def __init__(self, name: str, kind: int) -> None:
+        self.name: str = name
+        self.kind: int = kind
+        self.intervals: int = 0
+        self.count: int = 0
+        self.sum: int = 0
+        self.min: int | None = None
+        self.max: int | None = None
+        self.sub_bits: int = 0
+        self.buckets: dict[int, int] = {}
+
+    def add_counter(self, value: int) -> None:
+        self.intervals += 1
+        self.count += value
+
+    def add_histogram(
+        self, count: int, total: int, low: int, high: int, sub_bits: int, buckets: dict[int, int]
+    ) -> None:
+        self.intervals += 1
+        self.sub_bits = sub_bits
+        if count == 0:
+            return
+        self.count += count
+        self.sum += total
+        self.min = low if self.min is None else min(self.min, low)
+        self.max = high if self.max is None else max(self.max, high)
+        for index, n in buckets.items():
+            self.buckets[index] = self.buckets.get(index, 0) + n
+
+
+def percentile(
+    buckets: dict[int, int], count: int, q: float, sub_bits: int, low: int, high: int
+) -> int:
+    """The largest value of the bucket holding the `q` quantile, clamped to [`low`, `high`]."""
+    target = max(1, math.ceil(q * count))
+    cumulative = 0
+    for index in sorted(buckets):
+        cumulative += buckets[index]
+        if cumulative >= target:
+            return min(max(bucket_bounds(index, sub_bits)[1], low), high)
+    return high
+
+
+def _byte(value: Any) -> int:
+    # `uint8_t` arguments are decoded as characters
+    return int(getattr(value, "value", value))
+
+
+def _pairs(flat: Any) -> dict[int, int]:
+    values: list[int] = list(getattr(flat, "list", flat))
+    return {values[i]: values[i + 1] for i in range(0, len(values) - 1, 2)}
+
+
+class Metrics:
+    """Formatter for `EMT_METRIC_FORMAT` records, and the state to render them as a table.
+
+    In `lines` mode every record is rendered as a line of its own, in `csv` mode as a row of a
+    time series (with the time relative to the first metric record), and in `table` mode nothing is
+    rendered per record; instead `table()` summarizes all intervals at the end.
+    """
+
+    def __init__(self, mode: Literal["lines", "table", "csv"] = "lines") -> None:
+        self.mode: Literal["lines", "table", "csv"] = mode
+        self.series: dict[str, Series] = {}
+        self.start: int | None = None
+
+    def _series(self, name: str, kind: int) -> Series:
+        series = self.series.get(name)
+        if series is None:
+            series = Series(name, kind)
+            self.series[name] = series
+        return series
+
+    def _csv(self, timestamp: int, *columns: Any) -> str:
+        if self.start is None:
+            self.start = timestamp
+            header = "time_s,name,kind,count,sum,min,p50,p90,p99,max\n"
+        else:
+            header = ""
+        row = ",".join("" if c is None else str(c) for c in columns)
+        return f"{header}{(timestamp - self.start) / 1e9:.6f},{row}\n"
+
+    def format(self, name: str, args: list[Any]) -> str:
+        kind, timestamp = _byte(args[0]), args[1]
+        if kind == METRIC_COUNTER:
+            value = args[2]
+            series = self._series(name, kind)
+            series.add_counter(value)
+            match self.mode:
+                case "lines":
+                    return f"{name}: +{value} (total {series.count})\n"
+                case "csv":
+                    return self._csv(timestamp, name, "counter", value)
+                case "table":
+                    return ""
+
+        count, total, low, high = args[2:6]
+        sub_bits = _byte(args[6])
+        buckets = _pairs(args[7])
+        series = self._series(name, kind)
+        series.add_histogram(count, total, low, high, sub_bits, buckets)
+        quantiles = [percentile(buckets, count, q, sub_bits, low, high) for q in PERCENTILES]
+        match self.mode:
+            case "lines":
+                if count == 0:
+                    return f"{name}: count=0\n"
+                p50, p90, p99 = quantiles
+                return (
+                    f"{name}: count={count} min={low} p50={p50} p90={p90} p99={p99} max={high}\n"
+                )
+            case "csv":
+                if count == 0:
+                    return self._csv(timestamp, name, "histogram", 0)
+                return self._csv(timestamp, name, "histogram", count, total, low, *quantiles, high)
+            case "table":
+                return ""
+
+    def table(self) -> str:
+        """Summary of every metric over all intervals received."""
+        header = ["metric", "kind", "intervals", "count", "mean", "min", "p50", "p90", "p99", "max"]
+        rows: list[list[str]] = [header]
+        for series in self.series.values():
+            if series.kind == METRIC_COUNTER or series.count == 0:
+                kind = "counter" if series.kind == METRIC_COUNTER else "histogram"
+                rows.append(
+                    [series.name, kind, str(series.intervals), str(series.count)] + ["-"] * 6
+                )
+                continue
+            assert series.min is not None and series.max is not None
+            quantiles = [
+                percentile(series.buckets, series.count, q, series.sub_bits, series.min, series.max)
+                for q in PERCENTILES
+            ]
+            rows.append(
+                [
+                    series.name,
+                    "histogram",
+                    str(series.intervals),
+                    str(series.count),
+                    f"{series.sum / series.count:.1f}",
+                    str(series.min),
+                    *map(str, quantiles),
+                    str(series.max),
+                ]
+            )
+
+        widths = [max(len(row[i]) for row in rows) for i in range(len(header))]
+        lines = []
+        for row in rows:
+            cells = [
+                cell.ljust(width) if i < 2 else cell.rjust(width)
+                for i, (cell, width) in enumerate(zip(row, widths))
+            ]
+            lines.append("  ".join(cells).rstrip() + "\n")
+        return "".join(lines)
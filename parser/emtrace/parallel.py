@@ -0,0 +1,278 @@
+"""Decoding on several cores.
+
+The stream is decoded in a pipeline: a reader thread pulls chunks from the input, the main process
+splits them into batches of whole records, a pool of worker processes formats the batches, and
+the main process writes their output in the original order.
+
+Finding the record boundaries is cheap, since most records' sizes follow from their format info;
+only arguments of variable size need to be looked at, and even those are walked over without
+building their values. Records of counters and histograms are formatted in the main process, as
+their formatter accumulates state across records.
+"""
+
+from __future__ import annotations
+from typing import Callable
+from collections import deque
+from concurrent.futures import Future, ProcessPoolExecutor
+from pathlib import Path
+import queue
+import threading
+
+from .emtrace import (
+    Decoder,
+    Emtrace,
+    LineWriter,
+    TypeInfo,
+    error,
+    make_trace,
+    open_emtrace,
+    read_section,
+    report_format_error,
+)
+from .query import Query
+from .stats import fixed_size, record_size
+from .symbols import Symbolizer
+
+CHUNK_SIZE = 1 << 22
+BATCH_SIZE = 1 << 20
+
+# what a worker produces per record: the formatted text, the pieces of a record that failed to
+# format, or the raw arguments of a record to be formatted by the main process
+Formatted = tuple[int, str | list[str] | bytes]
+
+
+class Incomplete(Exception):
+    """The record continues past the end of the data at hand."""
+
+
+def arg_end(emtrace: Emtrace, data: bytes, pos: int, id: str, info: TypeInfo) -> int:
+    """Where the argument of type `id` starting at `pos` in `data` ends, without parsing it."""
+    size = fixed_size(id, info)
+    if size is not None:
+        return pos + size
+    if info.size.null_terminated:
+        end = data.find(b"\0", pos)
+        if end == -1:
+            raise Incomplete
+        return end + 1
+    if id in ("optional", "variant"):
+        if pos >= len(data):
+            raise Incomplete
+        selector = data[pos]
+        pos += 1
+        index = 0 if id == "optional" else selector
+        if (id == "optional" and selector == 0) or index >= len(info.fields):
+            return pos
+        _, child_id, child_info = info.fields[index]
+        return arg_end(emtrace, data, pos, child_id, child_info)
+
+    width = emtrace.size_t_size
+    if pos + width > len(data):
+        raise Incomplete
+    count = int.from_bytes(data[pos : pos + width], byteorder=emtrace.byteorder)
+    pos += width
+    match id:
+        case "list":
+            child_id, child_info = info.children[""]
+            child_size = fixed_size(child_id, child_info)
+            if child_size is not None:
+                return pos + count * child_size
+            for _ in range(count):
+                pos = arg_end(emtrace, data, pos, child_id, child_info)
+            return pos
+        case "stack":
+            return pos + count * info.size.min_size
+        case _:
+            # strings and blobs
+            return pos + count
+
+
+class Splitter:
+    """Finds the boundaries of the records in the stream."""
+
+    def __init__(self, decoder: Decoder) -> None:
+        self.decoder: Decoder = decoder
+        self.emtrace: Emtrace = decoder.emtrace
+        self.sizes: dict[int, int | None] = {}
+
+    def record_end(self, data: bytes, pos: int) -> int:
+        """Where the record starting at `pos` ends; raises `Incomplete` if it isn't all there."""
+        ptr_size = self.emtrace.ptr_size
+        if pos + ptr_size > len(data):
+            raise Incomplete
+        address = int.from_bytes(data[pos : pos + ptr_size], byteorder="little")
+        address *= 2**self.emtrace.alignment_power
+        info = self.decoder.info_at(address)
+        if address not in self.sizes:
+            self.sizes[address] = record_size(info, ptr_size)
+        size = self.sizes[address]
+        if size is not None:
+            end = pos + size
+        else:
+            end = pos + ptr_size
+            for id, type_info in info.type_infos:
+                end = arg_end(self.emtrace, data, end, id, type_info)
+        if end > len(data):
+            raise Incomplete
+        return end
+
+    def split(self, data: bytes) -> tuple[list[bytes], bytes]:
+        """Batches of whole records at the start of `data`, and the rest of it."""
+        batches: list[bytes] = []
+        start = 0
+        pos = 0
+        try:
+            while pos < len(data):
+                pos = self.record_end(data, pos)
+                if pos - start >= BATCH_SIZE:
+                    batches.append(data[start:pos])
+                    start = pos
+        except (Incomplete, IndexError):
+            pass
+        if pos > start:
+            batches.append(data[start:pos])
+        return batches, data[pos:]
+
+
+class BatchReader:
+    """An input stream over one batch at a time."""
+
+    def __init__(self) -> None:
+        self.data: bytes = b""
+        self.pos: int = 0
+
+    def reset(self, data: bytes) -> None:
+        self.data = data
+        self.pos = 0
+
+    def read(self, n: int) -> bytes:
+        b = self.data[self.pos : self.pos + n]
+        self.pos += len(b)
+        return b
+
+
+_worker: tuple[Decoder, BatchReader, Query | None] | None = None
+
+
+def _init_worker(
+    elf: Path, section_name: str, magic_address: int, query: Query | None, debug_script: bool
+) -> None:
+    global _worker
+    trace = make_trace(debug_script)
+    data, _ = read_section(elf, section_name, None, trace)
+    emtrace = open_emtrace(data, trace)
+    emtrace.symbolizer = Symbolizer.open(elf, section_name, trace)
+    emtrace.set_magic_address(magic_address)
+    reader = BatchReader()
+    _worker = (Decoder(emtrace, reader.read, trace), reader, query)
+
+
+def _format_batch(batch: bytes) -> list[Formatted]:
+    assert _worker is not None
+    decoder, reader, query = _worker
+    reader.reset(batch)
+    results: list[Formatted] = []
+    while True:
+        start = reader.pos
+        address = decoder.read_address()
+        if address is None:
+            return results
+        info = decoder.info_at(address)
+        if query is not None and not query.matches_site(address, info):
+            _ = decoder.skip_args(address, info)
+            continue
+        if info.is_metric:
+            _ = decoder.skip_args(address, info)
+            results.append((address, batch[start + decoder.emtrace.ptr_size : reader.pos]))
+            continue
+        args = info.parse_args(decoder.parser)
+        if query is not None and not query.matches_args(args):
+            continue
+        formatted = info.format(decoder.parser, args)
+        if isinstance(formatted, str):
+            results.append((address, formatted))
+        else:
+            # the values may refer back to the decoder, so only their text is sent back
+            results.append((address, [str(x) for x in formatted]))
+
+
+def _chunks(
+    istream: Callable[[int], bytes], chunks: queue.Queue[bytes], error_box: list[BaseException]
+) -> None:
+    try:
+        while True:
+            chunk = istream(CHUNK_SIZE)
+            chunks.put(chunk)
+            if len(chunk) == 0:
+                return
+    except BaseException as err:
+        error_box.append(err)
+        chunks.put(b"")
+
+
+def decode_parallel(
+    decoder: Decoder,
+    elf: Path,
+    section_name: str,
+    writer: LineWriter,
+    jobs: int,
+    query: Query | None = None,
+    debug_script: bool = False,
+) -> None:
+    """Decode the rest of `decoder`'s input stream with `jobs` worker processes.
+
+    `decoder` must already have consumed the magic address at the start of the stream.
+    """
+    assert decoder.emtrace.runtime_magic_address is not None
+    magic_address = decoder.emtrace.runtime_magic_address // 2**decoder.emtrace.alignment_power
+
+    chunks: queue.Queue[bytes] = queue.Queue(maxsize=4)
+    reader_errors: list[BaseException] = []
+    reader_thread = threading.Thread(
+        target=_chunks, args=(decoder.istream, chunks, reader_errors), daemon=True
+    )
+    reader_thread.start()
+
+    splitter = Splitter(decoder)
+    main_reader = BatchReader()
+    main_decoder = Decoder(decoder.emtrace, main_reader.read, decoder.trace)
+
+    def write(results: list[Formatted]) -> None:
+        for address, formatted in results:
+            info = main_decoder.info_at(address)
+            if isinstance(formatted, bytes):
+                main_reader.reset(formatted)
+                formatted = info.format(main_decoder.parser)
+            if not isinstance(formatted, str):
+                writer.flush()
+                report_format_error(info, formatted)
+                continue
+            if info.is_metric and formatted == "":
+                continue
+            writer.write(info, formatted)
+        writer.flush()
+
+    pending: deque[Future[list[Formatted]]] = deque()
+    rest = b""
+    with ProcessPoolExecutor(
+        max_workers=jobs,
+        initializer=_init_worker,
+        initargs=(elf, section_name, magic_address, query, debug_script),
+    ) as pool:
+        while True:
+            chunk = chunks.get()
+            if len(chunk) == 0:
+                break
+            batches, rest = splitter.split(rest + chunk)
+            for batch in batches:
+                pending.append(pool.submit(_format_batch, batch))
+            while len(pending) > 2 * jobs or (len(pending) > 0 and pending[0].done()):
+                write(pending.popleft().result())
+        while len(pending) > 0:
+            write(pending.popleft().result())
+
+    if len(reader_errors) > 0:
+        raise reader_errors[0]
+    if len(rest) > 0:
+        error("Stream ended in the middle of a record.")
+        error(f"Leftover bytes: {rest}")
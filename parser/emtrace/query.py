@@ -0,0 +1,103 @@
+"""Record filters of the decoder.
+
+Call site filters (source location globs and format string patterns) only depend on a record's
+format info, so they are evaluated once per call site, and the records of call sites that don't
+match are skipped without parsing their arguments where their size allows it. Argument predicates
+need the parsed arguments, but still spare non-matching records the formatting.
+"""
+
+from __future__ import annotations
+from typing import TYPE_CHECKING, Any, Callable
+import ast
+import fnmatch
+import operator
+import os
+import re
+
+if TYPE_CHECKING:
+    from .emtrace import FmtInfo
+
+OPERATORS: dict[str, Callable[[Any, Any], bool]] = {
+    "<=": operator.le,
+    ">=": operator.ge,
+    "==": operator.eq,
+    "!=": operator.ne,
+    "<": operator.lt,
+    ">": operator.gt,
+}
+
+PREDICATE = re.compile(r"^\s*arg(\d+)((?:\.\w+)*)\s*(<=|>=|==|!=|<|>)\s*(.+?)\s*$")
+
+
+class Predicate:
+    """`arg<N>[.field...] <op> <literal>`, e.g. `arg0 > 1000` or `arg1.state == 'RUNNING'`.
+
+    String literals are compared against the string an argument renders as (so they match the
+    names of enum values), numbers against its value.
+    """
+
+    def __init__(self, expression: str) -> None:
+        match = PREDICATE.match(expression)
+        if match is None:
+            raise ValueError(
+                f"Bad argument predicate '{expression}': expected arg<N>[.field] <op> <value>"
+            )
+        self.expression: str = expression
+        self.index: int = int(match[1])
+        self.fields: list[str] = [field for field in match[2].split(".") if field != ""]
+        self.op: Callable[[Any, Any], bool] = OPERATORS[match[3]]
+        try:
+            self.value: Any = ast.literal_eval(match[4])
+        except (ValueError, SyntaxError):
+            # bare words are strings
+            self.value = match[4]
+
+    def __call__(self, args: list[Any]) -> bool:
+        if self.index >= len(args):
+            return False
+        value = args[self.index]
+        try:
+            for field in self.fields:
+                value = value[field]
+            if isinstance(self.value, str):
+                return self.op(format(value), self.value)
+            if not isinstance(value, (int, float)):
+                value = int(getattr(value, "value", value))
+            return self.op(value, self.value)
+        except (KeyError, IndexError, TypeError, ValueError):
+            return False
+
+
+class Query:
+    """Which records to decode; a record has to pass every filter that was given."""
+
+    def __init__(
+        self,
+        sites: list[str] | None = None,
+        patterns: list[str] | None = None,
+        predicates: list[str] | None = None,
+    ) -> None:
+        self.sites: list[str] = sites or []
+        self.patterns: list[re.Pattern[str]] = [re.compile(p) for p in patterns or []]
+        self.predicates: list[Predicate] = [Predicate(p) for p in predicates or []]
+        self.site_cache: dict[int, bool] = {}
+
+    def _site_matches(self, info: FmtInfo) -> bool:
+        if len(self.sites) > 0:
+            locations = [f"{info.file}:{info.line}", info.file]
+            base = os.path.basename(info.file)
+            locations += [f"{base}:{info.line}", base]
+            if not any(fnmatch.fnmatchcase(l, g) for g in self.sites for l in locations):
+                return False
+        return all(pattern.search(info.fmt_string) for pattern in self.patterns)
+
+    def matches_site(self, address: int, info: FmtInfo) -> bool:
+        """Whether records from the call site at `address` can match at all."""
+        matches = self.site_cache.get(address)
+        if matches is None:
+            matches = self._site_matches(info)
+            self.site_cache[address] = matches
+        return matches
+
+    def matches_args(self, args: list[Any]) -> bool:
+        return all(predicate(args) for predicate in self.predicates)
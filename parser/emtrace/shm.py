@@ -0,0 +1,255 @@
+"""Decoder side of the shared-memory transport.
+
+Mirrors the region layout defined in `c/include/c/include/emtrace/shm.h`; keep both in sync.
+"""
+
+from __future__ import annotations
+from typing import Callable, Literal, Any
+from pathlib import Path
+import mmap
+import os
+import struct
+import sys
+import time
+
+from .emtrace import (
+    Decoder,
+    Emtrace,
+    LineWriter,
+    error,
+    make_trace,
+    open_emtrace,
+    read_section,
+    report_format_error,
+)
+from .symbols import Symbolizer
+
+SHM_MAGIC = 0x31304D4853544D45
+SHM_VERSION = 1
+
+HEADER = struct.Struct("=QIIQ40x")
+RING_HEADER_SIZE = 384
+HEAD_OFFSET = 0
+TAIL_OFFSET = 64
+RING_INFO = struct.Struct("=IiiIQQ")
+RING_INFO_OFFSET = 128
+EXE_OFFSET = 160
+EXE_PATH_MAX = 224
+
+RING_FREE = 0
+RING_CLAIMING = 1
+RING_ACTIVE = 2
+RING_CLOSED = 3
+
+U64 = struct.Struct("=Q")
+U32 = struct.Struct("=I")
+
+
+def _pid_alive(pid: int) -> bool:
+    try:
+        os.kill(pid, 0)
+    except ProcessLookupError:
+        return False
+    except PermissionError:
+        pass
+    return True
+
+
+class ShmInput:
+    """Marks the `--input` argument as the name of a shared-memory region."""
+
+    def __init__(self, name: str) -> None:
+        self.name: str = name.lstrip("/")
+
+
+class RingStream:
+    """Decodes the records of a single ring, for the lifetime of one owner."""
+
+    def __init__(
+        self,
+        emtrace: Emtrace,
+        pid: int,
+        tid: int,
+        with_src_loc: Literal["none", "absolute", "relative"],
+        trace: Callable[[*tuple[Any, ...]], None],
+    ) -> None:
+        self.chunk: memoryview = memoryview(b"")
+        self.pos: int = 0
+        self.pending: bytearray = bytearray()
+        self.prefix: bytes = f"[{pid}:{tid}] ".encode("utf-8")
+        self.dropped: int = 0
+        self.decoder: Decoder = Decoder(emtrace, self.read, trace)
+        self.writer: LineWriter = LineWriter(self.pending.extend, with_src_loc)
+
+    def read(self, n: int) -> bytes:
+        b = bytes(self.chunk[self.pos : self.pos + n])
+        self.pos += len(b)
+        return b
+
+    def decode(self, chunk: bytes) -> None:
+        """Decode `chunk`, which always contains a whole number of records."""
+        self.chunk = memoryview(chunk)
+        self.pos = 0
+        while True:
+            record = self.decoder.next()
+            if record is None:
+                break
+            info, formatted = record
+            if not isinstance(formatted, str):
+                report_format_error(info, formatted)
+                continue
+            self.writer.write(info, formatted)
+        self.writer.flush()
+
+    def flush_lines(self, ostream: Callable[[bytes], Any], final: bool = False) -> None:
+        """Write all complete lines (all lines if `final`) prefixed with the ring's owner."""
+        end = len(self.pending) if final else self.pending.rfind(b"\n") + 1
+        if end == 0:
+            return
+        lines = bytes(self.pending[:end])
+        del self.pending[:end]
+        if not lines.endswith(b"\n"):
+            lines += b"\n"
+        out = bytearray()
+        for line in lines.splitlines(keepends=True):
+            out += self.prefix
+            out += line
+        _ = ostream(bytes(out))
+
+
+class Region:
+    """A mapped shared-memory region, tailed ring by ring."""
+
+    def __init__(self, name: str, trace: Callable[[*tuple[Any, ...]], None]) -> None:
+        path = Path("/dev/shm") / name
+        while not path.exists():
+            time.sleep(0.01)
+        fd = os.open(path, os.O_RDWR)
+        try:
+            while os.fstat(fd).st_size < HEADER.size:
+                time.sleep(0.001)
+            self.map: mmap.mmap = mmap.mmap(fd, 0)
+        finally:
+            os.close(fd)
+
+        while U64.unpack_from(self.map, 0)[0] != SHM_MAGIC:
+            time.sleep(0.001)
+        _, version, self.num_rings, self.ring_size = HEADER.unpack_from(self.map, 0)
+        if version != SHM_VERSION:
+            error(f"Unsupported shared-memory region version {version} (expected {SHM_VERSION}).")
+            sys.exit(1)
+        trace(f"shm region {name}: {self.num_rings=} {self.ring_size=}")
+        self.data_start: int = HEADER.size + self.num_rings * RING_HEADER_SIZE
+
+    def ring_header(self, index: int) -> int:
+        return HEADER.size + index * RING_HEADER_SIZE
+
+    def ring_info(self, index: int) -> tuple[int, int, int, int, int, int]:
+        return RING_INFO.unpack_from(self.map, self.ring_header(index) + RING_INFO_OFFSET)
+
+    def exe(self, index: int) -> str:
+        start = self.ring_header(index) + EXE_OFFSET
+        raw = self.map[start : start + EXE_PATH_MAX]
+        return raw.split(b"\x00", 1)[0].decode("utf-8", errors="replace")
+
+    def consume(self, index: int) -> bytes:
+        """Take all published bytes out of ring `index`."""
+        header = self.ring_header(index)
+        head = U64.unpack_from(self.map, header + HEAD_OFFSET)[0]
+        tail = U64.unpack_from(self.map, header + TAIL_OFFSET)[0]
+        if head == tail:
+            return b""
+        base = self.data_start + index * self.ring_size
+        start = tail % self.ring_size
+        end = start + (head - tail)
+        if end <= self.ring_size:
+            chunk = self.map[base + start : base + end]
+        else:
+            chunk = (
+                self.map[base + start : base + self.ring_size]
+                + self.map[base : base + end - self.ring_size]
+            )
+        U64.pack_into(self.map, header + TAIL_OFFSET, head)
+        return chunk
+
+    def free(self, index: int) -> None:
+        U32.pack_into(self.map, self.ring_header(index) + RING_INFO_OFFSET, RING_FREE)
+
+
+def emtrace_shm(
+    name: str,
+    elf: Path,
+    ostream: Callable[[bytes], Any] = sys.stdout.buffer.write,
+    section_name: str = ".emtrace",
+    with_src_loc: Literal["none", "absolute", "relative"] = "none",
+    debug_script: bool = False,
+    exit_when_idle: bool = False,
+    poll_interval: float = 0.001,
+    flush: Callable[[], Any] = lambda: None,
+) -> None:
+    """Attach to the shared-memory region `name` and decode all of its rings live.
+
+    Each ring is decoded with the format info of the executable recorded in its header (falling
+    back to `elf` if that path isn't accessible), and every output line is prefixed with the
+    `[pid:tid]` of the ring's owner. Lines of different rings are merged as they complete.
+    """
+    trace = make_trace(debug_script)
+    region = Region(name, trace)
+
+    sections: dict[str, tuple[bytes, Symbolizer | None]] = {}
+
+    def section_for(exe: str) -> tuple[bytes, Symbolizer | None]:
+        path = Path(exe) if exe and os.access(exe, os.R_OK) else elf
+        key = str(path)
+        if key not in sections:
+            trace(f"loading format info from {path}")
+            sections[key] = (
+                read_section(path, section_name, None, trace)[0],
+                Symbolizer.open(path, section_name, trace),
+            )
+        return sections[key]
+
+    streams: dict[int, tuple[int, RingStream]] = {}
+    seen_any = False
+
+    while True:
+        progress = False
+        for index in range(region.num_rings):
+            state, pid, tid, generation, magic_ptr, dropped = region.ring_info(index)
+            if state not in (RING_ACTIVE, RING_CLOSED):
+                continue
+            seen_any = True
+
+            current = streams.get(index)
+            if current is None or current[0] != generation:
+                if current is not None:
+                    current[1].flush_lines(ostream, final=True)
+                data, symbolizer = section_for(region.exe(index))
+                emtrace = open_emtrace(data, trace)
+                emtrace.symbolizer = symbolizer
+                emtrace.set_magic_address(magic_ptr)
+                current = (generation, RingStream(emtrace, pid, tid, with_src_loc, trace))
+                streams[index] = current
+            stream = current[1]
+
+            chunk = region.consume(index)
+            if len(chunk) > 0:
+                progress = True
+                stream.decode(chunk)
+                stream.flush_lines(ostream)
+
+            if dropped > stream.dropped:
+                error(f"[{pid}:{tid}] {dropped - stream.dropped} records dropped (ring full)")
+                stream.dropped = dropped
+
+            if len(chunk) == 0 and (state == RING_CLOSED or not _pid_alive(pid)):
+                stream.flush_lines(ostream, final=True)
+                region.free(index)
+                del streams[index]
+                progress = True
+
+        if not progress:
+            flush()
+            if exit_when_idle and seen_any and len(streams) == 0:
+                break
+            time.sleep(poll_interval)
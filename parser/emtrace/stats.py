@@ -0,0 +1,154 @@
+"""Bandwidth and frequency profile of a trace stream, per call site.
+
+Records whose size follows from their format info alone are skipped without being parsed; only
+those with length-prefixed or null-terminated arguments (or C++ optionals and variants) are.
+"""
+
+from __future__ import annotations
+from typing import TYPE_CHECKING, Literal
+import csv
+import io
+import json
+
+if TYPE_CHECKING:
+    from .emtrace import FmtInfo, TypeInfo
+
+StatsFormat = Literal["table", "csv", "json"]
+StatsSort = Literal["bytes", "records", "rate", "avg"]
+
+# stored with a size of 1, but followed by a value only some of the time
+VARIABLE_TYPES = ("optional", "variant")
+
+COLUMNS = ("file", "line", "format", "records", "bytes", "avg_arg_bytes", "rate_per_s", "share")
+
+
+def fixed_size(id: str, info: TypeInfo) -> int | None:
+    """Bytes an argument of type `id` takes in the stream, or None if that depends on its value."""
+    size = info.size
+    if size.length_prefixed or size.null_terminated or id in VARIABLE_TYPES:
+        return None
+    if id == "list":
+        # the size of fixed-size arrays is their element count
+        child_id, child_info = info.children[""]
+        child = fixed_size(child_id, child_info)
+        return None if child is None else size.min_size * child
+    return size.min_size
+
+
+def record_size(info: FmtInfo, ptr_size: int) -> int | None:
+    """Bytes a record of `info` takes in the stream, including its address, if they are fixed."""
+    total = ptr_size
+    for id, type_info in info.type_infos:
+        size = fixed_size(id, type_info)
+        if size is None:
+            return None
+        total += size
+    return total
+
+
+class Site:
+    """Everything received from one call site so far."""
+
+    def __init__(self, info: FmtInfo, now: float) -> None:
+        self.info: FmtInfo = info
+        self.records: int = 0
+        self.bytes: int = 0
+        self.first: float = now
+        self.last: float = now
+
+    def add(self, size: int, now: float) -> None:
+        self.records += 1
+        self.bytes += size
+        self.last = now
+
+
+class Stats:
+    """Per call site record counts and sizes, and the table rendering them.
+
+    Rates are in records per second of the time the records were received over; when reading a
+    file that has already been written, that is the decoding time.
+    """
+
+    def __init__(self, ptr_size: int) -> None:
+        self.ptr_size: int = ptr_size
+        self.sites: dict[int, Site] = {}
+        self.records: int = 0
+        self.bytes: int = 0
+        self.first: float | None = None
+        self.last: float = 0.0
+
+    def add(self, address: int, info: FmtInfo, size: int, now: float) -> None:
+        site = self.sites.get(address)
+        if site is None:
+            site = Site(info, now)
+            self.sites[address] = site
+        site.add(size, now)
+        self.records += 1
+        self.bytes += size
+        if self.first is None:
+            self.first = now
+        self.last = now
+
+    def rows(self, sort: StatsSort = "bytes") -> list[dict[str, str | int | float]]:
+        """One row per call site, with the heaviest ones by `sort` first."""
+        elapsed = self.last - self.first if self.first is not None else 0.0
+        rows: list[dict[str, str | int | float]] = []
+        for site in self.sites.values():
+            rows.append(
+                {
+                    "file": site.info.file,
+                    "line": site.info.line,
+                    "format": site.info.fmt_string,
+                    "records": site.records,
+                    "bytes": site.bytes,
+                    "avg_arg_bytes": round(
+                        (site.bytes - site.records * self.ptr_size) / site.records, 1
+                    ),
+                    "rate_per_s": round(site.records / elapsed, 1) if elapsed > 0 else 0.0,
+                    "share": round(site.bytes / self.bytes, 4) if self.bytes > 0 else 0.0,
+                }
+            )
+        key = {"bytes": "bytes", "records": "records", "rate": "rate_per_s", "avg": "avg_arg_bytes"}
+        rows.sort(key=lambda row: (-row[key[sort]], row["file"], row["line"]))
+        return rows
+
+    def render(self, format: StatsFormat = "table", sort: StatsSort = "bytes") -> str:
+        rows = self.rows(sort)
+        match format:
+            case "json":
+                return json.dumps(
+                    {"records": self.records, "bytes": self.bytes, "sites": rows}, indent=2
+                ) + "\n"
+            case "csv":
+                out = io.StringIO()
+                writer = csv.DictWriter(out, list(COLUMNS), lineterminator="\n")
+                writer.writeheader()
+                writer.writerows(rows)
+                return out.getvalue()
+            case "table":
+                header = ["location", "records", "bytes", "avg args", "rate/s", "share", "format"]
+                cells: list[list[str]] = [header]
+                for row in rows:
+                    cells.append(
+                        [
+                            f"{row['file']}:{row['line']}",
+                            str(row["records"]),
+                            str(row["bytes"]),
+                            f"{row['avg_arg_bytes']:.1f}",
+                            f"{row['rate_per_s']:.1f}",
+                            f"{100 * float(row['share']):.1f}%",
+                            repr(row["format"]),
+                        ]
+                    )
+                cells.append(
+                    ["total", str(self.records), str(self.bytes), "", "", "100.0%", ""]
+                )
+                widths = [max(len(row[i]) for row in cells) for i in range(len(header))]
+                lines = []
+                for row in cells:
+                    padded = [
+                        cell.ljust(width) if i in (0, 6) else cell.rjust(width)
+                        for i, (cell, width) in enumerate(zip(row, widths))
+                    ]
+                    lines.append("  ".join(padded).rstrip() + "\n")
+                return "".join(lines)
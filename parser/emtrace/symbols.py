@@ -0,0 +1,116 @@
+"""Offline symbolization of the return addresses captured by `EMT_STACK` arguments."""
+
+from __future__ import annotations
+from typing import Any, Callable
+from pathlib import Path
+import bisect
+import os
+
+try:
+    from elftools.elf.elffile import ELFFile
+    from elftools.common.exceptions import ELFError
+except ImportError:
+    ELFFile: None | type = None
+    ELFError: type[Exception] = ImportError
+
+
+class Symbolizer:
+    """Resolves link-time addresses of an ELF file to functions and source locations.
+
+    Function symbols come from `.symtab` (or `.dynsym`), source locations from the DWARF line
+    tables, if the file has any. Both are only read on the first lookup.
+    """
+
+    def __init__(
+        self,
+        elf: Path,
+        section_address: int,
+        trace: Callable[[*tuple[Any, ...]], None] = lambda *args: None,
+    ) -> None:
+        self.elf: Path = elf
+        self.section_address: int = section_address
+        self.trace: Callable[[*tuple[Any, ...]], None] = trace
+        self.loaded: bool = False
+        self.functions: list[tuple[int, int, str]] = []
+        self.function_starts: list[int] = []
+        self.rows: list[tuple[int, str, int]] = []
+        self.row_starts: list[int] = []
+
+    @staticmethod
+    def open(
+        elf: Path,
+        section_name: str = ".emtrace",
+        trace: Callable[[*tuple[Any, ...]], None] = lambda *args: None,
+    ) -> Symbolizer | None:
+        """A symbolizer for `elf`, or None if it can't be read as an ELF file."""
+        if ELFFile is None:
+            return None
+        try:
+            with elf.open("rb") as fd:
+                section = ELFFile(fd).get_section_by_name(section_name)
+                if section is None:
+                    return None
+                return Symbolizer(elf, section["sh_addr"], trace)
+        except (ELFError, OSError):
+            return None
+
+    def _load(self) -> None:
+        self.loaded = True
+        assert ELFFile is not None
+        with self.elf.open("rb") as fd:
+            elffile = ELFFile(fd)
+            for name in (".symtab", ".dynsym"):
+                table = elffile.get_section_by_name(name)
+                if table is None:
+                    continue
+                for symbol in table.iter_symbols():
+                    if symbol["st_info"]["type"] != "STT_FUNC" or symbol["st_value"] == 0:
+                        continue
+                    self.functions.append((symbol["st_value"], symbol["st_size"], symbol.name))
+                if len(self.functions) > 0:
+                    break
+            self.functions.sort()
+            self.function_starts = [start for start, _, _ in self.functions]
+            self.trace(f"symbolizer: {len(self.functions)} functions")
+
+            if not elffile.has_dwarf_info():
+                return
+            dwarf = elffile.get_dwarf_info()
+            for cu in dwarf.iter_CUs():
+                program = dwarf.line_program_for_CU(cu)
+                if program is None:
+                    continue
+                # file indices are 1-based before DWARF 5
+                file_base = 0 if program["version"] >= 5 else 1
+                files = program["file_entry"]
+                for entry in program.get_entries():
+                    state = entry.state
+                    if state is None:
+                        continue
+                    if state.end_sequence:
+                        self.rows.append((state.address, "", 0))
+                        continue
+                    index = state.file - file_base
+                    file = files[index].name if 0 <= index < len(files) else b"?"
+                    self.rows.append((state.address, os.fsdecode(file), state.line))
+            self.rows.sort(key=lambda row: row[0])
+            self.row_starts = [address for address, _, _ in self.rows]
+            self.trace(f"symbolizer: {len(self.rows)} line table rows")
+
+    def lookup(self, address: int) -> str | None:
+        """`function+offset (file:line)` of the code at `address`, or None if it is unknown."""
+        if not self.loaded:
+            self._load()
+
+        i = bisect.bisect_right(self.function_starts, address) - 1
+        if i < 0:
+            return None
+        start, size, name = self.functions[i]
+        if size != 0 and address >= start + size:
+            return None
+        result = f"{name}+{hex(address - start)}"
+
+        j = bisect.bisect_right(self.row_starts, address) - 1
+        if j >= 0 and self.rows[j][1] != "":
+            result += f" ({self.rows[j][1]}:{self.rows[j][2]})"
+        return result
@@ -1,6 +1,12 @@
 import pytest
+import csv
+import json
+import os
+import select
 import subprocess
 import sys
+import time
+from typing import Any
 from pathlib import Path
 
 # Add paths to test executables here.
@@ -16,6 +22,20 @@ C_TEST_EXECUTABLES = [
     "examples/test_mixed",
     "examples/test_edge_cases",
     "examples/test_large_numbers",
+    "examples/test_many_args",
+    "examples/test_arrays",
+    "examples/test_structs",
+    "examples/test_enums",
+    "examples/test_blobs",
+    "examples/test_repeat",
+    "examples/test_metrics",
+    "examples/test_transaction",
+    "examples/test_sigsafe",
+    "examples/test_percpu",
+    "examples/test_drain",
+    "examples/test_freestanding",
+    "examples/test_stack",
+    "examples/test_vocabulary",
 ]
 
 C_BUILD_DIRS = [
@@ -125,3 +145,295 @@ def test_emtrace_on_executable(executable_path_str: str):
     print(emtrace_process.stdout.decode())
     if emtrace_process.stderr:
         print(emtrace_process.stderr.decode(), file=sys.stderr)
+
+
+# The decoder's modes, checked against its plain output on the C examples.
+
+PARSER_DIR = Path(__file__).parent.parent / "parser"
+
+# examples with arguments of variable size, whose record boundaries the parallel decoder finds
+# without formatting them
+VARIABLE_SIZE_EXAMPLES = [
+    "test_vocabulary",
+    "test_blobs",
+    "test_arrays",
+    "test_structs",
+    "test_enums",
+    "test_strings",
+    "test_metrics",
+    "test_many_args",
+]
+
+
+def find_c_example(name: str) -> Path:
+    for build_dir in C_BUILD_DIRS:
+        executable = Path(__file__).parent.resolve() / build_dir / "examples" / name
+        if executable.exists():
+            return executable
+    pytest.skip(f"Executable examples/{name} not found. Make sure it is built.")
+
+
+def run_example(executable: Path) -> bytes:
+    return subprocess.run(
+        [str(executable)], capture_output=True, check=True, timeout=5
+    ).stdout
+
+
+def decode(
+    executable: Path, *args: str, raw: bytes = b"", batch_size: int | None = None
+) -> bytes:
+    """Run the decoder's command line, optionally with smaller batches for `--jobs`."""
+    code = "from emtrace.cli import main; main()"
+    if batch_size is not None:
+        code = f"import emtrace.parallel as p; p.BATCH_SIZE = {batch_size}; {code}"
+    process = subprocess.run(
+        [sys.executable, "-c", code, str(executable), *args],
+        input=raw,
+        capture_output=True,
+        cwd=PARSER_DIR,
+        timeout=30,
+    )
+    assert process.returncode == 0, process.stderr.decode()
+    return process.stdout
+
+
+@pytest.mark.parametrize("name", VARIABLE_SIZE_EXAMPLES)
+def test_parallel_matches_sequential(name: str):
+    executable = find_c_example(name)
+    raw = run_example(executable)
+    sequential = decode(executable, raw=raw)
+    assert sequential != b""
+    # batches of a few records each, so that most records end up next to a batch boundary
+    for batch_size in [1, 64, 1 << 20]:
+        parallel = decode(executable, "-j", "3", raw=raw, batch_size=batch_size)
+        assert parallel == sequential, f"batch size {batch_size}"
+
+
+@pytest.mark.parametrize("name", ["test_integers", "test_arrays", "test_blobs", "test_metrics"])
+def test_stats_account_for_every_byte(name: str):
+    executable = find_c_example(name)
+    raw = run_example(executable)
+    stats = json.loads(decode(executable, "--stats=json", raw=raw))
+    assert sum(site["records"] for site in stats["sites"]) == stats["records"]
+    assert sum(site["bytes"] for site in stats["sites"]) == stats["bytes"]
+    # all but the init record, which is a single emt_ptr_t
+    assert len(raw) - stats["bytes"] in (4, 8)
+
+
+def test_filters():
+    executable = find_c_example("test_integers")
+    raw = run_example(executable)
+    lines = decode(executable, raw=raw).decode().splitlines()
+    assert len(lines) == 3
+
+    def select(*args: str) -> list[str]:
+        return decode(executable, *args, raw=raw).decode().splitlines()
+
+    assert select("--site", "*test_integers.c:32") == [lines[1]]
+    assert select("--grep", "^Size") == [lines[2]]
+    assert select("--where", "arg0 < 0") == [lines[0]]
+    assert select("--where", "arg0 > 100", "--grep", "integers") == [lines[1]]
+    assert select("--site", "*other.c:*") == []
+
+
+def test_inventory():
+    executable = find_c_example("test_integers")
+    inventory = decode(executable, "--inventory").decode()
+    assert "test_integers.c (3 call sites" in inventory
+    for line in ["'Signed integers: ", "'Unsigned integers: ", "'Size integers: "]:
+        assert line in inventory
+
+
+def test_inventory_library_sites():
+    """Sites with the formatters of the library's own records are listed as well."""
+    executable = find_c_example("test_drain")
+    inventory = json.loads(decode(executable, "--inventory", "json"))
+    formats = {site["format"]: site for site in inventory["sites"]}
+    assert formats["{} records dropped"]["file"].endswith("drain.h")
+    assert formats["{} records dropped"]["args"] == ["uint64_t"]
+    assert formats["record {}\n"]["args"] == ["int"]
+
+
+# how the cells of the exported columns are read back, by the column types in sites.csv
+CSV_KINDS = {
+    "int64": int,
+    "uint64": int,
+    "double": float,
+    "bool": lambda cell: {"True": True, "False": False}[cell],
+    "string": str,
+}
+
+
+def read_export(directory: Path) -> list[tuple[dict[str, str], list[dict[str, Any]]]]:
+    """Every exported call site with its rows, typed by their columns; missing values are None."""
+    tables = []
+    with open(directory / "sites.csv", newline="") as index:
+        for site in csv.DictReader(index):
+            kinds = {"seq": "uint64"}
+            kinds.update(column.split(":") for column in site["columns"].split())
+            with open(directory / site["table"], newline="") as table:
+                rows = [
+                    {
+                        column: None if cell == "" else CSV_KINDS[kinds[column]](cell)
+                        for column, cell in row.items()
+                    }
+                    for row in csv.DictReader(table)
+                ]
+            assert len(rows) == int(site["records"])
+            tables.append((site, rows))
+    return tables
+
+
+@pytest.mark.parametrize(
+    "name", ["test_integers", "test_many_args", "test_doubles", "test_edge_cases"]
+)
+def test_export_csv_round_trip(name: str, tmp_path: Path):
+    """Formatting the exported rows with their call sites' format strings gives the output."""
+    executable = find_c_example(name)
+    raw = run_example(executable)
+    expected = decode(executable, raw=raw).decode()
+
+    _ = decode(executable, "--export", str(tmp_path), raw=raw)
+    records: dict[int, str] = {}
+    for site, rows in read_export(tmp_path):
+        for row in rows:
+            values = [value for column, value in row.items() if column != "seq"]
+            records[row["seq"]] = site["format"].format(*values)
+    assert "".join(records[seq] for seq in sorted(records)) == expected
+
+
+def test_export_typed_values(tmp_path: Path):
+    """Empty optionals are exported as missing values, durations in seconds."""
+    executable = find_c_example("test_vocabulary")
+    _ = decode(executable, "--export", str(tmp_path), raw=run_example(executable))
+    tables = {site["format"].split(":")[0]: rows for site, rows in read_export(tmp_path)}
+    assert tables["name"] == [{"seq": 0, "arg0": "world", "arg1": 5}]
+    assert tables["retries"] == [{"seq": 1, "arg0": 3, "arg1": None}]
+    assert tables["value"] == [{"seq": 2, "arg0": "2.5", "arg1": "x", "arg2": "7"}]
+    assert tables["elapsed"] == [
+        {"seq": 3, "arg0": 1.5e-06, "arg1": 0.02, "arg2": 0.25, "arg3": 3.0}
+    ]
+
+
+def test_duration_periods():
+    """The period of each std::chrono duration is spelled out in its type id."""
+    executable = find_c_example("test_vocabulary")
+    inventory = json.loads(decode(executable, "--inventory", "json"))
+    formats = {site["format"].split(":")[0]: site for site in inventory["sites"]}
+    assert formats["elapsed"]["args"] == [
+        "duration:1/1000000000",
+        "duration:1/1000",
+        "duration:1/1",
+        "duration:1/1",
+    ]
+    output = decode(executable, raw=run_example(executable)).decode()
+    assert "elapsed: 1500ns, timeout: 20ms (0.02s), period: 0.25s" in output
+
+
+def follow(capture: Path, executable: Path) -> subprocess.Popen[bytes]:
+    code = "from emtrace.cli import main; main()"
+    return subprocess.Popen(
+        [sys.executable, "-c", code, str(executable), "-i", str(capture), "--follow"],
+        stdout=subprocess.PIPE,
+        cwd=PARSER_DIR,
+    )
+
+
+def read_followed(process: subprocess.Popen[bytes], expected: bytes, output: bytes = b"") -> bytes:
+    """Read from the follower until it has written `expected` (or time runs out)."""
+    assert process.stdout is not None
+    deadline = time.monotonic() + 10
+    while output != expected and time.monotonic() < deadline:
+        ready, _, _ = select.select([process.stdout], [], [], 0.1)
+        if ready:
+            output += os.read(process.stdout.fileno(), 1 << 16)
+    return output
+
+
+def test_follow(tmp_path: Path):
+    executable = find_c_example("test_integers")
+    raw = run_example(executable)
+    expected = decode(executable, raw=raw)
+    capture = tmp_path / "capture.bin"
+    # starting in the middle of a record
+    _ = capture.write_bytes(raw[:10])
+    process = follow(capture, executable)
+    try:
+        with open(capture, "ab") as file:
+            _ = file.write(raw[10:])
+        assert read_followed(process, expected) == expected
+    finally:
+        process.terminate()
+        _ = process.wait(timeout=5)
+
+
+@pytest.mark.parametrize("how", ["rotate", "truncate"])
+def test_follow_restart(tmp_path: Path, how: str):
+    """A rotated or truncated file is a new capture, by a producer that may have been restarted."""
+    executable = find_c_example("test_integers")
+    raw = run_example(executable)
+    expected = decode(executable, raw=raw)
+    # another run, at another load address where the executable is position independent
+    restarted = run_example(executable)
+    capture = tmp_path / "capture.bin"
+    # the old capture ends in the middle of a record, which is never completed
+    _ = capture.write_bytes(raw + raw[8:12])
+    process = follow(capture, executable)
+    try:
+        output = read_followed(process, expected)
+        assert output == expected
+        if how == "rotate":
+            rotated = tmp_path / "capture.bin.new"
+            _ = rotated.write_bytes(restarted)
+            os.replace(rotated, capture)
+        else:
+            with open(capture, "r+b") as file:
+                _ = file.truncate(0)
+                _ = file.write(restarted)
+        assert read_followed(process, expected * 2, output) == expected * 2
+    finally:
+        process.terminate()
+        _ = process.wait(timeout=5)
+
+
+def test_capture(tmp_path: Path):
+    executable = find_c_example("test_integers")
+    expected = decode(executable, raw=run_example(executable))
+    capture = tmp_path / "capture.bin"
+    code = "from emtrace.cli import main; main()"
+    # through a pipe, as in ./a.out | emtrace a.out --capture FILE
+    producer = subprocess.Popen([str(executable)], stdout=subprocess.PIPE)
+    _ = subprocess.run(
+        [sys.executable, "-c", code, str(executable), "--capture", str(capture)],
+        stdin=producer.stdout,
+        check=True,
+        cwd=PARSER_DIR,
+        timeout=30,
+    )
+    assert producer.wait(timeout=5) == 0
+    assert decode(executable, "-i", str(capture)) == expected
+
+
+def test_capture_from_shm(tmp_path: Path):
+    """Shared memory has no stream to capture; the decoder says so instead of attaching to it."""
+    executable = find_c_example("test_integers")
+    capture = tmp_path / "capture.bin"
+    code = "from emtrace.cli import main; main()"
+    process = subprocess.run(
+        [
+            sys.executable,
+            "-c",
+            code,
+            str(executable),
+            "-i",
+            "shm://emtrace_test",
+            "--capture",
+            str(capture),
+        ],
+        capture_output=True,
+        cwd=PARSER_DIR,
+        timeout=30,
+    )
+    assert process.returncode != 0
+    assert b"--capture needs a stream as --input" in process.stderr
+    assert not capture.exists()